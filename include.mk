@@ -55,6 +55,19 @@ CFLAGS += -DVIRT
 endif
 
 
+# initramfs：INITRAMFS指定内嵌进内核的cpio归档（newc格式），INITRAMFS_MOUNT指定挂载点（"/"表示作为根目录）
+ifdef INITRAMFS
+CFLAGS += -DINITRAMFS_IMAGE=\"$(abspath $(INITRAMFS))\"
+endif
+ifdef INITRAMFS_MOUNT
+CFLAGS += -DINITRAMFS_MOUNT=\"$(INITRAMFS_MOUNT)\"
+endif
+
+# 内存块设备/dev/ram0：RAMDISK_MB指定启动时预留的大小；INITRD是磁盘镜像而非cpio归档时直接以其作为内容
+ifdef RAMDISK_MB
+CFLAGS += -DRAMDISK_SIZE="($(RAMDISK_MB) * 1024ul * 1024ul)"
+endif
+
 # 链接时的参数
 LDFLAGS = -z max-page-size=4096
 
@@ -75,10 +88,17 @@ endif
 # QEMU 启动参数
 QEMUOPTS = -machine $(MACHINE) -bios default -kernel $(KERNEL_ELF) -m 1G -smp $(NCPU) -nographic
 
+# INITRD指定由QEMU加载的cpio归档，内核通过设备树找到它
+ifdef INITRD
+	QEMUOPTS += -initrd $(INITRD)
+endif
+
 ifeq ($(MACHINE),virt)
 	QEMUOPTS += -drive file=fs.img,if=none,format=raw,id=x0
 	QEMUOPTS += -device virtio-blk-device,drive=x0,bus=virtio-mmio-bus.0
 	QEMUOPTS += -device virtio-net-device
+	# 使用modern(v2)的virtio-mmio接口，驱动同时兼容legacy(v1)
+	QEMUOPTS += -global virtio-mmio.force-legacy=false
 else ifeq ($(MACHINE),sifive_u)
 	QEMUOPTS += -drive file=fs.img,if=sd,format=raw
 endif
@@ -21,7 +21,14 @@ struct MemInfo {
 	uint64 size;
 };
 
+// QEMU -initrd 加载的initrd所在的物理地址区间[start, end)，由/chosen节点给出
+struct InitrdInfo {
+	uint64 start;
+	uint64 end;
+};
+
 extern uint64 dtbEntry;
+extern struct InitrdInfo initrdInfo;
 void parseDtb();
 
 #define FDT_BEGIN_NODE 0x00000001
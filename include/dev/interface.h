@@ -1,6 +1,8 @@
 #ifndef _DEV_INTERFACE_H_
 #define _DEV_INTERFACE_H_
 
+#include <types.h>
+
 void cons_init();
 void dev_init();
 
@@ -10,7 +12,24 @@ int cons_test_getc();
 
 typedef struct Buffer Buffer;
 
+// 块设备号，即Buffer.dev和FileSystem.deviceNumber
+#define DEV_DISK 0    // virtio磁盘或SD卡
+#define DEV_RAMDISK 1 // 内存块设备
+
+// 直接I/O的一段物理内存，长度为扇区大小的整数倍
+typedef struct DiskSeg {
+	u64 addr;
+	u32 len;
+} DiskSeg;
+
+// 一次直接I/O请求最多包含的物理内存段数
+#define DISK_SEG_MAX 16
+
 void disk_rw(Buffer *buf, int write);
+void disk_rw_sg(int dev, u64 sector, DiskSeg *segs, int nseg, int write);
+int disk_read_async(Buffer *buf);
+bool disk_can_read_async(u32 dev);
+void disk_wait(Buffer *buf);
 void disk_intr();
 
 #endif // _DEV_INTERFACE_H_
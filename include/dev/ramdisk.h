@@ -0,0 +1,19 @@
+#ifndef _RAMDISK_H_
+#define _RAMDISK_H_
+
+#include <dev/interface.h>
+#include <types.h>
+
+// 启动时预留的内存块设备大小（字节），0表示不预留。initrd是磁盘镜像时优先使用initrd
+#ifndef RAMDISK_SIZE
+#define RAMDISK_SIZE 0
+#endif
+
+extern void *ramdiskData;
+extern u64 ramdiskSize;
+
+void ramdisk_init();
+void ramdisk_rw(Buffer *b, int write);
+void ramdisk_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write);
+
+#endif // _RAMDISK_H_
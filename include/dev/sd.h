@@ -77,6 +77,9 @@ int sdInit();
 
 typedef struct Buffer Buffer;
 
+typedef struct DiskSeg DiskSeg;
+
 void sd_rw(Buffer *buf, int write);
+void sd_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write);
 
 #endif
@@ -4,6 +4,7 @@
 
 #ifndef _VIRTIO_H
 #define _VIRTIO_H
+#include <dev/interface.h>
 #include <fs/buf.h>
 //
 // virtio device definitions.
@@ -21,17 +22,26 @@
 #define VIRTIO_MMIO_DEVICE_ID 0x008   // device type; 1 is net, 2 is disk
 #define VIRTIO_MMIO_VENDOR_ID 0x00c   // 0x554d4551
 #define VIRTIO_MMIO_DEVICE_FEATURES 0x010
+#define VIRTIO_MMIO_DEVICE_FEATURES_SEL 0x014 // v2: 选择读取特性的高/低32位
 #define VIRTIO_MMIO_DRIVER_FEATURES 0x020
-#define VIRTIO_MMIO_PAGE_SIZE 0X028
+#define VIRTIO_MMIO_DRIVER_FEATURES_SEL 0x024 // v2: 选择写入特性的高/低32位
+#define VIRTIO_MMIO_PAGE_SIZE 0X028	      // v1 only
 #define VIRTIO_MMIO_QUEUE_SEL 0x030	// select queue, write-only
 #define VIRTIO_MMIO_QUEUE_NUM_MAX 0x034 // max size of current queue, read-only
 #define VIRTIO_MMIO_QUEUE_NUM 0x038	// size of current queue, write-only
-#define VIRTIO_MMIO_QUEUE_ALIGN 0x03c
-#define VIRTIO_MMIO_QUEUE_PFN 0X040
+#define VIRTIO_MMIO_QUEUE_ALIGN 0x03c	// v1 only
+#define VIRTIO_MMIO_QUEUE_PFN 0X040	// v1 only
+#define VIRTIO_MMIO_QUEUE_READY 0x044	// v2 only, read/write
 #define VIRTIO_MMIO_QUEUE_NOTIFY 0x050	   // write-only
 #define VIRTIO_MMIO_INTERRUPT_STATUS 0x060 // read-only
 #define VIRTIO_MMIO_INTERRUPT_ACK 0x064	   // write-only
 #define VIRTIO_MMIO_STATUS 0x070	   // read/write
+#define VIRTIO_MMIO_QUEUE_DESC_LOW 0x080   // v2: physical address for descriptor table, write-only
+#define VIRTIO_MMIO_QUEUE_DESC_HIGH 0x084
+#define VIRTIO_MMIO_DRIVER_DESC_LOW 0x090 // v2: physical address for available ring, write-only
+#define VIRTIO_MMIO_DRIVER_DESC_HIGH 0x094
+#define VIRTIO_MMIO_DEVICE_DESC_LOW 0x0a0 // v2: physical address for used ring, write-only
+#define VIRTIO_MMIO_DEVICE_DESC_HIGH 0x0a4
 
 // status register bits, from qemu virtio_config.h
 #define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
@@ -47,10 +57,14 @@
 #define VIRTIO_F_ANY_LAYOUT 27
 #define VIRTIO_RING_F_INDIRECT_DESC 28
 #define VIRTIO_RING_F_EVENT_IDX 29
+#define VIRTIO_F_VERSION_1 32 /* modern设备(v2)必须协商此位 */
 
 // this many virtio descriptors.
 // must be a power of two.
-#define NUM 8
+#define NUM 64
+
+// 每个块请求占用的描述符数（请求头、数据、状态）
+#define VIRTIO_REQ_DESC 3
 
 // a single descriptor, from the spec.
 struct virtq_desc {
@@ -61,13 +75,17 @@ struct virtq_desc {
 };
 #define VRING_DESC_F_NEXT 1  // chained with another descriptor
 #define VRING_DESC_F_WRITE 2 // device writes (vs read)
+#define VRING_DESC_F_INDIRECT 4 // buffer contains a table of descriptors
+
+#define VRING_AVAIL_F_NO_INTERRUPT 1 // 未协商EVENT_IDX时，驱动用于抑制中断
+#define VRING_USED_F_NO_NOTIFY 1     // 未协商EVENT_IDX时，设备用于抑制notify
 
 // the (entire) avail ring, from the spec.
 struct virtq_avail {
 	uint16 flags;	  // always zero
 	uint16 idx;	  // driver will write ring[idx] next
 	uint16 ring[NUM]; // descriptor numbers of chain heads
-	uint16 unused;
+	uint16 used_event; // EVENT_IDX: used->idx越过此值时设备才发中断
 };
 
 // one entry in the "used" ring, with which the
@@ -81,9 +99,16 @@ struct virtq_used {
 	uint16 flags; // always zero
 	uint16 idx;   // device increments when it adds a ring[] entry
 	struct virtq_used_elem ring[NUM];
-	uint16 unused;
+	uint16 avail_event; // EVENT_IDX: avail->idx越过此值时驱动才需notify
 };
 
+/**
+ * @brief 判断在idx从old推进到new_idx的过程中是否越过了event，来自virtio spec 2.6.7.2
+ */
+static inline int vring_need_event(uint16 event, uint16 new_idx, uint16 old) {
+	return (uint16)(new_idx - event - 1) < (uint16)(new_idx - old);
+}
+
 // these are specific to virtio block devices, e.g. disks,
 // described in Section 5.2 of the spec.
 
@@ -101,6 +126,10 @@ struct virtio_blk_req {
 
 void virtio_disk_init(void);
 void virtio_disk_rw(Buffer *b, int write);
+void virtio_disk_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write);
+int virtio_disk_read_async(Buffer *b);
+bool virtio_disk_can_submit();
+void virtio_disk_wait(Buffer *b);
 void virtio_disk_intr(void);
 void virtioTest();
 
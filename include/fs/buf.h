@@ -2,7 +2,7 @@
 #define _BUF_H
 
 #include <lib/queue.h>
-#include <lock/sleeplock.h>
+#include <lock/mutex.h>
 #include <mm/memlayout.h>
 #include <types.h>
 #include <param.h>
@@ -15,20 +15,28 @@
 
 
 #define BUF_SIZE (512)			// 512B
-#define BGROUP_NUM (1 << 14)		// 1024 * 8
-
-#define BGROUP_MASK (BGROUP_NUM - 1)			      // 0x3ff
-#define BGROUP_BUF_NUM (BUF_SUM_SIZE / BGROUP_NUM / BUF_SIZE) // 8
 #define BUF_NUM (BUF_SUM_SIZE / BUF_SIZE)
 
+// 缓存划分为若干个分片，块按(dev, blockno)的哈希值归入分片。分片内全相联，各有一把锁
+#define BSHARD_NUM 64
+#define BSHARD_MASK (BSHARD_NUM - 1)
+#define BSHARD_BUF_NUM (BUF_NUM / BSHARD_NUM) // 64MB时为2048
+#define BSHARD_HASH_NUM BSHARD_BUF_NUM	      // 分片内的哈希桶数
+
+// 2Q置换策略的参数：首次访问的块进入FIFO队列A1in，从A1in换出的块号记入幽灵队列A1out，
+// 在A1out中再次被访问的块才进入LRU队列Am。顺序扫描只会在A1in中流过，不会冲掉Am中的热块
+#define BSHARD_A1IN_MAX (BSHARD_BUF_NUM / 4)
+#define BSHARD_GHOST_NUM (BSHARD_BUF_NUM / 2)
+// FAT表和目录等元数据放在单独的LRU队列中，在不超过此上限时只在没有其他可换出的缓冲区时才被换出
+#define BSHARD_META_MAX (BSHARD_BUF_NUM / 4)
+
+// 缓冲区所在的队列
+enum { BUFQ_FREE, BUFQ_A1IN, BUFQ_AM, BUFQ_META, BUFQ_NUM };
+
 typedef struct BufferData {
 	u8 data[BUF_SIZE];
 } BufferData;
 
-typedef struct BufferDataGroup {
-	BufferData buf[BGROUP_BUF_NUM];
-} BufferDataGroup;
-
 typedef struct Buffer {
 	// 缓冲区控制块属性
 	u64 blockno;
@@ -37,26 +45,49 @@ typedef struct Buffer {
 	bool dirty;
 	u16 disk;
 	u16 refcnt;
+	u8 queue; // 所在的队列
 	BufferData *data;
-	struct sleeplock lock;
-	TAILQ_ENTRY(Buffer) link;
+	TAILQ_ENTRY(Buffer) link;	// 所在队列中的链接（越靠前使用越近）
+	LIST_ENTRY(Buffer) hash_link; // 分片哈希桶中的链接
 } Buffer;
 
 typedef TAILQ_HEAD(BufList, Buffer) BufList;
+typedef LIST_HEAD(BufHashList, Buffer) BufHashList;
+
+// A1out中的一项，只记录块号，不占用缓冲区
+typedef struct BufGhost {
+	u64 blockno;
+	i32 dev;  // -1表示空闲
+	i32 next; // 同一哈希桶中的下一项，-1表示结束
+} BufGhost;
+
+typedef struct BufferShard {
+	BufHashList hash[BSHARD_HASH_NUM];
+	BufList queue[BUFQ_NUM];
+	u32 qlen[BUFQ_NUM];
+	Buffer buf[BSHARD_BUF_NUM];
+
+	// A1out：按FIFO顺序循环覆盖的数组，ghost_head指向最老的一项
+	BufGhost ghost[BSHARD_GHOST_NUM];
+	i32 ghost_hash[BSHARD_GHOST_NUM];
+	u32 ghost_head;
 
-typedef struct BufferGroup {
-	BufList list; // 缓冲区双向链表（越靠前使用越频繁）
-	Buffer buf[BGROUP_BUF_NUM];
-	struct spinlock lock;
-} BufferGroup;
+	// 保护分片内缓冲区的查找、换出、引用计数和磁盘读入
+	// 缓冲区数据本身不加锁：同一块的不同部分由持有各自Dirent锁（或fat_lock）的调用者访问
+	mutex_t lock;
+} BufferShard;
 
 void bufInit();
 void bufTest(u64 blockno);
 
 Buffer *bufRead(u32 dev, u64 blockno, bool is_read) __attribute__((warn_unused_result));
+void bufMarkMeta(Buffer *buf);
+int bufPrefetch(u32 dev, u64 blockno);
 void bufWrite(Buffer *buf);
 void bufRelease(Buffer *buf);
 void bufSync();
+void bufFlushRange(u32 dev, u64 blockno, u64 count);
+void bufInvalidateRange(u32 dev, u64 blockno, u64 count);
 
 // struct buf {
 // 	int valid; // has data been read from disk?
@@ -10,14 +10,30 @@
 
 // FarmOS 定义的函数
 err_t clusterInit(FileSystem *fs);
-void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser);
-void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser);
+void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser,
+		 bool meta);
+void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser,
+		  bool meta);
+int clusterPrefetch(FileSystem *fs, u64 cluster);
+void clusterCopy(FileSystem *sfs, u64 scluster, off_t soff, FileSystem *dfs, u64 dcluster,
+		 off_t doff, size_t n);
+err_t clusterDirectRw(FileSystem *fs, u64 cluster, off_t offset, u64 ubuf, size_t n,
+		      bool write);
 
 u64 clusterAlloc(FileSystem *fs, u64 prevCluster) __attribute__((warn_unused_result));
+u64 clusterAllocNoZero(FileSystem *fs, u64 prevCluster) __attribute__((warn_unused_result));
+u64 clusterAllocRun(FileSystem *fs, u64 prevCluster, u32 want, u32 *got)
+    __attribute__((warn_unused_result));
+void clusterZeroRange(FileSystem *fs, u64 cluster, off_t offset, size_t n);
 void clusterFree(FileSystem *fs, u64 cluster, u64 prevCluster);
+void clusterSync(FileSystem *fs);
+void clusterDestroy(FileSystem *fs);
 
 u32 fatRead(FileSystem *fs, u64 cluster);
 void fatWrite(FileSystem *fs, u64 cluster, u32 content);
 i64 fileBlockNo(FileSystem *fs, u64 firstclus, u64 fblockno);
+void loopMapInit(FileSystem *fs);
+void loopMapDestroy(FileSystem *fs);
+i64 loopBlockNo(FileSystem *fs, u64 blockNum);
 
 #endif
@@ -6,5 +6,11 @@ typedef struct Dirent Dirent;
 void dirent_init();
 Dirent *dirent_alloc();
 void dirent_dealloc(Dirent *dirent);
+void dirent_add_child(Dirent *dir, Dirent *child);
+void dirent_remove_child(Dirent *child);
+void dirent_populate(Dirent *dir);
+void dirent_mark_dirty(Dirent *file);
+void dirent_flush(Dirent *file);
+void dirent_flush_all();
 
 #endif
@@ -0,0 +1,75 @@
+#ifndef _EPOLL_H
+#define _EPOLL_H
+
+#include <fs/poll.h>
+#include <lib/queue.h>
+#include <lock/mutex.h>
+#include <types.h>
+
+#define EPOLL_CTL_ADD 1
+#define EPOLL_CTL_DEL 2
+#define EPOLL_CTL_MOD 3
+
+#define EPOLLIN 0x001
+#define EPOLLPRI 0x002
+#define EPOLLOUT 0x004
+#define EPOLLERR 0x008
+#define EPOLLHUP 0x010
+#define EPOLLRDNORM 0x040
+#define EPOLLWRNORM 0x100
+#define EPOLLRDHUP 0x2000
+#define EPOLLEXCLUSIVE (1U << 28)
+#define EPOLLWAKEUP (1U << 29)
+#define EPOLLONESHOT (1U << 30)
+#define EPOLLET (1U << 31)
+
+#define EPOLL_CLOEXEC 02000000
+
+// 与用户态一致，RISC-V上不是packed的
+struct epoll_event {
+	u32 events;
+	u64 data;
+};
+
+#define EPOLL_HASH_SIZE 64
+#define EPOLL_MAX_EVENTS 4096
+
+typedef struct Epoll Epoll;
+
+/**
+ * epoll关注的一个fd
+ */
+typedef struct EpollItem {
+	Epoll *ei_ep;
+	int ei_ufd;
+	struct Fd *ei_kfd; // 添加时fd对应的内核fd，用户关闭或替换fd后该项在epoll_pwait时被移除
+	u64 ei_gen;	   // 添加时内核fd的代数，同一槽位被重新分配时与之不同
+	u32 ei_events;
+	u64 ei_data;
+	bool ei_rdlist;	  // 是否在就绪链表中（mtx_poll保护）
+	bool ei_need_poll; // fd的状态变化无法通知，每次等待时都要检查
+	int ei_nentry;
+	PollEntry ei_entries[POLL_MAX_QUEUE];
+	LIST_ENTRY(EpollItem) ei_hash;
+	TAILQ_ENTRY(EpollItem) ei_rdlink;
+} EpollItem;
+
+struct Epoll {
+	// 串行化epoll_ctl和就绪项的收集，等待时不持有
+	mutex_t ep_lock;
+	LIST_HEAD(, EpollItem) ep_hash[EPOLL_HASH_SIZE];
+	int ep_need_poll; // ei_need_poll项的个数
+
+	// 可能就绪的项，由等待队列的回调加入（mtx_poll保护）
+	TAILQ_HEAD(, EpollItem) ep_rdlist;
+
+	// 等待本epoll的线程，以及嵌套关注本epoll的poll和epoll
+	PollQueue ep_pollq;
+};
+
+int epoll_create1(int flags);
+int epoll_ctl(int epfd, int op, int fd, u64 event);
+int epoll_pwait(int epfd, u64 events, int maxevents, int timeout, u64 sigmask);
+int epoll_check(Epoll *ep);
+
+#endif
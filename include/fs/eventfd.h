@@ -0,0 +1,25 @@
+#ifndef _EVENTFD_H
+#define _EVENTFD_H
+
+#include <fs/poll.h>
+#include <lock/mutex.h>
+#include <types.h>
+
+#define EFD_SEMAPHORE 1
+#define EFD_NONBLOCK 04000
+#define EFD_CLOEXEC 02000000
+
+#define EVENTFD_MAX 0xfffffffffffffffeul
+
+typedef struct EventFd {
+	mutex_t lock;
+	u64 count;	 // 计数器，为0时读者等待，将超过EVENTFD_MAX时写者等待
+	bool semaphore;	 // 每次读只减1
+	PollQueue pollq; // count变化时唤醒
+} EventFd;
+
+int eventfd2(unsigned int initval, int flags);
+int eventfd_check_read(EventFd *efd);
+int eventfd_check_write(EventFd *efd);
+
+#endif
@@ -65,6 +65,22 @@ typedef struct FAT32LongDirectory {
 	wchar LDIR_Name3[2];
 } __attribute__((packed)) FAT32LongDirectory;
 
+// FSInfo扇区，记录空闲簇数和下一个空闲簇的提示（均可能不准确）
+typedef struct FAT32FSInfo {
+	u32 FSI_LeadSig; // 0x41615252
+	u8 FSI_Reserved1[480];
+	u32 FSI_StrucSig; // 0x61417272
+	u32 FSI_Free_Count; // 0xFFFFFFFF表示未知
+	u32 FSI_Nxt_Free;   // 0xFFFFFFFF表示未知
+	u8 FSI_Reserved2[12];
+	u32 FSI_TrailSig; // 0xAA550000
+} __attribute__((packed)) FAT32FSInfo;
+
+#define FSI_LEAD_SIG 0x41615252
+#define FSI_STRUC_SIG 0x61417272
+#define FSI_TRAIL_SIG 0xAA550000
+#define FSI_UNKNOWN 0xFFFFFFFF
+
 // 长文件名项每项容纳的名称长度
 #define BYTES_LONGENT 13
 
@@ -12,6 +12,33 @@
 
 typedef struct FdDev FdDev;
 typedef struct Socket Socket;
+typedef struct IoUring IoUring;
+typedef struct Epoll Epoll;
+typedef struct EventFd EventFd;
+typedef struct TimerFd TimerFd;
+typedef struct SignalFd SignalFd;
+
+// posix_fadvise的advice取值
+#define POSIX_FADV_NORMAL 0
+#define POSIX_FADV_RANDOM 1
+#define POSIX_FADV_SEQUENTIAL 2
+#define POSIX_FADV_WILLNEED 3
+#define POSIX_FADV_DONTNEED 4
+#define POSIX_FADV_NOREUSE 5
+
+// 顺序预读窗口的上下限（以簇为单位）
+#define RA_MIN_CLUS 4
+#define RA_MAX_CLUS 32
+
+/**
+ * @brief 每个打开文件的预读状态
+ */
+typedef struct FileRa {
+	u32 next_off; // 若下一次读从此处开始，则认为是顺序读
+	u32 ra_end;   // 已经发起预读的簇下标上界（不含）
+	u16 window;   // 当前预读窗口大小（簇数），0表示尚未检测到顺序读
+	u16 advice;   // posix_fadvise设置的访问模式
+} FileRa;
 
 typedef struct Fd {
 	// 保证每个fd的读写不并发
@@ -26,7 +53,14 @@ typedef struct Fd {
 	FdDev *fd_dev;
 
 	u32 refcnt; // 引用计数
+	u64 gen;    // 分配时的代数，槽位被释放后重新分配时改变
 	Socket *socket;
+	IoUring *uring;
+	Epoll *epoll;
+	EventFd *eventfd;
+	TimerFd *timerfd;
+	SignalFd *signalfd;
+	FileRa ra; // 预读状态，仅对普通文件有效
 } Fd;
 
 typedef struct DirentUser {
@@ -48,6 +82,11 @@ extern uint citesNum[FDNUM];
 #define dev_pipe 2
 #define dev_console 3
 #define dev_socket 4
+#define dev_uring 5
+#define dev_epoll 6
+#define dev_eventfd 7
+#define dev_timerfd 8
+#define dev_signalfd 9
 
 #define O_RDONLY 0x000
 #define O_WRONLY 0x001
@@ -144,9 +183,22 @@ int fileStatAtFd(int dirFd, u64 pPath, u64 pkstat, int flags);
 off_t lseekFd(int fd, off_t offset, int whence);
 int faccessatFd(int dirFd, u64 pPath, int mode, int flags);
 
+int fd_file_advise(Fd *fd, u64 offset, u64 len, int advice);
+int fd_poll_check(int fd, int events);
+
+// splice、tee的flags
+#define SPLICE_F_MOVE 1
+#define SPLICE_F_NONBLOCK 2
+#define SPLICE_F_MORE 4
+#define SPLICE_F_GIFT 8
+#define SPLICE_F_ALL (SPLICE_F_MOVE | SPLICE_F_NONBLOCK | SPLICE_F_MORE | SPLICE_F_GIFT)
+
 // new
 size_t copy_file_range(int fd_in, off_t *off_in,
                         int fd_out, off_t *off_out,
                         size_t len, unsigned int flags);
+i64 sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+i64 splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags);
+i64 tee(int fd_in, int fd_out, size_t len, unsigned int flags);
 
 #endif
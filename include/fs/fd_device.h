@@ -5,12 +5,15 @@
 
 // 基于内核fd的读写，需要自行避免并发
 // fd的offset由本层维护
-// 其中的buf均是用户态地址
+// dev_read/dev_write的buf是用户态地址，dev_kread/dev_kwrite的buf是内核地址
+// dev_kread/dev_kwrite供sendfile、splice等在内核中搬运数据，设备不支持时为NULL
 typedef struct FdDev {
 	int dev_id;
 	char *dev_name; // 设备名
 	int (*dev_read)(struct Fd *fd, u64 buf, u64 n, u64 offset);
 	int (*dev_write)(struct Fd *fd, u64 buf, u64 n, u64 offset);
+	int (*dev_kread)(struct Fd *fd, u64 buf, u64 n, u64 offset);
+	int (*dev_kwrite)(struct Fd *fd, u64 buf, u64 n, u64 offset);
 	int (*dev_close)(struct Fd *fd);
 	int (*dev_stat)(struct Fd *fd, u64 pkStat);
 } FdDev;
@@ -21,6 +21,8 @@ struct kstat;
 void file_get_timestamp(Dirent *file, struct kstat *kstat);
 void file_update_timestamp(Dirent *file, int type);
 void file_set_timestamp(Dirent *file, int type, struct timespec *ts);
+void file_time_from_raw(Dirent *file);
+void file_time_to_raw(Dirent *file);
 
 #define UTIME_NOW ((1l << 30) - 1l)
 #define UTIME_OMIT ((1l << 30) - 2l)
@@ -3,13 +3,14 @@
 #include <types.h>
 
 typedef struct Dirent Dirent;
-typedef struct DirentPointer DirentPointer;
 typedef struct FileSystem FileSystem;
 
 void filepnt_init(Dirent *file);
 void filepnt_clear(Dirent *file);
 u32 filepnt_getclusbyno(Dirent *file, int fileClusNo);
-void filepnt_setval(DirentPointer* fileptr, int i, int value);
+u32 filepnt_trygetclus(Dirent *file, u32 fileClusNo);
+void filepnt_append(Dirent *file, u32 fileClusNo, u32 clus);
+void filepnt_truncate(Dirent *file, u32 nclus);
 void clus_sequence_free(FileSystem *fs, int clus);
 
 #endif
@@ -4,6 +4,7 @@
 #include <fs/fat32.h>
 #include <fs/file_time.h>
 #include <lib/queue.h>
+#include <lock/mutex.h>
 #include <mm/memlayout.h>
 #include <types.h>
 
@@ -19,28 +20,31 @@ LIST_HEAD(DirentList, Dirent);
 // 对应目录、文件、设备
 typedef enum dirent_type { DIRENT_DIR, DIRENT_FILE, DIRENT_CHARDEV, DIRENT_BLKDEV } dirent_type_t;
 
-// 一页能容纳的u32簇号个数
-#define PAGE_NCLUSNO (PAGE_SIZE / sizeof(u32))
-// #define NDIRENT_SECPOINTER 128
-#define NDIRENT_SECPOINTER 5
-
-// 二级指针
-struct TwicePointer {
-	u32 cluster[PAGE_NCLUSNO];
-};
-
-// 三级指针
-struct ThirdPointer {
-	struct TwicePointer *ptr[PAGE_SIZE / sizeof(struct TwicePointer *)];
-};
+// 文件系统的类型
+typedef enum fs_type { FS_FAT32, FS_TMPFS } fs_type_t;
 
-// 指向簇列表的指针
+// 一页能容纳的u32簇号个数
+// 一段连续的簇：文件的第file_clus个簇起的len个簇，位于磁盘上从disk_clus开始的连续簇
+typedef struct ClusExtent {
+	u32 file_clus;
+	u32 disk_clus;
+	u32 len;
+} ClusExtent;
+
+// 挂载的镜像文件中的一段连续扇区：镜像内从img_sec开始的nsec个扇区，位于其所在文件系统的dev_sec处
+typedef struct LoopExtent {
+	u64 img_sec;
+	u64 dev_sec;
+	u64 nsec;
+} LoopExtent;
+
+// 文件的簇映射表，按需沿FAT链懒惰构建
 typedef struct DirentPointer {
-	// 一级指针
-	// u32 first[10];
-	// 简化：只使用二级指针和三级指针
-	struct TwicePointer *second[NDIRENT_SECPOINTER];
-	struct ThirdPointer *third;
+	ClusExtent *extents; // 按file_clus升序排列，kmalloc分配
+	u32 cnt;	     // extent的个数
+	u32 cap;	     // extents数组的容量
+	u32 mapped;	     // 文件的前mapped个簇已经被映射
+	u32 next_clus;	     // 文件第mapped个簇的簇号，不是有效簇号时表示FAT链已全部映射
 	u16 valid;
 } DirentPointer;
 
@@ -49,13 +53,14 @@ typedef struct DirentPointer {
 
 struct file_time;
 
+#ifdef REFCNT_DEBUG
+// [调试] 记录每个进程持有Dirent引用的次数
 struct holder_info {
 	u16 proc_index;
 	u16 cnt;
-	#ifdef REFCNT_DEBUG
 	char *proc_name;
-	#endif
 };
+#endif
 
 // FarmOS Dirent
 struct Dirent {
@@ -72,11 +77,18 @@ struct Dirent {
 	// 仅用于是挂载点的目录，指向该挂载点所对应的文件系统。用于区分mount目录和非mount目录
 	FileSystem *head;
 
+	// 保护文件数据、簇号映射表与元数据（大小、首簇、时间戳）的锁
+	// 加锁顺序：mtx_file -> 子Dirent.lock -> 父Dirent.lock -> fat_lock -> 缓冲区分片锁
+	mutex_t lock;
+
 	DirentPointer pointer;
 
-	// [暂不用] 标记此Dirent节点是否已扩展子节点，用于弹性伸缩Dirent缓存，不过一般设置此字段为1
-	// 我们会在初始化时扫描所有文件，并构建Dirent
-	// u16 is_extend;
+	// tmpfs文件的两级页表：一级页中存放二级页的地址，二级页中存放文件各页的地址，未写入的页为0
+	u64 **tmp_pages;
+
+	// 标记此目录是否已从磁盘读入全部子节点。目录在首次查找时才展开，
+	// 展开后挂在LRU链上，其子节点在Dirent不足时可被整体回收并重置此标记
+	u16 is_extend;
 
 	// 在上一个目录项中的内容偏移，用于写回
 	u32 parent_dir_off;
@@ -86,6 +98,13 @@ struct Dirent {
 
 	u16 is_rm;
 
+	// 作为镜像被挂载的次数。挂载时按镜像的簇建立了映射表，期间不能改变文件大小
+	u16 loop_busy;
+
+	// 文件大小或首簇已改变但尚未写回父目录的目录项，在close、fsync或sync时写回
+	u16 meta_dirty;
+	LIST_ENTRY(Dirent) dirty_link;
+
 	// 文件的时间戳
 	struct file_time time;
 
@@ -98,6 +117,14 @@ struct Dirent {
 	// 用于空闲链表和父子连接中的链接，因为一个Dirent不是在空闲链表中就是在树上
 	LIST_ENTRY(Dirent) dirent_link;
 
+	// 目录项缓存：以(父目录, 文件名)为键的哈希链
+	LIST_ENTRY(Dirent) hash_link;
+	u32 name_hash;
+	u32 gen; // 分配时递增的代数，用于判断负目录项所指的目录是否已被释放重用
+
+	// 已展开目录的LRU链
+	TAILQ_ENTRY(Dirent) lru_link;
+
 	// 父亲Dirent
 	struct Dirent *
 	    parent_dirent; // 即使是mount的目录，也指向其上一级目录。如果该字段为NULL，表示为总的根目录
@@ -106,10 +133,12 @@ struct Dirent {
 
 	// 各种计数
 	u16 linkcnt; // 链接计数
-	u16 refcnt;  // 引用计数
+	u32 refcnt;  // 引用计数，由dget/dput原子地增减
 
+#ifdef REFCNT_DEBUG
 	struct holder_info holders[DIRENT_HOLDER_CNT];
 	int holder_cnt;
+#endif
 };
 
 // 有当前dirent引用时不变的项（只读，无需加锁）：parent_dirent, name, file_system,
@@ -138,19 +167,35 @@ struct SuperBlock {
 		u32 tot_sec;  /* total count of sectors including all regions */
 		u32 fat_sz;   /* count of sectors for a FAT region */
 		u32 root_clus;
+		u16 fsinfo_sec; /* sector of FSInfo, 0 if not present */
 	} bpb;
+
+	// 空闲簇位图（位为1表示已占用），按页分配，在挂载时由FAT表建立
+	u64 **free_map;
+	u32 free_cnt;  // 空闲簇数
+	u32 next_free; // 下一次分配开始搜索的簇号
+
+	// 主FAT中尚未同步到其余FAT镜像的扇区（位图，按FAT内的扇区下标），为NULL表示每次同时写所有FAT
+	u64 *fat_dirty;
+
+	// 保护FAT表、空闲簇位图和FSInfo的锁，与各文件的锁相互独立
+	mutex_t fat_lock;
 };
 
 // FarmOS VFS
 struct FileSystem {
 	bool valid; // 是否有效
 	char name[8];
+	fs_type_t type;
 	SuperBlock superBlock;					    // 超级块
 	Dirent *root;						    // root项
 	struct Dirent *image;					    // mount对应的文件描述符
 	struct Dirent *mountPoint;				    // 挂载点
 	int deviceNumber;					    // 对应真实设备的编号
+	LoopExtent *loop_map; // 镜像内扇区到镜像所在文件系统扇区的映射，按img_sec升序，挂载期间不变
+	u32 loop_cnt;
 	struct Buffer *(*get)(struct FileSystem *fs, u64 blockNum, bool is_read); // 读取FS的一个Buffer
+	int (*prefetch)(struct FileSystem *fs, u64 blockNum); // 异步预读FS的一个块，不等待完成，无法提交时返回负数
 	// 强制规定：传入的fs即为本身的fs
 	// 稍后用read返回的这个Buffer指针进行写入和释放动作
 	// 我们默认所有文件系统（不管是挂载的，还是从virtio读取的），都需要经过缓存层
@@ -176,11 +221,14 @@ union st_mode {
 	} __attribute__((packed)) bits; // 取消优化对齐
 };
 
+#define IS_TMPFS(fs) ((fs)->type == FS_TMPFS)
+
 typedef int (*findfs_callback_t)(FileSystem *fs, void *data);
 
 void allocFs(struct FileSystem **pFs);
 void deAllocFs(struct FileSystem *fs);
 FileSystem *find_fs_by(findfs_callback_t findfs, void *data);
+void fsSyncAll();
 
 #define MAX_FS_COUNT 16
 
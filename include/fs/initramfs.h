@@ -0,0 +1,18 @@
+#ifndef _INITRAMFS_H
+#define _INITRAMFS_H
+
+#include <types.h>
+
+typedef struct Dirent Dirent;
+typedef struct FileSystem FileSystem;
+
+// initramfs的挂载点，为"/"时直接作为根文件系统，启动过程不访问块设备
+#ifndef INITRAMFS_MOUNT
+#define INITRAMFS_MOUNT "/initramfs"
+#endif
+
+bool initramfs_init_root(FileSystem *fs);
+void initramfs_init();
+int initramfs_unpack(Dirent *root, void *archive, u64 size);
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef _IO_URING_H
+#define _IO_URING_H
+
+#include <lib/queue.h>
+#include <lock/mutex.h>
+#include <types.h>
+
+/**
+ * io_uring：用户态与内核共享的提交队列（SQ）和完成队列（CQ），用户一次io_uring_enter提交一批请求
+ * 以下结构体和常量与Linux的用户接口（linux/io_uring.h）保持一致
+ */
+
+typedef struct io_uring_sqe {
+	u8 opcode;
+	u8 flags;
+	u16 ioprio;
+	i32 fd;
+	u64 off; // 文件偏移，-1表示使用并推进fd的当前偏移
+	u64 addr;
+	u32 len;
+	union {
+		u32 rw_flags;
+		u32 fsync_flags;
+		u32 poll32_events;
+		u32 timeout_flags;
+		u32 msg_flags;
+	};
+	u64 user_data;
+	u16 buf_index;
+	u16 personality;
+	i32 splice_fd_in;
+	u64 __pad2[2];
+} io_uring_sqe_t;
+
+typedef struct io_uring_cqe {
+	u64 user_data;
+	i32 res;
+	u32 flags;
+} io_uring_cqe_t;
+
+struct io_sqring_offsets {
+	u32 head;
+	u32 tail;
+	u32 ring_mask;
+	u32 ring_entries;
+	u32 flags;
+	u32 dropped;
+	u32 array;
+	u32 resv1;
+	u64 resv2;
+};
+
+struct io_cqring_offsets {
+	u32 head;
+	u32 tail;
+	u32 ring_mask;
+	u32 ring_entries;
+	u32 overflow;
+	u32 cqes;
+	u32 flags;
+	u32 resv1;
+	u64 resv2;
+};
+
+struct io_uring_params {
+	u32 sq_entries;
+	u32 cq_entries;
+	u32 flags;
+	u32 sq_thread_cpu;
+	u32 sq_thread_idle;
+	u32 features;
+	u32 wq_fd;
+	u32 resv[3];
+	struct io_sqring_offsets sq_off;
+	struct io_cqring_offsets cq_off;
+};
+
+// io_uring_setup的flags
+#define IORING_SETUP_IOPOLL (1U << 0)
+#define IORING_SETUP_SQPOLL (1U << 1)
+#define IORING_SETUP_SQ_AFF (1U << 2)
+#define IORING_SETUP_CQSIZE (1U << 3)
+#define IORING_SETUP_CLAMP (1U << 4)
+
+// io_uring_params.features
+#define IORING_FEAT_SINGLE_MMAP (1U << 0)
+#define IORING_FEAT_NODROP (1U << 1)
+#define IORING_FEAT_SUBMIT_STABLE (1U << 2)
+#define IORING_FEAT_RW_CUR_POS (1U << 3)
+
+// io_uring_enter的flags
+#define IORING_ENTER_GETEVENTS (1U << 0)
+#define IORING_ENTER_SQ_WAKEUP (1U << 1)
+
+// SQ ring的flags
+#define IORING_SQ_CQ_OVERFLOW (1U << 1)
+
+// sqe->flags
+#define IOSQE_FIXED_FILE (1U << 0)
+#define IOSQE_IO_DRAIN (1U << 1)
+#define IOSQE_IO_LINK (1U << 2)
+
+// sqe->timeout_flags
+#define IORING_TIMEOUT_ABS (1U << 0)
+
+// mmap的偏移，用于区分映射的区域
+#define IORING_OFF_SQ_RING 0ULL
+#define IORING_OFF_CQ_RING 0x8000000ULL
+#define IORING_OFF_SQES 0x10000000ULL
+
+enum {
+	IORING_OP_NOP,
+	IORING_OP_READV,
+	IORING_OP_WRITEV,
+	IORING_OP_FSYNC,
+	IORING_OP_READ_FIXED,
+	IORING_OP_WRITE_FIXED,
+	IORING_OP_POLL_ADD,
+	IORING_OP_POLL_REMOVE,
+	IORING_OP_SYNC_FILE_RANGE,
+	IORING_OP_SENDMSG,
+	IORING_OP_RECVMSG,
+	IORING_OP_TIMEOUT,
+	IORING_OP_TIMEOUT_REMOVE,
+	IORING_OP_ACCEPT,
+	IORING_OP_ASYNC_CANCEL,
+	IORING_OP_LINK_TIMEOUT,
+	IORING_OP_CONNECT,
+	IORING_OP_FALLOCATE,
+	IORING_OP_OPENAT,
+	IORING_OP_CLOSE,
+	IORING_OP_FILES_UPDATE,
+	IORING_OP_STATX,
+	IORING_OP_READ,
+	IORING_OP_WRITE,
+	IORING_OP_FADVISE,
+	IORING_OP_MADVISE,
+	IORING_OP_SEND,
+	IORING_OP_RECV,
+};
+
+// SQ最大的项数，CQ的项数最多为其两倍
+#define IORING_MAX_ENTRIES 4096
+
+/**
+ * 暂时无法完成的请求：poll、timeout，以及fd尚未就绪的管道和socket读写
+ * 同一IOSQE_IO_LINK链上的请求在pend中连续排列，只有链头会被执行
+ */
+typedef struct IoUringPend {
+	io_uring_sqe_t sqe;
+	u64 deadline;	// timeout的到期时间（单调时钟，微秒）
+	u64 target_seq; // timeout在完成数达到此值时提前完成，0表示不计数
+	bool wait_prev; // 链上的前一个请求尚未完成
+	TAILQ_ENTRY(IoUringPend) link;
+} IoUringPend;
+
+// CQ已满时暂存的完成项，待用户消费后按顺序补入CQ
+typedef struct IoUringOverflow {
+	io_uring_cqe_t cqe;
+	TAILQ_ENTRY(IoUringOverflow) link;
+} IoUringOverflow;
+
+typedef struct IoUring {
+	// 串行化io_uring_enter
+	mutex_t lock;
+
+	u32 sq_entries;
+	u32 cq_entries;
+
+	// 共享区域由若干不连续的物理页组成，按页号索引。ring区域存放头部、CQE数组和SQ索引数组
+	u32 ring_npages;
+	u32 sqe_npages;
+	u64 *ring_pages;
+	u64 *sqe_pages;
+
+	u64 cq_seq;	  // 已经产生的完成项总数
+	u32 overflow_cnt; // 暂存在overflow中的完成项数
+
+	TAILQ_HEAD(, IoUringPend) pend;
+	TAILQ_HEAD(, IoUringOverflow) overflow;
+} IoUring;
+
+int io_uring_setup(u32 entries, struct io_uring_params *params);
+int io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags, u64 sig, size_t sigsz);
+void *io_uring_mmap(struct Fd *fd, u64 start, size_t len, u64 perm, off_t off);
+
+#endif
@@ -1,10 +1,12 @@
 #ifndef _PIPE_H
 #define _PIPE_H
+#include <fs/poll.h>
 #include <lock/mutex.h>
 #include <types.h>
 
 #define PIPE_BUF_SIZE (PAGE_SIZE * 32)
 struct thread;
+struct Fd;
 
 struct Pipe {
 	// 对管道进行读写访问操作均需要加锁
@@ -17,10 +19,15 @@ struct Pipe {
 	u64 pipeWritePos;	   // write position
 	void * pipeBuf; // data buffer
 	struct thread *waitProc;
+	PollQueue pollq; // 读写端的poll等待队列
 };
 
-int pipe(int fd[2]);
+int pipe(int fd[2], int flags);
 int pipe_check_read(struct Pipe *p);
 int pipe_check_write(struct Pipe *p);
+int pipe_peek(struct Pipe *p, void *kbuf, u64 n, bool nonblock);
+void pipe_consume(struct Pipe *p, u64 n);
+int pipe_wait_space(struct Pipe *p, bool nonblock);
+int pipe_kwrite(struct Fd *fd, void *kbuf, u64 n, bool nonblock);
 
 #endif
@@ -0,0 +1,62 @@
+#ifndef _POLL_H
+#define _POLL_H
+
+#include <lib/queue.h>
+#include <types.h>
+
+/**
+ * 就绪通知：管道、socket等对象各有一个等待队列，状态变化（写入数据、读走数据、关闭）时唤醒队列
+ * 等待者（ppoll/pselect的一次等待、epoll中的一项）在队列上挂一个PollEntry，被唤醒时调用其回调
+ * 所有队列的链表和回调由全局锁mtx_poll保护，加锁顺序：对象的锁（pipe、socket） -> mtx_poll
+ */
+
+struct Fd;
+typedef struct PollEntry PollEntry;
+typedef void (*poll_func_t)(PollEntry *entry);
+
+typedef struct PollQueue {
+	LIST_HEAD(, PollEntry) pq_head;
+} PollQueue;
+
+struct PollEntry {
+	PollQueue *pe_queue; // 所在的等待队列，队列销毁后为NULL
+	poll_func_t pe_func; // 队列被唤醒时调用（持有mtx_poll）
+	void *pe_priv;
+	LIST_ENTRY(PollEntry) pe_link;
+};
+
+// 一个fd至多关联的等待队列数。流式socket的可写状态取决于对端的缓冲区，还需挂在对端的队列上
+#define POLL_MAX_QUEUE 2
+
+// fd的状态变化无法通知（console）时，等待者的轮询间隔
+#define POLL_INTERVAL_US 10000
+
+/**
+ * @brief 一次ppoll/pselect/epoll_pwait的等待
+ */
+typedef struct PollWaiter {
+	bool pw_triggered; // 注册后是否有队列被唤醒（mtx_poll保护）
+	bool pw_need_poll; // 存在无法通知的fd，睡眠需要限时
+	int pw_cnt;
+	int pw_cap;
+	PollEntry *pw_entries;
+} PollWaiter;
+
+void poll_init();
+void poll_queue_init(PollQueue *q);
+void poll_queue_destroy(PollQueue *q);
+void poll_wakeup(PollQueue *q);
+void poll_wakeup_locked(PollQueue *q);
+void poll_entry_add(PollQueue *q, PollEntry *e, poll_func_t func, void *priv);
+void poll_entry_del(PollEntry *e);
+
+int fd_poll(struct Fd *kfd, int events);
+int fd_poll_queues(struct Fd *kfd, PollQueue *qs[POLL_MAX_QUEUE]);
+
+void poll_waiter_init(PollWaiter *w, int nfd);
+void poll_waiter_add_queue(PollWaiter *w, PollQueue *q);
+void poll_waiter_add(PollWaiter *w, struct Fd *kfd);
+int poll_waiter_wait(PollWaiter *w, u64 deadline);
+void poll_waiter_destroy(PollWaiter *w);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef _SIGNALFD_H
+#define _SIGNALFD_H
+
+#include <fs/poll.h>
+#include <param.h>
+#include <signal/sigset.h>
+#include <types.h>
+
+#define SFD_NONBLOCK 04000
+#define SFD_CLOEXEC 02000000
+
+// 与用户态一致，固定为128字节
+struct signalfd_siginfo {
+	u32 ssi_signo;
+	i32 ssi_errno;
+	i32 ssi_code;
+	u32 ssi_pid;
+	u32 ssi_uid;
+	i32 ssi_fd;
+	u32 ssi_tid;
+	u32 ssi_band;
+	u32 ssi_overrun;
+	u32 ssi_trapno;
+	i32 ssi_status;
+	i32 ssi_int;
+	u64 ssi_ptr;
+	u64 ssi_utime;
+	u64 ssi_stime;
+	u64 ssi_addr;
+	u16 ssi_addr_lsb;
+	u16 __pad2;
+	i32 ssi_syscall;
+	u64 ssi_call_addr;
+	u32 ssi_arch;
+	u8 __pad[28];
+};
+
+typedef struct SignalFd {
+	sigset_t mask; // 关注的信号（fd的锁保护）
+} SignalFd;
+
+int signalfd4(int fd, u64 mask, u64 sizemask, int flags);
+int signalfd_check_read(SignalFd *sfd);
+void signalfd_notify();
+PollQueue *signalfd_poll_queue();
+
+#endif
@@ -1,16 +1,24 @@
 #ifndef _SOCKET_H
 #define _SOCKET_H
 #include <fs/fd.h>
+#include <fs/poll.h>
 #include <lock/mutex.h>
 #include <types.h>
 #include <lib/queue.h>
 #include <lock/mutex.h>
 
-#define SOCKET_COUNT 128
+#define SOCKET_MAX 1024	    // 同时存在的socket数上限，socket结构体按需分配
+#define SOCKET_HASH_SIZE 64 // 散列表的桶数，须为2的幂
 #define PENDING_COUNT 128
-#define MESSAGE_COUNT 512
 #define SOCKET_BUFFER_SIZE (PAGE_SIZE * 32)
 
+#define SOCKET_MESSAGE_MAX 64	     // 每个socket至多缓存的数据报数
+#define MESSAGE_MAX_SIZE 65535	     // 数据报的最大长度
+#define MESSAGE_KEEP_SIZE PAGE_SIZE // 回收消息时保留的缓冲区上限，更大的缓冲区随消息释放
+
+#define SOCKET_LOAN_MIN (PAGE_SIZE * 4)	       // 缓冲区满后阻塞写入的剩余数据不少于此长度时出借页面
+#define SOCKET_LOAN_MAX_PAGES 32	       // 每次出借的页数上限
+
 #define AF_UNIX 1  /* Unix domain sockets 		*/
 #define AF_LOCAL 1 /* POSIX name for AF_UNIX	*/
 #define AF_INET 2
@@ -19,7 +27,15 @@
 #define SOCK_STREAM 1
 #define SOCK_DGRAM 2
 
+// socket、socketpair的type和accept4的flags中可以附带的标志，与O_NONBLOCK、O_CLOEXEC取值相同
+#define SOCK_NONBLOCK 04000
+#define SOCK_CLOEXEC 02000000
+
+// recvfrom、sendto的flags：本次调用不阻塞
+#define MSG_DONTWAIT 0x40
+
 #define SOL_SOCKET 1
+#define SO_ERROR 4
 #define SO_RCVBUF 8
 #define SO_SNDBUF 7
 
@@ -48,12 +64,27 @@ typedef	struct Message {
 	u32 addr;	// 发送方的addr
 	void * bufferAddr;
 	u64 length;
+	u64 capacity; // bufferAddr的大小，消息回收后缓冲区留给下一个数据报复用
 } Message;
 
 typedef TAILQ_HEAD(Message_list, Message) Message_list;
 
+/**
+ * 流式socket的页面出借：缓冲区已满时，写者把剩余数据所在的物理页借给对端，读者读空缓冲区后直接从中复制
+ * 结构体位于写者的内核栈上，写者一直等到数据被读完、对端关闭读或自己被杀死
+ */
+typedef struct SocketLoan {
+	u64 pages[SOCKET_LOAN_MAX_PAGES]; // 出借页面的物理地址，已增加引用计数
+	int npage;
+	u64 offset; // 数据在第一页中的偏移
+	u64 len;    // 出借的字节数
+	u64 done;   // 已被读者复制的字节数
+	bool aborted;
+} SocketLoan;
+
 
 typedef struct Socket {
+	int id; // socket的编号，首次分配时确定，回收后不变
 	bool used;
 	mutex_t lock;
 	u32 type;
@@ -65,17 +96,33 @@ typedef struct Socket {
 	int waiting_h;
 	int waiting_t;
 	int listening;
-	void *bufferAddr;
+	void *bufferAddr; // 流式socket的接收缓冲区，数据报socket不分配
+	SocketLoan *loan; // 对端正在出借给本socket的页面，读完缓冲区中的数据后从这里读（socket锁保护）
 	SocketState state;
 	// bool is_close; 由首先关闭连接的socket来写另一socket的is_close属性
 	u64 tid; // 归属的tid
 
 	bool self_read_close;
 	bool self_write_close;
-	Message_list messages;
+	Message_list messages;	    // 收到的数据报（socket锁保护，下同）
+	Message_list free_messages; // 本socket的消息池，发送方在接收方的池中分配
+	int message_cnt;	    // 已分配的消息数（含空闲的）
 
 	int udp_is_connect;
-	int opposite;
+	int opposite; // 连接的UDP对端的id
+
+	// 非阻塞connect已进入对端的等待队列，但尚未被accept
+	bool connecting;
+
+	// 本socket可读、对端可写的状态变化时唤醒
+	PollQueue pollq;
+
+	// 散列表的链接，以及addr、target_addr的修改，由mtx_sockhash保护
+	bool bind_hashed; // 按本地端口散列
+	bool conn_hashed; // 按（本地端口，对端端口）散列，用于查找对端
+	LIST_ENTRY(Socket) bind_link;
+	LIST_ENTRY(Socket) conn_link;
+	LIST_ENTRY(Socket) free_link; // 空闲socket链表（mtx_socketmap保护）
 } Socket;
 
 struct Fd;
@@ -86,7 +133,9 @@ int bind(int sockfd, const SocketAddr *sockectaddr, socklen_t addrlen);
 int listen(int sockfd, int backlog);
 int connect(int sockfd, const SocketAddr *addr, socklen_t addrlen);
 int accept(int sockfd, SocketAddr *p_addr, socklen_t * addrlen);
-void socketFree(int socketNum);
+int accept4(int sockfd, SocketAddr *p_addr, socklen_t * addrlen, int flags);
+int socketpair(int domain, int type, int protocol, int sv[2]);
+void socketFree(Socket *socket);
 
 int setsockopt(int sockfd, int lever, int optname, const void * optval, socklen_t optlen);
 int getsockopt(int sockfd, int lever, int optname, void * optval, socklen_t * optlen);
@@ -95,6 +144,7 @@ int sendto(int sockfd, const void * buffer, size_t len, int flags, const SocketA
 int recvfrom(int sockfd, void *buffer, size_t len, int flgas, SocketAddr * src_addr, socklen_t *addrlen, int user);
 int socket_read_check(struct Fd *fd);
 int socket_write_check(struct Fd* fd);
+int socket_poll_queues(struct Fd *fd, PollQueue *qs[POLL_MAX_QUEUE]);
 int getpeername(int sockfd, SocketAddr * addr, socklen_t* addrlen);
 int shutdown(int sockfd, int how);
 
@@ -0,0 +1,39 @@
+#ifndef _TIMERFD_H
+#define _TIMERFD_H
+
+#include <fs/poll.h>
+#include <lib/queue.h>
+#include <sys/time.h>
+#include <types.h>
+
+#define TFD_TIMER_ABSTIME 1
+#define TFD_TIMER_CANCEL_ON_SET 2
+
+#define TFD_NONBLOCK 04000
+#define TFD_CLOEXEC 02000000
+
+struct itimerspec {
+	struct timespec it_interval; /* Interval for periodic timer */
+	struct timespec it_value;    /* Time until next expiration */
+};
+
+/**
+ * 时间均以单调时钟的微秒计，由时钟中断检查到期（精度为一个时钟中断间隔）
+ */
+typedef struct TimerFd {
+	int clockid;
+	u64 expire;   // 下次到期的时间，0表示未启动（mtx_timerfd保护，下同）
+	u64 interval; // 周期，0表示只触发一次
+	u64 ticks;    // 上次读取后到期的次数
+	PollQueue pollq;
+	LIST_ENTRY(TimerFd) link; // 已启动的定时器链表
+} TimerFd;
+
+void timerfd_init();
+void timerfd_check();
+int timerfd_create(int clockid, int flags);
+int timerfd_settime(int fd, int flags, u64 new_value, u64 old_value);
+int timerfd_gettime(int fd, u64 curr_value);
+int timerfd_check_read(TimerFd *tfd);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef _TMPFS_H
+#define _TMPFS_H
+
+#include <types.h>
+
+typedef struct Dirent Dirent;
+typedef struct FileSystem FileSystem;
+
+void tmpfs_init(FileSystem *fs);
+bool tmpfs_busy(FileSystem *fs);
+void tmpfs_destroy(FileSystem *fs);
+int tmpfs_alloc_file(Dirent *dir, Dirent **file, char *name);
+int tmpfs_getdent(Dirent *dir, u32 offset, char *name, int len, int *next_offset);
+
+int tmpfs_read(Dirent *file, int user, u64 dst, uint off, uint n);
+int tmpfs_write(Dirent *file, int user, u64 src, uint off, uint n);
+int tmpfs_copy_range(Dirent *src, uint soff, Dirent *dst, uint doff, uint n);
+void tmpfs_truncate(Dirent *file, u64 newsize);
+int tmpfs_fallocate(Dirent *file, int mode, u64 offset, u64 len);
+
+#endif
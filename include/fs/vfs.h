@@ -15,8 +15,13 @@ int createFile(struct Dirent *baseDir, char *path, Dirent **file);
 int create_file_and_close(char *path);
 int file_read(struct Dirent *file, int user, u64 dst, uint off, uint n);
 int file_write(struct Dirent *file, int user, u64 src, uint off, uint n);
-void file_shrink(Dirent *file, u64 newsize);
-void file_extend(struct Dirent *file, int newSize);
+bool file_can_direct(struct Dirent *file);
+int file_direct_rw(struct Dirent *file, int write, u64 buf, uint off, uint n);
+int file_copy_range(struct Dirent *src, uint soff, struct Dirent *dst, uint doff, uint n);
+void file_readahead(struct Dirent *file, u32 clusIndex, u32 count);
+int file_shrink(Dirent *file, u64 newsize);
+int file_extend(struct Dirent *file, int newSize);
+int file_fallocate(struct Dirent *file, int mode, u64 offset, u64 len);
 void file_close(Dirent *file);
 void dget(Dirent *dirent);
 void dput(Dirent *dirent);
@@ -33,6 +38,8 @@ void fs_sync();
 
 int find_fs_of_dir(FileSystem *fs, void *data);
 void sync_dirent_rawdata_back(Dirent *dirent);
+void dirent_meta_to_raw(Dirent *dirent);
+void dirent_meta_from_raw(Dirent *dirent);
 int dirGetDentFrom(Dirent *dir, u64 offset, struct Dirent **file, int *next_offset,
 		   longEntSet *longSet);
 int dir_alloc_file(Dirent *dir, Dirent **file, char *name);
@@ -46,7 +53,7 @@ void dget_path(Dirent *file);
 
 void fat32_init(FileSystem *fs);
 void init_files();
-int mount_fs(char *special, Dirent *baseDir, char *dirPath);
+int mount_fs(char *special, Dirent *baseDir, char *dirPath, char *fstype);
 int umount_fs(char *dirPath, Dirent *baseDir);
 
 #endif
@@ -8,6 +8,9 @@ void copyOutOnPageTable(Pte *pgDir, u64 uPtr, void *kPtr, int len);
 void copyOut(u64 uPtr, void *kPtr, int len);
 void copyIn(u64 uPtr, void *kPtr, int len);
 void copyInStr(u64 uPtr, void *kPtr, int n);
+void copyOutEither(int user, u64 dst, void *kPtr, int len);
+void copyInEither(int user, u64 src, void *kPtr, int len);
+err_t userPinPage(u64 uPtr, bool write, u64 *pa);
 
 void copy_in(Pte *upd, u64 uptr, void *kptr, size_t len);
 void copy_in_str(Pte *upd, u64 uptr, void *kptr, size_t len);
@@ -74,7 +74,6 @@
 #define MMAP_START 0x600000000
 #define MMAP_END 0x800000000
 #define U_DYNAMIC_SO_START 0x800000000
-#define U_KTEMPSPACE 0xa00000000
 
 
 // BELOW TO BE CLASSIFIED (TODO)
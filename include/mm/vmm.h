@@ -53,6 +53,9 @@ err_t ptMap(Pte *pgdir, u64 va, u64 pa, u64 perm) __attribute__((warn_unused_res
 err_t ptUnmap(Pte *pgdir, u64 va) __attribute__((warn_unused_result));
 
 Pte ptLookup(Pte *pgdir, u64 va) __attribute__((warn_unused_result));
+// 固定页面，必须保证在使用完毕后使用 ptUnpin 进行释放
+err_t ptPin(Pte *pgdir, u64 va, u64 perm, u64 *pa) __attribute__((warn_unused_result));
+void ptUnpin(u64 pa);
 
 static inline Pte paToPte(u64 pa) {
 	return (pa >> PAGE_SHIFT) << PTE_PPNSHIFT;
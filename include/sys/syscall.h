@@ -68,7 +68,7 @@ int sys_close(int fd);
 int sys_dup(int fd);
 int sys_dup3(int fd_old, int fd_new);
 u64 sys_getcwd(u64 buf, int size);
-int sys_pipe2(u64 pfd);
+int sys_pipe2(u64 pfd, int flags);
 int sys_chdir(u64 path);
 int sys_mkdirat(int dirFd, u64 path, int mode);
 int sys_mount(u64 special, u64 dir, u64 fstype, u64 flags, u64 data);
@@ -89,7 +89,10 @@ off_t sys_lseek(int fd, off_t offset, int whence);
 int sys_renameat2(int olddirfd, u64 oldpath, int newdirfd, u64 newpath, unsigned int flags);
 int sys_statfs(u64 ppath, struct statfs *buf);
 int sys_ftruncate(int fd, off_t length);
+int sys_fallocate(int fd, int mode, off_t offset, off_t len);
 int sys_fsync(int fd);
+int sys_fadvise64(int fd, off_t offset, off_t len, int advice);
+int sys_readahead(int fd, off_t offset, size_t count);
 int sys_sync();
 int sys_syncfs(int fd);
 int sys_pselect6(int nfds, u64 p_readfds, u64 p_writefds, u64 p_exceptfds, u64 p_timeout, u64 sigmask);
@@ -98,6 +101,20 @@ int sys_readlinkat(int dirfd, u64 pathname, u64 buf, size_t bufsiz);
 size_t sys_copy_file_range(int fd_in, off_t *off_in,
                         int fd_out, off_t *off_out,
                         size_t len, unsigned int flags);
+i64 sys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count);
+i64 sys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len,
+	       unsigned int flags);
+i64 sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags);
+int sys_io_uring_setup(u32 entries, u64 params);
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags, u64 sig, size_t sigsz);
+int sys_epoll_create1(int flags);
+int sys_epoll_ctl(int epfd, int op, int fd, u64 event);
+int sys_epoll_pwait(int epfd, u64 events, int maxevents, int timeout, u64 sigmask);
+int sys_eventfd2(unsigned int initval, int flags);
+int sys_timerfd_create(int clockid, int flags);
+int sys_timerfd_settime(int fd, int flags, u64 new_value, u64 old_value);
+int sys_timerfd_gettime(int fd, u64 curr_value);
+int sys_signalfd4(int fd, u64 mask, u64 sizemask, int flags);
 size_t sys_getrandom(u64 buf, size_t buflen, unsigned int flags);
 int sys_fchmod(int fd, mode_t mode);
 
@@ -126,6 +143,7 @@ int sys_bind(int sockfd, const SocketAddr *sockectaddr, socklen_t addrlen);
 int sys_listen(int sockfd, int backlog);
 int sys_connect(int sockfd, const SocketAddr *addr, socklen_t addrlen);
 int sys_accept(int sockfd, SocketAddr *addr);
+int sys_accept4(int sockfd, SocketAddr *addr, socklen_t *addrlen, int flags);
 int sys_recvfrom(int sockfd, void *buffer, size_t len, int flgas, SocketAddr * src_addr, socklen_t addrlen);
 int sys_sendto(int sockfd, const void * buffer, size_t len, int flags, const SocketAddr * dst_addr, socklen_t addrlen);
 int sys_getsocketname(int sockfd, SocketAddr * addr, socklen_t addrlen);
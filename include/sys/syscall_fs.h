@@ -32,6 +32,10 @@ typedef struct iovec {
 #define SEEK_DATA 3 /* Seek to next data.  */
 #define SEEK_HOLE 4 /* Seek to next hole.  */
 
+// 用于fallocate的mode
+#define FALLOC_FL_KEEP_SIZE 0x01  /* Don't extend the file size.  */
+#define FALLOC_FL_PUNCH_HOLE 0x02 /* Deallocate the range.  */
+
 // 用于fstatat的flags
 #define AT_SYMLINK_NOFOLLOW 0x100 /* Do not follow symbolic links.  */
 #define AT_REMOVEDIR                                                                               \
@@ -81,6 +85,9 @@ struct pollfd {
 #define FCNTL_DUPFD_CLOEXEC 1030
 #define FCNTL_SETFL 4 /* Set file status flags.  */
 
+// F_SETFL可以修改的状态标志（取值见fs/fd.h）
+#define FCNTL_SETFL_MASK (O_APPEND | O_NONBLOCK | O_ASYNC | __O_DIRECT)
+
 // for getfd and setfd
 #define FD_CLOEXEC 1
 
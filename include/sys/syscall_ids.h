@@ -280,6 +280,8 @@
 #define SYS_io_pgetevents 292
 #define SYS_rseq 293
 #define SYS_kexec_file_load 294
+#define SYS_io_uring_setup 425
+#define SYS_io_uring_enter 426
 #define SYS_riscv_flush_icache 244 + 15
 #define SYS_spawn 400
 #define SYS_mailread 401
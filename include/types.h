@@ -88,5 +88,6 @@ typedef unsigned long uint64;
 	})
 
 #define ROUNDUP(a, x) (((a) + (x)-1) & ~((x)-1))
+#define ROUNDDOWN(a, x) ((a) & ~((x)-1))
 
 #endif
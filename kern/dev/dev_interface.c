@@ -1,4 +1,5 @@
 #include <dev/interface.h>
+#include <dev/ramdisk.h>
 #include <dev/sbi.h>
 #include <dev/sd.h>
 #include <dev/uart.h>
@@ -32,6 +33,7 @@ void dev_init() {
 #else
 	virtio_disk_init();
 #endif
+	ramdisk_init();
 }
 
 void cons_putc(int c) {
@@ -70,6 +72,10 @@ int cons_getc() {
 }
 
 void disk_rw(Buffer *buf, int write) {
+	if (buf->dev == DEV_RAMDISK) {
+		ramdisk_rw(buf, write);
+		return;
+	}
 #ifdef FEATURE_DISK_SD
 	sd_rw(buf, write);
 #else
@@ -77,6 +83,60 @@ void disk_rw(Buffer *buf, int write) {
 #endif
 }
 
+/**
+ * @brief 绕过块缓存，在连续的扇区[sector, ...)与若干段物理内存之间直接传输数据，等待传输完成
+ */
+void disk_rw_sg(int dev, u64 sector, DiskSeg *segs, int nseg, int write) {
+	if (dev == DEV_RAMDISK) {
+		ramdisk_rw_sg(sector, segs, nseg, write);
+		return;
+	}
+#ifdef FEATURE_DISK_SD
+	sd_rw_sg(sector, segs, nseg, write);
+#else
+	virtio_disk_rw_sg(sector, segs, nseg, write);
+#endif
+}
+
+/**
+ * @brief 异步读取一个块，返回0表示已提交。SD卡驱动和内存块设备不支持异步读取，总是返回-1
+ */
+int disk_read_async(Buffer *buf) {
+	if (buf->dev == DEV_RAMDISK) {
+		return -1;
+	}
+#ifdef FEATURE_DISK_SD
+	return -1;
+#else
+	return virtio_disk_read_async(buf);
+#endif
+}
+
+/**
+ * @brief 设备当前能否接受一个异步读请求，用于在分配缓冲区之前判断预读是否值得
+ */
+bool disk_can_read_async(u32 dev) {
+	if (dev == DEV_RAMDISK) {
+		return false;
+	}
+#ifdef FEATURE_DISK_SD
+	return false;
+#else
+	return virtio_disk_can_submit();
+#endif
+}
+
+/**
+ * @brief 等待buf上由disk_read_async提交的请求完成
+ */
+void disk_wait(Buffer *buf) {
+#ifdef FEATURE_DISK_SD
+	return;
+#else
+	virtio_disk_wait(buf);
+#endif
+}
+
 void disk_intr() {
 #ifdef FEATURE_DISK_SD
     panic("sd card not support disk_intr");
@@ -10,6 +10,7 @@
 
 uint64 dtbEntry = 0;
 struct MemInfo memInfo;
+struct InitrdInfo initrdInfo;
 
 static void swapChar(void *a, void *b) {
 	char c = *(char *)a;
@@ -74,6 +75,13 @@ static inline uint64 readBigEndian64(void *p) {
 	return ret;
 }
 
+/**
+ * @brief 读取/chosen节点中以1个或2个cell表示的initrd地址
+ */
+static uint64 readInitrdAddr(void *value, uint32 len) {
+	return len == 8 ? readBigEndian64(value) : readBigEndian32(value);
+}
+
 #define FOURROUNDUP(sz) (((sz) + 4 - 1) & ~(4 - 1))
 
 /**
@@ -120,6 +128,12 @@ void *parseFdtNode(struct FDTHeader *fdtHeader, void *node, char *parent) {
 				}
 				log(LEVEL_MODULE, "len:    %d\n", len);
 
+				if (strncmp(name, "linux,initrd-start", 19) == 0) {
+					initrdInfo.start = readInitrdAddr(node, len);
+				} else if (strncmp(name, "linux,initrd-end", 17) == 0) {
+					initrdInfo.end = readInitrdAddr(node, len);
+				}
+
 				// values需要以info形式输出
 				if (len == 4 || len == 8 || len == 16 || len == 32) {
 					const char pre[] = "values: ";
@@ -175,4 +189,7 @@ void parseDtb() {
 
 	log(LEVEL_GLOBAL, "Memory Start Addr = 0x%016lx, size = %d MB\n", memInfo.start,
 	    memInfo.size / 1024 / 1024);
+	if (initrdInfo.end > initrdInfo.start) {
+		log(LEVEL_GLOBAL, "Initrd at 0x%016lx~0x%016lx\n", initrdInfo.start, initrdInfo.end);
+	}
 }
@@ -0,0 +1,67 @@
+#include <dev/dtb.h>
+#include <dev/ramdisk.h>
+#include <fs/buf.h>
+#include <lib/error.h>
+#include <lib/log.h>
+#include <lib/string.h>
+
+/**
+ * 内存块设备（设备号DEV_RAMDISK）：扇区依次存放在一段连续的物理内存中，读写就是内存复制，没有设备延迟
+ * 后备内存有两个来源：QEMU -initrd 加载的磁盘镜像（initrd不是cpio归档时），或者pmmInit按RAMDISK_SIZE
+ * 预留的全0内存。两者都有时使用initrd，预留的内存不再使用
+ */
+
+void *ramdiskData = NULL;
+u64 ramdiskSize = 0;
+
+void ramdisk_init() {
+	extern struct InitrdInfo initrdInfo;
+	u64 size = initrdInfo.end - initrdInfo.start;
+
+	if (size >= BUF_SIZE && strncmp((char *)initrdInfo.start, "07070", 5) != 0) {
+		// initrd所在的页由pmmInit保留，此后归内存块设备所有，不再释放；也不再作为initramfs解包
+		ramdiskData = (void *)initrdInfo.start;
+		ramdiskSize = size;
+		initrdInfo.start = initrdInfo.end = 0;
+	}
+	ramdiskSize = ROUNDDOWN(ramdiskSize, BUF_SIZE);
+
+	if (ramdiskSize > 0) {
+		log(LEVEL_GLOBAL, "ramdisk: %d sectors at 0x%lx\n", ramdiskSize / BUF_SIZE, ramdiskData);
+	}
+}
+
+/**
+ * @brief 在内存块设备的扇区[sector, sector + len / BUF_SIZE)与物理内存addr之间复制
+ */
+static void ramdisk_copy(u64 sector, u64 addr, u64 len, int write) {
+	u64 off = sector * BUF_SIZE;
+	if (off + len > ramdiskSize) {
+		warn("ramdisk: access sector %ld~%ld beyond size %ld\n", sector, sector + len / BUF_SIZE,
+		     ramdiskSize / BUF_SIZE);
+		if (!write) {
+			memset((void *)addr, 0, len);
+		}
+		return;
+	}
+
+	if (write) {
+		memcpy(ramdiskData + off, (void *)addr, len);
+	} else {
+		memcpy((void *)addr, ramdiskData + off, len);
+	}
+}
+
+void ramdisk_rw(Buffer *b, int write) {
+	ramdisk_copy(b->blockno, (u64)b->data->data, BUF_SIZE, write);
+}
+
+/**
+ * @brief 多扇区读写：各段物理内存依次对应从sector开始的连续扇区
+ */
+void ramdisk_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write) {
+	for (int i = 0; i < nseg; i++) {
+		ramdisk_copy(sector, segs[i].addr, segs[i].len, write);
+		sector += segs[i].len / BUF_SIZE;
+	}
+}
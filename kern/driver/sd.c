@@ -377,8 +377,24 @@ int sdTest() {
 	return 0;
 }
 
+#include <dev/interface.h>
 #include <fs/buf.h>
 
+/**
+ * @brief 多扇区直接读写，每段内存对应若干连续的扇区
+ */
+void sd_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write) {
+	for (int i = 0; i < nseg; i++) {
+		u32 cnt = segs[i].len / 512;
+		if (write) {
+			sdWrite((u8 *)segs[i].addr, sector, cnt);
+		} else {
+			sdRead((u8 *)segs[i].addr, sector, cnt);
+		}
+		sector += cnt;
+	}
+}
+
 void sd_rw(Buffer *buf, int write) {
 	u64 sector = buf->blockno * (BUF_SIZE / 512);
 	u8 *buffer = (u8 *)buf->data;
@@ -14,15 +14,23 @@
 // the address of virtio mmio register r.
 #define R(r) ((volatile uint32 *)(VIRTIO0 + (r)))
 #define availOffset (sizeof(struct virtq_desc) * NUM)
+#define indirectOffset (2 * PAGE_SIZE)
+#define HAS_FEATURE(f) ((disk.features >> (f)) & 1)
+
+// 布局：[0, PAGE_SIZE)为desc和avail，[PAGE_SIZE, 2*PAGE_SIZE)为used，最后一页为间接描述符表
 void *virtioDriverBuffer;
 
 mutex_t mtx_virtio;
 
 static struct disk {
+	uint32 version; // virtio-mmio版本（1为legacy，2为modern）
+	uint64 features; // 协商后的特性位
 
 	struct virtq_desc *desc;
 	struct virtq_avail *avail;
 	struct virtq_used *used;
+	// 协商INDIRECT_DESC后，每个环上的描述符i使用indirect[i]作为自己的间接描述符表
+	struct virtq_desc (*indirect)[VIRTIO_REQ_DESC];
 	char free[NUM];
 	uint16 used_idx;
 
@@ -36,6 +44,31 @@ static struct disk {
 
 } disk;
 
+/**
+ * @brief 读取设备特性。v2的特性有64位，需要分两次读取
+ */
+static uint64 virtio_get_features() {
+	if (disk.version == 1) {
+		return *R(VIRTIO_MMIO_DEVICE_FEATURES);
+	}
+	*R(VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 0;
+	uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
+	*R(VIRTIO_MMIO_DEVICE_FEATURES_SEL) = 1;
+	features |= (uint64)*R(VIRTIO_MMIO_DEVICE_FEATURES) << 32;
+	return features;
+}
+
+static void virtio_set_features(uint64 features) {
+	if (disk.version == 1) {
+		*R(VIRTIO_MMIO_DRIVER_FEATURES) = (uint32)features;
+		return;
+	}
+	*R(VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 0;
+	*R(VIRTIO_MMIO_DRIVER_FEATURES) = (uint32)features;
+	*R(VIRTIO_MMIO_DRIVER_FEATURES_SEL) = 1;
+	*R(VIRTIO_MMIO_DRIVER_FEATURES) = (uint32)(features >> 32);
+}
+
 void virtio_disk_init(void) {
 	mtx_init(&mtx_virtio, "virtio", false, MTX_SPIN);
 
@@ -43,7 +76,8 @@ void virtio_disk_init(void) {
 	uint32 status = 0;
 
 	// 检查设备的魔术值、版本、设备ID和厂商ID，确保找到了virtio磁盘设备。如果条件不满足，会触发panic
-	if (*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 || *R(VIRTIO_MMIO_VERSION) != 1 ||
+	disk.version = *R(VIRTIO_MMIO_VERSION);
+	if (*R(VIRTIO_MMIO_MAGIC_VALUE) != 0x74726976 || (disk.version != 1 && disk.version != 2) ||
 	    *R(VIRTIO_MMIO_DEVICE_ID) != 2 || *R(VIRTIO_MMIO_VENDOR_ID) != 0x554d4551) {
 		panic("could not find virtio disk");
 	}
@@ -58,33 +92,37 @@ void virtio_disk_init(void) {
 	status |= VIRTIO_CONFIG_S_DRIVER;
 	*R(VIRTIO_MMIO_STATUS) = status;
 
-	// 协商设备和驱动程序所支持的特性，
-	// 将驱动程序支持的特性写入VIRTIO_MMIO_DRIVER_FEATURES寄存器。
-	uint64 features = *R(VIRTIO_MMIO_DEVICE_FEATURES);
-	features &= ~(1 << VIRTIO_BLK_F_RO);
-	features &= ~(1 << VIRTIO_BLK_F_SCSI);
-	features &= ~(1 << VIRTIO_BLK_F_CONFIG_WCE);
-	features &= ~(1 << VIRTIO_BLK_F_MQ);
-	features &= ~(1 << VIRTIO_F_ANY_LAYOUT);
-	features &= ~(1 << VIRTIO_RING_F_EVENT_IDX);
-	features &= ~(1 << VIRTIO_RING_F_INDIRECT_DESC);
-	*R(VIRTIO_MMIO_DRIVER_FEATURES) = features;
-
-	// 这些是verison2的操作,删去
-	//   // 设置FEATURES_OK状态位，告诉设备特性协商已完成。
-	//   status |= VIRTIO_CONFIG_S_FEATURES_OK;
-	//   *R(VIRTIO_MMIO_STATUS) = status;
-
-	//   // 重新读取状态寄存器，确保FEATURES_OK状态位已设置。如果没有设置，触发panic。
-	//   status = *R(VIRTIO_MMIO_STATUS);
-	//   if(!(status & VIRTIO_CONFIG_S_FEATURES_OK))
-	//     panic("virtio disk FEATURES_OK unset");
+	// 协商设备和驱动程序所支持的特性，将驱动程序支持的特性写入VIRTIO_MMIO_DRIVER_FEATURES寄存器。
+	// 我们接受间接描述符和EVENT_IDX；高32位只保留VERSION_1（v2设备必须协商此位）
+	uint64 features = virtio_get_features();
+	features &= (1ul << VIRTIO_F_VERSION_1) | 0xfffffffful;
+	features &= ~(1ul << VIRTIO_BLK_F_RO);
+	features &= ~(1ul << VIRTIO_BLK_F_SCSI);
+	features &= ~(1ul << VIRTIO_BLK_F_CONFIG_WCE);
+	features &= ~(1ul << VIRTIO_BLK_F_MQ);
+	features &= ~(1ul << VIRTIO_F_ANY_LAYOUT);
+	if (disk.version == 2 && !(features & (1ul << VIRTIO_F_VERSION_1))) {
+		panic("virtio disk v2 without VERSION_1");
+	}
+	virtio_set_features(features);
+	disk.features = features;
+
+	if (disk.version == 2) {
+		// 设置FEATURES_OK状态位，告诉设备特性协商已完成。
+		status |= VIRTIO_CONFIG_S_FEATURES_OK;
+		*R(VIRTIO_MMIO_STATUS) = status;
+
+		// 重新读取状态寄存器，确保FEATURES_OK状态位已设置。如果没有设置，触发panic。
+		status = *R(VIRTIO_MMIO_STATUS);
+		if (!(status & VIRTIO_CONFIG_S_FEATURES_OK))
+			panic("virtio disk FEATURES_OK unset");
+	}
 
 	// 选择队列0进行初始化
 	*R(VIRTIO_MMIO_QUEUE_SEL) = 0;
 
 	// 确保队列0未被使用。如果队列0已被使用，触发panic
-	if (*R(VIRTIO_MMIO_QUEUE_PFN) != 0)
+	if (*R(disk.version == 1 ? VIRTIO_MMIO_QUEUE_PFN : VIRTIO_MMIO_QUEUE_READY) != 0)
 		panic("virtio disk should not be ready");
 
 	// 检查最大队列大小。如果最大队列大小为0，触发panic。如果最大队列大小小于NUM（预定义的队列大小），触发panic
@@ -94,44 +132,42 @@ void virtio_disk_init(void) {
 	if (max < NUM)
 		panic("virtio disk max queue too short");
 
-	// 输入page size
-	*R(VIRTIO_MMIO_PAGE_SIZE) = PAGE_SIZE;
-
-	// 分配内存用于存储队列相关的描述符（desc）、可用环（avail）和已使用环（used）。如果分配失败，触发panic。然后使用memset将分配的内存清零
+	// 分配内存用于存储队列相关的描述符（desc）、可用环（avail）和已使用环（used）。然后使用memset将分配的内存清零
+	// legacy接口要求used环按页对齐，因此used单独放在第二页
 	disk.desc = (void *)virtioDriverBuffer;
 	disk.avail = (void *)((uint64)disk.desc + availOffset);
 	disk.used = (void *)((uint64)disk.desc + PAGE_SIZE);
-
-	// 这里后续考虑用一次alloc()
+	disk.indirect = (void *)((uint64)disk.desc + indirectOffset);
+	assert(sizeof(struct virtq_desc[NUM][VIRTIO_REQ_DESC]) <= PAGE_SIZE);
 
 	if (!disk.desc || !disk.used)
 		panic("virtio disk kalloc");
-	memset(disk.desc, 0, PAGE_SIZE);
-	memset(disk.used, 0, PAGE_SIZE);
+	memset(disk.desc, 0, 3 * PAGE_SIZE);
 
 	// 设置队列的大小
 	*R(VIRTIO_MMIO_QUEUE_NUM) = NUM;
 
-	// 设置Queue Align
-	*R(VIRTIO_MMIO_QUEUE_ALIGN) = PAGE_SIZE;
-
-	// 设置QUEUE PFN
-	*R(VIRTIO_MMIO_QUEUE_PFN) = (uint64)disk.desc >> 12;
-
-	/* 这是version1的内容
-	// 将队列相关数据结构的物理地址写入相应的寄存器
-	  *R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
-	  *R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
-	  *R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
-	  *R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
-	  *R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
-	  *R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
-	*/
-
-	/* 这是verison2的内容
-	 *R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
-	 */
-	// 设置队列为就绪状态.
+	if (disk.version == 1) {
+		// 输入page size
+		*R(VIRTIO_MMIO_PAGE_SIZE) = PAGE_SIZE;
+
+		// 设置Queue Align
+		*R(VIRTIO_MMIO_QUEUE_ALIGN) = PAGE_SIZE;
+
+		// 设置QUEUE PFN
+		*R(VIRTIO_MMIO_QUEUE_PFN) = (uint64)disk.desc >> 12;
+	} else {
+		// 将队列相关数据结构的物理地址写入相应的寄存器
+		*R(VIRTIO_MMIO_QUEUE_DESC_LOW) = (uint64)disk.desc;
+		*R(VIRTIO_MMIO_QUEUE_DESC_HIGH) = (uint64)disk.desc >> 32;
+		*R(VIRTIO_MMIO_DRIVER_DESC_LOW) = (uint64)disk.avail;
+		*R(VIRTIO_MMIO_DRIVER_DESC_HIGH) = (uint64)disk.avail >> 32;
+		*R(VIRTIO_MMIO_DEVICE_DESC_LOW) = (uint64)disk.used;
+		*R(VIRTIO_MMIO_DEVICE_DESC_HIGH) = (uint64)disk.used >> 32;
+
+		// 设置队列为就绪状态.
+		*R(VIRTIO_MMIO_QUEUE_READY) = 0x1;
+	}
 
 	// 将所有的NUM个描述符设置为未使用状态
 	for (int i = 0; i < NUM; i++)
@@ -141,6 +177,9 @@ void virtio_disk_init(void) {
 	status |= VIRTIO_CONFIG_S_DRIVER_OK;
 	*R(VIRTIO_MMIO_STATUS) = status;
 
+	log(LEVEL_GLOBAL, "virtio disk: mmio v%d, queue %d, indirect %d, event_idx %d\n", disk.version, NUM,
+	    (int)HAS_FEATURE(VIRTIO_RING_F_INDIRECT_DESC), (int)HAS_FEATURE(VIRTIO_RING_F_EVENT_IDX));
+
 	mtx_unlock(&mtx_virtio);
 }
 
@@ -164,6 +203,7 @@ static void free_desc(int i) {
 	disk.desc[i].flags = 0;
 	disk.desc[i].next = 0;
 	disk.free[i] = 1;
+	wakeup(&disk.free[0]);
 }
 
 static void free_chain(int i) {
@@ -178,8 +218,11 @@ static void free_chain(int i) {
 	}
 }
 
-static int alloc3_desc(int *idx) {
-	for (int i = 0; i < 3; i++) {
+/**
+ * @brief 一次分配n个描述符，不够时已分配的全部释放，不持有部分描述符等待，避免多个请求互相死锁
+ */
+static int alloc_n_desc(int *idx, int n) {
+	for (int i = 0; i < n; i++) {
 		idx[i] = alloc_desc();
 		if (idx[i] < 0) {
 			for (int j = 0; j < i; j++)
@@ -191,16 +234,57 @@ static int alloc3_desc(int *idx) {
 }
 
 /**
- * @brief virtio读写接口，此函数使用忙等策略，若磁盘未准备好，则驱动会一直阻塞等待到磁盘就绪。
- * 		  调用示例可以参见virtioTest函数
- * @param b
- * 要读或写的缓冲区描述符（定义在fs/buf.h）。在调用之前，b->blockno需要设置为要读或写的扇区号，
- * 		  每个扇区512字节。若为读取，调用此函数后，b->data的内容就是对应扇区的数据；若为写入，则b->data
- * 		  需要提前写入要写入的数据
- * @param write 是否读。设为0表示读取，1表示写入
+ * @brief 分配一个请求所需的描述符，返回可供填写的三个描述符指针，以及放入avail环的链首下标
+ * @note 协商了INDIRECT_DESC时，环上只占用一个描述符，三个描述符位于该描述符专属的间接表中
  */
-void virtio_disk_rw(Buffer *b, int write) {
-	mtx_lock(&mtx_virtio);
+static int alloc_req_desc(struct virtq_desc **d) {
+	int idx[3];
+	if (HAS_FEATURE(VIRTIO_RING_F_INDIRECT_DESC)) {
+		idx[0] = alloc_desc();
+		if (idx[0] < 0) {
+			return -1;
+		}
+		struct virtq_desc *table = disk.indirect[idx[0]];
+		disk.desc[idx[0]].addr = (uint64)table;
+		disk.desc[idx[0]].len = sizeof(struct virtq_desc) * VIRTIO_REQ_DESC;
+		disk.desc[idx[0]].flags = VRING_DESC_F_INDIRECT;
+		disk.desc[idx[0]].next = 0;
+		for (int i = 0; i < VIRTIO_REQ_DESC; i++) {
+			d[i] = &table[i];
+			// 间接表中的next为表内下标
+			d[i]->next = i + 1;
+		}
+		return idx[0];
+	}
+
+	if (alloc_n_desc(idx, VIRTIO_REQ_DESC) < 0) {
+		return -1;
+	}
+	for (int i = 0; i < VIRTIO_REQ_DESC; i++) {
+		d[i] = &disk.desc[idx[i]];
+		d[i]->next = i + 1 < VIRTIO_REQ_DESC ? idx[i + 1] : 0;
+	}
+	return idx[0];
+}
+
+/**
+ * @brief 判断在发布新的avail项后是否需要写QUEUE_NOTIFY
+ * @param old 发布前的avail->idx
+ */
+static int virtio_need_notify(uint16 old) {
+	__sync_synchronize();
+	if (HAS_FEATURE(VIRTIO_RING_F_EVENT_IDX)) {
+		return vring_need_event(disk.used->avail_event, disk.avail->idx, old);
+	}
+	return !(disk.used->flags & VRING_USED_F_NO_NOTIFY);
+}
+
+/**
+ * @brief 向设备提交一个块请求，不等待其完成。请求完成后中断处理函数会清除b->disk并回收描述符
+ * @param wait_desc 描述符不足时是否睡眠等待，否则直接返回-1
+ * @note 需持有mtx_virtio
+ */
+static int virtio_submit(Buffer *b, int write, bool wait_desc) {
 	uint64 sector = b->blockno * (BUF_SIZE / 512);
 
 	// the spec's Section 5.2 says that legacy block operations use
@@ -208,18 +292,20 @@ void virtio_disk_rw(Buffer *b, int write) {
 	// data, one for a 1-byte status result.
 
 	// allocate the three descriptors.
-	int idx[3];
-	while (1) {
-		if (alloc3_desc(idx) == 0) {
-			break;
+	// 描述符不足时睡眠等待其他请求完成
+	struct virtq_desc *d[VIRTIO_REQ_DESC];
+	int head;
+	while ((head = alloc_req_desc(d)) < 0) {
+		if (!wait_desc) {
+			return -1;
 		}
-		panic("there is no free des");
+		sleep(&disk.free[0], &mtx_virtio, "wait for virtio desc");
 	}
 
 	// format the three descriptors.
 	// qemu's virtio-blk.c reads them.
 
-	struct virtio_blk_req *buf0 = &disk.ops[idx[0]];
+	struct virtio_blk_req *buf0 = &disk.ops[head];
 
 	if (write)
 		buf0->type = VIRTIO_BLK_T_OUT; // write the disk
@@ -228,41 +314,56 @@ void virtio_disk_rw(Buffer *b, int write) {
 	buf0->reserved = 0;
 	buf0->sector = sector;
 
-	disk.desc[idx[0]].addr = (uint64)buf0;
-	disk.desc[idx[0]].len = sizeof(struct virtio_blk_req);
-	disk.desc[idx[0]].flags = VRING_DESC_F_NEXT;
-	disk.desc[idx[0]].next = idx[1];
+	d[0]->addr = (uint64)buf0;
+	d[0]->len = sizeof(struct virtio_blk_req);
+	d[0]->flags = VRING_DESC_F_NEXT;
 
-	disk.desc[idx[1]].addr = (uint64)b->data;
-	disk.desc[idx[1]].len = BUF_SIZE;
+	d[1]->addr = (uint64)b->data;
+	d[1]->len = BUF_SIZE;
 	if (write)
-		disk.desc[idx[1]].flags = 0; // device reads b->data
+		d[1]->flags = 0; // device reads b->data
 	else
-		disk.desc[idx[1]].flags = VRING_DESC_F_WRITE; // device writes b->data
-	disk.desc[idx[1]].flags |= VRING_DESC_F_NEXT;
-	disk.desc[idx[1]].next = idx[2];
+		d[1]->flags = VRING_DESC_F_WRITE; // device writes b->data
+	d[1]->flags |= VRING_DESC_F_NEXT;
 
-	disk.info[idx[0]].status = 0xff; // device writes 0 on success
-	disk.desc[idx[2]].addr = (uint64)&disk.info[idx[0]].status;
-	disk.desc[idx[2]].len = 1;
-	disk.desc[idx[2]].flags = VRING_DESC_F_WRITE; // device writes the status
-	disk.desc[idx[2]].next = 0;
+	disk.info[head].status = 0xff; // device writes 0 on success
+	d[2]->addr = (uint64)&disk.info[head].status;
+	d[2]->len = 1;
+	d[2]->flags = VRING_DESC_F_WRITE; // device writes the status
+	d[2]->next = 0;
 
 	// record struct buf for virtio_disk_intr().
 	b->disk = 1;
-	disk.info[idx[0]].b = b;
+	disk.info[head].b = b;
 
 	// tell the device the first index in our chain of descriptors.
-	disk.avail->ring[disk.avail->idx % NUM] = idx[0];
+	uint16 old_idx = disk.avail->idx;
+	disk.avail->ring[old_idx % NUM] = head;
 
 	__sync_synchronize();
 
 	// tell the device another avail ring entry is available.
-	disk.avail->idx += 1; // not % NUM ...
+	disk.avail->idx = old_idx + 1; // not % NUM ...
 
-	__sync_synchronize();
+	// 设备仍在处理队列时（EVENT_IDX或NO_NOTIFY表明）不必notify，减少MMIO退出
+	if (virtio_need_notify(old_idx)) {
+		*R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+	}
+	return 0;
+}
 
-	*R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0; // value is queue number
+/**
+ * @brief virtio读写接口，若磁盘未准备好，则驱动会睡眠等待到请求完成。
+ * 		  调用示例可以参见virtioTest函数
+ * @param b
+ * 要读或写的缓冲区描述符（定义在fs/buf.h）。在调用之前，b->blockno需要设置为要读或写的扇区号，
+ * 		  每个扇区512字节。若为读取，调用此函数后，b->data的内容就是对应扇区的数据；若为写入，则b->data
+ * 		  需要提前写入要写入的数据
+ * @param write 是否读。设为0表示读取，1表示写入
+ */
+void virtio_disk_rw(Buffer *b, int write) {
+	mtx_lock(&mtx_virtio);
+	virtio_submit(b, write, true);
 
 	log(LEVEL_MODULE, "enter virtio wait!\n");
 	// printf("rw: Buffer = %lx\n", b);
@@ -272,9 +373,104 @@ void virtio_disk_rw(Buffer *b, int write) {
 	}
 
 	log(LEVEL_MODULE, "exit virtio wait!\n");
+	mtx_unlock(&mtx_virtio);
+}
+
+/**
+ * @brief 多扇区直接读写：一个请求头、nseg个数据描述符和一个状态描述符串成一条链，
+ * 设备在一次请求中完成整段连续扇区与各段物理内存之间的传输。等待传输完成后返回
+ * @note 数据描述符数不固定，不使用每个描述符专属的间接表，而是直接占用环上的nseg + 2个描述符
+ */
+void virtio_disk_rw_sg(u64 sector, DiskSeg *segs, int nseg, int write) {
+	assert(nseg > 0 && nseg <= DISK_SEG_MAX);
+	int idx[DISK_SEG_MAX + 2];
+	int cnt = nseg + 2;
+
+	// 完成通知沿用块请求的方式：中断处理函数清除done.disk并唤醒&done
+	Buffer done = {.blockno = sector, .disk = 0};
+
+	mtx_lock(&mtx_virtio);
+	while (alloc_n_desc(idx, cnt) < 0) {
+		sleep(&disk.free[0], &mtx_virtio, "wait for virtio desc");
+	}
+
+	int head = idx[0];
+	struct virtio_blk_req *req = &disk.ops[head];
+	req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+	req->reserved = 0;
+	req->sector = sector;
+
+	disk.desc[head].addr = (uint64)req;
+	disk.desc[head].len = sizeof(struct virtio_blk_req);
+	disk.desc[head].flags = VRING_DESC_F_NEXT;
+	disk.desc[head].next = idx[1];
+
+	for (int i = 0; i < nseg; i++) {
+		struct virtq_desc *d = &disk.desc[idx[i + 1]];
+		d->addr = segs[i].addr;
+		d->len = segs[i].len;
+		d->flags = (write ? 0 : VRING_DESC_F_WRITE) | VRING_DESC_F_NEXT;
+		d->next = idx[i + 2];
+	}
+
+	disk.info[head].status = 0xff;
+	struct virtq_desc *st = &disk.desc[idx[cnt - 1]];
+	st->addr = (uint64)&disk.info[head].status;
+	st->len = 1;
+	st->flags = VRING_DESC_F_WRITE;
+	st->next = 0;
+
+	done.disk = 1;
+	disk.info[head].b = &done;
+
+	uint16 old_idx = disk.avail->idx;
+	disk.avail->ring[old_idx % NUM] = head;
+	__sync_synchronize();
+	disk.avail->idx = old_idx + 1;
+	if (virtio_need_notify(old_idx)) {
+		*R(VIRTIO_MMIO_QUEUE_NOTIFY) = 0;
+	}
 
-	disk.info[idx[0]].b = 0;
-	free_chain(idx[0]);
+	while (done.disk == 1) {
+		sleep(&done, &mtx_virtio, "sleep waiting for virtio...");
+	}
+	mtx_unlock(&mtx_virtio);
+}
+
+/**
+ * @brief 异步读取一个块，用于预读。提交后立即返回，b->disk在读取完成前保持为1
+ * @return 0表示已提交，-1表示队列已满（调用者可放弃本次预读）
+ */
+/**
+ * @brief 当前空闲的描述符是否足够再提交一个块请求（不等待）
+ * @note 只是提示，提交前其他核仍可能取走描述符
+ */
+bool virtio_disk_can_submit() {
+	int need = HAS_FEATURE(VIRTIO_RING_F_INDIRECT_DESC) ? 1 : VIRTIO_REQ_DESC;
+	int nfree = 0;
+	mtx_lock(&mtx_virtio);
+	for (int i = 0; i < NUM && nfree < need; i++) {
+		nfree += disk.free[i];
+	}
+	mtx_unlock(&mtx_virtio);
+	return nfree >= need;
+}
+
+int virtio_disk_read_async(Buffer *b) {
+	mtx_lock(&mtx_virtio);
+	int r = virtio_submit(b, 0, false);
+	mtx_unlock(&mtx_virtio);
+	return r;
+}
+
+/**
+ * @brief 等待b上正在进行的异步请求完成
+ */
+void virtio_disk_wait(Buffer *b) {
+	mtx_lock(&mtx_virtio);
+	while (b->disk == 1) {
+		sleep(b, &mtx_virtio, "sleep waiting for virtio...");
+	}
 	mtx_unlock(&mtx_virtio);
 }
 
@@ -290,6 +486,7 @@ void virtio_disk_intr() {
 	// the device increments disk.used->idx when it
 	// adds an entry to the used ring.
 
+again:
 	while (disk.used_idx != disk.used->idx) {
 		__sync_synchronize();
 		int id = disk.used->ring[disk.used_idx % NUM].id;
@@ -305,11 +502,23 @@ void virtio_disk_intr() {
 		b->disk = 0; // disk is done with buf
 		__sync_synchronize();
 
+		// 请求可能是异步提交的，由中断统一回收描述符
+		disk.info[id].b = 0;
+		free_chain(id);
 		wakeup(b);
 
 		disk.used_idx += 1;
 	}
 
+	if (HAS_FEATURE(VIRTIO_RING_F_EVENT_IDX)) {
+		// 要求设备在下一个请求完成时发中断；写回后需复查，避免丢失期间完成的请求
+		disk.avail->used_event = disk.used_idx;
+		__sync_synchronize();
+		if (disk.used_idx != disk.used->idx) {
+			goto again;
+		}
+	}
+
 	log(LEVEL_MODULE, "finish virtio intr\n");
 	mtx_unlock(&mtx_virtio);
 }
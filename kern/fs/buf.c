@@ -3,81 +3,302 @@
 #include <lib/error.h>
 #include <lib/log.h>
 #include <lib/string.h>
+#include <lock/mutex.h>
 #include <mm/memlayout.h>
+#include <sys/errno.h>
 
-BufferDataGroup *bufferData;
-BufferGroup *bufferGroups;
+BufferData *bufferData;
+BufferShard *bufferShards;
+
+/**
+ * 块缓存：按(dev, blockno)的哈希值分为BSHARD_NUM个分片，分片内全相联，以2Q策略置换
+ * - 首次访问的块进入A1in（FIFO）。A1in中的再次命中不调整位置，因为对同一扇区的连续小块读写只是同一次访问
+ * - 从A1in换出的块号记入A1out，之后再次访问时，块被认为是真正的热块，进入Am（LRU）
+ * - A1in超过BSHARD_A1IN_MAX时优先从A1in换出，因此顺序扫描只会替换A1in中的缓冲区
+ * - FAT表、FSInfo和目录的扇区被标记为元数据，放在独立的META队列（LRU）中，
+ *   在其不超过BSHARD_META_MAX时，只有在A1in和Am都没有可换出的缓冲区时才被换出
+ */
+
+static inline u64 bufHash(u32 dev, u64 blockno) {
+	return (blockno ^ ((u64)dev << 48)) * 0x9e3779b97f4a7c15ull;
+}
+
+static inline BufferShard *bufShard(u32 dev, u64 blockno) {
+	return &bufferShards[(bufHash(dev, blockno) >> 32) & BSHARD_MASK];
+}
+
+static inline u32 bufBucket(u32 dev, u64 blockno) {
+	return (bufHash(dev, blockno) >> 40) % BSHARD_HASH_NUM;
+}
 
 void bufInit() {
 	log(MM_GLOBAL, "bufInit\n");
-	for (int i = 0; i < BGROUP_NUM; i++) {
-		// 初始化缓冲区组
-		BufferDataGroup *bdata = &bufferData[i];
-		BufferGroup *b = &bufferGroups[i];
-		// todo: Init Lock
-		TAILQ_INIT(&b->list);
-		for (int j = 0; j < BGROUP_BUF_NUM; j++) {
-			// 初始化第 i 组的缓冲区
-			Buffer *buf = &b->buf[j];
+	for (int i = 0; i < BSHARD_NUM; i++) {
+		// 初始化缓冲区分片
+		BufferShard *shard = &bufferShards[i];
+		mtx_init(&shard->lock, "bshard", false, MTX_SLEEP);
+		for (int q = 0; q < BUFQ_NUM; q++) {
+			TAILQ_INIT(&shard->queue[q]);
+			shard->qlen[q] = 0;
+		}
+		for (int j = 0; j < BSHARD_HASH_NUM; j++) {
+			LIST_INIT(&shard->hash[j]);
+		}
+		for (int j = 0; j < BSHARD_GHOST_NUM; j++) {
+			shard->ghost[j].dev = -1;
+			shard->ghost_hash[j] = -1;
+		}
+		shard->ghost_head = 0;
+
+		for (int j = 0; j < BSHARD_BUF_NUM; j++) {
+			// 初始化第 i 个分片的缓冲区，全部放入空闲队列
+			Buffer *buf = &shard->buf[j];
 			buf->dev = -1;
-			buf->data = &bdata->buf[j];
-			// TODO: Init Lock
-			TAILQ_INSERT_TAIL(&b->list, buf, link);
+			buf->data = &bufferData[i * BSHARD_BUF_NUM + j];
+			buf->queue = BUFQ_FREE;
+			TAILQ_INSERT_TAIL(&shard->queue[BUFQ_FREE], buf, link);
+			shard->qlen[BUFQ_FREE]++;
+		}
+	}
+}
+
+static void bufEnqueue(BufferShard *shard, Buffer *buf, int q) {
+	buf->queue = q;
+	TAILQ_INSERT_HEAD(&shard->queue[q], buf, link);
+	shard->qlen[q]++;
+}
+
+static void bufDequeue(BufferShard *shard, Buffer *buf) {
+	TAILQ_REMOVE(&shard->queue[buf->queue], buf, link);
+	shard->qlen[buf->queue]--;
+}
+
+/**
+ * @brief 把从A1in换出的块号记入A1out，覆盖最老的一项
+ */
+static void ghostInsert(BufferShard *shard, u32 dev, u64 blockno) {
+	i32 slot = shard->ghost_head;
+	BufGhost *g = &shard->ghost[slot];
+
+	// 把被覆盖的项从其哈希链中摘下
+	if (g->dev != -1) {
+		i32 *pp = &shard->ghost_hash[bufBucket(g->dev, g->blockno) % BSHARD_GHOST_NUM];
+		while (*pp != slot) {
+			pp = &shard->ghost[*pp].next;
+		}
+		*pp = g->next;
+	}
+
+	i32 *head = &shard->ghost_hash[bufBucket(dev, blockno) % BSHARD_GHOST_NUM];
+	g->dev = dev;
+	g->blockno = blockno;
+	g->next = *head;
+	*head = slot;
+	shard->ghost_head = (slot + 1) % BSHARD_GHOST_NUM;
+}
+
+/**
+ * @brief 若块在A1out中，则将其移出并返回true
+ */
+static bool ghostRemove(BufferShard *shard, u32 dev, u64 blockno) {
+	i32 *pp = &shard->ghost_hash[bufBucket(dev, blockno) % BSHARD_GHOST_NUM];
+	while (*pp != -1) {
+		BufGhost *g = &shard->ghost[*pp];
+		if (g->dev == dev && g->blockno == blockno) {
+			*pp = g->next;
+			g->dev = -1;
+			return true;
+		}
+		pp = &g->next;
+	}
+	return false;
+}
+
+/**
+ * @brief 从队列q的尾部（最久未使用）开始找一个可以换出的缓冲区
+ * @note 被引用或正在进行异步读取（预读）的缓冲区不能被换出
+ */
+static Buffer *bufVictimIn(BufferShard *shard, int q) {
+	Buffer *buf;
+	TAILQ_FOREACH_REVERSE(buf, &shard->queue[q], BufList, link) {
+		if (buf->refcnt == 0 && buf->disk == 0) {
+			return buf;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief 按2Q策略选择换出的缓冲区
+ */
+static Buffer *bufVictim(BufferShard *shard) {
+	Buffer *buf = NULL;
+
+	if (!TAILQ_EMPTY(&shard->queue[BUFQ_FREE])) {
+		return TAILQ_LAST(&shard->queue[BUFQ_FREE], BufList);
+	}
+	if (shard->qlen[BUFQ_META] > BSHARD_META_MAX) {
+		buf = bufVictimIn(shard, BUFQ_META);
+	}
+	if (buf == NULL && shard->qlen[BUFQ_A1IN] > BSHARD_A1IN_MAX) {
+		buf = bufVictimIn(shard, BUFQ_A1IN);
+	}
+	if (buf == NULL) {
+		buf = bufVictimIn(shard, BUFQ_AM);
+	}
+	if (buf == NULL) {
+		buf = bufVictimIn(shard, BUFQ_A1IN);
+	}
+	if (buf == NULL) {
+		buf = bufVictimIn(shard, BUFQ_META);
+	}
+	return buf;
+}
+
+/**
+ * @brief 在块所在的分片中查找已缓存的块，调用者需持有分片锁
+ */
+static Buffer *bufLookup(BufferShard *shard, u32 dev, u64 blockno) {
+	Buffer *buf;
+	LIST_FOREACH (buf, &shard->hash[bufBucket(dev, blockno)], hash_link) {
+		if (buf->dev == dev && buf->blockno == blockno) {
+			return buf;
 		}
 	}
+	return NULL;
 }
 
-static Buffer *bufAlloc(u32 dev, u64 blockno) {
-	u64 group = blockno & BGROUP_MASK;
+/**
+ * @brief 在块所在的分片中查找或换出一个缓冲区，调用者需持有分片锁
+ */
+static Buffer *bufAlloc(BufferShard *shard, u32 dev, u64 blockno) {
+	u32 bucket = bufBucket(dev, blockno);
 
 	// 检查对应块是否已经被缓存
 	Buffer *buf;
-	TAILQ_FOREACH (buf, &bufferGroups[group].list, link) {
-		// 如果已经被缓存，直接返回 todo:lock
+	LIST_FOREACH (buf, &shard->hash[bucket], hash_link) {
 		if (buf->dev == dev && buf->blockno == blockno) {
 			buf->refcnt++;
-			log(BUF_MODULE, "BufAlloc HIT: <dev: %d, blockno: %d> in Buffer[%d][%d]\n",
-			    dev, blockno, group, buf - bufferGroups[group].buf);
+			// A1in中的命中不调整位置
+			if (buf->queue == BUFQ_AM || buf->queue == BUFQ_META) {
+				bufDequeue(shard, buf);
+				bufEnqueue(shard, buf, buf->queue);
+			}
+			log(BUF_MODULE, "BufAlloc HIT: <dev: %d, blockno: %d> in shard %d\n", dev,
+			    blockno, shard - bufferShards);
 			return buf;
 		}
 	}
 
-	// 没有被缓存，找到最久未使用的缓冲区（LRU策略换出）
-	TAILQ_FOREACH_REVERSE(buf, &bufferGroups[group].list, BufList, link) {
-		if (buf->refcnt == 0) {
-			if (buf->valid && buf->dirty) {
-				// 如果该缓冲区已经被使用，写回磁盘
-				// 即换出时写回磁盘
-				disk_rw(buf, 1);
-			}
+	// 没有被缓存，按2Q策略换出一个缓冲区
+	buf = bufVictim(shard);
+	if (buf == NULL) {
+		return NULL;
+	}
 
-			// 如果该缓冲区没有被引用，直接使用
-			buf->dev = dev;
-			buf->blockno = blockno;
-			buf->valid = 0;
-			buf->dirty = 0;
-			buf->refcnt = 1;
-			log(BUF_MODULE, "BufAlloc MISS: <dev: %d, blockno: %d> in Buffer[%d][%d]\n",
-			    dev, blockno, group, buf - bufferGroups[group].buf);
-			return buf;
+	if (buf->dev != -1) {
+		if (buf->valid && buf->dirty) {
+			// 即换出时写回磁盘
+			disk_rw(buf, 1);
+		}
+		if (buf->queue == BUFQ_A1IN) {
+			ghostInsert(shard, buf->dev, buf->blockno);
 		}
+		LIST_REMOVE(buf, hash_link);
 	}
+	bufDequeue(shard, buf);
 
-	error("No Buffer Available!\n");
+	buf->dev = dev;
+	buf->blockno = blockno;
+	buf->valid = 0;
+	buf->dirty = 0;
+	buf->refcnt = 1;
+	LIST_INSERT_HEAD(&shard->hash[bucket], buf, hash_link);
+	// 曾经从A1in中换出过的块进入Am
+	bufEnqueue(shard, buf, ghostRemove(shard, dev, blockno) ? BUFQ_AM : BUFQ_A1IN);
+	log(BUF_MODULE, "BufAlloc MISS: <dev: %d, blockno: %d> in shard %d\n", dev, blockno,
+	    shard - bufferShards);
+	return buf;
 }
 
 /**
  * @brief 当is_read为1时，首次获取时，只获取buffer，而不读取buffer，适合于clusterAlloc
  */
 Buffer *bufRead(u32 dev, u64 blockno, bool is_read) {
-	Buffer *buf = bufAlloc(dev, blockno);
+	BufferShard *shard = bufShard(dev, blockno);
+	mtx_lock_sleep(&shard->lock);
+
+	Buffer *buf = bufAlloc(shard, dev, blockno);
+	if (buf == NULL) {
+		error("No Buffer Available!\n");
+	}
+	// 在分片锁内完成读入，保证其他核拿到的缓冲区总是有效的
+	if (buf->disk) {
+		// 该块正在被预读，等待读取完成
+		disk_wait(buf);
+	}
 	if (!buf->valid) {
 		if (is_read) disk_rw(buf, 0);
 		buf->valid = true;
 	}
+
+	mtx_unlock_sleep(&shard->lock);
 	return buf;
 }
 
+/**
+ * @brief 将调用者持有的缓冲区标记为元数据（FAT表、目录等），移入META队列
+ * @note 标记在缓冲区被换出前一直有效，因此已标记时无需加锁
+ */
+void bufMarkMeta(Buffer *buf) {
+	if (buf->queue == BUFQ_META) {
+		return;
+	}
+
+	BufferShard *shard = bufShard(buf->dev, buf->blockno);
+	mtx_lock_sleep(&shard->lock);
+	bufDequeue(shard, buf);
+	bufEnqueue(shard, buf, BUFQ_META);
+	mtx_unlock_sleep(&shard->lock);
+}
+
+/**
+ * @brief 预读一个块：若块未被缓存，则向磁盘提交异步读请求后立即返回，不等待读取完成
+ * @note 之后的bufRead会在读取未完成时等待
+ * @note 设备无法接受请求时不分配缓冲区，以免为提交不了的预读换出其他块
+ * @return 块已缓存或已提交时返回0，设备队列已满或不支持异步读取时返回-EAGAIN
+ */
+int bufPrefetch(u32 dev, u64 blockno) {
+	BufferShard *shard = bufShard(dev, blockno);
+	mtx_lock_sleep(&shard->lock);
+
+	Buffer *buf = bufLookup(shard, dev, blockno);
+	if (buf != NULL && (buf->valid || buf->disk)) {
+		mtx_unlock_sleep(&shard->lock);
+		return 0;
+	}
+	if (!disk_can_read_async(dev)) {
+		mtx_unlock_sleep(&shard->lock);
+		return -EAGAIN;
+	}
+
+	buf = bufAlloc(shard, dev, blockno);
+	if (buf == NULL) {
+		// 没有可换出的缓冲区，放弃预读
+		mtx_unlock_sleep(&shard->lock);
+		return -EAGAIN;
+	}
+	// 检查之后描述符仍可能被其他核取走，此时缓冲区保持无效，由之后的bufRead读入
+	int r = buf->valid ? 0 : disk_read_async(buf);
+	if (r == 0) {
+		buf->valid = true;
+	}
+
+	mtx_unlock_sleep(&shard->lock);
+	bufRelease(buf);
+	return r == 0 ? 0 : -EAGAIN;
+}
+
 
 void bufWrite(Buffer *buf) {
 	buf->dirty = true;
@@ -85,12 +306,60 @@ void bufWrite(Buffer *buf) {
 }
 
 void bufRelease(Buffer *buf) {
+	BufferShard *shard = bufShard(buf->dev, buf->blockno);
+	mtx_lock_sleep(&shard->lock);
 	buf->refcnt--;
-	if (buf->refcnt == 0) {
-		// 刚刚完成使用的缓冲区，放在链表头部晚些被替换
-		u64 group = buf->blockno & BGROUP_MASK;
-		TAILQ_REMOVE(&bufferGroups[group].list, buf, link);
-		TAILQ_INSERT_HEAD(&bufferGroups[group].list, buf, link);
+	mtx_unlock_sleep(&shard->lock);
+}
+
+/**
+ * @brief 直接I/O前调用：把[blockno, blockno + count)中被缓存的脏块写回磁盘
+ */
+void bufFlushRange(u32 dev, u64 blockno, u64 count) {
+	for (u64 b = blockno; b < blockno + count; b++) {
+		BufferShard *shard = bufShard(dev, b);
+		mtx_lock_sleep(&shard->lock);
+
+		Buffer *buf = bufLookup(shard, dev, b);
+		if (buf != NULL) {
+			if (buf->disk) {
+				// 预读尚未完成
+				disk_wait(buf);
+			}
+			if (buf->valid && buf->dirty) {
+				disk_rw(buf, 1);
+				buf->dirty = false;
+			}
+		}
+
+		mtx_unlock_sleep(&shard->lock);
+	}
+}
+
+/**
+ * @brief 直接写入磁盘后调用：使[blockno, blockno + count)的缓存与磁盘一致
+ * @note 未被引用的缓冲区失效，之后的bufRead从磁盘重新读入；被引用中的缓冲区不能失效（持有者仍在使用其数据），
+ * 从磁盘重新读入新数据
+ */
+void bufInvalidateRange(u32 dev, u64 blockno, u64 count) {
+	for (u64 b = blockno; b < blockno + count; b++) {
+		BufferShard *shard = bufShard(dev, b);
+		mtx_lock_sleep(&shard->lock);
+
+		Buffer *buf = bufLookup(shard, dev, b);
+		if (buf != NULL) {
+			if (buf->disk) {
+				disk_wait(buf);
+			}
+			if (buf->refcnt == 0) {
+				buf->valid = false;
+			} else if (buf->valid) {
+				disk_rw(buf, 0);
+			}
+			buf->dirty = false;
+		}
+
+		mtx_unlock_sleep(&shard->lock);
 	}
 }
 
@@ -123,10 +392,10 @@ void bufSync() {
 	// 为了运行速度暂时关闭
 	/*
 	log(LEVEL_GLOBAL, "begin sync all pages to disk!\n");
-	for (int i = 0; i < BGROUP_NUM; i++) {
-		BufferGroup *b = &bufferGroups[i];
-		for (int j = 0; j < BGROUP_BUF_NUM; j++) {
-			Buffer *buf = &b->buf[j];
+	for (int i = 0; i < BSHARD_NUM; i++) {
+		BufferShard *shard = &bufferShards[i];
+		for (int j = 0; j < BSHARD_BUF_NUM; j++) {
+			Buffer *buf = &shard->buf[j];
 			if (buf->valid && buf->dirty) {
 				disk_rw(buf, 1);
 				buf->dirty = false;
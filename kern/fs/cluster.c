@@ -1,15 +1,27 @@
+#include <dev/interface.h>
 #include <fs/buf.h>
 #include <fs/cluster.h>
 #include <fs/fat32.h>
+#include <fs/filepnt.h>
 #include <lib/error.h>
 #include <lib/log.h>
 #include <lib/string.h>
 #include <lib/profiling.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <mm/vmm.h>
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// 空闲簇位图每页管理的簇数
+#define FREEMAP_PAGE_BITS (PAGE_SIZE * 8)
+
 u64 alloced_clus = 0;
 
+static void clusterFreeMapInit(FileSystem *fs);
+static void fatMirrorInit(FileSystem *fs);
+
 /**
  * @brief 簇层初始化，填写文件系统结构体里面的超级块
  */
@@ -42,6 +54,7 @@ err_t clusterInit(FileSystem *fs) {
 	fs->superBlock.bpb.tot_sec = bpb->BPB_TotSec32;
 	fs->superBlock.bpb.fat_sz = bpb->BPB_FATSz32;
 	fs->superBlock.bpb.root_clus = bpb->BPB_RootClus;
+	fs->superBlock.bpb.fsinfo_sec = bpb->BPB_FSInfo;
 
 	log(FAT_MODULE, "cluster Get superblock!\n");
 
@@ -61,6 +74,11 @@ err_t clusterInit(FileSystem *fs) {
 	bufRelease(buf);
 
 	log(FAT_MODULE, "buf release!\n");
+
+	// 建立空闲簇位图
+	mtx_init(&fs->superBlock.fat_lock, "fat", false, MTX_SLEEP | MTX_RECURSE);
+	clusterFreeMapInit(fs);
+	fatMirrorInit(fs);
 	return 0;
 }
 
@@ -93,7 +111,300 @@ static u64 clusterFatSecIndex(FileSystem *fs, u64 cluster) {
 	return ((cluster * fat32_entry_sz) % fs->superBlock.bpb.bytes_per_sec) / fat32_entry_sz;
 }
 
-void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser) {
+// 空闲簇位图
+
+static inline u64 *freemap_word(FileSystem *fs, u64 index) {
+	return &fs->superBlock.free_map[index / FREEMAP_PAGE_BITS][(index % FREEMAP_PAGE_BITS) / 64];
+}
+
+static inline bool freemap_used(FileSystem *fs, u64 cluster) {
+	return (*freemap_word(fs, cluster - 2) >> ((cluster - 2) % 64)) & 1;
+}
+
+/**
+ * @brief 在位图中标记簇的占用状态，并维护空闲簇计数。调用者需持有fat_lock
+ */
+static void freemap_mark(FileSystem *fs, u64 cluster, bool used) {
+	SuperBlock *sb = &fs->superBlock;
+	if (sb->free_map == NULL) {
+		return;
+	}
+	u64 *word = freemap_word(fs, cluster - 2);
+	u64 bit = 1ul << ((cluster - 2) % 64);
+	if (used && !(*word & bit)) {
+		*word |= bit;
+		sb->free_cnt -= 1;
+	} else if (!used && (*word & bit)) {
+		*word &= ~bit;
+		sb->free_cnt += 1;
+	}
+}
+
+/**
+ * @brief 从簇号start开始（到末尾后回绕）寻找第一个空闲簇，每次检查64个簇
+ * @return 空闲簇号，找不到时返回0
+ */
+static u64 freemap_find(FileSystem *fs, u64 start) {
+	u64 nbits = (u64)fs->superBlock.data_clus_cnt;
+	u64 index = start - 2;
+	for (u64 scanned = 0; scanned < nbits + 64;) {
+		if (index >= nbits) {
+			index = 0;
+		}
+		u64 shift = index % 64;
+		// 低于index的位视作已占用
+		u64 free = ~(*freemap_word(fs, index) | ((1ul << shift) - 1));
+		if (free != 0) {
+			u64 bit = shift;
+			while (!((free >> bit) & 1)) {
+				bit++;
+			}
+			// 位图尾部超出簇数的位已被置为占用，不会被选中
+			return index - shift + bit + 2;
+		}
+		scanned += 64 - shift;
+		index += 64 - shift;
+	}
+	return 0;
+}
+
+/**
+ * @brief 从簇号start开始（到末尾后回绕）寻找一个64个簇全部空闲的位图字
+ * @return 该字对应的第一个簇号，找不到时返回0
+ */
+static u64 freemap_find_empty_word(FileSystem *fs, u64 start) {
+	u64 nwords = ((u64)fs->superBlock.data_clus_cnt + 63) / 64;
+	u64 word = (start - 2) / 64;
+	for (u64 i = 0; i < nwords; i++, word++) {
+		if (word >= nwords) {
+			word = 0;
+		}
+		if (*freemap_word(fs, word * 64) == 0) {
+			return word * 64 + 2;
+		}
+	}
+	return 0;
+}
+
+/**
+ * @brief 计算从空闲簇first开始的连续空闲簇数，最多统计want个
+ */
+static u32 freemap_run_len(FileSystem *fs, u64 first, u32 want) {
+	u64 end = (u64)fs->superBlock.data_clus_cnt + 2;
+	u32 n = 1;
+	while (n < want && first + n < end && !freemap_used(fs, first + n)) {
+		n++;
+	}
+	return n;
+}
+
+/**
+ * @brief 从start开始寻找一段连续的空闲簇，长度为1~want
+ * @note 离start最近的空闲段过短时，改从一整片空闲的64个簇开始分配，以减少大文件的碎片
+ * @return 空闲段的第一个簇号，找不到时返回0
+ */
+static u64 freemap_find_run(FileSystem *fs, u64 start, u32 want, u32 *len) {
+	u64 first = freemap_find(fs, start);
+	if (first == 0) {
+		return 0;
+	}
+	u32 n = freemap_run_len(fs, first, want);
+	if (n < want && n < 64) {
+		u64 alt = freemap_find_empty_word(fs, first);
+		if (alt != 0) {
+			first = alt;
+			n = freemap_run_len(fs, alt, want);
+		}
+	}
+	*len = n;
+	return first;
+}
+
+/**
+ * @brief 扫描FAT表建立空闲簇位图，并用FSInfo中的提示初始化下一次分配的位置
+ */
+static void clusterFreeMapInit(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	u64 nclus = sb->data_clus_cnt;
+	u64 npage = (nclus + FREEMAP_PAGE_BITS - 1) / FREEMAP_PAGE_BITS;
+
+	sb->free_map = kmalloc(npage * sizeof(u64 *));
+	for (u64 i = 0; i < npage; i++) {
+		sb->free_map[i] = (u64 *)kvmAlloc();
+		memset(sb->free_map[i], 0, PAGE_SIZE);
+	}
+	// 位图尾部超出簇数的位标记为占用
+	for (u64 index = nclus; index < npage * FREEMAP_PAGE_BITS; index++) {
+		*freemap_word(fs, index) |= 1ul << (index % 64);
+	}
+
+	// 逐扇区扫描第一个FAT表
+	sb->free_cnt = 0;
+	u32 ent_per_sec = sb->bpb.bytes_per_sec / sizeof(u32);
+	for (u64 sec = 0; sec < sb->bpb.fat_sz; sec++) {
+		u64 base = sec * ent_per_sec;
+		if (base >= nclus + 2) {
+			break;
+		}
+		Buffer *buf = fs->get(fs, sb->bpb.rsvd_sec_cnt + sec, true);
+		u32 *fat = (u32 *)buf->data->data;
+		for (u64 j = 0; j < ent_per_sec && base + j < nclus + 2; j++) {
+			u64 cluster = base + j;
+			if (cluster < 2) {
+				continue;
+			}
+			if ((fat[j] & FAT32_EOF) != 0) {
+				*freemap_word(fs, cluster - 2) |= 1ul << ((cluster - 2) % 64);
+			} else {
+				sb->free_cnt += 1;
+			}
+		}
+		bufRelease(buf);
+	}
+
+	// FSInfo中的值只是提示，空闲簇数以位图为准
+	sb->next_free = 2;
+	if (sb->bpb.fsinfo_sec != 0) {
+		Buffer *buf = fs->get(fs, sb->bpb.fsinfo_sec, true);
+		FAT32FSInfo *info = (FAT32FSInfo *)buf->data->data;
+		if (info->FSI_LeadSig == FSI_LEAD_SIG && info->FSI_StrucSig == FSI_STRUC_SIG) {
+			if (info->FSI_Nxt_Free >= 2 && info->FSI_Nxt_Free < nclus + 2) {
+				sb->next_free = info->FSI_Nxt_Free;
+			}
+			if (info->FSI_Free_Count != FSI_UNKNOWN && info->FSI_Free_Count != sb->free_cnt) {
+				warn("FSInfo free count %d mismatch, actual %d\n", info->FSI_Free_Count,
+				     sb->free_cnt);
+			}
+		}
+		bufRelease(buf);
+	}
+	log(LEVEL_GLOBAL, "fat32 free clusters: %d/%d, next free: %d\n", sb->free_cnt, nclus,
+	    sb->next_free);
+}
+
+// FAT镜像的延迟同步：平时只写主FAT并记下改动的扇区，同步时再整扇区复制到其余的FAT
+
+// 位图最多占用的字节数（kmalloc能分配的上限以内）
+#define FAT_DIRTY_MAX_BYTES (32 * PAGE_SIZE)
+
+static void fatMirrorInit(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	u64 bytes = (sb->bpb.fat_sz + 63) / 64 * sizeof(u64);
+	sb->fat_dirty = NULL;
+	if (sb->bpb.fat_cnt <= 1 || bytes > FAT_DIRTY_MAX_BYTES) {
+		// 没有镜像，或位图过大时退回到同时写所有FAT
+		return;
+	}
+	sb->fat_dirty = kmalloc(bytes);
+	memset(sb->fat_dirty, 0, bytes);
+}
+
+/**
+ * @brief 本次写FAT需要写入的FAT个数：有脏扇区位图时只写主FAT
+ */
+static inline u8 fatWriteCopies(FileSystem *fs) {
+	return fs->superBlock.fat_dirty != NULL ? 1 : fs->superBlock.bpb.fat_cnt;
+}
+
+/**
+ * @brief 记录主FAT中的扇区fatSec已被改动，调用者需持有fat_lock
+ */
+static inline void fatMirrorMark(FileSystem *fs, u64 fatSec) {
+	SuperBlock *sb = &fs->superBlock;
+	if (sb->fat_dirty != NULL) {
+		u64 index = fatSec - sb->bpb.rsvd_sec_cnt;
+		sb->fat_dirty[index / 64] |= 1ul << (index % 64);
+	}
+}
+
+/**
+ * @brief 将主FAT中改动过的扇区复制到其余的FAT镜像中
+ */
+static void fatMirrorSync(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	if (sb->fat_dirty == NULL) {
+		return;
+	}
+	for (u64 w = 0; w < (sb->bpb.fat_sz + 63) / 64; w++) {
+		while (sb->fat_dirty[w] != 0) {
+			u64 bit = 0;
+			while (!((sb->fat_dirty[w] >> bit) & 1)) {
+				bit++;
+			}
+			sb->fat_dirty[w] &= ~(1ul << bit);
+
+			u64 fatSec = sb->bpb.rsvd_sec_cnt + w * 64 + bit;
+			Buffer *src = fs->get(fs, fatSec, true);
+			for (u8 fatno = 1; fatno < sb->bpb.fat_cnt; fatno++) {
+				// 镜像扇区被整个覆盖，无需读盘
+				Buffer *dst = fs->get(fs, fatSec + fatno * sb->bpb.fat_sz, false);
+				memcpy(dst->data->data, src->data->data, BUF_SIZE);
+				bufWrite(dst);
+				bufRelease(dst);
+			}
+			bufRelease(src);
+		}
+	}
+}
+
+/**
+ * @brief 将空闲簇数和下一空闲簇写回FSInfo扇区
+ */
+static void clusterSyncFsInfo(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	if (sb->free_map == NULL || sb->bpb.fsinfo_sec == 0) {
+		return;
+	}
+	mtx_lock_sleep(&sb->fat_lock);
+	Buffer *buf = fs->get(fs, sb->bpb.fsinfo_sec, true);
+	FAT32FSInfo *info = (FAT32FSInfo *)buf->data->data;
+	if (info->FSI_LeadSig == FSI_LEAD_SIG && info->FSI_StrucSig == FSI_STRUC_SIG) {
+		if (info->FSI_Free_Count != sb->free_cnt || info->FSI_Nxt_Free != sb->next_free) {
+			info->FSI_Free_Count = sb->free_cnt;
+			info->FSI_Nxt_Free = sb->next_free;
+			bufWrite(buf);
+		}
+	}
+	bufRelease(buf);
+	mtx_unlock_sleep(&sb->fat_lock);
+}
+
+/**
+ * @brief 同步簇层的元数据：更新FAT镜像，并写回FSInfo
+ */
+void clusterSync(FileSystem *fs) {
+	mtx_lock_sleep(&fs->superBlock.fat_lock);
+	fatMirrorSync(fs);
+	clusterSyncFsInfo(fs);
+	mtx_unlock_sleep(&fs->superBlock.fat_lock);
+}
+
+/**
+ * @brief 卸载文件系统时调用：同步FAT镜像和FSInfo，释放空闲簇位图
+ */
+void clusterDestroy(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	if (sb->free_map == NULL) {
+		return;
+	}
+	clusterSync(fs);
+	if (sb->fat_dirty != NULL) {
+		kfree(sb->fat_dirty);
+		sb->fat_dirty = NULL;
+	}
+	u64 npage = (sb->data_clus_cnt + FREEMAP_PAGE_BITS - 1) / FREEMAP_PAGE_BITS;
+	for (u64 i = 0; i < npage; i++) {
+		kvmFree((u64)sb->free_map[i]);
+	}
+	kfree(sb->free_map);
+	sb->free_map = NULL;
+}
+
+/**
+ * @param meta 簇属于目录时为真，其扇区在块缓存中作为元数据保留
+ */
+void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n, bool isUser,
+		 bool meta) {
 	PROFILING_START
 	// 读的偏移不能超出该扇区
 	panic_on(offset + n > fs->superBlock.bytes_per_clus);
@@ -109,6 +420,9 @@ void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n,
 	// 读扇区
 	for (u64 i = 0; i < n; secno++, secoff = 0) {
 		Buffer *buf = fs->get(fs, secno, true);
+		if (meta) {
+			bufMarkMeta(buf);
+		}
 		// 计算本次读写的长度
 		size_t len = min(fs->superBlock.bpb.bytes_per_sec - secoff, n - i);
 		if (isUser) {
@@ -123,7 +437,23 @@ void clusterRead(FileSystem *fs, u64 cluster, off_t offset, void *dst, size_t n,
 	PROFILING_END
 }
 
-void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *src, size_t n, bool isUser) {
+/**
+ * @brief 对簇的所有扇区发起异步预读，不等待读取完成
+ * @return 某个扇区无法提交时停止并返回负数
+ */
+int clusterPrefetch(FileSystem *fs, u64 cluster) {
+	u64 secno = clusterSec(fs, cluster);
+	for (int i = 0; i < fs->superBlock.bpb.sec_per_clus; i++) {
+		int r = fs->prefetch(fs, secno + i);
+		if (r < 0) {
+			return r;
+		}
+	}
+	return 0;
+}
+
+void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *src, size_t n, bool isUser,
+		  bool meta) {
 	panic_on(offset + n > fs->superBlock.bytes_per_clus);
 
 	// 计算簇号 cluster 所在的扇区号
@@ -136,9 +466,13 @@ void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *src, size_t n
 
 	// 写扇区
 	for (u64 i = 0; i < n; secno++, secoff = 0) {
-		Buffer *buf = fs->get(fs, secno, true);
 		// 计算本次读写的长度
 		size_t len = min(fs->superBlock.bpb.bytes_per_sec - secoff, n - i);
+		// 整个扇区都被覆盖时无需先从磁盘读出
+		Buffer *buf = fs->get(fs, secno, len != fs->superBlock.bpb.bytes_per_sec);
+		if (meta) {
+			bufMarkMeta(buf);
+		}
 		if (isUser) {
 			extern void copyIn(u64 uPtr, void *kPtr, int len);
 			copyIn((u64)src + i, &buf->data->data[secoff], len);
@@ -151,11 +485,105 @@ void clusterWrite(FileSystem *fs, u64 cluster, off_t offset, void *src, size_t n
 	}
 }
 
+/**
+ * @brief 在块缓存中把簇scluster偏移soff处的n字节复制到簇dcluster偏移doff处，数据不经过中转缓冲区
+ * @note 两端的扇区对齐时，目标扇区被整个覆盖，无需先从磁盘读出
+ */
+void clusterCopy(FileSystem *sfs, u64 scluster, off_t soff, FileSystem *dfs, u64 dcluster,
+		 off_t doff, size_t n) {
+	panic_on(soff + n > sfs->superBlock.bytes_per_clus);
+	panic_on(doff + n > dfs->superBlock.bytes_per_clus);
+
+	u32 sbps = sfs->superBlock.bpb.bytes_per_sec;
+	u32 dbps = dfs->superBlock.bpb.bytes_per_sec;
+	u64 ssec = clusterSec(sfs, scluster) + soff / sbps, ssecoff = soff % sbps;
+	u64 dsec = clusterSec(dfs, dcluster) + doff / dbps, dsecoff = doff % dbps;
+
+	for (u64 i = 0; i < n;) {
+		// 本次复制不跨越源扇区和目标扇区的边界
+		size_t len = min(min(sbps - ssecoff, dbps - dsecoff), n - i);
+		Buffer *sbuf = sfs->get(sfs, ssec, true);
+		Buffer *dbuf = dfs->get(dfs, dsec, len != dbps);
+		memcpy(&dbuf->data->data[dsecoff], &sbuf->data->data[ssecoff], len);
+		bufWrite(dbuf);
+		bufRelease(dbuf);
+		bufRelease(sbuf);
+
+		i += len;
+		ssecoff += len;
+		dsecoff += len;
+		if (ssecoff == sbps) {
+			ssec++;
+			ssecoff = 0;
+		}
+		if (dsecoff == dbps) {
+			dsec++;
+			dsecoff = 0;
+		}
+	}
+}
+
+/**
+ * @brief 绕过块缓存，在从簇cluster偏移offset处开始的n字节磁盘空间与用户缓冲区ubuf之间直接传输
+ * @note 从cluster开始的若干簇必须物理连续；offset、n和ubuf均按扇区对齐；只适用于直接挂载在块设备上的文件系统
+ * @note 用户页按物理地址拆分为若干段，每次至多固定DISK_SEG_MAX页组成一个多扇区请求，请求完成后释放
+ * @return 用户缓冲区无效时返回-EFAULT，此前的请求已经完成
+ */
+err_t clusterDirectRw(FileSystem *fs, u64 cluster, off_t offset, u64 ubuf, size_t n, bool write) {
+	u32 bps = fs->superBlock.bpb.bytes_per_sec;
+	u64 secno = clusterSec(fs, cluster) + offset / bps;
+	assert(fs->image == NULL);
+	assert(offset % bps == 0 && n % bps == 0 && ubuf % bps == 0);
+
+	// 先写回重叠的脏块：读时从磁盘读到最新的数据，写时脏块之后不会覆盖直接写入的数据
+	bufFlushRange(fs->deviceNumber, secno, n / bps);
+
+	DiskSeg segs[DISK_SEG_MAX];
+	u64 pinned[DISK_SEG_MAX];
+	for (u64 done = 0; done < n;) {
+		u64 reqStart = done;
+		int nseg = 0, npin = 0;
+		err_t r = 0;
+		while (done < n && npin < DISK_SEG_MAX) {
+			// 从磁盘读入时设备写用户页，需要可写（必要时写时复制）。固定页面，传输期间不会被回收
+			u64 pa;
+			if ((r = userPinPage(ubuf + done, !write, &pa)) < 0) {
+				break;
+			}
+			pinned[npin++] = pa;
+			u32 len = min(PAGE_SIZE - (ubuf + done) % PAGE_SIZE, n - done);
+			if (nseg > 0 && segs[nseg - 1].addr + segs[nseg - 1].len == pa) {
+				segs[nseg - 1].len += len;
+			} else {
+				segs[nseg].addr = pa;
+				segs[nseg].len = len;
+				nseg++;
+			}
+			done += len;
+		}
+		if (r == 0) {
+			disk_rw_sg(fs->deviceNumber, (secno + reqStart / bps) * (bps / 512), segs, nseg, write);
+			if (write) {
+				// 写入完成后再使缓存失效（或更新被引用的缓冲区），写入期间读入缓存的旧数据也会被丢弃
+				bufInvalidateRange(fs->deviceNumber, secno + reqStart / bps, (done - reqStart) / bps);
+			}
+		}
+		for (int i = 0; i < npin; i++) {
+			ptUnpin(pinned[i]);
+		}
+		if (r < 0) {
+			return r;
+		}
+	}
+	return 0;
+}
+
 void fatWrite(FileSystem *fs, u64 cluster, u32 content) {
 	panic_on(cluster < 2 || cluster > fs->superBlock.data_clus_cnt + 1);
 
-	// fatno从0开始
-	for (u8 fatno = 0; fatno < fs->superBlock.bpb.fat_cnt; fatno++) {
+	mtx_lock_sleep(&fs->superBlock.fat_lock);
+	// fatno从0开始，镜像FAT延迟到同步时更新
+	for (u8 fatno = 0; fatno < fatWriteCopies(fs); fatno++) {
 		u64 fatSec = clusterFatSec(fs, cluster, fatno);
 		Buffer *buf = fs->get(fs, fatSec, true);
 		u32 *fat = (u32 *)buf->data->data;
@@ -164,6 +592,38 @@ void fatWrite(FileSystem *fs, u64 cluster, u32 content) {
 		bufWrite(buf);
 		bufRelease(buf);
 	}
+	fatMirrorMark(fs, clusterFatSec(fs, cluster, 0));
+	freemap_mark(fs, cluster, content != 0);
+	mtx_unlock_sleep(&fs->superBlock.fat_lock);
+}
+
+/**
+ * @brief 将[first, first + len)写为一条连续的簇链（最后一个簇为链尾），每个FAT扇区只读写一次
+ */
+static void fatWriteRun(FileSystem *fs, u64 first, u32 len) {
+	u64 end = first + len;
+	panic_on(first < 2 || end > fs->superBlock.data_clus_cnt + 2);
+
+	mtx_lock_sleep(&fs->superBlock.fat_lock);
+	for (u8 fatno = 0; fatno < fatWriteCopies(fs); fatno++) {
+		for (u64 cluster = first; cluster < end;) {
+			u64 fatSec = clusterFatSec(fs, cluster, fatno);
+			fatMirrorMark(fs, fatSec);
+			Buffer *buf = fs->get(fs, fatSec, true);
+			u32 *fat = (u32 *)buf->data->data;
+			// 填写本扇区内的所有表项
+			do {
+				fat[clusterFatSecIndex(fs, cluster)] = cluster + 1 == end ? FAT32_EOF : cluster + 1;
+				cluster++;
+			} while (cluster < end && clusterFatSec(fs, cluster, fatno) == fatSec);
+			bufWrite(buf);
+			bufRelease(buf);
+		}
+	}
+	for (u64 cluster = first; cluster < end; cluster++) {
+		freemap_mark(fs, cluster, true);
+	}
+	mtx_unlock_sleep(&fs->superBlock.fat_lock);
 }
 
 u32 fatRead(FileSystem *fs, u64 cluster) {
@@ -186,21 +646,21 @@ u32 fatRead(FileSystem *fs, u64 cluster) {
 }
 
 /**
- * @brief 清空cluster
+ * @brief 清空新分配的簇中[offset, offset + n)的部分
+ * @note 簇刚被分配，原有内容无意义，因此不从磁盘读取。部分清零的扇区中其余的部分由调用者随后写入
  */
-static void clusterZero(FileSystem *fs, u64 cluster) {
-	int n = fs->superBlock.bytes_per_clus;
+void clusterZeroRange(FileSystem *fs, u64 cluster, off_t offset, size_t n) {
+	panic_on(offset + n > fs->superBlock.bytes_per_clus);
 
-	// 计算簇号 cluster 所在的扇区号
-	u64 secno = clusterSec(fs, cluster);
-	// 计算簇号 cluster 所在的扇区内的偏移量
+	u64 secno = clusterSec(fs, cluster) + offset / fs->superBlock.bpb.bytes_per_sec;
+	u64 secoff = offset % fs->superBlock.bpb.bytes_per_sec;
 
 	// 写扇区
-	for (u64 i = 0; i < n; secno++) {
+	for (u64 i = 0; i < n; secno++, secoff = 0) {
 		Buffer *buf = fs->get(fs, secno, false);
 		// 计算本次读写的长度
-		size_t len = fs->superBlock.bpb.bytes_per_sec;
-		memset(&buf->data->data[0], 0, len);
+		size_t len = min(fs->superBlock.bpb.bytes_per_sec - secoff, n - i);
+		memset(&buf->data->data[secoff], 0, len);
 		bufWrite(buf);
 		bufRelease(buf);
 		i += len;
@@ -208,34 +668,77 @@ static void clusterZero(FileSystem *fs, u64 cluster) {
 }
 
 /**
- * @brief 分配一个扇区，并将其内容清空
+ * @brief 清空cluster
  */
-u64 clusterAlloc(FileSystem *fs, u64 prev) {
+static void clusterZero(FileSystem *fs, u64 cluster) {
+	clusterZeroRange(fs, cluster, 0, fs->superBlock.bytes_per_clus);
+}
+
+/**
+ * @brief 分配一段至多want个的连续簇并接在prev之后（prev为0表示新建簇链），不清空其内容
+ * @note 有prev时从prev之后寻找空闲簇，使文件尽量连续；否则从上次分配的位置继续寻找。
+ * 整段的FAT表项按扇区批量写入
+ * @param got 返回实际分配的簇数（1~want）
+ * @return 分配的第一个簇号，分配的簇为[返回值, 返回值 + *got)；磁盘已满时返回0，不修改FAT表
+ */
+u64 clusterAllocRun(FileSystem *fs, u64 prev, u32 want, u32 *got) {
 	PROFILING_START
-	for (u64 cluster = prev == 0 ? 2 : prev + 1; cluster < fs->superBlock.data_clus_cnt + 2;
-	     cluster++) {
-		if (fatRead(fs, cluster) == 0) {
-			if (prev != 0) {
-				fatWrite(fs, prev, cluster);
-			}
-			fatWrite(fs, cluster, FAT32_EOF);
-			clusterZero(fs, cluster);
-			alloced_clus += 1;
-			PROFILING_END
-			return cluster;
-		}
+	SuperBlock *sb = &fs->superBlock;
+	assert(want >= 1);
+	mtx_lock_sleep(&sb->fat_lock);
+	u64 cluster = 0;
+	if (sb->free_cnt != 0) {
+		cluster = freemap_find_run(fs, prev == 0 ? sb->next_free : prev + 1, want, got);
 	}
-	panic("disk volumn out!\n");
-	return 0;
+	if (cluster == 0) {
+		warn("disk volumn out!\n");
+		*got = 0;
+		mtx_unlock_sleep(&sb->fat_lock);
+		return 0;
+	}
+	u64 last = cluster + *got - 1;
+	sb->next_free = last + 1 < sb->data_clus_cnt + 2 ? last + 1 : 2;
+
+	fatWriteRun(fs, cluster, *got);
+	if (prev != 0) {
+		fatWrite(fs, prev, cluster);
+	}
+	alloced_clus += *got;
+	mtx_unlock_sleep(&sb->fat_lock);
+	PROFILING_END
+	return cluster;
+}
+
+/**
+ * @brief 分配一个簇但不清空其内容，调用者需保证簇的每个字节在被读取前都已写入
+ */
+u64 clusterAllocNoZero(FileSystem *fs, u64 prev) {
+	u32 got;
+	u64 cluster = clusterAllocRun(fs, prev, 1, &got);
+	if (cluster == 0) {
+		panic("disk volumn out!\n");
+	}
+	return cluster;
+}
+
+/**
+ * @brief 分配一个簇，并将其内容清空
+ */
+u64 clusterAlloc(FileSystem *fs, u64 prev) {
+	u64 cluster = clusterAllocNoZero(fs, prev);
+	clusterZero(fs, cluster);
+	return cluster;
 }
 
 void clusterFree(FileSystem *fs, u64 cluster, u64 prev) {
+	mtx_lock_sleep(&fs->superBlock.fat_lock);
 	if (prev == 0) {
 		fatWrite(fs, cluster, 0);
 	} else {
 		fatWrite(fs, prev, FAT32_EOF);
 		fatWrite(fs, cluster, 0);
 	}
+	mtx_unlock_sleep(&fs->superBlock.fat_lock);
 }
 
 /**
@@ -258,3 +761,92 @@ i64 fileBlockNo(FileSystem *fs, u64 firstclus, u64 fblockno) {
 	// 找到第 fblockno 个块所在的扇区号
 	return clusterSec(fs, curClus) + fblockno % block_per_clus;
 }
+
+// 镜像映射表的最大字节数，超出时（镜像过于碎片化）退回到沿FAT链查找
+#define LOOP_MAP_MAX_SIZE (16 * PAGE_SIZE)
+
+/**
+ * @brief 为挂载的镜像文件fs->image建立镜像内扇区到其所在文件系统扇区的映射表
+ * @note 在镜像上初始化fs之前调用。映射表由镜像的簇映射表一次性生成，此后的块访问只需二分查找，
+ * 不再获取镜像Dirent的锁，也不再读FAT表
+ * @note 挂载期间镜像文件的扩充和截断返回-EBUSY（见Dirent.loop_busy），映射表因此一直有效
+ */
+void loopMapInit(FileSystem *fs) {
+	Dirent *img = fs->image;
+	FileSystem *parentFs = img->file_system;
+	u32 spc = parentFs->superBlock.bpb.sec_per_clus;
+	u32 clusSize = CLUS_SIZE(parentFs);
+
+	mtx_lock_sleep(&img->lock);
+	u32 nclus = (img->file_size + clusSize - 1) / clusSize;
+	if (nclus == 0) {
+		mtx_unlock_sleep(&img->lock);
+		return;
+	}
+
+	// 映射镜像的全部簇
+	filepnt_getclusbyno(img, nclus - 1);
+	DirentPointer *ptr = &img->pointer;
+	if (ptr->mapped < nclus) {
+		warn("loop: image %s is too fragmented to map\n", img->name);
+		mtx_unlock_sleep(&img->lock);
+		return;
+	}
+	u32 cnt = 0;
+	while (cnt < ptr->cnt && ptr->extents[cnt].file_clus < nclus) {
+		cnt++;
+	}
+	if (cnt * sizeof(LoopExtent) > LOOP_MAP_MAX_SIZE) {
+		warn("loop: image %s has too many extents (%d)\n", img->name, cnt);
+		mtx_unlock_sleep(&img->lock);
+		return;
+	}
+
+	LoopExtent *map = kmalloc(cnt * sizeof(LoopExtent));
+	for (u32 i = 0; i < cnt; i++) {
+		ClusExtent *ext = &ptr->extents[i];
+		map[i].img_sec = (u64)ext->file_clus * spc;
+		map[i].dev_sec = clusterSec(parentFs, ext->disk_clus);
+		map[i].nsec = (u64)MIN(ext->len, nclus - ext->file_clus) * spc;
+	}
+	mtx_unlock_sleep(&img->lock);
+
+	fs->loop_map = map;
+	fs->loop_cnt = cnt;
+	log(FAT_MODULE, "loop: image %s mapped by %d extents\n", img->name, cnt);
+}
+
+void loopMapDestroy(FileSystem *fs) {
+	if (fs->loop_map != NULL) {
+		kfree(fs->loop_map);
+		fs->loop_map = NULL;
+		fs->loop_cnt = 0;
+	}
+}
+
+/**
+ * @brief 计算镜像内第blockNum个扇区在镜像所在文件系统中的扇区号
+ */
+i64 loopBlockNo(FileSystem *fs, u64 blockNum) {
+	if (fs->loop_map == NULL) {
+		return fileBlockNo(fs->image->file_system, fs->image->first_clus, blockNum);
+	}
+
+	// 找到最后一个img_sec <= blockNum的段
+	u32 lo = 0, hi = fs->loop_cnt;
+	while (hi - lo > 1) {
+		u32 mid = (lo + hi) / 2;
+		if (fs->loop_map[mid].img_sec <= blockNum) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+
+	LoopExtent *ext = &fs->loop_map[lo];
+	if (blockNum < ext->img_sec || blockNum >= ext->img_sec + ext->nsec) {
+		warn("read mounted img error! exceed fileSize!\n");
+		return -1;
+	}
+	return ext->dev_sec + (blockNum - ext->img_sec);
+}
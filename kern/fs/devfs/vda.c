@@ -1,3 +1,4 @@
+#include <dev/ramdisk.h>
 #include <fs/dirent.h>
 #include <fs/file_device.h>
 #include <fs/vfs.h>
@@ -5,9 +6,7 @@
 #include <lib/log.h>
 #include <lib/transfer.h>
 
-static int dev = 0;
-
-static int vda_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
+static int blkdev_read(int dev, u64 dst, uint off, uint n) {
 	u64 begin = off, end = off + n;
 	Buffer *buf;
 	if (begin % BUF_SIZE != 0) {
@@ -25,10 +24,7 @@ static int vda_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
 	return n;
 }
 
-/**
- * @brief vda可以无限写入
- */
-static int vda_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
+static int blkdev_write(int dev, u64 src, uint off, uint n) {
 	u64 begin = off, end = off + n;
 	Buffer *buf;
 	if (begin % BUF_SIZE != 0) {
@@ -48,6 +44,34 @@ static int vda_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
 	return n;
 }
 
+static int vda_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
+	return blkdev_read(DEV_DISK, dst, off, n);
+}
+
+/**
+ * @brief vda可以无限写入
+ */
+static int vda_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
+	return blkdev_write(DEV_DISK, src, off, n);
+}
+
+/**
+ * @brief ram0的读写不超过内存块设备的大小
+ */
+static int ram0_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
+	if (off >= ramdiskSize) {
+		return 0;
+	}
+	return blkdev_read(DEV_RAMDISK, dst, off, MIN(n, ramdiskSize - off));
+}
+
+static int ram0_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
+	if (off >= ramdiskSize) {
+		return 0;
+	}
+	return blkdev_write(DEV_RAMDISK, src, off, MIN(n, ramdiskSize - off));
+}
+
 /**
  * vda文件设备
  */
@@ -58,3 +82,14 @@ struct FileDev file_dev_vda = {
     .dev_read = vda_read,
     .dev_write = vda_write,
 };
+
+/**
+ * 内存块设备文件
+ */
+
+struct FileDev file_dev_ram0 = {
+    .dev_id = 'r',
+    .dev_name = "ram0_file",
+    .dev_read = ram0_read,
+    .dev_write = ram0_write,
+};
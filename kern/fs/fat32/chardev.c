@@ -14,11 +14,10 @@
 #include <mm/kmalloc.h>
 #include <sys/errno.h>
 
-extern mutex_t mtx_file;
 
 // reference: file_read
 static int chardev_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	chardev_data_t *pdata = file->dev->data;
 	// 预读数据
@@ -28,7 +27,7 @@ static int chardev_read(struct Dirent *file, int user, u64 dst, uint off, uint n
 
 	file->file_size = pdata->size; // 将文件大小写回到宿主文件上
 	if (off >= pdata->size) {
-		mtx_unlock_sleep(&mtx_file);
+		mtx_unlock_sleep(&file->lock);
 		return -E_EXCEED_FILE;
 	} else if (off + n > pdata->size) {
 		warn("read too much. shorten read length from %d to %d!\n", n, pdata->size - off);
@@ -42,20 +41,20 @@ static int chardev_read(struct Dirent *file, int user, u64 dst, uint off, uint n
 		memcpy((void *)dst, (void *)(pdata->str + off), n);
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 	return n;
 }
 
 static int chardev_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
 	return -EINVAL;
 	/*
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	chardev_data_t *pdata = file->dev->data;
 	assert(n != 0);
 	if (off + n > MAX_CHARDEV_STR_LEN) {
 		warn("exceed chardev's max size %d!\n", MAX_CHARDEV_STR_LEN);
-		mtx_unlock_sleep(&mtx_file);
+		mtx_unlock_sleep(&file->lock);
 		return -1;
 	} else if (off + n > pdata->size) {
 		pdata->size = off + n;	   // 扩充文件大小
@@ -73,7 +72,7 @@ static int chardev_write(struct Dirent *file, int user, u64 src, uint off, uint
 		pdata->write(pdata);
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 	return n;
 	*/
 }
@@ -23,7 +23,7 @@ extern mutex_t mtx_file;
  * @brief 从offset偏移开始，查询一个目录项
  * @param offset 开始查询的位置偏移
  * @param next_offset 下一个dirent的开始位置
- * @note 目前设计为仅在初始化时使用，因此使用file_read读取，无需外部加锁
+ * @note 用于展开目录和getdents，使用file_read读取，无需外部加锁
  * @return 读取的内容长度。若为0，表示读到末尾
  */
 int dirGetDentFrom(Dirent *dir, u64 offset, struct Dirent **file, int *next_offset,
@@ -104,6 +104,7 @@ int dirGetDentFrom(Dirent *dir, u64 offset, struct Dirent **file, int *next_offs
 			dirent->parent_dirent = dir; // 设置父级目录项
 			LIST_INIT(&dirent->child_list);
 			dirent->linkcnt = 1;
+			dirent_meta_from_raw(dirent);
 
 			// 对于目录文件的大小，我们将其重置为其簇数乘以簇大小，不再是0
 			if (dirent->raw_dirent.DIR_Attr & ATTR_DIRECTORY) {
@@ -126,14 +127,43 @@ int dirGetDentFrom(Dirent *dir, u64 offset, struct Dirent **file, int *next_offs
 }
 
 /**
- * @brief 将Dirent结构体里的有效数据同步到dirent中，并写回(无需加锁)
+ * @brief 把Dirent中能保存在目录项里的状态填入内存中的目录项：首簇、大小、时间戳，以及文件的写权限
+ * @note name不需要，因为在文件创建阶段就已经固定了。FAT只能表示只读属性，其余权限位不保存
  */
-void sync_dirent_rawdata_back(Dirent *dirent) {
-	// first_clus, file_size
-	// name不需要，因为在文件创建阶段就已经固定了
+void dirent_meta_to_raw(Dirent *dirent) {
 	dirent->raw_dirent.DIR_FstClusHI = dirent->first_clus / 65536;
 	dirent->raw_dirent.DIR_FstClusLO = dirent->first_clus % 65536;
 	dirent->raw_dirent.DIR_FileSize = dirent->file_size;
+	file_time_to_raw(dirent);
+	if (dirent->type == DIRENT_FILE) {
+		if ((dirent->mode & 0222) == 0) {
+			dirent->raw_dirent.DIR_Attr |= ATTR_READ_ONLY;
+		} else {
+			dirent->raw_dirent.DIR_Attr &= ~ATTR_READ_ONLY;
+		}
+	}
+}
+
+/**
+ * @brief 从读入的目录项中恢复时间戳和权限，与dirent_meta_to_raw对应
+ */
+void dirent_meta_from_raw(Dirent *dirent) {
+	file_time_from_raw(dirent);
+	if (dirent->type == DIRENT_FILE && (dirent->raw_dirent.DIR_Attr & ATTR_READ_ONLY)) {
+		dirent->mode = 0555;
+	}
+}
+
+/**
+ * @brief 将Dirent结构体里的有效数据同步到dirent中，并写回。调用者需持有dirent的锁，写回时获取父目录的锁
+ */
+void sync_dirent_rawdata_back(Dirent *dirent) {
+	// tmpfs没有磁盘上的目录项
+	if (IS_TMPFS(dirent->file_system)) {
+		return;
+	}
+
+	dirent_meta_to_raw(dirent);
 
 	// 将目录项写回父级目录中
 	Dirent *parentDir = dirent->parent_dirent;
@@ -13,6 +13,7 @@
 #include <proc/thread.h>
 #include <sys/errno.h>
 #include <fs/filepnt.h>
+#include <fs/tmpfs.h>
 
 u64 used_dirents = 0;
 
@@ -32,9 +33,42 @@ struct DirentList dirent_free_list = {NULL};
 // 管理dirent分配和释放的互斥锁
 struct mutex mtx_dirent;
 
+// 目录项缓存（dcache）：以(父目录, 文件名)为键的全局哈希表，链接树上的所有Dirent
+#define DCACHE_BUCKETS (1 << 14)
+#define DCACHE_MASK (DCACHE_BUCKETS - 1)
+static struct DirentList dcache[DCACHE_BUCKETS];
+
+// 负目录项：记录最近在某目录中查找失败的文件名，按哈希直接映射
+#define NEG_DCACHE_SIZE 512
+static struct neg_dentry {
+	Dirent *dir;
+	u32 gen; // dir分配时的代数，不一致表示dir已被释放重用
+	u32 hash;
+	char name[MAX_NAME_LEN];
+} neg_dcache[NEG_DCACHE_SIZE];
+
+// Dirent分配的代数计数
+static u32 dirent_gen = 0;
+
+// 已展开子节点的目录按最近查找的顺序排列（队头最新），由mtx_file保护
+// Dirent耗尽时从队尾开始，整体回收那些子节点全部未被引用且无内存态修改的目录
+static TAILQ_HEAD(DirentLru, Dirent) dirent_lru = TAILQ_HEAD_INITIALIZER(dirent_lru);
+
+// 目录项尚未写回的Dirent，由mtx_dirent保护
+static struct DirentList dirent_dirty_list = {NULL};
+
+// 一次回收至少释放的Dirent数
+#define DIRENT_RECLAIM_BATCH 64
+
+static void dirent_reclaim();
+
 void dirent_init() {
 	mtx_init(&mtx_dirent, "Dirent", 1, MTX_SPIN);
 
+	for (int i = 0; i < DCACHE_BUCKETS; i++) {
+		LIST_INIT(&dcache[i]);
+	}
+
 	for (int i = 0; i < MAX_DIRENT; i++) {
 		LIST_INSERT_HEAD(&dirent_free_list, &dirents[i], dirent_link);
 	}
@@ -46,20 +80,40 @@ void dirent_init() {
 Dirent *dirent_alloc() {
 	mtx_lock(&mtx_dirent);
 
+	if (LIST_EMPTY(&dirent_free_list)) {
+		// 回收需要持有mtx_file并释放Dirent，不能在自旋锁内进行
+		mtx_unlock(&mtx_dirent);
+		dirent_reclaim();
+		mtx_lock(&mtx_dirent);
+	}
+
 	panic_on(LIST_EMPTY(&dirent_free_list));
 	Dirent *dirent = LIST_FIRST(&dirent_free_list);
-	// TODO: 需要初始化dirent的睡眠锁
 	LIST_REMOVE(dirent, dirent_link);
 	memset(dirent, 0, sizeof(Dirent));
+	mtx_init(&dirent->lock, "dirent", false, MTX_SLEEP | MTX_RECURSE);
 	used_dirents += 1;
+	dirent->gen = ++dirent_gen;
 	dirent->mode = 0777;
 	mtx_unlock(&mtx_dirent);
 	return dirent;
 }
 
 void dirent_dealloc(Dirent *dirent) {
+	// 释放簇号映射表
+	filepnt_clear(dirent);
+
+	// 已展开的目录需要离开LRU链
+	if (dirent->is_extend) {
+		TAILQ_REMOVE(&dirent_lru, dirent, lru_link);
+	}
+
 	mtx_lock(&mtx_dirent);
 
+	// 文件已被删除，不再需要写回目录项
+	if (dirent->meta_dirty) {
+		LIST_REMOVE(dirent, dirty_link);
+	}
 	memset(dirent, 0, sizeof(Dirent));
 	LIST_INSERT_HEAD(&dirent_free_list, dirent, dirent_link);
 	used_dirents -= 1;
@@ -67,6 +121,226 @@ void dirent_dealloc(Dirent *dirent) {
 	mtx_unlock(&mtx_dirent);
 }
 
+/**
+ * @brief 标记file的目录项需要写回，调用者需持有file->lock
+ * @note 连续的扩展和截断只改动内存中的大小，直到close、fsync或sync时才写回父目录一次
+ */
+void dirent_mark_dirty(Dirent *file) {
+	if (file->meta_dirty) {
+		return;
+	}
+	mtx_lock(&mtx_dirent);
+	file->meta_dirty = 1;
+	LIST_INSERT_HEAD(&dirent_dirty_list, file, dirty_link);
+	mtx_unlock(&mtx_dirent);
+}
+
+/**
+ * @brief 若file的目录项有尚未写回的改动，则写回父目录
+ */
+void dirent_flush(Dirent *file) {
+	mtx_lock_sleep(&file->lock);
+	if (file->meta_dirty) {
+		mtx_lock(&mtx_dirent);
+		file->meta_dirty = 0;
+		LIST_REMOVE(file, dirty_link);
+		mtx_unlock(&mtx_dirent);
+
+		sync_dirent_rawdata_back(file);
+	}
+	mtx_unlock_sleep(&file->lock);
+}
+
+/**
+ * @brief 写回所有尚未写回的目录项
+ * @note 持有mtx_file，使得期间不会有Dirent被删除或回收
+ */
+void dirent_flush_all() {
+	mtx_lock_sleep(&mtx_file);
+	while (1) {
+		mtx_lock(&mtx_dirent);
+		Dirent *file = LIST_FIRST(&dirent_dirty_list);
+		mtx_unlock(&mtx_dirent);
+
+		if (file == NULL) {
+			break;
+		}
+		dirent_flush(file);
+	}
+	mtx_unlock_sleep(&mtx_file);
+}
+
+/**
+ * @brief 计算(dir, name)的哈希值（FNV-1a）
+ */
+static u32 dcache_hash(Dirent *dir, const char *name) {
+	u64 h = 2166136261u ^ ((u64)dir >> 4);
+	for (int i = 0; name[i] && i < MAX_NAME_LEN; i++) {
+		h = (h ^ (u8)name[i]) * 16777619u;
+	}
+	return (u32)(h ^ (h >> 32));
+}
+
+static struct neg_dentry *neg_slot(u32 hash) {
+	return &neg_dcache[hash % NEG_DCACHE_SIZE];
+}
+
+/**
+ * @brief 查询负目录项，返回1表示dir中最近确认过不存在name
+ */
+static int neg_lookup(Dirent *dir, const char *name, u32 hash) {
+	struct neg_dentry *neg = neg_slot(hash);
+	return neg->dir == dir && neg->gen == dir->gen && neg->hash == hash &&
+	       strncmp(neg->name, name, MAX_NAME_LEN) == 0;
+}
+
+static void neg_insert(Dirent *dir, const char *name, u32 hash) {
+	struct neg_dentry *neg = neg_slot(hash);
+	neg->dir = dir;
+	neg->gen = dir->gen;
+	neg->hash = hash;
+	strncpy(neg->name, name, MAX_NAME_LEN);
+}
+
+/**
+ * @brief 将child加入dir的子Dirent列表，并登记到目录项缓存中
+ */
+void dirent_add_child(Dirent *dir, Dirent *child) {
+	LIST_INSERT_HEAD(&dir->child_list, child, dirent_link);
+
+	child->name_hash = dcache_hash(dir, child->name);
+	LIST_INSERT_HEAD(&dcache[child->name_hash & DCACHE_MASK], child, hash_link);
+
+	// 使可能存在的负目录项失效
+	if (neg_lookup(dir, child->name, child->name_hash)) {
+		neg_slot(child->name_hash)->dir = NULL;
+	}
+}
+
+/**
+ * @brief 将child从其父目录的子Dirent列表和目录项缓存中删除
+ */
+void dirent_remove_child(Dirent *child) {
+	LIST_REMOVE(child, dirent_link);
+	LIST_REMOVE(child, hash_link);
+}
+
+/**
+ * @brief 将dir标记为已展开，并放到LRU链的头部
+ */
+static void dirent_mark_extended(Dirent *dir) {
+	dir->is_extend = 1;
+	TAILQ_INSERT_HEAD(&dirent_lru, dir, lru_link);
+}
+
+/**
+ * @brief 从磁盘读入dir的一层子节点（不递归），已展开的目录直接返回
+ * @note 调用者遍历dir->child_list前需调用此函数，并持有dir的引用以防其子节点被回收
+ * @note tmpfs的目录树只存在于内存中，总是完整的，不需要展开，也不挂上LRU链
+ */
+void dirent_populate(Dirent *dir) {
+	Dirent *child;
+	int off = 0;
+
+	mtx_lock_sleep(&mtx_file);
+	if (dir->is_extend || dir->type != DIRENT_DIR || IS_TMPFS(dir->file_system)) {
+		mtx_unlock_sleep(&mtx_file);
+		return;
+	}
+
+	// 展开期间dir未挂上LRU链，但仍需防止dir自身作为其父目录的子节点被回收
+	dget(dir);
+	while (dirGetDentFrom(dir, off, &child, &off, NULL) != 0) {
+		dirent_add_child(dir, child);
+	}
+	dirent_mark_extended(dir);
+	dput(dir);
+
+	mtx_unlock_sleep(&mtx_file);
+}
+
+/**
+ * @brief 判断一个Dirent能否被回收：未被引用，且回收前写回目录项后全部状态都能从磁盘重新读出
+ * @note 时间戳和写权限在回收时写回目录项（见dirent_shrink_dir），不阻止回收
+ */
+static int dirent_evictable(Dirent *d) {
+	extern struct FileDev file_dev_file;
+
+	if (d->refcnt != 0 || d->is_rm || d->meta_dirty || d->head != NULL ||
+	    d->dev != &file_dev_file) {
+		return 0;
+	}
+	// 已展开的目录需先回收其子节点
+	if (d->type != DIRENT_FILE && !(d->type == DIRENT_DIR && !d->is_extend)) {
+		return 0;
+	}
+	// 链接计数只保存在内存中，只有被链接的文件才大于1
+	return d->linkcnt <= 1;
+}
+
+/**
+ * @brief 回收前把时间戳、权限等只改动了内存的状态写回目录项，目录项没有变化时不写
+ */
+static void dirent_writeback_meta(Dirent *d) {
+	mtx_lock_sleep(&d->lock);
+	FAT32Directory old = d->raw_dirent;
+	dirent_meta_to_raw(d);
+	if (memcmp(&old, &d->raw_dirent, sizeof(old)) != 0) {
+		sync_dirent_rawdata_back(d);
+	}
+	mtx_unlock_sleep(&d->lock);
+}
+
+/**
+ * @brief 若dir的子节点全部可回收，则释放全部子节点，并将dir恢复为未展开状态
+ * @return 释放的Dirent数
+ */
+static int dirent_shrink_dir(Dirent *dir) {
+	Dirent *child;
+	int cnt = 0;
+
+	// 被引用的目录可能正有人遍历其子节点
+	if (dir->refcnt != 0) {
+		return 0;
+	}
+
+	LIST_FOREACH (child, &dir->child_list, dirent_link) {
+		if (!dirent_evictable(child)) {
+			return 0;
+		}
+	}
+
+	while ((child = LIST_FIRST(&dir->child_list)) != NULL) {
+		dirent_writeback_meta(child);
+		dirent_remove_child(child);
+		dirent_dealloc(child);
+		cnt++;
+	}
+
+	TAILQ_REMOVE(&dirent_lru, dir, lru_link);
+	dir->is_extend = 0;
+	return cnt;
+}
+
+/**
+ * @brief 从LRU链尾部开始回收目录的子节点，直到释放了足够多的Dirent
+ */
+static void dirent_reclaim() {
+	Dirent *dir, *prev;
+	int freed = 0;
+
+	mtx_lock_sleep(&mtx_file);
+	for (dir = TAILQ_LAST(&dirent_lru, DirentLru); dir != NULL && freed < DIRENT_RECLAIM_BATCH;
+	     dir = prev) {
+		// 被回收的子节点都是未展开的，不会是prev
+		prev = TAILQ_PREV(dir, DirentLru, lru_link);
+		freed += dirent_shrink_dir(dir);
+	}
+	mtx_unlock_sleep(&mtx_file);
+
+	log(FS_MODULE, "dirent reclaim: freed %d dirents\n", freed);
+}
+
 /**
  * @brief 跳过左斜线。unix传统，允许路径上有连续的多个左斜线，解析时看作一条
  */
@@ -77,10 +351,11 @@ static char *skip_slash(char *p) {
 	return p;
 }
 
+#ifdef REFCNT_DEBUG
 /**
- * @brief 将dirent的引用计数加一
+ * @brief [调试] 记录当前进程对dirent的一次引用
  */
-void dget(Dirent *dirent) {
+static void holder_get(Dirent *dirent) {
 	int is_filled = 0;
 	int i;
 	int cur_proc_index = get_proc_index(cpu_this()->cpu_running->td_proc);
@@ -92,12 +367,7 @@ void dget(Dirent *dirent) {
 		} else if (dirent->holders[i].proc_index == 0) {
 			dirent->holders[i].proc_index = cur_proc_index;
 			dirent->holders[i].cnt = 1;
-
-			#ifdef REFCNT_DEBUG
-			// strncpy(dirent->holders[i].proc_name, cpu_this()->cpu_running->td_name, MAX_NAME_LEN);
 			dirent->holders[i].proc_name = cpu_this()->cpu_running->td_name;
-			#endif
-
 			dirent->holder_cnt += 1;
 			is_filled = 1;
 			break;
@@ -105,59 +375,72 @@ void dget(Dirent *dirent) {
 	}
 	if (!is_filled) {
 		for (int i = 0; i < dirent->holder_cnt; i++) {
-			#ifdef REFCNT_DEBUG
 			printf("dget: %s, process: %s, holder: %s, hold_cnts\n", dirent->name,
 				cpu_this()->cpu_running->td_name,
 				dirent->holders[i].proc_name,
 				dirent->holders[i].cnt);
-			#else
-			printf("dget: %s, process: %s, holder: %d, hold_cnts\n", dirent->name,
-				cpu_this()->cpu_running->td_name,
-				dirent->holders[i].proc_index,
-				dirent->holders[i].cnt);
-			#endif
 		}
 		panic("dget: file %s holder_cnt is full!\n", dirent->name);
 	}
 
-#ifdef REFCNT_DEBUG
 	mtx_lock_sleep(&mtx_file);
 	warn("dget: %s, process: %s, cur_hold_cnt: %d\n", dirent->name, cpu_this()->cpu_running->td_name, dirent->holders[i].cnt);
 	mtx_unlock_sleep(&mtx_file);
-#endif
-	dirent->refcnt += 1;
 }
 
 /**
- * @brief 将dirent的引用数减一
+ * @brief [调试] 撤销当前进程对dirent的一次引用记录
  */
-void dput(Dirent *dirent) {
+static void holder_put(Dirent *dirent) {
 	u16 index = get_proc_index(cpu_this()->cpu_running->td_proc);
-	#ifdef REFCNT_DEBUG
 	u16 rmed = 0;
-	#endif
 	int i;
 	for (i = 0; i < dirent->holder_cnt; i++) {
 		if (dirent->holders[i].proc_index == index) {
 			dirent->holders[i].cnt -= 1;
 			if (dirent->holders[i].cnt == 0) {
 				dirent->holders[i] = dirent->holders[dirent->holder_cnt - 1];
-				dirent->holders[dirent->holder_cnt - 1] = (struct holder_info){0, 0};
+				dirent->holders[dirent->holder_cnt - 1] = (struct holder_info){0, 0, NULL};
 				dirent->holder_cnt -= 1;
-				#ifdef REFCNT_DEBUG
 				rmed = 1;
-				#endif
 			}
 			break;
 		}
 	}
 
-#ifdef REFCNT_DEBUG
 	mtx_lock_sleep(&mtx_file);
 	warn("dput: %s, process: %s, cur_hold_cnt: %d\n", dirent->name, cpu_this()->cpu_running->td_name, rmed == 1 ? 0 : dirent->holders[i].cnt);
 	mtx_unlock_sleep(&mtx_file);
+}
+#endif
+
+/**
+ * @brief 将dirent的引用计数加一
+ * @note 普通构建下只维护原子的引用计数；定义REFCNT_DEBUG时额外记录每个进程的持有情况
+ */
+void dget(Dirent *dirent) {
+#ifdef REFCNT_DEBUG
+	holder_get(dirent);
 #endif
-	dirent->refcnt -= 1;
+	__sync_fetch_and_add(&dirent->refcnt, 1);
+}
+
+/**
+ * @brief 将dirent的引用数减一
+ * @note 检查与减一需在同一次CAS中完成，否则并发的dput可能把引用计数减到0以下
+ */
+void dput(Dirent *dirent) {
+	u32 old;
+#ifdef REFCNT_DEBUG
+	holder_put(dirent);
+#endif
+	do {
+		old = dirent->refcnt;
+		if (old == 0) {
+			warn("dput: %s refcnt is already 0!\n", dirent->name);
+			return;
+		}
+	} while (!__sync_bool_compare_and_swap(&dirent->refcnt, old, old - 1));
 }
 
 /**
@@ -187,14 +470,28 @@ static Dirent *get_parent_dirent(Dirent *dirent) {
 
 /**
  * @brief 在dir中找一个名字为name的文件，找到后获取其引用
- * @note 只需要遍历Dirent树即可，无需实际访问磁盘
+ * @note 查询目录项缓存的哈希表。dir尚未展开时先从磁盘读入其一层子节点，查找失败的名字会被记为负目录项
  */
 static int dir_lookup(FileSystem *fs, Dirent *dir, char *name, struct Dirent **file) {
 	Dirent *child;
+	u32 hash = dcache_hash(dir, name);
 
-	LIST_FOREACH (child, &dir->child_list, dirent_link) {
+	if (neg_lookup(dir, name, hash)) {
+		return -ENOENT;
+	}
+
+	dirent_populate(dir);
+
+	mtx_lock_sleep(&mtx_file);
+	if (dir->is_extend) {
+		TAILQ_REMOVE(&dirent_lru, dir, lru_link);
+		TAILQ_INSERT_HEAD(&dirent_lru, dir, lru_link);
+	}
+	mtx_unlock_sleep(&mtx_file);
 
-		if (strncmp(name, child->name, MAX_NAME_LEN) == 0) {
+	LIST_FOREACH (child, &dcache[hash & DCACHE_MASK], hash_link) {
+		if (child->name_hash == hash && child->parent_dirent == dir &&
+		    strncmp(name, child->name, MAX_NAME_LEN) == 0) {
 			dget(child);
 
 			*file = child;
@@ -202,6 +499,7 @@ static int dir_lookup(FileSystem *fs, Dirent *dir, char *name, struct Dirent **f
 		}
 	}
 
+	neg_insert(dir, name, hash);
 	warn("dir_lookup: %s not found in %s\n", name, dir->name);
 	return -ENOENT;
 }
@@ -446,7 +744,12 @@ static int createItemAt(struct Dirent *baseDir, char *path, Dirent **file, int i
 	dget_path(dir);
 
 	// 3. 分配Dirent，并获取新创建文件的引用
-	if ((r = dir_alloc_file(dir, &f, lastElem)) < 0) {
+	if (IS_TMPFS(dir->file_system)) {
+		r = tmpfs_alloc_file(dir, &f, lastElem);
+	} else {
+		r = dir_alloc_file(dir, &f, lastElem);
+	}
+	if (r < 0) {
 		mtx_unlock_sleep(&mtx_file);
 		return r;
 	}
@@ -454,9 +757,26 @@ static int createItemAt(struct Dirent *baseDir, char *path, Dirent **file, int i
 	// 4. 填写Dirent的各项信息
 	f->parent_dirent = dir;				   // 设置父亲节点，以安排写回
 	f->file_system = dir->file_system;
+	f->type = (isDir) ? DIRENT_DIR : DIRENT_FILE;
+
+	if (IS_TMPFS(dir->file_system)) {
+		// tmpfs的文件数据按页存放在内存中，没有簇，也没有需要回写的目录项
+		extern struct FileDev file_dev_tmpfs;
+		f->dev = &file_dev_tmpfs;
+		if (isDir) {
+			f->raw_dirent.DIR_Attr = ATTR_DIRECTORY;
+		}
+		dirent_add_child(dir, f);
+
+		if (file) {
+			*file = f;
+		}
+		mtx_unlock_sleep(&mtx_file);
+		return 0;
+	}
+
 	extern struct FileDev file_dev_file;
 	f->dev = &file_dev_file; // 赋值设备指针
-	f->type = (isDir) ? DIRENT_DIR : DIRENT_FILE;
 
 	// 5. 目录应当以其分配了的大小为其文件大小（TODO：但写回时只写回0）
 	if (isDir) {
@@ -472,8 +792,11 @@ static int createItemAt(struct Dirent *baseDir, char *path, Dirent **file, int i
 	}
 	filepnt_init(f);
 
-	// 4. 将dirent加入到上级目录的子Dirent列表
-	LIST_INSERT_HEAD(&(dir->child_list), f, dirent_link);
+	// 4. 将dirent加入到上级目录的子Dirent列表。新目录为空，视为已展开
+	dirent_add_child(dir, f);
+	if (isDir) {
+		dirent_mark_extended(f);
+	}
 
 	// 5. 回写dirent信息
 	sync_dirent_rawdata_back(f);
@@ -4,6 +4,7 @@
 #include <fs/fat32.h>
 #include <fs/fs.h>
 #include <fs/initcall.h>
+#include <fs/initramfs.h>
 #include <fs/vfs.h>
 #include <lib/error.h>
 #include <lib/log.h>
@@ -18,38 +19,6 @@
 FileSystem *fatFs;
 extern mutex_t mtx_file;
 
-// recursive
-/**
- * @brief 递归建立树结构，需要保证parent的child_list已经初始化过
- */
-static void build_dirent_tree(Dirent *parent) {
-	Dirent *child;
-	int off = 0; // 当前读到的偏移位置
-	int ret;
-
-	filepnt_init(parent);
-	while (1) {
-		ret = dirGetDentFrom(parent, off, &child, &off, NULL);
-		if (ret == 0) {
-			// 读到末尾
-			break;
-		}
-		// printf("get child: %s, parent: %s\n", child->name, parent->name);
-
-		// 跳过.和..
-		if (strncmp(child->name, ".          ", 11) == 0 ||
-		    strncmp(child->name, "..         ", 11) == 0) {
-			continue;
-		}
-		LIST_INSERT_HEAD(&parent->child_list, child, dirent_link);
-
-		// 如果为目录，就向下一层递归
-		if (child->type == DIRENT_DIR) {
-			build_dirent_tree(child);
-		}
-	}
-}
-
 /**
  * @brief 用fat32初始化一个文件系统，根目录记录在fs->root中
  */
@@ -57,6 +26,7 @@ void fat32_init(FileSystem *fs) {
 	// 1. 以fs为单位初始化簇管理器
 	log(LEVEL_GLOBAL, "fat32 is initing...\n");
 	strncpy(fs->name, "FAT32", 8);
+	fs->type = FS_FAT32;
 	panic_on(clusterInit(fs));
 
 	log(LEVEL_GLOBAL, "cluster Init Finished!\n");
@@ -87,9 +57,7 @@ void fat32_init(FileSystem *fs) {
 	log(LEVEL_GLOBAL, "root directory init finished!\n");
 	assert(sizeof(FAT32Directory) == DIRENT_SIZE);
 
-	// 3. 递归建立Dirent树
-	build_dirent_tree(fs->root);
-	log(LEVEL_GLOBAL, "build dirent tree succeed!\n");
+	// 3. 目录树不在挂载时建立，各目录在首次查找时由dirent_populate展开
 	log(LEVEL_GLOBAL, "fat32 init finished!\n");
 }
 
@@ -104,7 +72,9 @@ void init_root_fs() {
 	fatFs->image = NULL;
 	fatFs->deviceNumber = 0;
 
-	fat32_init(fatFs);
+	if (!initramfs_init_root(fatFs)) {
+		fat32_init(fatFs);
+	}
 }
 
 static void create_bind_device(const char *path, struct FileDev *dev, u16 type) {
@@ -137,6 +107,12 @@ static void init_dev_fs() {
 	create_bind_device("/dev/urandom", &file_dev_urandom, DIRENT_CHARDEV);
 	create_bind_device("/dev/tty", &file_dev_tty, DIRENT_CHARDEV);
 	create_bind_device("/dev/vda", &file_dev_vda, DIRENT_BLKDEV);
+
+	extern u64 ramdiskSize;
+	extern struct FileDev file_dev_ram0;
+	if (ramdiskSize > 0) {
+		create_bind_device("/dev/ram0", &file_dev_ram0, DIRENT_BLKDEV);
+	}
 }
 
 static void init_proc_fs() {
@@ -177,6 +153,9 @@ static void init_fs_other() {
 
 	makeDirAt(fatFs->root, "/etc", 0);
 	makeDirAt(fatFs->root, "/tmp", 0);
+	// 临时文件放在内存中，不经过FAT和磁盘
+	mount_fs("tmpfs", fatFs->root, "/tmp", "tmpfs");
+	initramfs_init();
 
 	create_file_and_close("/etc/filesystems");
 
@@ -8,17 +8,20 @@
 #include <fs/vfs.h>
 #include <fs/filepnt.h>
 #include <fs/buf.h>
+#include <fs/tmpfs.h>
 #include <lib/error.h>
 #include <lib/log.h>
 #include <lib/string.h>
 #include <lock/mutex.h>
 #include <sys/errno.h>
+#include <sys/syscall_fs.h>
 #include <lib/profiling.h>
 
 /**
- * @brief mtx_file是负责维护磁盘file访问互斥性的锁。
- * 每次我们携带dirent指针进入文件系统层对文件进行操作，都需要获取这个锁，以保证对dirent的
- * 读、写、删除等是互斥的。之前曾设计过更细粒度的锁（对每个Dirent加锁），但因太复杂而使用此粗粒度的锁。
+ * @brief mtx_file是目录树（命名空间）的锁。
+ * 路径查找、目录展开与回收、文件的创建、删除、重命名和挂载，以及引用计数归零时的删除都需要持有此锁。
+ * 文件数据和元数据的读写只获取对应Dirent的lock，因此对不同文件的读写可以在多个核上并行进行。
+ * 写回目录项时会在持有子Dirent锁的情况下获取父目录的锁，Dirent锁之间只会自下而上嵌套，不会形成环。
  */
 mutex_t mtx_file;
 
@@ -79,7 +82,9 @@ int get_file_raw(Dirent *baseDir, char *path, Dirent **pfile) {
 		return r;
 	} else {
 		// 首次打开，更新pointer
+		mtx_lock_sleep(&file->lock);
 		filepnt_init(file);
+		mtx_unlock_sleep(&file->lock);
 		mtx_unlock_sleep(&mtx_file);
 		*pfile = file;
 		return 0;
@@ -130,6 +135,9 @@ int getFile(Dirent *baseDir, char *path, Dirent **pfile) {
  */
 void file_close(Dirent *file) {
 	mtx_lock_sleep(&mtx_file);
+	if (file->meta_dirty) {
+		dirent_flush(file);
+	}
 	dput_path(file);
 	if (file->is_rm && file->refcnt == 0) {
 		warn("file close and is_rm is set, rm file %s\n", file->name);
@@ -147,13 +155,17 @@ void file_close(Dirent *file) {
  * @return 返回读取文件的字节数
  */
 int file_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
+	if (IS_TMPFS(file->file_system)) {
+		return tmpfs_read(file, user, dst, off, n);
+	}
+
 	PROFILING_START
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	log(LEVEL_MODULE, "read from file %s: off = %d, n = %d\n", file->name, off, n);
 	if (off >= file->file_size) {
 		// 起始地址超出文件的最大范围，遇到文件结束，返回0
-		mtx_unlock_sleep(&mtx_file);
+		mtx_unlock_sleep(&file->lock);
 		return 0;
 	} else if (off + n > file->file_size) {
 		warn("read too much. shorten read length from %d to %d!\n", n,
@@ -161,7 +173,7 @@ int file_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
 		n = file->file_size - off;
 	}
 	if (n == 0) {
-		mtx_unlock_sleep(&mtx_file);
+		mtx_unlock_sleep(&file->lock);
 		return 0;
 	}
 
@@ -175,7 +187,9 @@ int file_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
 	u32 len = 0; // 累计读取的字节数
 
 	// 读取第一块
-	clusterRead(file->file_system, clus, offset, (void *)dst, MIN(n, clusSize - offset), user);
+	bool meta = file->type == DIRENT_DIR;
+	clusterRead(file->file_system, clus, offset, (void *)dst, MIN(n, clusSize - offset), user,
+		    meta);
 	len += MIN(n, clusSize - offset);
 
 	// 之后的块
@@ -183,53 +197,207 @@ int file_read(struct Dirent *file, int user, u64 dst, uint off, uint n) {
 	for (; end >= clusIndex * clusSize; clusIndex++) {
 		clus = filepnt_getclusbyno(file, clusIndex);
 		clusterRead(file->file_system, clus, 0, (void *)(dst + len), MIN(clusSize, n - len),
-			    user);
+			    user, meta);
 		len += MIN(clusSize, n - len);
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 	PROFILING_END
 	return n;
 }
 
 /**
- * @brief 扩充文件到新的大小
+ * @brief 对文件第clusIndex个簇开始的count个簇发起异步预读，超出文件末尾的部分被忽略
+ * @note 设备队列已满时停止，剩余的簇留给之后的读取
  */
-void file_extend(struct Dirent *file, int newSize) {
-	assert(file->file_size < newSize);
+void file_readahead(struct Dirent *file, u32 clusIndex, u32 count) {
+	if (IS_TMPFS(file->file_system)) {
+		return;
+	}
 
-	u32 oldSize = file->file_size;
-	file->file_size = newSize;
-	FileSystem *fs = file->file_system;
+	mtx_lock_sleep(&file->lock);
 
 	u32 clusSize = CLUS_SIZE(file->file_system);
-	u32 clusIndex = 0;
-	u32 clus;
+	u32 fileClus = (file->file_size + clusSize - 1) / clusSize;
+	u32 end = MIN(clusIndex + count, fileClus);
+	for (u32 i = clusIndex; i < end; i++) {
+		if (clusterPrefetch(file->file_system, filepnt_getclusbyno(file, i)) < 0) {
+			break;
+		}
+	}
+
+	mtx_unlock_sleep(&file->lock);
+}
+
+/**
+ * @brief 将新分配的第clusIndex个簇中不被[woff, woff + wlen)覆盖的部分清零
+ * @note 被覆盖的部分紧接着就会被写入，无需先写一遍0
+ */
+static void file_zero_uncovered(FileSystem *fs, u32 clus, u32 clusIndex, u32 woff, u32 wlen) {
+	u32 clusSize = CLUS_SIZE(fs);
+	u64 cstart = (u64)clusIndex * clusSize, cend = cstart + clusSize;
+	u64 ws = MAX(cstart, (u64)woff), we = MIN(cend, (u64)woff + wlen);
+	if (ws >= we) {
+		clusterZeroRange(fs, clus, 0, clusSize);
+		return;
+	}
+	if (ws > cstart) {
+		clusterZeroRange(fs, clus, 0, ws - cstart);
+	}
+	if (we < cend) {
+		clusterZeroRange(fs, clus, we - cstart, cend - we);
+	}
+}
 
-	// 1. 处理空文件的情况
-	if (file->first_clus != 0) {
-		clus = file->first_clus;
+/**
+ * @brief 释放文件簇链上从第nclus个簇开始的所有簇，簇链只保留前nclus个簇
+ */
+static void file_free_clusters_from(struct Dirent *file, u32 nclus) {
+	u32 first = filepnt_trygetclus(file, nclus);
+	if (first == 0) {
+		return;
+	}
+	if (nclus != 0) {
+		fatWrite(file->file_system, filepnt_getclusbyno(file, nclus - 1), FAT32_EOF);
 	} else {
-		file->first_clus = clus = clusterAlloc(file->file_system, 0);
-		filepnt_setval(&file->pointer, 0, clus);
-		oldSize = 1; // 扩充文件
+		file->first_clus = 0;
 	}
+	clus_sequence_free(file->file_system, first);
+	filepnt_truncate(file, nclus);
+}
 
-	// 2. 计算最后一个簇的簇号和index
-	u32 old_clusters = (oldSize + clusSize - 1) / clusSize;
-	clus = filepnt_getclusbyno(file, old_clusters-1); // 最后簇的簇号
-	clusIndex = old_clusters - 1;
+/**
+ * @brief 保证文件的簇链至少有nclus个簇，第from个簇之前的簇已经存在
+ * @note 先启用簇链上预留（fallocate KEEP_SIZE）的簇，不足的部分按连续的段批量分配
+ * @param zero 为真时，将启用的簇中不被[woff, woff + wlen)覆盖的部分清零；只预留不启用时无需清零
+ * @return 磁盘空间不足时释放本次新分配的簇，返回-ENOSPC
+ */
+static int file_alloc_clusters(struct Dirent *file, u32 from, u32 nclus, bool zero, u32 woff,
+			       u32 wlen) {
+	FileSystem *fs = file->file_system;
+	u32 clusIndex = from;
+	u32 clus;
 
-	// 3. 分配簇，并更新pointer簇号表
-	while (newSize > (clusIndex + 1) * clusSize) {
-		clus = clusterAlloc(fs, clus);
-		clusIndex += 1;
-		// 同时将增加的簇数加入到簇号指针表中
-		filepnt_setval(&file->pointer, clusIndex, clus);
+	// 1. 启用簇链上已预留的簇
+	for (; clusIndex < nclus; clusIndex++) {
+		clus = filepnt_trygetclus(file, clusIndex);
+		if (clus == 0) {
+			break;
+		}
+		if (zero) {
+			file_zero_uncovered(fs, clus, clusIndex, woff, wlen);
+		}
 	}
 
-	// 4. 写回目录项
-	sync_dirent_rawdata_back(file);
+	// 2. 分配剩余的簇，每次尽量分配一整段连续的簇
+	u32 allocFrom = clusIndex;
+	u32 prev = clusIndex == 0 ? 0 : filepnt_getclusbyno(file, clusIndex - 1);
+	while (clusIndex < nclus) {
+		u32 got;
+		clus = clusterAllocRun(fs, prev, nclus - clusIndex, &got);
+		if (clus == 0) {
+			file_free_clusters_from(file, allocFrom);
+			return -ENOSPC;
+		}
+		if (clusIndex == 0) {
+			file->first_clus = clus;
+		}
+		for (u32 i = 0; i < got; i++, clusIndex++) {
+			if (zero) {
+				file_zero_uncovered(fs, clus + i, clusIndex, woff, wlen);
+			}
+			// 同时将增加的簇数加入到簇号指针表中
+			filepnt_append(file, clusIndex, clus + i);
+		}
+		prev = clus + got - 1;
+	}
+	return 0;
+}
+
+/**
+ * @brief 扩充文件到新的大小，[woff, woff + wlen)是随后将被写入的范围，新簇中的这部分不清零
+ * @return 磁盘空间不足时文件大小不变，返回-ENOSPC；文件正作为镜像被挂载时返回-EBUSY
+ */
+static int file_extend_for_write(struct Dirent *file, int newSize, u32 woff, u32 wlen) {
+	assert(file->file_size < newSize);
+	if (file->loop_busy) {
+		return -EBUSY;
+	}
+
+	u32 clusSize = CLUS_SIZE(file->file_system);
+	u32 old_clusters = (file->file_size + clusSize - 1) / clusSize;
+	u32 new_clusters = (newSize + clusSize - 1) / clusSize;
+
+	// 一次性为整个扩充的范围分配簇
+	if (new_clusters > old_clusters) {
+		int r = file_alloc_clusters(file, old_clusters, new_clusters, true, woff, wlen);
+		if (r < 0) {
+			return r;
+		}
+	}
+	file->file_size = newSize;
+
+	// 目录项延迟到close、fsync或sync时写回
+	dirent_mark_dirty(file);
+	return 0;
+}
+
+/**
+ * @brief 扩充文件到新的大小，新分配的簇被清零
+ * @return 磁盘空间不足时返回-ENOSPC
+ */
+int file_extend(struct Dirent *file, int newSize) {
+	if (IS_TMPFS(file->file_system)) {
+		tmpfs_truncate(file, newSize);
+		return 0;
+	}
+
+	mtx_lock_sleep(&file->lock);
+	int r = file_extend_for_write(file, newSize, 0, 0);
+	mtx_unlock_sleep(&file->lock);
+	return r;
+}
+
+/**
+ * @brief 为文件的[offset, offset + len)预先分配簇
+ * @note FAT32没有空洞，文件内部的范围总是已分配的。不带FALLOC_FL_KEEP_SIZE时扩充文件（新簇被清零）；
+ * 带FALLOC_FL_KEEP_SIZE时只把连续的簇接在簇链尾部而不改变文件大小，这些簇在被写入启用时才清零
+ */
+int file_fallocate(struct Dirent *file, int mode, u64 offset, u64 len) {
+	if (mode & ~FALLOC_FL_KEEP_SIZE) {
+		return -EOPNOTSUPP;
+	}
+	if (len == 0) {
+		return -EINVAL;
+	}
+	if (file->type != DIRENT_FILE) {
+		return -ENODEV;
+	}
+	// 文件大小以int传递（FAT32目录项中也只有32位）
+	if (offset + len > 0x7fffffff) {
+		return -EFBIG;
+	}
+	if (IS_TMPFS(file->file_system)) {
+		return tmpfs_fallocate(file, mode, offset, len);
+	}
+
+	int r = 0;
+	mtx_lock_sleep(&file->lock);
+	if (offset + len > file->file_size) {
+		if (file->loop_busy) {
+			r = -EBUSY;
+		} else if (mode & FALLOC_FL_KEEP_SIZE) {
+			u32 clusSize = CLUS_SIZE(file->file_system);
+			u32 nclus = (offset + len + clusSize - 1) / clusSize;
+			u32 old_clusters = (file->file_size + clusSize - 1) / clusSize;
+			r = file_alloc_clusters(file, old_clusters, nclus, false, 0, 0);
+			dirent_mark_dirty(file);
+		} else {
+			r = file_extend_for_write(file, offset + len, 0, 0);
+		}
+	}
+	mtx_unlock_sleep(&file->lock);
+	return r;
 }
 
 /**
@@ -239,7 +407,11 @@ void file_extend(struct Dirent *file, int newSize) {
  * @return 返回写入文件的字节数
  */
 int file_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
-	mtx_lock_sleep(&mtx_file);
+	if (IS_TMPFS(file->file_system)) {
+		return tmpfs_write(file, user, src, off, n);
+	}
+
+	mtx_lock_sleep(&file->lock);
 
 	log(FS_MODULE, "write file: %s\n", file->name);
 	assert(n != 0);
@@ -247,8 +419,12 @@ int file_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
 	// Note: 支持off在任意位置的写入（允许超过file->size），[file->size, off)的部分将被填充为0
 	if (off + n > file->file_size) {
 		// 超出文件的最大范围
-		// Note: 扩充
-		file_extend(file, off + n);
+		// Note: 扩充，新簇中即将写入的部分不必清零
+		int r = file_extend_for_write(file, off + n, off, n);
+		if (r < 0) {
+			mtx_unlock_sleep(&file->lock);
+			return r;
+		}
 	}
 
 	u64 start = off, end = off + n - 1;
@@ -261,7 +437,9 @@ int file_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
 	u32 len = 0; // 累计读取的字节数
 
 	// 读取第一块
-	clusterWrite(file->file_system, clus, offset, (void *)src, MIN(n, clusSize - offset), user);
+	bool meta = file->type == DIRENT_DIR;
+	clusterWrite(file->file_system, clus, offset, (void *)src, MIN(n, clusSize - offset), user,
+		     meta);
 	len += MIN(n, clusSize - offset);
 
 	// 之后的块
@@ -269,23 +447,160 @@ int file_write(struct Dirent *file, int user, u64 src, uint off, uint n) {
 	for (; end >= clusIndex * clusSize; clusIndex++) {
 		clus = filepnt_getclusbyno(file, clusIndex);
 		clusterWrite(file->file_system, clus, 0, (void *)(src + len),
-			     MIN(clusSize, n - len), user);
+			     MIN(clusSize, n - len), user, meta);
 		len += MIN(clusSize, n - len);
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
+	return n;
+}
+
+/**
+ * @brief 判断文件能否进行O_DIRECT读写：只支持直接挂载在块设备上的普通文件，其他情况退回到经过缓存的读写
+ */
+bool file_can_direct(struct Dirent *file) {
+	extern struct FileDev file_dev_file;
+	return file->type == DIRENT_FILE && file->dev == &file_dev_file &&
+	       file->file_system->image == NULL;
+}
+
+/**
+ * @brief O_DIRECT读写：文件数据在用户缓冲区buf与磁盘之间直接传输，不经过块缓存
+ * @note buf、off和n必须按扇区对齐。读取时n被截断到文件尾，文件尾所在的扇区整体传输
+ * @note 物理连续的簇合并为一个多扇区请求
+ * @return 传输的字节数，不满足对齐要求时返回-EINVAL，用户缓冲区无效时返回-EFAULT
+ */
+int file_direct_rw(struct Dirent *file, int write, u64 buf, uint off, uint n) {
+	FileSystem *fs = file->file_system;
+	u32 bps = fs->superBlock.bpb.bytes_per_sec;
+	u32 clusSize = CLUS_SIZE(fs);
+	if (buf % bps || off % bps || n % bps) {
+		return -EINVAL;
+	}
+	if (n == 0) {
+		return 0;
+	}
+
+	mtx_lock_sleep(&file->lock);
+	if (write) {
+		if (off + n > file->file_size) {
+			// 新簇随后被整体写入，无需清零
+			int r = file_extend_for_write(file, off + n, off, n);
+			if (r < 0) {
+				mtx_unlock_sleep(&file->lock);
+				return r;
+			}
+		}
+	} else {
+		if (off >= file->file_size) {
+			mtx_unlock_sleep(&file->lock);
+			return 0;
+		}
+		n = MIN(n, file->file_size - off);
+	}
+
+	u32 xfer = (n + bps - 1) / bps * bps;
+	for (u32 done = 0; done < xfer;) {
+		u32 pos = off + done;
+		u32 clusIndex = pos / clusSize;
+		u32 clus = filepnt_getclusbyno(file, clusIndex);
+		u32 len = clusSize - pos % clusSize;
+		for (u32 k = 1; done + len < xfer && filepnt_getclusbyno(file, clusIndex + k) == clus + k;
+		     k++) {
+			len += clusSize;
+		}
+		len = MIN(len, xfer - done);
+		err_t r = clusterDirectRw(fs, clus, pos % clusSize, buf + done, len, write);
+		if (r < 0) {
+			mtx_unlock_sleep(&file->lock);
+			return r;
+		}
+		done += len;
+	}
+
+	mtx_unlock_sleep(&file->lock);
+	return n;
+}
+
+/**
+ * @brief 把文件src偏移soff处的至多n字节复制到文件dst偏移doff处，数据在块缓存中逐簇复制
+ * @note 同时持有两个文件的锁，按地址顺序加锁，避免两个方向相反的复制互相死锁
+ * @note src与dst为同一文件时，由调用者保证两个范围不重叠
+ * @return 复制的字节数，soff处已到文件尾时返回0
+ */
+int file_copy_range(struct Dirent *src, uint soff, struct Dirent *dst, uint doff, uint n) {
+	if (IS_TMPFS(src->file_system) || IS_TMPFS(dst->file_system)) {
+		return tmpfs_copy_range(src, soff, dst, doff, n);
+	}
+
+	Dirent *first = src < dst ? src : dst;
+	Dirent *second = src < dst ? dst : src;
+	mtx_lock_sleep(&first->lock);
+	if (second != first) {
+		mtx_lock_sleep(&second->lock);
+	}
+
+	n = soff >= src->file_size ? 0 : MIN(n, src->file_size - soff);
+	if (n > 0 && doff + n > dst->file_size) {
+		// 新簇中即将被复制覆盖的部分不必清零
+		int r = file_extend_for_write(dst, doff + n, doff, n);
+		if (r < 0) {
+			if (second != first) {
+				mtx_unlock_sleep(&second->lock);
+			}
+			mtx_unlock_sleep(&first->lock);
+			return r;
+		}
+	}
+
+	FileSystem *sfs = src->file_system, *dfs = dst->file_system;
+	u32 sclusSize = CLUS_SIZE(sfs), dclusSize = CLUS_SIZE(dfs);
+	u32 sfileClus = (soff + n + sclusSize - 1) / sclusSize;
+	u32 prevIndex = -1;
+
+	for (u32 done = 0; done < n;) {
+		u32 s = soff + done, d = doff + done;
+		u32 sindex = s / sclusSize, dindex = d / dclusSize;
+		u32 len = MIN(MIN(sclusSize - s % sclusSize, dclusSize - d % dclusSize), n - done);
+
+		// 进入新的源簇时，异步预读下一个源簇，使磁盘读取与本簇的复制重叠
+		if (sindex != prevIndex && sindex + 1 < sfileClus) {
+			clusterPrefetch(sfs, filepnt_getclusbyno(src, sindex + 1));
+		}
+		prevIndex = sindex;
+
+		clusterCopy(sfs, filepnt_getclusbyno(src, sindex), s % sclusSize, dfs,
+			    filepnt_getclusbyno(dst, dindex), d % dclusSize, len);
+		done += len;
+	}
+
+	if (second != first) {
+		mtx_unlock_sleep(&second->lock);
+	}
+	mtx_unlock_sleep(&first->lock);
 	return n;
 }
 
 /**
  * @brief 缩小文件到指定的大小，并释放之前的簇
  * 在ftruncate之前首先需要将文件最后一个簇的多余部分清零
+ * @return 文件正作为镜像被挂载时不改变文件，返回-EBUSY
  */
-void file_shrink(Dirent *file, u64 newsize) {
-	mtx_lock_sleep(&mtx_file);
+int file_shrink(Dirent *file, u64 newsize) {
+	if (IS_TMPFS(file->file_system)) {
+		tmpfs_truncate(file, newsize);
+		return 0;
+	}
+
+	mtx_lock_sleep(&file->lock);
 
 	assert(file != NULL);
 	assert(file->file_size >= newsize);
+	// 挂载的镜像按挂载时的簇映射表访问，释放的簇会被镜像继续读写
+	if (file->loop_busy) {
+		mtx_unlock_sleep(&file->lock);
+		return -EBUSY;
+	}
 
 	u32 oldsize = file->file_size;
 	u32 clusSize = CLUS_SIZE(file->file_system);
@@ -299,21 +614,18 @@ void file_shrink(Dirent *file, u64 newsize) {
 		}
 	}
 
-	// 2. 释放后面的簇
+	// 2. 释放后面的簇（包括fallocate在文件尾之后预留的簇）
 	u32 new_clusters = (newsize + clusSize - 1) / clusSize;
-	u32 old_clusters = (oldsize + clusSize - 1) / clusSize;
-	if (new_clusters < old_clusters) {
-		// 获取新文件大小之后的第一个簇
-		u32 last_clus = filepnt_getclusbyno(file, new_clusters);
+	// 获取新文件大小之后的第一个簇
+	u32 last_clus = filepnt_trygetclus(file, new_clusters);
+	if (last_clus != 0) {
 		if (new_clusters != 0) {
 			u32 prev_clus = filepnt_getclusbyno(file, new_clusters-1);
 			fatWrite(file->file_system, prev_clus, FAT32_EOF); // 标识最后一个簇
 		}
 		clus_sequence_free(file->file_system, last_clus);
-		for (int i = new_clusters; i < old_clusters; i++) {
-			// 清空簇号表的对应位置
-			filepnt_setval(&file->pointer, i, 0);
-		}
+		// 截断簇号映射表
+		filepnt_truncate(file, new_clusters);
 	}
 
 	// 2. 缩小文件
@@ -322,9 +634,10 @@ void file_shrink(Dirent *file, u64 newsize) {
 		file->first_clus = 0;
 	}
 
-	// 3. 写回
-	sync_dirent_rawdata_back(file);
-	mtx_unlock_sleep(&mtx_file);
+	// 3. 标记目录项待写回
+	dirent_mark_dirty(file);
+	mtx_unlock_sleep(&file->lock);
+	return 0;
 }
 
 static mode_t get_file_mode(struct Dirent *file) {
@@ -373,7 +686,7 @@ static mode_t get_file_mode(struct Dirent *file) {
  * @param kstat 内核态指针，指向文件信息结构体
  */
 void fileStat(struct Dirent *file, struct kstat *pKStat) {
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	memset(pKStat, 0, sizeof(struct kstat));
 	// P262 Linux-Unix系统编程手册
@@ -394,7 +707,7 @@ void fileStat(struct Dirent *file, struct kstat *pKStat) {
 	// 时间相关
 	file_get_timestamp(file, pKStat);
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 }
 
 // 检查文件的用户权限，暂时忽略flags
@@ -417,7 +730,10 @@ int faccessat(Dirent *dir, char *path, int mode, int flags) {
  * @brief 同步文件系统到磁盘
  */
 void fs_sync() {
+	dirent_flush_all();
+	// 包括挂载的镜像等所有FAT文件系统，持有mtx_file避免同步时文件系统被卸载
 	mtx_lock_sleep(&mtx_file);
-	bufSync();
+	fsSyncAll();
 	mtx_unlock_sleep(&mtx_file);
+	bufSync();
 }
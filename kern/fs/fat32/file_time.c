@@ -5,16 +5,16 @@
 #include <fs/file_time.h>
 #include <fs/fs.h>
 #include <fs/vfs.h>
+#include <lib/string.h>
 #include <lock/mutex.h>
 #include <sys/time.h>
 
-extern mutex_t mtx_file;
 
 /**
  * @brief 从file中获取到文件的时间戳，存储到kstat结构体中
  */
 void file_get_timestamp(Dirent *file, struct kstat *kstat) {
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	kstat->st_atime_sec = file->time.st_atime_sec;
 	kstat->st_atime_nsec = file->time.st_atime_nsec;
@@ -23,7 +23,7 @@ void file_get_timestamp(Dirent *file, struct kstat *kstat) {
 	kstat->st_ctime_sec = file->time.st_ctime_sec;
 	kstat->st_ctime_nsec = file->time.st_ctime_nsec;
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 }
 
 /**
@@ -34,7 +34,7 @@ void file_update_timestamp(Dirent *file, int type) {
 	u64 tv_sec = ts.tv_sec;
 	u64 tv_nsec = ts.tv_nsec;
 
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	if (type & ACCESS_TIME) {
 		file->time.st_atime_sec = tv_sec;
@@ -51,7 +51,95 @@ void file_update_timestamp(Dirent *file, int type) {
 		file->time.st_ctime_nsec = tv_nsec;
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
+}
+
+/**
+ * FAT目录项中的时间戳按本地日期保存（这里视为UTC），精度为2秒：
+ * 日期为 (年 - 1980) << 9 | 月 << 5 | 日，时间为 时 << 11 | 分 << 5 | 秒 / 2
+ * 目录项只有修改时间和访问日期，没有状态改变时间，读入时状态改变时间取修改时间
+ */
+#define FAT_EPOCH_DAYS 3652 // 1970-01-01到1980-01-01的天数
+#define FAT_MAX_YEAR 2107
+
+// 公历日期与1970-01-01起的天数互相换算，年份不早于1970
+static long days_from_civil(long y, long m, long d) {
+	y -= m <= 2;
+	long era = y / 400;
+	long yoe = y - era * 400;
+	long doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+	long doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static void civil_from_days(long z, long *y, long *m, long *d) {
+	z += 719468;
+	long era = z / 146097;
+	long doe = z - era * 146097;
+	long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	long mp = (5 * doy + 2) / 153;
+	*d = doy - (153 * mp + 2) / 5 + 1;
+	*m = mp < 10 ? mp + 3 : mp - 9;
+	*y = yoe + era * 400 + (*m <= 2);
+}
+
+/**
+ * @brief 把Unix时间换算为FAT的日期和时间，超出FAT能表示的范围时返回false
+ */
+static bool fat_time_encode(long sec, u16 *date, u16 *time) {
+	long days = sec / 86400, rem = sec % 86400;
+	long y, m, d;
+	if (sec <= 0 || days < FAT_EPOCH_DAYS) {
+		return false;
+	}
+	civil_from_days(days, &y, &m, &d);
+	if (y > FAT_MAX_YEAR) {
+		return false;
+	}
+	*date = (y - 1980) << 9 | m << 5 | d;
+	*time = (rem / 3600) << 11 | (rem % 3600 / 60) << 5 | (rem % 60) / 2;
+	return true;
+}
+
+static long fat_time_decode(u16 date, u16 time) {
+	long y = 1980 + (date >> 9), m = (date >> 5) & 0xf, d = date & 0x1f;
+	if (m < 1 || m > 12 || d < 1) {
+		return 0;
+	}
+	return days_from_civil(y, m, d) * 86400 + (time >> 11) * 3600 + ((time >> 5) & 0x3f) * 60 +
+	       (time & 0x1f) * 2;
+}
+
+/**
+ * @brief 从读入的目录项中恢复文件的时间戳。日期为0（未设置）时时间戳保持为0
+ */
+void file_time_from_raw(Dirent *file) {
+	FAT32Directory *raw = &file->raw_dirent;
+	memset(&file->time, 0, sizeof(file->time));
+	if (raw->DIR_WrtDate != 0) {
+		file->time.st_mtime_sec = fat_time_decode(raw->DIR_WrtDate, raw->DIR_WrtTime);
+		file->time.st_ctime_sec = file->time.st_mtime_sec;
+	}
+	if (raw->DIR_LstAccDate != 0) {
+		file->time.st_atime_sec = fat_time_decode(raw->DIR_LstAccDate, 0);
+	}
+}
+
+/**
+ * @brief 把文件的时间戳写入内存中的目录项，调用者随后写回父目录
+ * @note 从未设置过（为0）或超出FAT范围的时间戳不改动目录项中原有的值
+ */
+void file_time_to_raw(Dirent *file) {
+	FAT32Directory *raw = &file->raw_dirent;
+	u16 date, time;
+	if (fat_time_encode(file->time.st_mtime_sec, &date, &time)) {
+		raw->DIR_WrtDate = date;
+		raw->DIR_WrtTime = time;
+	}
+	if (fat_time_encode(file->time.st_atime_sec, &date, &time)) {
+		raw->DIR_LstAccDate = date;
+	}
 }
 
 // 主要由utimensat系统调用使用
@@ -63,7 +151,7 @@ void file_set_timestamp(Dirent *file, int type, struct timespec *ts) {
 		return;
 	}
 
-	mtx_lock_sleep(&mtx_file);
+	mtx_lock_sleep(&file->lock);
 
 	if (type & ACCESS_TIME) {
 		file->time.st_atime_sec = ts->tv_sec;
@@ -80,5 +168,5 @@ void file_set_timestamp(Dirent *file, int type, struct timespec *ts) {
 		file->time.st_ctime_nsec = ts->tv_nsec;
 	}
 
-	mtx_unlock_sleep(&mtx_file);
+	mtx_unlock_sleep(&file->lock);
 }
@@ -1,53 +1,137 @@
 #include <fs/cluster.h>
-#include <mm/vmm.h>
+#include <fs/filepnt.h>
+#include <mm/kmalloc.h>
 #include <lib/log.h>
+#include <lib/string.h>
 #include <fs/fs.h>
 
+// extents数组的初始容量
+#define FILEPNT_INIT_CAP 4
+// extents数组的容量上限（96KB），不超过kmalloc单次分配的大小。
+// 极度碎片化的文件超出上限后，之后的簇不再映射，查找时从第一个未映射的簇沿FAT链遍历
+#define FILEPNT_MAX_CAP 8192
+
 /**
- * @brief 更新pointer值
+ * @brief 向映射表末尾追加文件的第fileClusNo个簇，若与最后一个extent在磁盘上连续则合并
+ * @return 映射表已满（或内存不足）不能追加时返回false
  */
-void filepnt_setval(DirentPointer* fileptr, int i, int value) {
-	u32 index1 = i / PAGE_NCLUSNO;
-	u32 index2 = i % PAGE_NCLUSNO;
-	if (index1 >= NDIRENT_SECPOINTER) {
-		// 导入三级指针
-		if (fileptr->third == NULL) {
-			fileptr->third = (struct ThirdPointer *)kvmAlloc();
+static bool filepnt_push(DirentPointer *fileptr, u32 fileClusNo, u32 clus) {
+	assert(fileClusNo == fileptr->mapped);
+
+	if (fileptr->cnt > 0) {
+		ClusExtent *last = &fileptr->extents[fileptr->cnt - 1];
+		if (last->disk_clus + last->len == clus) {
+			last->len += 1;
+			fileptr->mapped += 1;
+			return true;
+		}
+	}
+
+	if (fileptr->cnt == fileptr->cap) {
+		if (fileptr->cap == FILEPNT_MAX_CAP) {
+			return false;
 		}
-		index1 = index1 - NDIRENT_SECPOINTER;
-		if (fileptr->third->ptr[index1] == NULL) {
-			fileptr->third->ptr[index1] = (struct TwicePointer *)kvmAlloc();
+		// 扩容为原来的两倍
+		u32 newcap = fileptr->cap == 0 ? FILEPNT_INIT_CAP : MIN(fileptr->cap * 2, FILEPNT_MAX_CAP);
+		ClusExtent *extents = kmalloc(newcap * sizeof(ClusExtent));
+		if (extents == NULL) {
+			return false;
 		}
-		struct TwicePointer *twicep = fileptr->third->ptr[index1];
-		twicep->cluster[index2] = value;
-	} else {
-		if (fileptr->second[index1] == NULL) {
-			fileptr->second[index1] = (struct TwicePointer *)kvmAlloc();
+		if (fileptr->extents != NULL) {
+			memcpy(extents, fileptr->extents, fileptr->cnt * sizeof(ClusExtent));
+			kfree(fileptr->extents);
 		}
-		struct TwicePointer *twicep = fileptr->second[index1];
-		twicep->cluster[index2] = value;
+		fileptr->extents = extents;
+		fileptr->cap = newcap;
 	}
+
+	ClusExtent *ext = &fileptr->extents[fileptr->cnt++];
+	ext->file_clus = fileClusNo;
+	ext->disk_clus = clus;
+	ext->len = 1;
+	fileptr->mapped += 1;
+	return true;
 }
 
-// 文件刚打开时初始化文件的指针
-void filepnt_init(Dirent *file) {
-	if (!file->pointer.valid) {
-		// 首次打开，更新pointer
-		int clus = file->first_clus;
-		if (clus == 0) {
-			// 文件的大小为0，返回
-			return;
+/**
+ * @brief 沿FAT链继续构建映射，直到文件的前nclus个簇都已映射、链已结束，或映射表已满
+ */
+static void filepnt_map_until(Dirent *file, u32 nclus) {
+	DirentPointer *fileptr = &file->pointer;
+	while (fileptr->mapped < nclus && fileptr->next_clus >= 2 &&
+	       FAT32_NOT_END_CLUSTER(fileptr->next_clus)) {
+		u32 clus = fileptr->next_clus;
+		if (!filepnt_push(fileptr, fileptr->mapped, clus)) {
+			break;
 		}
+		fileptr->next_clus = fatRead(file->file_system, clus);
+	}
+}
 
-		DirentPointer *fileptr = &file->pointer;
-		for (int i = 0; FAT32_NOT_END_CLUSTER(clus); i++) {
-			// 更新pointer值
-			filepnt_setval(fileptr, i, clus);
+/**
+ * @brief 映射表已满时，从第一个未映射的簇（next_clus）沿FAT链找到文件的第fileClusNo个簇
+ * @return 簇链不够长时返回0
+ */
+static u32 filepnt_walk(Dirent *file, u32 fileClusNo) {
+	DirentPointer *fileptr = &file->pointer;
+	u32 clus = fileptr->next_clus;
+	for (u32 i = fileptr->mapped; i < fileClusNo && clus >= 2 && FAT32_NOT_END_CLUSTER(clus); i++) {
+		clus = fatRead(file->file_system, clus);
+	}
+	return clus >= 2 && FAT32_NOT_END_CLUSTER(clus) ? clus : 0;
+}
+
+/**
+ * @brief 文件扩展时，在映射表末尾追加文件的第fileClusNo个簇
+ * @note 调用前文件原有的簇必须都已映射（扩展时会先查询最后一个簇，满足此条件），
+ * 或映射表已满，此时新簇已在FAT链上，之后沿链查找
+ */
+void filepnt_append(Dirent *file, u32 fileClusNo, u32 clus) {
+	DirentPointer *fileptr = &file->pointer;
+	filepnt_init(file);
+	filepnt_map_until(file, fileClusNo);
+	if (fileptr->mapped != fileClusNo) {
+		return;
+	}
+	// 映射表已满时，新簇是第一个未映射的簇
+	fileptr->next_clus = filepnt_push(fileptr, fileClusNo, clus) ? FAT32_EOF : clus;
+}
 
-			// 查询下一级簇号
-			clus = fatRead(file->file_system, clus);
+/**
+ * @brief 文件缩小时，将映射表截断为前nclus个簇
+ * @note 调用者需要已在FAT表中将第nclus-1个簇标为链尾
+ */
+void filepnt_truncate(Dirent *file, u32 nclus) {
+	DirentPointer *fileptr = &file->pointer;
+	if (!fileptr->valid) {
+		return;
+	}
+	while (fileptr->cnt > 0) {
+		ClusExtent *last = &fileptr->extents[fileptr->cnt - 1];
+		if (last->file_clus >= nclus) {
+			fileptr->cnt -= 1;
+		} else {
+			last->len = MIN(last->len, nclus - last->file_clus);
+			break;
 		}
-		file->pointer.valid = 1;
+	}
+	// 映射表已满时，未映射的簇仍有一部分保留，next_clus不变
+	if (fileptr->mapped >= nclus) {
+		fileptr->mapped = nclus;
+		fileptr->next_clus = FAT32_EOF;
+	}
+}
+
+// 文件刚打开时初始化文件的指针，映射表在访问时才沿FAT链构建
+void filepnt_init(Dirent *file) {
+	if (!file->pointer.valid) {
+		DirentPointer *fileptr = &file->pointer;
+		fileptr->extents = NULL;
+		fileptr->cnt = fileptr->cap = 0;
+		fileptr->mapped = 0;
+		// 文件的大小为0时first_clus为0，表示没有簇
+		fileptr->next_clus = file->first_clus;
+		fileptr->valid = 1;
 	}
 }
 
@@ -57,44 +141,58 @@ void filepnt_init(Dirent *file) {
 void filepnt_clear(Dirent *file) {
 	DirentPointer *fileptr = &file->pointer;
 	if (fileptr->valid) {
-		for (int i = 0; i < NDIRENT_SECPOINTER; i++) {
-			if (fileptr->second[i]) {
-				kvmFree((u64)fileptr->second[i]);
-			}
+		if (fileptr->extents != NULL) {
+			kfree(fileptr->extents);
 		}
-		if (fileptr->third) {
-			for (int i = 0; i < PAGE_SIZE / sizeof(long); i++) {
-				if (fileptr->third->ptr[i]) {
-					kvmFree((u64)fileptr->third->ptr[i]);
-				}
-			}
-			kvmFree((u64)fileptr->third);
+		memset(fileptr, 0, sizeof(DirentPointer));
+	}
+}
+
+/**
+ * @brief 返回文件簇链上第fileClusNo个簇的簇号，簇链不够长时返回0
+ * @note 簇链可能长于文件大小（fallocate以FALLOC_FL_KEEP_SIZE预留的簇）
+ */
+u32 filepnt_trygetclus(Dirent *file, u32 fileClusNo) {
+	filepnt_init(file);
+	if (fileClusNo >= file->pointer.mapped) {
+		filepnt_map_until(file, fileClusNo + 1);
+		if (fileClusNo >= file->pointer.mapped) {
+			return filepnt_walk(file, fileClusNo);
 		}
 	}
+	return filepnt_getclusbyno(file, fileClusNo);
 }
 
 /**
- * @brief 返回文件file第fileClusNo块簇的簇号
+ * @brief 返回文件file第fileClusNo块簇的簇号，在extent表中二分查找
  * @note 要求要查找的文件肯定有第fileClusNo个簇，否则会报错
  */
 u32 filepnt_getclusbyno(Dirent *file, int fileClusNo) {
-	u32 ind1 = fileClusNo / PAGE_NCLUSNO;
-	u32 ind2 = fileClusNo % PAGE_NCLUSNO;
 	DirentPointer *fileptr = &file->pointer;
+	filepnt_init(file);
+	if (fileClusNo >= fileptr->mapped) {
+		filepnt_map_until(file, fileClusNo + 1);
+		if (fileClusNo >= fileptr->mapped) {
+			// 映射表已满
+			u32 clus = filepnt_walk(file, fileClusNo);
+			assert(clus != 0); // 假设要查找的文件肯定有第fileClusNo个簇
+			return clus;
+		}
+	}
 
-	struct TwicePointer *twicep;
-	if (ind1 < NDIRENT_SECPOINTER) {
-		twicep = fileptr->second[ind1];
-	} else {
-		ind1 -= NDIRENT_SECPOINTER;
-		assert(ind1 < PAGE_SIZE / sizeof(long));
-		assert(fileptr->third != NULL);
-		twicep = fileptr->third->ptr[ind1];
+	// 找到最后一个file_clus <= fileClusNo的extent
+	u32 lo = 0, hi = fileptr->cnt;
+	while (hi - lo > 1) {
+		u32 mid = (lo + hi) / 2;
+		if (fileptr->extents[mid].file_clus <= fileClusNo) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
 	}
-	assert(twicep != NULL);
-	u32 ret = twicep->cluster[ind2];
-	assert(ret != 0); // 假设要查找的文件肯定有第fileClusNo个簇
-	return ret;
+	ClusExtent *ext = &fileptr->extents[lo];
+	assert(fileClusNo - ext->file_clus < ext->len);
+	return ext->disk_clus + (fileClusNo - ext->file_clus);
 }
 
 /**
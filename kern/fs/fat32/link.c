@@ -105,17 +105,20 @@ int rm_unused_file(struct Dirent *file) {
 	// 先递归删除子Dirent（由于存在意向锁，因此这样）
 	if (file->type == DIRENT_DIR) {
 		Dirent *tmp;
+		dget(file);
+		dirent_populate(file);
 		LIST_FOREACH (tmp, &file->child_list, dirent_link) {
 			rmfile(tmp);
 		}
+		dput(file);
 	}
-	LIST_REMOVE(file, dirent_link); // 从父亲的子Dirent列表删除
+	dirent_remove_child(file); // 从父亲的子Dirent列表删除
 
-	// 3. 释放其占用的Cluster
+	// 3. 释放其占用的Cluster（tmpfs文件释放其数据页）
 	file_shrink(file, 0);
 
-	// 4. 清空目录项
-	for (int i = 0; i < cnt; i++) {
+	// 4. 清空目录项（tmpfs没有磁盘上的目录项）
+	for (int i = 0; i < cnt && !IS_TMPFS(file->file_system); i++) {
 		panic_on(file_write(file->parent_dirent, 0, (u64)&data,
 				    file->parent_dir_off - i * DIR_SIZE, 1) < 0);
 	}
@@ -129,16 +132,20 @@ int rm_unused_file(struct Dirent *file) {
  */
 static int rmfile(struct Dirent *file) {
 	if (file->refcnt > 1) {
-		// 检查是否都是当前进程(TODO: 目前为线程)持有此文件，如果是，可以直接删除
-		int hold_by_cur = 1;
+		// 普通文件可以推迟到最后一次close时删除；目录的引用还包括其下所有被打开文件的路径引用，
+		// 推迟删除无法保证被执行，故仍返回EBUSY
+		int can_defer = file->type != DIRENT_DIR;
+#ifdef REFCNT_DEBUG
+		// 调试时可以精确判断是否都是当前进程持有此文件
 		for (int i = 0; i < file->holder_cnt; i++) {
 			if (file->holders[i].proc_index != get_proc_index(cpu_this()->cpu_running->td_proc)) {
-				hold_by_cur = 0;
+				can_defer = 0;
 				break;
 			}
 		}
+#endif
 
-		if (!hold_by_cur) {
+		if (!can_defer) {
 			warn("other process uses file %s! refcnt = %d\n", file->name, file->refcnt);
 
 #ifdef REFCNT_DEBUG
@@ -149,8 +156,8 @@ static int rmfile(struct Dirent *file) {
 
 			return -EBUSY; // in use
 		} else {
-			// 自己持有的
-			warn("file %s is hold by current process(refcnt = %d), can't remove, will remove on close, "
+			// 仍被打开的普通文件
+			warn("file %s is still in use(refcnt = %d), can't remove, will remove on close, "
 			     "continue!\n",
 			     file->name, file->refcnt);
 			// 因为在rm之前也获取过一次文件的引用
@@ -246,6 +253,8 @@ static int mvfile(Dirent *oldfile, Dirent *newDir, char *newPath) {
 		// 2. 遍历oldFile目录下的文件，递归，如果中途有错误，就立刻返回
 		// 名称newPath由kmalloc分配，记得释放（之所以不在栈上是为了防止溢出）
 		Dirent *child;
+		dget(oldfile);
+		dirent_populate(oldfile);
 		LIST_FOREACH (child, &oldfile->child_list, dirent_link) {
 			char *new_child_path = kmalloc(MAX_NAME_LEN);
 			strncpy(new_child_path, newPath, MAX_NAME_LEN);
@@ -258,9 +267,11 @@ static int mvfile(Dirent *oldfile, Dirent *newDir, char *newPath) {
 
 			if (ret < 0) {
 				warn("mvfile: mv child %s failed! (partially move)\n", child->name);
+				dput(oldfile);
 				return ret;
 			}
 		}
+		dput(oldfile);
 
 		// 3. 删除旧的目录
 		return rmfile(oldfile);
@@ -1,7 +1,10 @@
+#include <dev/ramdisk.h>
+#include <fs/cluster.h>
 #include <fs/dirent.h>
 #include <fs/fat32.h>
 #include <fs/file_device.h>
 #include <fs/fs.h>
+#include <fs/tmpfs.h>
 #include <fs/vfs.h>
 #include <lib/error.h>
 #include <lib/log.h>
@@ -12,7 +15,9 @@
 extern mutex_t mtx_file;
 
 // mount之后，目录中原有的文件将被暂时取代为挂载的文件系统内的内容，umount时会重新出现
-int mount_fs(char *special, Dirent *baseDir, char *dirPath) {
+// fstype为"tmpfs"时挂载内存文件系统并忽略special，否则将special作为FAT32镜像挂载
+// special为"/dev/ram0"时挂载内存块设备上的FAT32文件系统
+int mount_fs(char *special, Dirent *baseDir, char *dirPath, char *fstype) {
 	mtx_lock_sleep(&mtx_file);
 
 	// 1. 寻找mount的目录
@@ -33,11 +38,23 @@ int mount_fs(char *special, Dirent *baseDir, char *dirPath) {
 		return -ENOTDIR;
 	}
 
+	bool tmpfs = fstype != NULL && strncmp(fstype, "tmpfs", 6) == 0;
+
 	// 2. 寻找mount的文件
 	// 特判是否是设备（deprecated）
 	Dirent *image;
-	if (strncmp(special, "/dev/vda2", 10) == 0) {
+	int devno = DEV_DISK;
+	if (tmpfs || strncmp(special, "/dev/vda2", 10) == 0) {
 		image = NULL;
+	} else if (strncmp(special, "/dev/ram0", 10) == 0) {
+		if (ramdiskSize == 0) {
+			warn("ramdisk is not present!\n");
+			file_close(dir);
+			mtx_unlock_sleep(&mtx_file);
+			return -ENXIO;
+		}
+		image = NULL;
+		devno = DEV_RAMDISK;
 	} else {
 		ret = getFile(baseDir, special, &image);
 		if (ret < 0) {
@@ -52,9 +69,17 @@ int mount_fs(char *special, Dirent *baseDir, char *dirPath) {
 	FileSystem *fs;
 	allocFs(&fs);
 	fs->image = image;
-	fs->deviceNumber = 0;
+	fs->deviceNumber = devno;
 	fs->mountPoint = dir;
-	fat32_init(fs);
+	if (tmpfs) {
+		tmpfs_init(fs);
+	} else {
+		if (image != NULL) {
+			image->loop_busy++;
+			loopMapInit(fs);
+		}
+		fat32_init(fs);
+	}
 
 	// 4. 将fs挂载到dir上
 	dir->head = fs;
@@ -83,6 +108,13 @@ int umount_fs(char *dirPath, Dirent *baseDir) {
 		mtx_unlock_sleep(&mtx_file);
 		return -EINVAL; // 传入的不是挂载点
 	}
+	// tmpfs的内容在卸载时随之释放，不能卸载仍有文件被引用的tmpfs
+	if (IS_TMPFS(dir->file_system) && tmpfs_busy(dir->file_system)) {
+		warn("tmpfs on %s is busy!\n", dirPath);
+		file_close(dir);
+		mtx_unlock_sleep(&mtx_file);
+		return -EBUSY;
+	}
 	mntPoint->head = NULL;
 
 	// 3. 寻找fs
@@ -94,9 +126,17 @@ int umount_fs(char *dirPath, Dirent *baseDir) {
 	}
 
 	// 4. 关闭fs镜像（如果有）和挂载点，并卸载fs
-	if (fs->image != NULL) {
-		file_close(fs->image);
+	if (IS_TMPFS(fs)) {
 		file_close(dir);
+		tmpfs_destroy(fs);
+	} else {
+		if (fs->image != NULL) {
+			fs->image->loop_busy--;
+			file_close(fs->image);
+			file_close(dir);
+		}
+		clusterDestroy(fs);
+		loopMapDestroy(fs);
 	}
 	deAllocFs(fs);
 
@@ -0,0 +1,383 @@
+#include <fs/epoll.h>
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/poll.h>
+#include <fs/thread_fs.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/cpu.h>
+#include <proc/interface.h>
+#include <proc/thread.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+#include <dev/timer.h>
+
+/**
+ * epoll：关注的fd挂在其对象（管道、socket）的等待队列上，状态变化时回调把该项加入就绪链表
+ * epoll_pwait只检查就绪链表中的项，空闲时睡眠在epoll自身的等待队列上，不再轮询所有fd
+ * 水平触发的项报告后重新放回就绪链表，下次等待时再检查；边沿触发的项只在被唤醒后报告一次
+ * 关注的fd被关闭或替换后，该项在下次检查时被移除（而不是在内核fd释放时）
+ */
+
+extern mutex_t mtx_poll;
+
+static int fd_epoll_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_epoll_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_epoll_close(struct Fd *fd);
+static int fd_epoll_stat(struct Fd *fd, u64 pkStat);
+
+struct FdDev fd_dev_epoll = {
+    .dev_id = 'e',
+    .dev_name = "epoll",
+    .dev_read = fd_epoll_read,
+    .dev_write = fd_epoll_write,
+    .dev_close = fd_epoll_close,
+    .dev_stat = fd_epoll_stat,
+};
+
+// 用户可以设置的事件，其余位（EPOLLET等）只影响报告方式
+#define EPOLL_EVENT_MASK (EPOLLIN | EPOLLOUT)
+
+static inline int epoll_hash(int ufd) {
+	return ufd % EPOLL_HASH_SIZE;
+}
+
+static Epoll *get_epoll_by_fd(int epfd) {
+	Fd *kfd = get_kfd_by_fd(epfd);
+	if (kfd == NULL || kfd->type != dev_epoll) {
+		return NULL;
+	}
+	return kfd->epoll;
+}
+
+/**
+ * @brief 把项加入就绪链表，并唤醒等待该epoll的线程。需持有mtx_poll
+ */
+static void epoll_item_ready(EpollItem *item) {
+	if (item->ei_rdlist) {
+		return;
+	}
+	item->ei_rdlist = true;
+	TAILQ_INSERT_TAIL(&item->ei_ep->ep_rdlist, item, ei_rdlink);
+	// 只在项新加入时级联唤醒，互相嵌套的epoll因此不会无限递归
+	poll_wakeup_locked(&item->ei_ep->ep_pollq);
+}
+
+static void epoll_item_wake(PollEntry *e) {
+	epoll_item_ready(e->pe_priv);
+}
+
+/**
+ * @brief 项添加时的fd是否仍是用户的ufd。仅比较槽位不够：关闭后重新打开可能得到同一个槽位
+ */
+static bool epoll_item_alive(EpollItem *item, Fd *kfd) {
+	return kfd == item->ei_kfd && kfd->gen == item->ei_gen;
+}
+
+static EpollItem *epoll_find(Epoll *ep, int ufd) {
+	EpollItem *item;
+	LIST_FOREACH (item, &ep->ep_hash[epoll_hash(ufd)], ei_hash) {
+		if (item->ei_ufd == ufd) {
+			return item;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * @brief 移除一项，需持有ep_lock
+ */
+static void epoll_remove(Epoll *ep, EpollItem *item) {
+	for (int i = 0; i < item->ei_nentry; i++) {
+		poll_entry_del(&item->ei_entries[i]);
+	}
+
+	mtx_lock(&mtx_poll);
+	if (item->ei_rdlist) {
+		TAILQ_REMOVE(&ep->ep_rdlist, item, ei_rdlink);
+		item->ei_rdlist = false;
+	}
+	mtx_unlock(&mtx_poll);
+
+	if (item->ei_need_poll) {
+		ep->ep_need_poll--;
+	}
+	LIST_REMOVE(item, ei_hash);
+	kfree(item);
+}
+
+int epoll_create1(int flags) {
+	if (flags & ~EPOLL_CLOEXEC) {
+		return -EINVAL;
+	}
+
+	Epoll *ep = kmalloc(sizeof(Epoll));
+	if (ep == NULL) {
+		return -ENOMEM;
+	}
+	mtx_init(&ep->ep_lock, "epoll", false, MTX_SLEEP);
+	for (int i = 0; i < EPOLL_HASH_SIZE; i++) {
+		LIST_INIT(&ep->ep_hash[i]);
+	}
+	ep->ep_need_poll = 0;
+	TAILQ_INIT(&ep->ep_rdlist);
+	poll_queue_init(&ep->ep_pollq);
+
+	int ufd = alloc_ufd();
+	if (ufd < 0) {
+		kfree(ep);
+		return ufd;
+	}
+	int kfd = fdAlloc();
+	if (kfd < 0) {
+		free_ufd(ufd);
+		kfree(ep);
+		return kfd;
+	}
+	fds[kfd].type = dev_epoll;
+	fds[kfd].flags = O_RDWR | ((flags & EPOLL_CLOEXEC) ? __O_CLOEXEC : 0);
+	fds[kfd].fd_dev = &fd_dev_epoll;
+	fds[kfd].epoll = ep;
+	cur_proc_fs_struct()->fdList[ufd] = kfd;
+	return ufd;
+}
+
+int epoll_ctl(int epfd, int op, int fd, u64 event) {
+	Epoll *ep = get_epoll_by_fd(epfd);
+	if (ep == NULL) {
+		return -EBADF;
+	}
+	Fd *kfd = get_kfd_by_fd(fd);
+	if (kfd == NULL) {
+		return -EBADF;
+	}
+	if (kfd->epoll == ep) {
+		return -EINVAL;
+	}
+
+	struct epoll_event ev;
+	if (op != EPOLL_CTL_DEL) {
+		copyIn(event, &ev, sizeof(ev));
+	}
+
+	mtx_lock_sleep(&ep->ep_lock);
+	EpollItem *item = epoll_find(ep, fd);
+	// fd被关闭后重新分配的同号fd不是原来的项
+	if (item != NULL && !epoll_item_alive(item, kfd)) {
+		epoll_remove(ep, item);
+		item = NULL;
+	}
+
+	int ret = 0;
+	switch (op) {
+	case EPOLL_CTL_ADD:
+		if (item != NULL) {
+			ret = -EEXIST;
+			break;
+		}
+		item = kmalloc(sizeof(EpollItem));
+		if (item == NULL) {
+			ret = -ENOMEM;
+			break;
+		}
+		memset(item, 0, sizeof(EpollItem));
+		item->ei_ep = ep;
+		item->ei_ufd = fd;
+		item->ei_kfd = kfd;
+		item->ei_gen = kfd->gen;
+		item->ei_events = ev.events;
+		item->ei_data = ev.data;
+		LIST_INSERT_HEAD(&ep->ep_hash[epoll_hash(fd)], item, ei_hash);
+
+		PollQueue *qs[POLL_MAX_QUEUE];
+		int n = fd_poll_queues(kfd, qs);
+		if (n < 0) {
+			item->ei_need_poll = true;
+			ep->ep_need_poll++;
+			n = 0;
+		}
+		for (int i = 0; i < n; i++) {
+			poll_entry_add(qs[i], &item->ei_entries[i], epoll_item_wake, item);
+		}
+		item->ei_nentry = n;
+
+		// fd可能已经就绪，先放入就绪链表检查一次
+		mtx_lock(&mtx_poll);
+		epoll_item_ready(item);
+		mtx_unlock(&mtx_poll);
+		break;
+	case EPOLL_CTL_MOD:
+		if (item == NULL) {
+			ret = -ENOENT;
+			break;
+		}
+		item->ei_events = ev.events;
+		item->ei_data = ev.data;
+		mtx_lock(&mtx_poll);
+		epoll_item_ready(item);
+		mtx_unlock(&mtx_poll);
+		break;
+	case EPOLL_CTL_DEL:
+		if (item == NULL) {
+			ret = -ENOENT;
+			break;
+		}
+		epoll_remove(ep, item);
+		break;
+	default:
+		ret = -EINVAL;
+		break;
+	}
+	mtx_unlock_sleep(&ep->ep_lock);
+	return ret;
+}
+
+/**
+ * @brief 检查就绪链表中的项，把就绪的事件写入用户的events数组
+ * @note 需持有ep_lock
+ * @return 写入的事件数
+ */
+static int epoll_collect(Epoll *ep, u64 events, int maxevents) {
+	int n = 0;
+
+	// 状态变化无法通知的项每次都要检查
+	if (ep->ep_need_poll > 0) {
+		EpollItem *item;
+		mtx_lock(&mtx_poll);
+		for (int i = 0; i < EPOLL_HASH_SIZE; i++) {
+			LIST_FOREACH (item, &ep->ep_hash[i], ei_hash) {
+				if (item->ei_need_poll) {
+					epoll_item_ready(item);
+				}
+			}
+		}
+		mtx_unlock(&mtx_poll);
+	}
+
+	// 只处理进入时已在链表中的项，重新放回的水平触发项留到下次等待
+	mtx_lock(&mtx_poll);
+	int todo = 0;
+	EpollItem *item;
+	TAILQ_FOREACH (item, &ep->ep_rdlist, ei_rdlink) {
+		todo++;
+	}
+	mtx_unlock(&mtx_poll);
+
+	while (todo-- > 0 && n < maxevents) {
+		mtx_lock(&mtx_poll);
+		item = TAILQ_FIRST(&ep->ep_rdlist);
+		if (item == NULL) {
+			mtx_unlock(&mtx_poll);
+			break;
+		}
+		TAILQ_REMOVE(&ep->ep_rdlist, item, ei_rdlink);
+		item->ei_rdlist = false;
+		mtx_unlock(&mtx_poll);
+
+		// 用户已经关闭或替换了fd
+		Fd *kfd = get_kfd_by_fd(item->ei_ufd);
+		if (kfd == NULL || !epoll_item_alive(item, kfd)) {
+			epoll_remove(ep, item);
+			continue;
+		}
+
+		u32 revents = fd_poll(kfd, item->ei_events & EPOLL_EVENT_MASK);
+		if (revents == 0) {
+			// 未就绪的项留在各个等待队列上，状态变化时会被重新加入
+			continue;
+		}
+
+		struct epoll_event ev = {.events = revents, .data = item->ei_data};
+		copyOut(events + n * sizeof(ev), &ev, sizeof(ev));
+		n++;
+
+		if (item->ei_events & EPOLLONESHOT) {
+			// 在EPOLL_CTL_MOD重新启用之前不再报告
+			item->ei_events &= ~EPOLL_EVENT_MASK;
+		} else if (!(item->ei_events & EPOLLET)) {
+			mtx_lock(&mtx_poll);
+			epoll_item_ready(item);
+			mtx_unlock(&mtx_poll);
+		}
+	}
+	return n;
+}
+
+/**
+ * @param timeout 毫秒，-1表示不限时
+ * @note 暂不支持sigmask
+ */
+int epoll_pwait(int epfd, u64 events, int maxevents, int timeout, u64 sigmask) {
+	Epoll *ep = get_epoll_by_fd(epfd);
+	if (ep == NULL) {
+		return -EBADF;
+	}
+	if (maxevents <= 0 || maxevents > EPOLL_MAX_EVENTS) {
+		return -EINVAL;
+	}
+
+	thread_t *td = cpu_this()->cpu_running;
+	u64 deadline = timeout > 0 ? time_mono_us() + timeout * 1000ul : 0;
+	PollWaiter w;
+	int n;
+
+	poll_waiter_init(&w, 1);
+	poll_waiter_add_queue(&w, &ep->ep_pollq);
+	while (1) {
+		mtx_lock_sleep(&ep->ep_lock);
+		n = epoll_collect(ep, events, maxevents);
+		w.pw_need_poll = ep->ep_need_poll > 0;
+		mtx_unlock_sleep(&ep->ep_lock);
+
+		if (n > 0 || timeout == 0 || td->td_killed) {
+			break;
+		}
+		if (poll_waiter_wait(&w, deadline) == -ETIMEDOUT) {
+			timeout = 0; // 超时前再收集一次
+		}
+	}
+	poll_waiter_destroy(&w);
+	return n;
+}
+
+/**
+ * @brief epoll是否有可能就绪的项（嵌套在poll或其他epoll中时使用）
+ */
+int epoll_check(Epoll *ep) {
+	mtx_lock(&mtx_poll);
+	int ret = !TAILQ_EMPTY(&ep->ep_rdlist) || ep->ep_need_poll > 0;
+	mtx_unlock(&mtx_poll);
+	return ret;
+}
+
+static int fd_epoll_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+static int fd_epoll_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+static int fd_epoll_close(struct Fd *fd) {
+	Epoll *ep = fd->epoll;
+
+	mtx_lock_sleep(&ep->ep_lock);
+	for (int i = 0; i < EPOLL_HASH_SIZE; i++) {
+		while (!LIST_EMPTY(&ep->ep_hash[i])) {
+			epoll_remove(ep, LIST_FIRST(&ep->ep_hash[i]));
+		}
+	}
+	mtx_unlock_sleep(&ep->ep_lock);
+
+	poll_queue_destroy(&ep->ep_pollq);
+	kfree(ep);
+	fd->epoll = NULL;
+	return 0;
+}
+
+static int fd_epoll_stat(struct Fd *fd, u64 pkStat) {
+	return 0;
+}
@@ -0,0 +1,195 @@
+#include <fs/eventfd.h>
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/poll.h>
+#include <fs/thread_fs.h>
+#include <lib/log.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/cpu.h>
+#include <proc/interface.h>
+#include <proc/sleep.h>
+#include <proc/thread.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+
+/**
+ * eventfd：内核维护一个64位计数器，write加到计数器上，read取走计数器（信号量模式下每次取1）
+ * 读者在计数器为0时等待，写者在计数器将要溢出时等待
+ */
+
+static int fd_eventfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_eventfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_eventfd_kread(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_eventfd_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_eventfd_close(struct Fd *fd);
+static int fd_eventfd_stat(struct Fd *fd, u64 pkStat);
+
+struct FdDev fd_dev_eventfd = {
+    .dev_id = 'v',
+    .dev_name = "eventfd",
+    .dev_read = fd_eventfd_read,
+    .dev_write = fd_eventfd_write,
+    .dev_kread = fd_eventfd_kread,
+    .dev_kwrite = fd_eventfd_kwrite,
+    .dev_close = fd_eventfd_close,
+    .dev_stat = fd_eventfd_stat,
+};
+
+int eventfd2(unsigned int initval, int flags) {
+	if (flags & ~(EFD_SEMAPHORE | EFD_NONBLOCK | EFD_CLOEXEC)) {
+		return -EINVAL;
+	}
+
+	EventFd *efd = kmalloc(sizeof(EventFd));
+	if (efd == NULL) {
+		return -ENOMEM;
+	}
+	mtx_init(&efd->lock, "eventfd", false, MTX_SPIN);
+	efd->count = initval;
+	efd->semaphore = (flags & EFD_SEMAPHORE) != 0;
+	poll_queue_init(&efd->pollq);
+
+	int ufd = alloc_ufd();
+	if (ufd < 0) {
+		kfree(efd);
+		return ufd;
+	}
+	int kfd = fdAlloc();
+	if (kfd < 0) {
+		free_ufd(ufd);
+		kfree(efd);
+		return kfd;
+	}
+	fds[kfd].type = dev_eventfd;
+	fds[kfd].flags = O_RDWR | (flags & EFD_NONBLOCK ? O_NONBLOCK : 0) |
+			 (flags & EFD_CLOEXEC ? __O_CLOEXEC : 0);
+	fds[kfd].fd_dev = &fd_dev_eventfd;
+	fds[kfd].eventfd = efd;
+	cur_proc_fs_struct()->fdList[ufd] = kfd;
+	return ufd;
+}
+
+/**
+ * @brief 读取计数器。计数器为0时等待写者，非阻塞时返回-EAGAIN
+ * @note 传入的fd需要带锁（睡眠锁），等待期间暂时放掉
+ */
+static int eventfd_read(struct Fd *fd, int user, u64 buf, u64 n) {
+	if (n < sizeof(u64)) {
+		return -EINVAL;
+	}
+	EventFd *efd = fd->eventfd;
+	thread_t *td = cpu_this()->cpu_running;
+	bool nonblock = (fd->flags & O_NONBLOCK) != 0;
+	mtx_unlock_sleep(&fd->lock);
+
+	mtx_lock(&efd->lock);
+	while (efd->count == 0 && !nonblock && !td->td_killed) {
+		sleep(&efd->count, &efd->lock, "wait for eventfd writer");
+	}
+	if (efd->count == 0) {
+		mtx_unlock(&efd->lock);
+		mtx_lock_sleep(&fd->lock);
+		return nonblock ? -EAGAIN : -EINTR;
+	}
+
+	u64 val = efd->semaphore ? 1 : efd->count;
+	efd->count -= val;
+
+	// 计数器减小后，可能有写者可以继续
+	wakeup(&efd->count);
+	poll_wakeup(&efd->pollq);
+	mtx_unlock(&efd->lock);
+	mtx_lock_sleep(&fd->lock);
+
+	copyOutEither(user, buf, &val, sizeof(u64));
+	return sizeof(u64);
+}
+
+/**
+ * @brief 把写入的值加到计数器上。计数器将超过EVENTFD_MAX时等待读者，非阻塞时返回-EAGAIN
+ * @note 传入的fd需要带锁（睡眠锁），等待期间暂时放掉
+ */
+static int eventfd_write(struct Fd *fd, int user, u64 buf, u64 n) {
+	if (n < sizeof(u64)) {
+		return -EINVAL;
+	}
+	u64 val;
+	copyInEither(user, buf, &val, sizeof(u64));
+	if (val > EVENTFD_MAX) {
+		return -EINVAL;
+	}
+
+	EventFd *efd = fd->eventfd;
+	thread_t *td = cpu_this()->cpu_running;
+	bool nonblock = (fd->flags & O_NONBLOCK) != 0;
+	mtx_unlock_sleep(&fd->lock);
+
+	mtx_lock(&efd->lock);
+	while (EVENTFD_MAX - efd->count < val && !nonblock && !td->td_killed) {
+		sleep(&efd->count, &efd->lock, "wait for eventfd reader");
+	}
+	if (EVENTFD_MAX - efd->count < val) {
+		mtx_unlock(&efd->lock);
+		mtx_lock_sleep(&fd->lock);
+		return nonblock ? -EAGAIN : -EINTR;
+	}
+
+	efd->count += val;
+	if (val != 0) {
+		wakeup(&efd->count);
+		poll_wakeup(&efd->pollq);
+	}
+	mtx_unlock(&efd->lock);
+	mtx_lock_sleep(&fd->lock);
+	return sizeof(u64);
+}
+
+static int fd_eventfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return eventfd_read(fd, 1, buf, n);
+}
+
+static int fd_eventfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return eventfd_write(fd, 1, buf, n);
+}
+
+static int fd_eventfd_kread(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return eventfd_read(fd, 0, buf, n);
+}
+
+static int fd_eventfd_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return eventfd_write(fd, 0, buf, n);
+}
+
+static int fd_eventfd_close(struct Fd *fd) {
+	EventFd *efd = fd->eventfd;
+	poll_queue_destroy(&efd->pollq);
+	kfree(efd);
+	fd->eventfd = NULL;
+	return 0;
+}
+
+static int fd_eventfd_stat(struct Fd *fd, u64 pkStat) {
+	return 0;
+}
+
+/**
+ * @brief 计数器大于0时可读
+ */
+int eventfd_check_read(EventFd *efd) {
+	mtx_lock(&efd->lock);
+	int ret = efd->count > 0;
+	mtx_unlock(&efd->lock);
+	return ret;
+}
+
+/**
+ * @brief 至少还能写入1时可写
+ */
+int eventfd_check_write(EventFd *efd) {
+	mtx_lock(&efd->lock);
+	int ret = efd->count < EVENTFD_MAX;
+	mtx_unlock(&efd->lock);
+	return ret;
+}
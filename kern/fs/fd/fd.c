@@ -3,6 +3,9 @@
 #include <fs/fd_device.h>
 #include <fs/file.h>
 #include <fs/pipe.h>
+#include <fs/poll.h>
+#include <fs/tmpfs.h>
+#include <fs/timerfd.h>
 #include <fs/vfs.h>
 #include <lib/log.h>
 #include <lib/string.h>
@@ -35,10 +38,15 @@ void fd_init() {
 	extern mutex_t mtx_file_load;
 	mtx_init(&mtx_file_load, "kload", 0, MTX_SLEEP);
 	mtx_init(&mtx_fd, "sys_fdtable", 1, MTX_SPIN | MTX_RECURSE);
+	poll_init();
+	timerfd_init();
 }
 
 void freeFd(uint i);
 
+// 每次分配内核fd时递增，用于区分先后占用同一槽位的不同fd（mtx_fd保护）
+static u64 fdGen;
+
 /**
  * @brief 分配一个文件描述符，保证文件描述符的内容是清空过的
  * @note 此为全局操作，需要获取fd锁
@@ -55,6 +63,7 @@ int fdAlloc() {
 
 			memset(&fds[i], 0, sizeof(struct Fd));
 			fds[i].refcnt = 1;
+			fds[i].gen = ++fdGen;
 			mtx_init(&fds[i].lock, "fd_lock", 1, MTX_SLEEP | MTX_RECURSE);
 
 			mtx_unlock(&mtx_fd);
@@ -164,6 +173,11 @@ void freeFd(uint i) {
 		fds[i].dirent = NULL;
 		fds[i].pipe = NULL;
 		fds[i].socket = NULL;
+		fds[i].uring = NULL;
+		fds[i].epoll = NULL;
+		fds[i].eventfd = NULL;
+		fds[i].timerfd = NULL;
+		fds[i].signalfd = NULL;
 		fds[i].type = 0;
 		fds[i].offset = 0;
 		fds[i].flags = 0;
@@ -407,52 +421,89 @@ size_t writev(int fd, const struct iovec *iov, int iovcnt) {
 }
 
 
+// copy_file_range每次持有两个文件的锁复制的最大字节数，超过的部分分多次复制
+#define COPY_RANGE_CHUNK (1 << 20)
+
+/**
+ * @brief 在两个普通文件之间复制数据，数据在内核的块缓存中逐簇复制，不经过用户态
+ * @param off_in,off_out 用户地址。为NULL时使用并推进fd的偏移，否则使用并推进*off，不改变fd的偏移
+ */
 size_t copy_file_range(int fd_in, off_t *off_in,
                         int fd_out, off_t *off_out,
                         size_t len, unsigned int flags) {
+	Fd *in, *out;
 	off_t koff_in, koff_out;
-	if (off_in != NULL) copyIn((u64)off_in, &koff_in, sizeof(off_t));
-	if (off_out != NULL) copyIn((u64)off_out, &koff_out, sizeof(off_t));
-	u64 r;
+	size_t total = 0;
 
-	if (ptLookup(cur_proc_pt(), U_KTEMPSPACE) == 0) {
-		// 为用户态分配临时空间
-		sys_map(U_KTEMPSPACE, 64 * PAGE_SIZE, PTE_R | PTE_W | PTE_U);
+	if (flags != 0) {
+		return -EINVAL;
+	}
+	if ((in = get_kfd_by_fd(fd_in)) == NULL || (out = get_kfd_by_fd(fd_out)) == NULL) {
+		return -EBADF;
+	}
+	if ((in->flags & O_ACCMODE) == O_WRONLY || (out->flags & O_ACCMODE) == O_RDONLY ||
+	    (out->flags & O_APPEND)) {
+		return -EBADF;
+	}
+	if (in->type != dev_file || out->type != dev_file) {
+		return -EINVAL;
 	}
 
-	// 读取
-	if (off_in == NULL) {
-		// 维护偏移
-		r = read(fd_in, U_KTEMPSPACE, len);
+	if (off_in != NULL) {
+		copyIn((u64)off_in, &koff_in, sizeof(off_t));
 	} else {
-		r = pread64(fd_in, U_KTEMPSPACE, len, koff_in);
-		koff_in += r;
+		koff_in = in->offset;
 	}
-
-	// 处理读取错误
-	if (r <= 0) {
-		return r;
+	if (off_out != NULL) {
+		copyIn((u64)off_out, &koff_out, sizeof(off_t));
+	} else {
+		koff_out = out->offset;
+	}
+	if (koff_in < 0 || koff_out < 0) {
+		return -EINVAL;
+	}
+	// 文件大小以32位记录
+	if (koff_out + len > 0x7fffffff) {
+		if (koff_out >= 0x7fffffff) {
+			return -EFBIG;
+		}
+		len = 0x7fffffff - koff_out;
+	}
+	// 同一文件内的两个范围不能重叠
+	if (in->dirent == out->dirent && koff_in < koff_out + len && koff_out < koff_in + len) {
+		return -EINVAL;
 	}
 
-	len = r; // 约束复制量
+	while (total < len) {
+		int r = file_copy_range(in->dirent, koff_in + total, out->dirent, koff_out + total,
+					MIN(len - total, COPY_RANGE_CHUNK));
+		if (r <= 0) {
+			// 目标文件系统空间不足（tmpfs）且尚未复制任何数据时返回错误
+			if (r < 0 && total == 0) {
+				return r;
+			}
+			break;
+		}
+		total += r;
+	}
 
-	// 写入
-	if (off_out == NULL) {
-		// 维护偏移
-		r = write(fd_out, U_KTEMPSPACE, len);
+	if (off_in != NULL) {
+		koff_in += total;
+		copyOut((u64)off_in, &koff_in, sizeof(off_t));
 	} else {
-		r = pwrite64(fd_out, U_KTEMPSPACE, len, koff_out);
-		koff_out += r;
+		mtx_lock_sleep(&in->lock);
+		in->offset = koff_in + total;
+		mtx_unlock_sleep(&in->lock);
 	}
-
-	// 处理写入错误
-	if (r < 0) {
-		return r;
+	if (off_out != NULL) {
+		koff_out += total;
+		copyOut((u64)off_out, &koff_out, sizeof(off_t));
+	} else {
+		mtx_lock_sleep(&out->lock);
+		out->offset = koff_out + total;
+		mtx_unlock_sleep(&out->lock);
 	}
-
-	if (off_in != NULL) copyOut((u64)off_in, &koff_in, sizeof(off_t));
-	if (off_out != NULL) copyOut((u64)off_out, &koff_out, sizeof(off_t));
-	return len;
+	return total;
 }
 
 int dup(int fd) {
@@ -574,7 +625,14 @@ int getdents64(int fd, u64 buf, int len) {
 	direntUser->d_ino = 0;
 	direntUser->d_reclen = DIRENT_USER_SIZE;
 	direntUser->d_type = dev_file;
-	ret = dirGetDentFrom(dir, fds[kernFd].offset, &file, &offset, NULL);
+	if (IS_TMPFS(dir->file_system)) {
+		// tmpfs目录没有磁盘上的目录项，偏移即子项的序号
+		ret = tmpfs_getdent(dir, fds[kernFd].offset, direntUser->d_name, DIRENT_NAME_LENGTH,
+				    &offset);
+		file = NULL;
+	} else {
+		ret = dirGetDentFrom(dir, fds[kernFd].offset, &file, &offset, NULL);
+	}
 	direntUser->d_off = offset;
 	fds[kernFd].offset = offset;
 
@@ -586,9 +644,11 @@ int getdents64(int fd, u64 buf, int len) {
 		kfree(direntUser);
 		return 0;
 	} else {
-		strncpy(direntUser->d_name, file->name, DIRENT_NAME_LENGTH);
+		if (file != NULL) {
+			strncpy(direntUser->d_name, file->name, DIRENT_NAME_LENGTH);
+			dirent_dealloc(file);
+		}
 		copyOut(buf, direntUser, DIRENT_USER_SIZE);
-		dirent_dealloc(file);
 		kfree(direntUser);
 		return DIRENT_USER_SIZE;
 	}
@@ -18,6 +18,8 @@
 
 static int fd_file_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
 static int fd_file_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_file_kread(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_file_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset);
 int fd_file_close(struct Fd *fd);
 int fd_file_stat(struct Fd *fd, u64 pkStat);
 
@@ -28,6 +30,8 @@ struct FdDev fd_dev_file = {
     .dev_name = "file",
     .dev_read = fd_file_read,
     .dev_write = fd_file_write,
+    .dev_kread = fd_file_kread,
+    .dev_kwrite = fd_file_kwrite,
     .dev_close = fd_file_close,
     .dev_stat = fd_file_stat,
 };
@@ -35,7 +39,6 @@ struct FdDev fd_dev_file = {
 // 注意：设备的相关读写均不需要对fd加锁
 // Fd的锁应当由fd.c维护
 
-extern mutex_t mtx_file;
 
 int openat(int fd, u64 filename, int flags, mode_t mode) {
 	log(LEVEL_GLOBAL, "openat: fd = %d, filename = %lx, flags = %lx, mode = %d\n", fd, filename,
@@ -107,8 +110,11 @@ int openat(int fd, u64 filename, int flags, mode_t mode) {
 		}
 	}
 
-	if (flags & O_TRUNC) {
-		file_shrink(fileDirent, 0);
+	if ((flags & O_TRUNC) && (r = file_shrink(fileDirent, 0)) < 0) {
+		file_close(fileDirent);
+		free_ufd(userFd);
+		freeFd(kernFd);
+		return r;
 	}
 
 	fds[kernFd].dirent = fileDirent;
@@ -119,9 +125,9 @@ int openat(int fd, u64 filename, int flags, mode_t mode) {
 	fds[kernFd].fd_dev = &fd_dev_file; // 设置dev
 
 	if (flags & O_APPEND) {
-		mtx_lock_sleep(&mtx_file);
+		mtx_lock_sleep(&fileDirent->lock);
 		fds[kernFd].offset = fileDirent->file_size;
-		mtx_unlock_sleep(&mtx_file);
+		mtx_unlock_sleep(&fileDirent->lock);
 	} else {
 		fds[kernFd].offset = 0;
 	}
@@ -130,28 +136,139 @@ int openat(int fd, u64 filename, int flags, mode_t mode) {
 	return userFd;
 }
 
-// 读一个文件，返回读取的字节数
-static int fd_file_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+/**
+ * @brief 根据本次读的位置更新fd的预读状态，检测到顺序读时异步预读后续的簇
+ * @note 预读窗口从RA_MIN_CLUS开始，每次顺序读翻倍直至RA_MAX_CLUS；随机读则重置窗口
+ */
+static void fd_file_readahead(struct Fd *fd, u64 offset, u64 n) {
 	Dirent *dirent = fd->dirent;
-	// 向抽象的文件设备写入内容
-	n = dirent->dev->dev_read(dirent, 1, buf, offset, n);
-	if (n < 0) {
-		warn("file read num is below zero\n");
-		return -1;
+	FileRa *ra = &fd->ra;
+	extern struct FileDev file_dev_file;
+
+	if (n == 0 || dirent->dev != &file_dev_file || ra->advice == POSIX_FADV_RANDOM ||
+	    offset >= dirent->file_size) {
+		return;
+	}
+
+	if (offset != ra->next_off && ra->advice != POSIX_FADV_SEQUENTIAL) {
+		// 随机读，不预读
+		ra->window = 0;
+		ra->ra_end = 0;
+		ra->next_off = offset + n;
+		return;
+	}
+	ra->next_off = offset + n;
+	if (ra->window == 0) {
+		ra->window = ra->advice == POSIX_FADV_SEQUENTIAL ? RA_MAX_CLUS : RA_MIN_CLUS;
+	} else {
+		ra->window = MIN(ra->window * 2, RA_MAX_CLUS);
+	}
+
+	u32 clusSize = CLUS_SIZE(dirent->file_system);
+	u32 first = offset / clusSize;
+	u32 last = (MIN(offset + n, dirent->file_size) - 1) / clusSize;
+
+	// 已预读的部分还剩超过半个窗口时，不必发起新的预读
+	if (ra->ra_end > first && ra->ra_end > last + ra->window / 2) {
+		return;
 	}
-	fd->offset = offset + n;
-	return n;
+
+	// 本次要读的簇也一并提交，使它们能在设备上并行读取
+	u32 start = MAX(ra->ra_end, first);
+	u32 target = last + 1 + ra->window;
+	file_readahead(dirent, start, target - start);
+	ra->ra_end = target;
 }
 
-static int fd_file_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+/**
+ * @brief 处理posix_fadvise和readahead的提示
+ */
+int fd_file_advise(struct Fd *fd, u64 offset, u64 len, int advice) {
+	Dirent *dirent = fd->dirent;
+	extern struct FileDev file_dev_file;
+
+	switch (advice) {
+	case POSIX_FADV_NORMAL:
+	case POSIX_FADV_RANDOM:
+	case POSIX_FADV_SEQUENTIAL:
+		fd->ra.advice = advice;
+		fd->ra.window = 0;
+		fd->ra.ra_end = 0;
+		break;
+	case POSIX_FADV_WILLNEED:
+		if (dirent->dev == &file_dev_file && offset < dirent->file_size) {
+			u32 clusSize = CLUS_SIZE(dirent->file_system);
+			// len为0表示直到文件末尾
+			u64 end = len == 0 ? dirent->file_size : MIN(offset + len, dirent->file_size);
+			u32 first = offset / clusSize;
+			// 与顺序读的预读窗口一样至多预读RA_MAX_CLUS个簇，以免大文件把整个缓存换出
+			u32 count = MIN((end + clusSize - 1) / clusSize - first, RA_MAX_CLUS);
+			file_readahead(dirent, first, count);
+		}
+		break;
+	case POSIX_FADV_DONTNEED:
+	case POSIX_FADV_NOREUSE:
+		// 缓存层没有按文件的回收接口，忽略
+		break;
+	default:
+		return -EINVAL;
+	}
+	return 0;
+}
+
+/**
+ * @brief 读一个文件，返回读取的字节数
+ * @param user 为真时buf为用户地址，否则为内核地址
+ */
+static int file_fd_read(struct Fd *fd, int user, u64 buf, u64 n, u64 offset) {
 	Dirent *dirent = fd->dirent;
-	n = dirent->dev->dev_write(dirent, 1, buf, offset, n);
-	if (n < 0) {
+	int r;
+	if (user && (fd->flags & __O_DIRECT) && file_can_direct(dirent)) {
+		// 直接I/O不经过缓存，也不预读
+		r = file_direct_rw(dirent, 0, buf, offset, n);
+	} else {
+		fd_file_readahead(fd, offset, n);
+		// 向抽象的文件设备写入内容
+		r = dirent->dev->dev_read(dirent, user, buf, offset, n);
+	}
+	if (r < 0) {
 		warn("file read num is below zero\n");
-		return -1;
+		return r;
+	}
+	fd->offset = offset + r;
+	return r;
+}
+
+static int file_fd_write(struct Fd *fd, int user, u64 buf, u64 n, u64 offset) {
+	Dirent *dirent = fd->dirent;
+	int r;
+	if (user && (fd->flags & __O_DIRECT) && file_can_direct(dirent)) {
+		r = file_direct_rw(dirent, 1, buf, offset, n);
+	} else {
+		r = dirent->dev->dev_write(dirent, user, buf, offset, n);
+	}
+	if (r < 0) {
+		warn("file write num is below zero\n");
+		return r;
 	}
-	fd->offset = offset + n;
-	return n;
+	fd->offset = offset + r;
+	return r;
+}
+
+static int fd_file_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return file_fd_read(fd, 1, buf, n, offset);
+}
+
+static int fd_file_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return file_fd_write(fd, 1, buf, n, offset);
+}
+
+static int fd_file_kread(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return file_fd_read(fd, 0, buf, n, offset);
+}
+
+static int fd_file_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return file_fd_write(fd, 0, buf, n, offset);
 }
 
 // 文件关闭：关闭对应的dirent
@@ -0,0 +1,715 @@
+#include <dev/timer.h>
+#include <fs/dirent.h>
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/io_uring.h>
+#include <fs/poll.h>
+#include <fs/socket.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <mm/vmm.h>
+#include <proc/interface.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+#include <sys/time.h>
+
+/**
+ * io_uring：SQ、CQ和SQE数组位于与用户共享的页中，用户填写SQE后推进SQ的tail，
+ * 一次io_uring_enter即可提交一整批请求，完成项写入CQ后由用户直接读取，不再陷入内核
+ * 请求在io_uring_enter中按提交顺序就地执行。管道、socket等fd尚未就绪时不阻塞，而是把请求挂起，
+ * 连同poll和timeout一起在之后的io_uring_enter中重试。等待完成项期间挂在这些fd的等待队列上，
+ * fd状态变化或最近的timeout到期时才重试。
+ * 链头被挂起时，链上后续的请求随之按序挂起，链头完成后才执行下一个
+ * 不支持SQPOLL、IOPOLL和固定文件/缓冲区
+ */
+
+static int fd_uring_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_uring_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_uring_close(struct Fd *fd);
+static int fd_uring_stat(struct Fd *fd, u64 pkStat);
+
+struct FdDev fd_dev_uring = {
+    .dev_id = 'u',
+    .dev_name = "io_uring",
+    .dev_read = fd_uring_read,
+    .dev_write = fd_uring_write,
+    .dev_close = fd_uring_close,
+    .dev_stat = fd_uring_stat,
+};
+
+// ring区域的布局：头部各字段、CQE数组、SQ索引数组
+#define RING_SQ_HEAD 0
+#define RING_SQ_TAIL 4
+#define RING_SQ_MASK 8
+#define RING_SQ_ENTRIES 12
+#define RING_SQ_FLAGS 16
+#define RING_SQ_DROPPED 20
+#define RING_CQ_HEAD 24
+#define RING_CQ_TAIL 28
+#define RING_CQ_MASK 32
+#define RING_CQ_ENTRIES 36
+#define RING_CQ_OVERFLOW 40
+#define RING_CQ_FLAGS 44
+#define RING_CQES 64
+#define RING_SQ_ARRAY(ring) (RING_CQES + (ring)->cq_entries * sizeof(io_uring_cqe_t))
+
+static inline void *ring_ptr(IoUring *ring, u64 off) {
+	return (void *)(ring->ring_pages[off / PAGE_SIZE] + off % PAGE_SIZE);
+}
+
+static inline u32 *ring_u32(IoUring *ring, u64 off) {
+	return ring_ptr(ring, off);
+}
+
+static inline io_uring_sqe_t *ring_sqe(IoUring *ring, u32 idx) {
+	u64 off = (u64)idx * sizeof(io_uring_sqe_t);
+	return (void *)(ring->sqe_pages[off / PAGE_SIZE] + off % PAGE_SIZE);
+}
+
+static void uring_free_pages(u64 *pages, u32 npages) {
+	if (pages == NULL) {
+		return;
+	}
+	for (u32 i = 0; i < npages; i++) {
+		if (pages[i]) {
+			kvmFree(pages[i]);
+		}
+	}
+	kfree(pages);
+}
+
+static u64 *uring_alloc_pages(u32 npages) {
+	u64 *pages = kmalloc(npages * sizeof(u64));
+	if (pages == NULL) {
+		return NULL;
+	}
+	for (u32 i = 0; i < npages; i++) {
+		pages[i] = kvmAlloc();
+	}
+	return pages;
+}
+
+static void uring_free(IoUring *ring) {
+	while (!TAILQ_EMPTY(&ring->pend)) {
+		IoUringPend *p = TAILQ_FIRST(&ring->pend);
+		TAILQ_REMOVE(&ring->pend, p, link);
+		kfree(p);
+	}
+	while (!TAILQ_EMPTY(&ring->overflow)) {
+		IoUringOverflow *o = TAILQ_FIRST(&ring->overflow);
+		TAILQ_REMOVE(&ring->overflow, o, link);
+		kfree(o);
+	}
+	uring_free_pages(ring->ring_pages, ring->ring_npages);
+	uring_free_pages(ring->sqe_pages, ring->sqe_npages);
+	kfree(ring);
+}
+
+static inline u32 round_up_pow2(u32 n) {
+	u32 r = 1;
+	while (r < n) {
+		r <<= 1;
+	}
+	return r;
+}
+
+/**
+ * @brief 创建一个io_uring实例，返回其fd。用户随后以params中的偏移mmap共享区域
+ */
+int io_uring_setup(u32 entries, struct io_uring_params *params) {
+	extern u64 pageleft;
+	struct io_uring_params p;
+	copyIn((u64)params, &p, sizeof(p));
+
+	if (p.flags & ~(IORING_SETUP_CQSIZE | IORING_SETUP_CLAMP)) {
+		warn("io_uring_setup: unsupported flags %x\n", p.flags);
+		return -EINVAL;
+	}
+	if (entries == 0) {
+		return -EINVAL;
+	}
+	if (entries > IORING_MAX_ENTRIES) {
+		if (!(p.flags & IORING_SETUP_CLAMP)) {
+			return -EINVAL;
+		}
+		entries = IORING_MAX_ENTRIES;
+	}
+	u32 sq_entries = round_up_pow2(entries);
+	u32 cq_entries = 2 * sq_entries;
+	if (p.flags & IORING_SETUP_CQSIZE) {
+		if (p.cq_entries == 0) {
+			return -EINVAL;
+		}
+		if (p.cq_entries > 2 * IORING_MAX_ENTRIES) {
+			if (!(p.flags & IORING_SETUP_CLAMP)) {
+				return -EINVAL;
+			}
+			p.cq_entries = 2 * IORING_MAX_ENTRIES;
+		}
+		cq_entries = round_up_pow2(p.cq_entries);
+		if (cq_entries < sq_entries) {
+			return -EINVAL;
+		}
+	}
+
+	IoUring *ring = kmalloc(sizeof(IoUring));
+	if (ring == NULL) {
+		return -ENOMEM;
+	}
+	memset(ring, 0, sizeof(IoUring));
+	mtx_init(&ring->lock, "io_uring", false, MTX_SLEEP);
+	TAILQ_INIT(&ring->pend);
+	TAILQ_INIT(&ring->overflow);
+	ring->sq_entries = sq_entries;
+	ring->cq_entries = cq_entries;
+
+	u64 ring_size = RING_SQ_ARRAY(ring) + sq_entries * sizeof(u32);
+	ring->ring_npages = PGROUNDUP(ring_size) / PAGE_SIZE;
+	ring->sqe_npages = PGROUNDUP(sq_entries * sizeof(io_uring_sqe_t)) / PAGE_SIZE;
+	if (ring->ring_npages + ring->sqe_npages > pageleft / 2) {
+		kfree(ring);
+		return -ENOMEM;
+	}
+	ring->ring_pages = uring_alloc_pages(ring->ring_npages);
+	ring->sqe_pages = uring_alloc_pages(ring->sqe_npages);
+	if (ring->ring_pages == NULL || ring->sqe_pages == NULL) {
+		uring_free(ring);
+		return -ENOMEM;
+	}
+
+	*ring_u32(ring, RING_SQ_MASK) = sq_entries - 1;
+	*ring_u32(ring, RING_SQ_ENTRIES) = sq_entries;
+	*ring_u32(ring, RING_CQ_MASK) = cq_entries - 1;
+	*ring_u32(ring, RING_CQ_ENTRIES) = cq_entries;
+
+	int ufd = alloc_ufd();
+	if (ufd < 0) {
+		uring_free(ring);
+		return ufd;
+	}
+	int kfd = fdAlloc();
+	if (kfd < 0) {
+		free_ufd(ufd);
+		uring_free(ring);
+		return kfd;
+	}
+	fds[kfd].type = dev_uring;
+	fds[kfd].flags = O_RDWR;
+	fds[kfd].fd_dev = &fd_dev_uring;
+	fds[kfd].uring = ring;
+	cur_proc_fs_struct()->fdList[ufd] = kfd;
+
+	memset(&p.sq_off, 0, sizeof(p.sq_off));
+	memset(&p.cq_off, 0, sizeof(p.cq_off));
+	p.sq_entries = sq_entries;
+	p.cq_entries = cq_entries;
+	p.features = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP | IORING_FEAT_SUBMIT_STABLE |
+		     IORING_FEAT_RW_CUR_POS;
+	p.sq_off.head = RING_SQ_HEAD;
+	p.sq_off.tail = RING_SQ_TAIL;
+	p.sq_off.ring_mask = RING_SQ_MASK;
+	p.sq_off.ring_entries = RING_SQ_ENTRIES;
+	p.sq_off.flags = RING_SQ_FLAGS;
+	p.sq_off.dropped = RING_SQ_DROPPED;
+	p.sq_off.array = RING_SQ_ARRAY(ring);
+	p.cq_off.head = RING_CQ_HEAD;
+	p.cq_off.tail = RING_CQ_TAIL;
+	p.cq_off.ring_mask = RING_CQ_MASK;
+	p.cq_off.ring_entries = RING_CQ_ENTRIES;
+	p.cq_off.overflow = RING_CQ_OVERFLOW;
+	p.cq_off.cqes = RING_CQES;
+	p.cq_off.flags = RING_CQ_FLAGS;
+	copyOut((u64)params, &p, sizeof(p));
+	return ufd;
+}
+
+/**
+ * @brief 把共享区域映射到用户地址start处。SQ和CQ位于同一区域（IORING_FEAT_SINGLE_MMAP）
+ */
+void *io_uring_mmap(Fd *fd, u64 start, size_t len, u64 perm, off_t off) {
+	IoUring *ring = fd->uring;
+	u64 *pages;
+	u32 npages;
+
+	if (off == IORING_OFF_SQ_RING || off == IORING_OFF_CQ_RING) {
+		pages = ring->ring_pages;
+		npages = ring->ring_npages;
+	} else if (off == IORING_OFF_SQES) {
+		pages = ring->sqe_pages;
+		npages = ring->sqe_npages;
+	} else {
+		warn("io_uring_mmap: bad offset %lx\n", off);
+		return MAP_FAILED;
+	}
+	if (len > (u64)npages * PAGE_SIZE) {
+		warn("io_uring_mmap: len %lx exceeds %d pages\n", len, npages);
+		return MAP_FAILED;
+	}
+
+	// 共享页在fork后仍然共享，不做写时复制
+	mtx_lock(&cur_proc()->p_lock);
+	for (u64 i = 0; i < len / PAGE_SIZE; i++) {
+		panic_on(ptMap(cur_proc_pt(), start + i * PAGE_SIZE, pages[i], perm | PTE_SHARED));
+	}
+	mtx_unlock(&cur_proc()->p_lock);
+	return (void *)start;
+}
+
+/**
+ * @brief 向CQ写入一个完成项
+ * @return CQ已满时返回false
+ */
+static bool uring_cq_push(IoUring *ring, io_uring_cqe_t *cqe) {
+	u32 *tailp = ring_u32(ring, RING_CQ_TAIL);
+	u32 tail = *tailp;
+	u32 head = __atomic_load_n(ring_u32(ring, RING_CQ_HEAD), __ATOMIC_ACQUIRE);
+	if (tail - head >= ring->cq_entries) {
+		return false;
+	}
+
+	u64 off = RING_CQES + (u64)(tail & (ring->cq_entries - 1)) * sizeof(io_uring_cqe_t);
+	*(io_uring_cqe_t *)ring_ptr(ring, off) = *cqe;
+	__atomic_store_n(tailp, tail + 1, __ATOMIC_RELEASE);
+	return true;
+}
+
+/**
+ * @brief 把暂存的完成项按顺序补入CQ
+ */
+static void uring_flush_overflow(IoUring *ring) {
+	while (!TAILQ_EMPTY(&ring->overflow)) {
+		IoUringOverflow *o = TAILQ_FIRST(&ring->overflow);
+		if (!uring_cq_push(ring, &o->cqe)) {
+			return;
+		}
+		TAILQ_REMOVE(&ring->overflow, o, link);
+		ring->overflow_cnt--;
+		kfree(o);
+	}
+	__atomic_and_fetch(ring_u32(ring, RING_SQ_FLAGS), ~IORING_SQ_CQ_OVERFLOW, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 产生一个完成项。CQ已满（或已有暂存项）时暂存，不丢弃
+ * @note 暂存项分配失败时只能丢弃该完成项，计入CQ的overflow计数
+ */
+static void uring_post(IoUring *ring, u64 user_data, i32 res) {
+	io_uring_cqe_t cqe = {.user_data = user_data, .res = res, .flags = 0};
+	ring->cq_seq++;
+
+	if (TAILQ_EMPTY(&ring->overflow) && uring_cq_push(ring, &cqe)) {
+		return;
+	}
+
+	IoUringOverflow *o = kmalloc(sizeof(IoUringOverflow));
+	if (o == NULL) {
+		warn("io_uring: no memory to hold cqe %lx, dropped\n", user_data);
+		(*ring_u32(ring, RING_CQ_OVERFLOW))++;
+		return;
+	}
+	o->cqe = cqe;
+	TAILQ_INSERT_TAIL(&ring->overflow, o, link);
+	ring->overflow_cnt++;
+	__atomic_or_fetch(ring_u32(ring, RING_SQ_FLAGS), IORING_SQ_CQ_OVERFLOW, __ATOMIC_RELEASE);
+}
+
+/**
+ * @brief 用户尚未消费的完成项数
+ */
+static u32 uring_cq_ready(IoUring *ring) {
+	u32 tail = *ring_u32(ring, RING_CQ_TAIL);
+	u32 head = __atomic_load_n(ring_u32(ring, RING_CQ_HEAD), __ATOMIC_ACQUIRE);
+	return tail - head + ring->overflow_cnt;
+}
+
+/**
+ * @brief 向量读写。off为-1时使用并推进fd的偏移，否则从off处读写且不改变fd的偏移
+ */
+static i64 uring_rw_vec(io_uring_sqe_t *sqe, bool write) {
+	if (sqe->off == (u64)-1) {
+		const struct iovec *iov = (const struct iovec *)sqe->addr;
+		return write ? writev(sqe->fd, iov, sqe->len) : readv(sqe->fd, iov, sqe->len);
+	}
+
+	i64 total = 0;
+	u64 off = sqe->off;
+	for (u32 i = 0; i < sqe->len; i++) {
+		struct iovec iov;
+		copyIn(sqe->addr + i * sizeof(struct iovec), &iov, sizeof(iov));
+		i64 r = write ? (i64)pwrite64(sqe->fd, (u64)iov.iov_base, iov.iov_len, off)
+			      : (i64)pread64(sqe->fd, (u64)iov.iov_base, iov.iov_len, off);
+		if (r < 0) {
+			return total > 0 ? total : r;
+		}
+		total += r;
+		off += r;
+		if (r < iov.iov_len) {
+			break;
+		}
+	}
+	return total;
+}
+
+static int uring_fsync(int fd) {
+	Dirent *file;
+	int r = getDirentByFd(fd, &file, NULL);
+	if (r < 0) {
+		return r;
+	}
+	if (file != NULL) {
+		dirent_flush(file);
+	}
+	return 0;
+}
+
+/**
+ * @brief 完成一个挂起的请求并释放它
+ * 请求带IOSQE_IO_LINK时，成功则让链上的下一个请求成为链头，失败则以-ECANCELED完成链上后续的请求
+ * @return pend中位于p之后、尚未完成的第一个请求
+ */
+static IoUringPend *uring_complete(IoUring *ring, IoUringPend *p, i32 res) {
+	IoUringPend *next = TAILQ_NEXT(p, link);
+	bool linked = p->sqe.flags & IOSQE_IO_LINK;
+
+	TAILQ_REMOVE(&ring->pend, p, link);
+	uring_post(ring, p->sqe.user_data, res);
+	kfree(p);
+
+	while (linked && next != NULL && next->wait_prev) {
+		if (res >= 0) {
+			next->wait_prev = false;
+			break;
+		}
+		p = next;
+		next = TAILQ_NEXT(p, link);
+		linked = p->sqe.flags & IOSQE_IO_LINK;
+		TAILQ_REMOVE(&ring->pend, p, link);
+		uring_post(ring, p->sqe.user_data, -ECANCELED);
+		kfree(p);
+	}
+	return next;
+}
+
+/**
+ * @brief 取消一个挂起的poll或timeout请求，被取消的请求以-ECANCELED完成
+ */
+static int uring_cancel(IoUring *ring, u8 opcode, u64 user_data) {
+	IoUringPend *p;
+	TAILQ_FOREACH (p, &ring->pend, link) {
+		if (p->sqe.opcode == opcode && p->sqe.user_data == user_data) {
+			uring_complete(ring, p, -ECANCELED);
+			return 0;
+		}
+	}
+	return -ENOENT;
+}
+
+/**
+ * @brief 尝试执行一个请求
+ * @return 请求完成时返回true，结果写入*res；需要等待时返回false
+ */
+static bool uring_issue(IoUring *ring, io_uring_sqe_t *sqe, i32 *res) {
+	int need = 0;
+
+	if (sqe->flags & IOSQE_FIXED_FILE) {
+		*res = -EBADF;
+		return true;
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_READ:
+	case IORING_OP_READV:
+	case IORING_OP_RECV:
+		need = POLLIN;
+		break;
+	case IORING_OP_WRITE:
+	case IORING_OP_WRITEV:
+	case IORING_OP_SEND:
+		need = POLLOUT;
+		break;
+	case IORING_OP_POLL_ADD:
+		need = sqe->poll32_events & (POLLIN | POLLOUT);
+		break;
+	case IORING_OP_TIMEOUT:
+		return false;
+	}
+
+	// 读写前先检查就绪，未就绪的管道和socket不阻塞在这里，而是挂起请求
+	if (need) {
+		int revents = fd_poll_check(sqe->fd, need);
+		if (revents < 0) {
+			*res = revents;
+			return true;
+		}
+		if (revents == 0) {
+			return false;
+		}
+		if (sqe->opcode == IORING_OP_POLL_ADD) {
+			*res = revents;
+			return true;
+		}
+	}
+
+	switch (sqe->opcode) {
+	case IORING_OP_NOP:
+		*res = 0;
+		break;
+	case IORING_OP_READ:
+		*res = sqe->off == (u64)-1 ? read(sqe->fd, sqe->addr, sqe->len)
+					   : pread64(sqe->fd, sqe->addr, sqe->len, sqe->off);
+		break;
+	case IORING_OP_WRITE:
+		*res = sqe->off == (u64)-1 ? write(sqe->fd, sqe->addr, sqe->len)
+					   : pwrite64(sqe->fd, sqe->addr, sqe->len, sqe->off);
+		break;
+	case IORING_OP_READV:
+		*res = uring_rw_vec(sqe, false);
+		break;
+	case IORING_OP_WRITEV:
+		*res = uring_rw_vec(sqe, true);
+		break;
+	case IORING_OP_RECV:
+		*res = recvfrom(sqe->fd, (void *)sqe->addr, sqe->len, sqe->msg_flags, NULL, NULL, 1);
+		break;
+	case IORING_OP_SEND:
+		*res = sendto(sqe->fd, (void *)sqe->addr, sqe->len, sqe->msg_flags, NULL, NULL, 1);
+		break;
+	case IORING_OP_FSYNC:
+		*res = uring_fsync(sqe->fd);
+		break;
+	case IORING_OP_POLL_REMOVE:
+		*res = uring_cancel(ring, IORING_OP_POLL_ADD, sqe->addr);
+		break;
+	case IORING_OP_TIMEOUT_REMOVE:
+		*res = uring_cancel(ring, IORING_OP_TIMEOUT, sqe->addr);
+		break;
+	default:
+		warn("io_uring: unsupported opcode %d\n", sqe->opcode);
+		*res = -EINVAL;
+		break;
+	}
+	return true;
+}
+
+/**
+ * @brief 挂起一个暂时无法完成的请求
+ * @param wait_prev 请求所在链的前一个请求也被挂起，需等它完成后再执行
+ * @return 内存不足时返回false
+ */
+static bool uring_defer(IoUring *ring, io_uring_sqe_t *sqe, bool wait_prev) {
+	IoUringPend *p = kmalloc(sizeof(IoUringPend));
+	if (p == NULL) {
+		return false;
+	}
+	p->sqe = *sqe;
+	p->deadline = 0;
+	p->target_seq = 0;
+	p->wait_prev = wait_prev;
+
+	if (sqe->opcode == IORING_OP_TIMEOUT) {
+		// addr指向到期时间，off为提前完成所需的完成项数
+		struct timespec ts;
+		copyIn(sqe->addr, &ts, sizeof(ts));
+		p->deadline = (sqe->timeout_flags & IORING_TIMEOUT_ABS) ? TS_USEC(ts)
+									  : time_mono_us() + TS_USEC(ts);
+		if (sqe->off) {
+			p->target_seq = ring->cq_seq + sqe->off;
+		}
+	}
+	TAILQ_INSERT_TAIL(&ring->pend, p, link);
+	return true;
+}
+
+/**
+ * @brief 重试所有挂起的链头请求，完成的请求产生完成项
+ */
+static void uring_reap(IoUring *ring) {
+	u64 now = time_mono_us();
+	IoUringPend *p = TAILQ_FIRST(&ring->pend);
+
+	// 执行链上的POLL_REMOVE等请求会移除其他挂起项，因此每次都从p重新取后继
+	while (p != NULL) {
+		i32 res;
+
+		if (p->wait_prev) {
+			p = TAILQ_NEXT(p, link);
+			continue;
+		} else if (p->sqe.opcode == IORING_OP_TIMEOUT) {
+			if (p->target_seq && ring->cq_seq >= p->target_seq) {
+				res = 0;
+			} else if (now >= p->deadline) {
+				res = -ETIME;
+			} else {
+				p = TAILQ_NEXT(p, link);
+				continue;
+			}
+		} else if (!uring_issue(ring, &p->sqe, &res)) {
+			p = TAILQ_NEXT(p, link);
+			continue;
+		}
+
+		// 链上的下一个请求成为链头后紧随其后，在本轮中接着重试
+		p = uring_complete(ring, p, res);
+	}
+}
+
+/**
+ * @brief 在挂起的链头请求所用fd的等待队列上注册w
+ * @return 最近的timeout到期时间，没有timeout时返回0
+ */
+static u64 uring_wait_prepare(IoUring *ring, PollWaiter *w) {
+	IoUringPend *p;
+	u64 deadline = 0;
+	int n = 0;
+
+	TAILQ_FOREACH (p, &ring->pend, link) {
+		n++;
+	}
+	poll_waiter_init(w, n);
+	if (n > 0 && w->pw_entries == NULL) {
+		// 无法注册时退化为限时轮询
+		w->pw_cap = 0;
+		w->pw_need_poll = true;
+	}
+
+	TAILQ_FOREACH (p, &ring->pend, link) {
+		if (p->wait_prev) {
+			continue;
+		}
+		if (p->sqe.opcode == IORING_OP_TIMEOUT) {
+			u64 t = MAX(p->deadline, 1);
+			if (deadline == 0 || t < deadline) {
+				deadline = t;
+			}
+		} else {
+			Fd *kfd = get_kfd_by_fd(p->sqe.fd);
+			if (kfd != NULL) {
+				poll_waiter_add(w, kfd);
+			}
+		}
+	}
+	return deadline;
+}
+
+/**
+ * @brief 从SQ中取出至多to_submit个请求依次执行
+ * @note 带IOSQE_IO_LINK的请求失败时，同一链上的后续请求以-ECANCELED完成；
+ * 挂起时，同一链上的后续请求不执行，按序挂在它之后
+ * @return 取出的请求数
+ */
+static u32 uring_submit(IoUring *ring, u32 to_submit) {
+	u32 *headp = ring_u32(ring, RING_SQ_HEAD);
+	u32 head = *headp;
+	u32 tail = __atomic_load_n(ring_u32(ring, RING_SQ_TAIL), __ATOMIC_ACQUIRE);
+	u32 submitted = 0;
+	bool cancel_link = false;
+	bool defer_link = false;
+
+	while (submitted < to_submit && head != tail) {
+		u32 idx = *ring_u32(ring, RING_SQ_ARRAY(ring) + (head & (ring->sq_entries - 1)) * sizeof(u32));
+		head++;
+		if (idx >= ring->sq_entries) {
+			(*ring_u32(ring, RING_SQ_DROPPED))++;
+			continue;
+		}
+		// 复制一份SQE，用户在head推进后即可复用该项
+		io_uring_sqe_t sqe = *ring_sqe(ring, idx);
+		submitted++;
+
+		i32 res;
+		bool deferred;
+		if (cancel_link) {
+			uring_post(ring, sqe.user_data, -ECANCELED);
+			cancel_link = sqe.flags & IOSQE_IO_LINK;
+			continue;
+		} else if (defer_link) {
+			deferred = uring_defer(ring, &sqe, true);
+		} else if (uring_issue(ring, &sqe, &res)) {
+			uring_post(ring, sqe.user_data, res);
+			cancel_link = (sqe.flags & IOSQE_IO_LINK) && res < 0;
+			continue;
+		} else {
+			deferred = uring_defer(ring, &sqe, false);
+		}
+
+		if (deferred) {
+			defer_link = sqe.flags & IOSQE_IO_LINK;
+		} else {
+			// 挂在它之前的链上请求仍会执行，之后的请求随它失败
+			uring_post(ring, sqe.user_data, -ENOMEM);
+			cancel_link = sqe.flags & IOSQE_IO_LINK;
+			defer_link = false;
+		}
+	}
+
+	__atomic_store_n(headp, head, __ATOMIC_RELEASE);
+	return submitted;
+}
+
+/**
+ * @brief 提交至多to_submit个请求；flags含IORING_ENTER_GETEVENTS时等待至少min_complete个完成项
+ * @return 提交的请求数
+ */
+int io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags, u64 sig, size_t sigsz) {
+	Fd *kfd = get_kfd_by_fd(fd);
+	if (kfd == NULL) {
+		return -EBADF;
+	}
+	if (kfd->type != dev_uring) {
+		return -EOPNOTSUPP;
+	}
+	IoUring *ring = kfd->uring;
+	thread_t *td = cpu_this()->cpu_running;
+
+	mtx_lock_sleep(&ring->lock);
+	uring_flush_overflow(ring);
+	u32 submitted = uring_submit(ring, to_submit);
+	uring_reap(ring);
+
+	if (flags & IORING_ENTER_GETEVENTS) {
+		min_complete = MIN(min_complete, ring->cq_entries);
+		while (uring_cq_ready(ring) < min_complete && !td->td_killed) {
+			PollWaiter w;
+			u64 deadline = uring_wait_prepare(ring, &w);
+
+			// 注册之后再重试一次，以免错过注册之前的状态变化
+			uring_reap(ring);
+			if (uring_cq_ready(ring) < min_complete) {
+				mtx_unlock_sleep(&ring->lock);
+				poll_waiter_wait(&w, deadline);
+				mtx_lock_sleep(&ring->lock);
+			}
+			poll_waiter_destroy(&w);
+
+			uring_flush_overflow(ring);
+			uring_reap(ring);
+		}
+	}
+	mtx_unlock_sleep(&ring->lock);
+
+	return submitted;
+}
+
+static int fd_uring_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+static int fd_uring_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+/**
+ * @brief 释放io_uring。用户仍映射着的共享页由页表保持引用，在munmap或进程退出时释放
+ */
+static int fd_uring_close(struct Fd *fd) {
+	uring_free(fd->uring);
+	fd->uring = NULL;
+	return 0;
+}
+
+static int fd_uring_stat(struct Fd *fd, u64 pkStat) {
+	return 0;
+}
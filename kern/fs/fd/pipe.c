@@ -19,6 +19,8 @@
 
 static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
 static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_pipe_kread(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_pipe_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset);
 static int fd_pipe_close(struct Fd *fd);
 static int fd_pipe_stat(struct Fd *fd, u64 pkStat);
 static int pipeIsClose(struct Pipe *p);
@@ -30,6 +32,8 @@ struct FdDev fd_dev_pipe = {
     .dev_name = "pipe",
     .dev_read = fd_pipe_read,
     .dev_write = fd_pipe_write,
+    .dev_kread = fd_pipe_kread,
+    .dev_kwrite = fd_pipe_kwrite,
     .dev_close = fd_pipe_close,
     .dev_stat = fd_pipe_stat,
 };
@@ -43,11 +47,18 @@ static inline void free_both_ufd(int ufd1, int ufd2) {
 
 extern mutex_t mtx_fd;
 
-int pipe(int fd[2]) {
+/**
+ * @param flags pipe2的标志，支持O_NONBLOCK和O_CLOEXEC，同时设置在两端
+ */
+int pipe(int fd[2], int flags) {
 	int fd1 = -1, fd2 = -1;
 	int kernfd1 = -1, kernfd2 = -1;
 	u64 pipeAlloc;
 
+	if (flags & ~(O_NONBLOCK | __O_CLOEXEC)) {
+		return -EINVAL;
+	}
+
 	fd1 = alloc_ufd();
 	fd2 = alloc_ufd();
 	if (fd1 < 0 || fd2 < 0) {
@@ -74,11 +85,12 @@ int pipe(int fd[2]) {
 
 		// 初始化管道的锁
 		mtx_init(&p->lock, "pipe", 1, MTX_SPIN);
+		poll_queue_init(&p->pollq);
 
 		fds[kernfd1].dirent = NULL;
 		fds[kernfd1].pipe = (struct Pipe *)pipeAlloc;
 		fds[kernfd1].type = dev_pipe;
-		fds[kernfd1].flags = O_RDONLY;
+		fds[kernfd1].flags = O_RDONLY | flags;
 		fds[kernfd1].offset = 0;
 		fds[kernfd1].fd_dev = &fd_dev_pipe;
 		cur_proc_fs_struct()->fdList[fd1] = kernfd1;
@@ -86,7 +98,7 @@ int pipe(int fd[2]) {
 		fds[kernfd2].dirent = NULL;
 		fds[kernfd2].pipe = (struct Pipe *)pipeAlloc;
 		fds[kernfd2].type = dev_pipe;
-		fds[kernfd2].flags = O_WRONLY;
+		fds[kernfd2].flags = O_WRONLY | flags;
 		fds[kernfd2].offset = 0;
 		fds[kernfd2].fd_dev = &fd_dev_pipe;
 		cur_proc_fs_struct()->fdList[fd2] = kernfd2;
@@ -99,10 +111,12 @@ int pipe(int fd[2]) {
 
 /**
  * @brief 从管道中读取字符，允许读取少于n个字符。如果未读到字符且管道未关闭，则等待。
+ * 非阻塞模式下不等待，返回-EAGAIN
  * @note 传入的fd需要带锁（睡眠锁）
- * @param offset 无用参数
+ * @param user 为真时buf为用户地址，否则为内核地址
  */
-static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+static int pipe_read(struct Fd *fd, int user, u64 buf, u64 n) {
+	bool nonblock = (fd->flags & O_NONBLOCK) != 0;
 	mtx_unlock_sleep(&fd->lock);
 
 	struct Pipe *p = fd->pipe;
@@ -112,6 +126,11 @@ static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 	// 如果管道为空，则一直等待
 	warn("Thread %s: fd_pipe_read pipe %lx, content: %d B\n", cpu_this()->cpu_running->td_name, p, p->pipeWritePos - p->pipeReadPos);
 	while (p->pipeReadPos == p->pipeWritePos && !pipeIsClose(p) && !td->td_killed) {
+		if (nonblock) {
+			mtx_unlock(&p->lock);
+			mtx_lock_sleep(&fd->lock);
+			return -EAGAIN;
+		}
 		// TODO：判断进程是否被kill，如被kill，就释放锁并返回负数
 		// read时的channel是readPos，对方也应该以此方式唤醒
 		// 睡眠时暂时放掉管道的锁
@@ -142,10 +161,10 @@ static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	if (read_size != 0) {
 		if (read_begin < read_end) {
-			copyOut(buf, p->pipeBuf + read_begin, read_size);
+			copyOutEither(user, buf, p->pipeBuf + read_begin, read_size);
 		} else {
-			copyOut(buf, p->pipeBuf + read_begin, PIPE_BUF_SIZE - read_begin);
-			copyOut(buf + PIPE_BUF_SIZE - read_begin, p->pipeBuf, read_end);
+			copyOutEither(user, buf, p->pipeBuf + read_begin, PIPE_BUF_SIZE - read_begin);
+			copyOutEither(user, buf + PIPE_BUF_SIZE - read_begin, p->pipeBuf, read_end);
 		}
 	} else {
 		warn("read fd %d empty: maybe target pipe closed.\n", fd - fds);
@@ -158,13 +177,20 @@ static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	// 唤醒可能在等待的写者
 	wakeup(&p->pipeWritePos);
+	poll_wakeup(&p->pollq);
 	mtx_unlock(&p->lock);
 	mtx_lock_sleep(&fd->lock);
 	
 	return read_size;
 }
 
-static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+/**
+ * @brief 向管道写入n个字符，管道满时等待读者
+ * 非阻塞模式下不等待，返回已写入的字符数，一个也没写入时返回-EAGAIN
+ * @note 传入的fd需要带锁（睡眠锁）
+ * @param user 为真时buf为用户地址，否则为内核地址
+ */
+static int pipe_write(struct Fd *fd, int user, u64 buf, u64 n, bool nonblock) {
 	mtx_unlock_sleep(&fd->lock);
 	int i = 0;
 	struct Pipe *p = fd->pipe;
@@ -183,23 +209,32 @@ static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 		}
 
 		if (p->pipeWritePos - p->pipeReadPos == PIPE_BUF_SIZE) {
+			if (nonblock) {
+				if (i == 0) {
+					mtx_unlock(&p->lock);
+					mtx_lock_sleep(&fd->lock);
+					return -EAGAIN;
+				}
+				break;
+			}
 			wakeup(&p->pipeReadPos);
+			poll_wakeup(&p->pollq);
 			sleep(&p->pipeWritePos, &p->lock, "pipe writer wait for pipe reader.\n");
 			// 唤醒之后进入下一个while轮次，继续判断管道是否关闭和进程是否结束
 			// 我们采取的唤醒策略是：尽可能地接受唤醒信号，但唤醒信号不一定对本睡眠进程有效，唤醒后还需要做额外检查，若不满足条件(管道非空)应当继续睡眠
 		} else {
 			u64 left_size = PIPE_BUF_SIZE - (p->pipeWritePos - p->pipeReadPos);
-			u64 write_length = MIN(left_size, n);
+			u64 write_length = MIN(left_size, n - i);
 			u64 write_dst = p->pipeWritePos + write_length;
 
 			u64 write_begin = p->pipeWritePos % PIPE_BUF_SIZE;
 			u64 write_end = write_dst % PIPE_BUF_SIZE;
 
 			if (write_begin < write_end) {
-				copyIn(buf + i, p->pipeBuf + write_begin, write_length);
+				copyInEither(user, buf + i, p->pipeBuf + write_begin, write_length);
 			} else {
-				copyIn(buf + i, p->pipeBuf + write_begin,  PIPE_BUF_SIZE - write_begin);
-				copyIn(buf + i + PIPE_BUF_SIZE - write_begin, p->pipeBuf,  write_end);
+				copyInEither(user, buf + i, p->pipeBuf + write_begin,  PIPE_BUF_SIZE - write_begin);
+				copyInEither(user, buf + i + PIPE_BUF_SIZE - write_begin, p->pipeBuf,  write_end);
 			}
 			p->pipeWritePos += write_length;
 			i += write_length;
@@ -209,6 +244,7 @@ static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	// 唤醒读者
 	wakeup(&p->pipeReadPos);
+	poll_wakeup(&p->pollq);
 	mtx_unlock(&p->lock);
 			mtx_lock_sleep(&fd->lock);
 
@@ -216,6 +252,98 @@ static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 	return i;
 }
 
+// offset为无用参数
+static int fd_pipe_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return pipe_read(fd, 1, buf, n);
+}
+
+static int fd_pipe_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return pipe_write(fd, 1, buf, n, fd->flags & O_NONBLOCK);
+}
+
+static int fd_pipe_kread(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return pipe_read(fd, 0, buf, n);
+}
+
+static int fd_pipe_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return pipe_write(fd, 0, buf, n, fd->flags & O_NONBLOCK);
+}
+
+/**
+ * @brief 把内核缓冲区kbuf中的n字节写入管道，由调用者决定是否阻塞（splice、tee使用）
+ * @note 传入的fd需要带锁（睡眠锁）
+ */
+int pipe_kwrite(struct Fd *fd, void *kbuf, u64 n, bool nonblock) {
+	return pipe_write(fd, 0, (u64)kbuf, n, nonblock);
+}
+
+/**
+ * @brief 复制管道中至多n字节到内核缓冲区kbuf，但不消耗管道内容（tee、splice使用）
+ * 管道为空且未关闭时等待写者，非阻塞时返回-EAGAIN
+ * @return 复制的字节数，管道已关闭且为空时返回0
+ */
+int pipe_peek(struct Pipe *p, void *kbuf, u64 n, bool nonblock) {
+	thread_t *td = cpu_this()->cpu_running;
+
+	mtx_lock(&p->lock);
+	while (p->pipeReadPos == p->pipeWritePos && !pipeIsClose(p) && !td->td_killed) {
+		if (nonblock) {
+			mtx_unlock(&p->lock);
+			return -EAGAIN;
+		}
+		sleep(&p->pipeReadPos, &p->lock, "wait for pipe writer to write");
+	}
+	if (td->td_killed) {
+		mtx_unlock(&p->lock);
+		return -EPIPE;
+	}
+
+	u64 size = MIN(n, p->pipeWritePos - p->pipeReadPos);
+	u64 begin = p->pipeReadPos % PIPE_BUF_SIZE;
+	u64 first = MIN(size, PIPE_BUF_SIZE - begin);
+	memcpy(kbuf, p->pipeBuf + begin, first);
+	memcpy(kbuf + first, p->pipeBuf, size - first);
+
+	mtx_unlock(&p->lock);
+	return size;
+}
+
+/**
+ * @brief 从管道中取走pipe_peek复制过的前n字节，并唤醒写者
+ * @note 调用者需保证同一时刻只有自己在读该管道，否则取走的未必是复制过的数据
+ */
+void pipe_consume(struct Pipe *p, u64 n) {
+	mtx_lock(&p->lock);
+	p->pipeReadPos += MIN(n, p->pipeWritePos - p->pipeReadPos);
+	wakeup(&p->pipeWritePos);
+	poll_wakeup(&p->pollq);
+	mtx_unlock(&p->lock);
+}
+
+/**
+ * @brief 等待管道中有空闲空间，非阻塞时不等待
+ * @return 空闲的字节数，非阻塞且管道已满时返回-EAGAIN，读端已关闭时返回-EPIPE
+ */
+int pipe_wait_space(struct Pipe *p, bool nonblock) {
+	thread_t *td = cpu_this()->cpu_running;
+	int r;
+
+	mtx_lock(&p->lock);
+	while (p->pipeWritePos - p->pipeReadPos == PIPE_BUF_SIZE && !pipeIsClose(p) &&
+	       !td->td_killed && !nonblock) {
+		sleep(&p->pipeWritePos, &p->lock, "pipe writer wait for pipe reader.\n");
+	}
+	if (pipeIsClose(p) || td->td_killed) {
+		r = -EPIPE;
+	} else if (p->pipeWritePos - p->pipeReadPos == PIPE_BUF_SIZE) {
+		r = -EAGAIN;
+	} else {
+		r = PIPE_BUF_SIZE - (p->pipeWritePos - p->pipeReadPos);
+	}
+	mtx_unlock(&p->lock);
+	return r;
+}
+
 static int fd_pipe_close(struct Fd *fd) {
 	struct Pipe *p = fd->pipe;
 	mtx_lock(&p->lock);
@@ -225,8 +353,10 @@ static int fd_pipe_close(struct Fd *fd) {
 	// 唤醒读写端的程序。这里不需要考虑当前是读端还是写端，直接全部唤醒就可
 	wakeup(&p->pipeReadPos);
 	wakeup(&p->pipeWritePos);
+	poll_wakeup(&p->pollq);
 
 	if (p && p->count == 0) {
+		poll_queue_destroy(&p->pollq);
 		if (p->pipeBuf != NULL) {
 			kfree(p->pipeBuf);
 			p->pipeBuf = NULL;
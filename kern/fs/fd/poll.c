@@ -0,0 +1,279 @@
+#include <fs/console.h>
+#include <fs/epoll.h>
+#include <fs/eventfd.h>
+#include <fs/fd.h>
+#include <fs/pipe.h>
+#include <fs/poll.h>
+#include <fs/signalfd.h>
+#include <fs/socket.h>
+#include <fs/timerfd.h>
+#include <lib/log.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/cpu.h>
+#include <proc/tsleep.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+#include <sys/time.h>
+#include <dev/timer.h>
+
+/**
+ * 本文件实现fd的就绪检查和等待队列，供ppoll、pselect6、epoll和io_uring使用
+ */
+
+mutex_t mtx_poll;
+
+void poll_init() {
+	mtx_init(&mtx_poll, "poll", false, MTX_SPIN);
+}
+
+void poll_queue_init(PollQueue *q) {
+	LIST_INIT(&q->pq_head);
+}
+
+/**
+ * @brief 在持有mtx_poll时唤醒等待队列，供回调中级联唤醒（嵌套的epoll）
+ */
+void poll_wakeup_locked(PollQueue *q) {
+	assert(mtx_hold(&mtx_poll));
+	PollEntry *e = LIST_FIRST(&q->pq_head);
+	while (e != NULL) {
+		// 回调不会把自己移出队列，但先取出next更稳妥
+		PollEntry *next = LIST_NEXT(e, pe_link);
+		e->pe_func(e);
+		e = next;
+	}
+}
+
+/**
+ * @brief 对象状态变化后唤醒其等待队列
+ * @note 应在持有对象的锁时调用。就绪检查也持有该锁，因而不加锁判断队列为空不会错过刚注册的等待者
+ */
+void poll_wakeup(PollQueue *q) {
+	// 队列为空是常态（没有人poll），此时不必获取全局锁
+	if (LIST_EMPTY(&q->pq_head)) {
+		return;
+	}
+	mtx_lock(&mtx_poll);
+	poll_wakeup_locked(q);
+	mtx_unlock(&mtx_poll);
+}
+
+/**
+ * @brief 对象即将释放：唤醒所有等待者，并把它们的PollEntry从队列上摘下
+ */
+void poll_queue_destroy(PollQueue *q) {
+	mtx_lock(&mtx_poll);
+	poll_wakeup_locked(q);
+	while (!LIST_EMPTY(&q->pq_head)) {
+		PollEntry *e = LIST_FIRST(&q->pq_head);
+		LIST_REMOVE(e, pe_link);
+		e->pe_queue = NULL;
+	}
+	mtx_unlock(&mtx_poll);
+}
+
+void poll_entry_add(PollQueue *q, PollEntry *e, poll_func_t func, void *priv) {
+	e->pe_func = func;
+	e->pe_priv = priv;
+	mtx_lock(&mtx_poll);
+	e->pe_queue = q;
+	LIST_INSERT_HEAD(&q->pq_head, e, pe_link);
+	mtx_unlock(&mtx_poll);
+}
+
+void poll_entry_del(PollEntry *e) {
+	mtx_lock(&mtx_poll);
+	if (e->pe_queue != NULL) {
+		LIST_REMOVE(e, pe_link);
+		e->pe_queue = NULL;
+	}
+	mtx_unlock(&mtx_poll);
+}
+
+/**
+ * @brief 检查fd是否可以读取。可以返回1，不可以返回0
+ */
+static int fd_poll_read(Fd *kfd) {
+	int ret;
+	mtx_lock_sleep(&kfd->lock);
+
+	if (kfd->type == dev_socket) {
+		ret = socket_read_check(kfd);
+	} else if (kfd->type == dev_pipe) {
+		ret = pipe_check_read(kfd->pipe);
+	} else if (kfd->type == dev_console) {
+		ret = console_check_read();
+	} else if (kfd->type == dev_epoll) {
+		ret = epoll_check(kfd->epoll);
+	} else if (kfd->type == dev_eventfd) {
+		ret = eventfd_check_read(kfd->eventfd);
+	} else if (kfd->type == dev_timerfd) {
+		ret = timerfd_check_read(kfd->timerfd);
+	} else if (kfd->type == dev_signalfd) {
+		ret = signalfd_check_read(kfd->signalfd);
+	} else {
+		ret = 1;
+	}
+	mtx_unlock_sleep(&kfd->lock);
+	return ret;
+}
+
+/**
+ * @brief 检查fd是否可以写入。可以返回1，不可以返回0
+ */
+static int fd_poll_write(Fd *kfd) {
+	int ret;
+	mtx_lock_sleep(&kfd->lock);
+
+	if (kfd->type == dev_socket) {
+		ret = socket_write_check(kfd);
+	} else if (kfd->type == dev_pipe) {
+		ret = pipe_check_write(kfd->pipe);
+	} else if (kfd->type == dev_console) {
+		ret = console_check_write();
+	} else if (kfd->type == dev_eventfd) {
+		ret = eventfd_check_write(kfd->eventfd);
+	} else if (kfd->type == dev_epoll || kfd->type == dev_timerfd || kfd->type == dev_signalfd) {
+		ret = 0;
+	} else {
+		ret = 1;
+	}
+	mtx_unlock_sleep(&kfd->lock);
+	return ret;
+}
+
+/**
+ * @brief 检查内核fd上events（POLLIN、POLLOUT）中的哪些事件已经就绪
+ * @return 就绪事件的掩码
+ */
+int fd_poll(Fd *kfd, int events) {
+	int revents = 0;
+	if ((events & POLLIN) && fd_poll_read(kfd)) {
+		revents |= POLLIN;
+	}
+	if ((events & POLLOUT) && fd_poll_write(kfd)) {
+		revents |= POLLOUT;
+	}
+	return revents;
+}
+
+/**
+ * @brief 检查用户fd上events中的哪些事件已经就绪
+ * @return 就绪事件的掩码，fd无效时返回-EBADF
+ */
+int fd_poll_check(int fd, int events) {
+	Fd *kfd = get_kfd_by_fd(fd);
+	if (kfd == NULL) {
+		return -EBADF;
+	}
+	return fd_poll(kfd, events);
+}
+
+/**
+ * @brief 获取内核fd的状态变化会唤醒的等待队列
+ * @return 队列数。普通文件等始终就绪，返回0；状态变化无法通知（console）时返回-1
+ */
+int fd_poll_queues(Fd *kfd, PollQueue *qs[POLL_MAX_QUEUE]) {
+	switch (kfd->type) {
+	case dev_pipe:
+		qs[0] = &kfd->pipe->pollq;
+		return 1;
+	case dev_socket:
+		return socket_poll_queues(kfd, qs);
+	case dev_epoll:
+		qs[0] = &kfd->epoll->ep_pollq;
+		return 1;
+	case dev_eventfd:
+		qs[0] = &kfd->eventfd->pollq;
+		return 1;
+	case dev_timerfd:
+		qs[0] = &kfd->timerfd->pollq;
+		return 1;
+	case dev_signalfd:
+		qs[0] = signalfd_poll_queue();
+		return 1;
+	case dev_console:
+		return -1;
+	default:
+		return 0;
+	}
+}
+
+static void poll_waiter_wake(PollEntry *e) {
+	PollWaiter *w = e->pe_priv;
+	w->pw_triggered = true;
+	twakeup(w);
+}
+
+/**
+ * @param nfd 至多注册的fd数
+ */
+void poll_waiter_init(PollWaiter *w, int nfd) {
+	w->pw_triggered = false;
+	w->pw_need_poll = false;
+	w->pw_cnt = 0;
+	w->pw_cap = nfd * POLL_MAX_QUEUE;
+	w->pw_entries = w->pw_cap ? kmalloc(w->pw_cap * sizeof(PollEntry)) : NULL;
+}
+
+void poll_waiter_add_queue(PollWaiter *w, PollQueue *q) {
+	if (w->pw_cnt < w->pw_cap) {
+		poll_entry_add(q, &w->pw_entries[w->pw_cnt++], poll_waiter_wake, w);
+	}
+}
+
+/**
+ * @brief 在kfd的等待队列上注册。应在检查fd是否就绪之前注册，以免错过检查之后的唤醒
+ */
+void poll_waiter_add(PollWaiter *w, Fd *kfd) {
+	PollQueue *qs[POLL_MAX_QUEUE];
+	int n = fd_poll_queues(kfd, qs);
+	if (n < 0) {
+		w->pw_need_poll = true;
+		return;
+	}
+	for (int i = 0; i < n; i++) {
+		poll_waiter_add_queue(w, qs[i]);
+	}
+}
+
+/**
+ * @brief 睡眠直到注册的某个队列被唤醒、到达deadline（单调时钟，微秒，0表示不限时）或线程被杀死
+ * @note 存在无法通知的fd时至多睡眠POLL_INTERVAL_US，返回后调用者应重新检查所有fd
+ * @return 到达deadline时返回-ETIMEDOUT，否则返回0
+ */
+int poll_waiter_wait(PollWaiter *w, u64 deadline) {
+	u64 now = time_mono_us();
+	if (deadline && now >= deadline) {
+		return -ETIMEDOUT;
+	}
+
+	u64 wake = deadline;
+	if (w->pw_need_poll && (wake == 0 || wake > now + POLL_INTERVAL_US)) {
+		wake = now + POLL_INTERVAL_US;
+	}
+
+	mtx_lock(&mtx_poll);
+	// 持有mtx_poll检查并睡眠，唤醒方设置pw_triggered时也持有该锁，不会丢失唤醒
+	if (!w->pw_triggered && !cpu_this()->cpu_running->td_killed) {
+		tsleep(w, &mtx_poll, "poll", wake);
+	}
+	w->pw_triggered = false;
+	mtx_unlock(&mtx_poll);
+
+	if (deadline && time_mono_us() >= deadline) {
+		return -ETIMEDOUT;
+	}
+	return 0;
+}
+
+void poll_waiter_destroy(PollWaiter *w) {
+	for (int i = 0; i < w->pw_cnt; i++) {
+		poll_entry_del(&w->pw_entries[i]);
+	}
+	if (w->pw_entries != NULL) {
+		kfree(w->pw_entries);
+	}
+	w->pw_cnt = 0;
+}
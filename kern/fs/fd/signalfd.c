@@ -0,0 +1,233 @@
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/poll.h>
+#include <fs/signalfd.h>
+#include <fs/thread_fs.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/cpu.h>
+#include <proc/interface.h>
+#include <proc/proc.h>
+#include <proc/thread.h>
+#include <signal/signal.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+
+/**
+ * signalfd：从本进程线程的信号队列中取出mask中的信号，以signalfd_siginfo的形式读出
+ * 信号通常已被阻塞，因而留在队列中不会被递送。读者等待在全局的等待队列上，任何信号发送后都会唤醒它
+ */
+
+static PollQueue signalfd_pollq;
+
+static int fd_signalfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_signalfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_signalfd_close(struct Fd *fd);
+static int fd_signalfd_stat(struct Fd *fd, u64 pkStat);
+
+struct FdDev fd_dev_signalfd = {
+    .dev_id = 'g',
+    .dev_name = "signalfd",
+    .dev_read = fd_signalfd_read,
+    .dev_write = fd_signalfd_write,
+    .dev_close = fd_signalfd_close,
+    .dev_stat = fd_signalfd_stat,
+};
+
+/**
+ * @brief 信号进入某个线程的队列后调用，唤醒等待的signalfd读者
+ * @note 不能持有线程的锁：等待者持有mtx_poll睡眠时会获取自己的线程锁
+ */
+void signalfd_notify() {
+	poll_wakeup(&signalfd_pollq);
+}
+
+static void signalfd_mask_in(sigset_t *kmask, u64 mask, u64 sizemask) {
+	sigset_init(kmask);
+	copyIn(mask, kmask, MIN(sizemask, sizeof(sigset_t)));
+	// 与Linux一致，SIGKILL和SIGSTOP不能通过signalfd接收，静默忽略
+	sigset_clear(kmask, SIGKILL);
+	sigset_clear(kmask, SIGSTOP);
+}
+
+int signalfd4(int fd, u64 mask, u64 sizemask, int flags) {
+	if (flags & ~(SFD_NONBLOCK | SFD_CLOEXEC)) {
+		return -EINVAL;
+	}
+	sigset_t kmask;
+	signalfd_mask_in(&kmask, mask, sizemask);
+
+	if (fd != -1) {
+		// 修改已有signalfd关注的信号
+		Fd *kfd = get_kfd_by_fd(fd);
+		if (kfd == NULL) {
+			return -EBADF;
+		}
+		if (kfd->type != dev_signalfd) {
+			return -EINVAL;
+		}
+		mtx_lock_sleep(&kfd->lock);
+		kfd->signalfd->mask = kmask;
+		mtx_unlock_sleep(&kfd->lock);
+		return fd;
+	}
+
+	SignalFd *sfd = kmalloc(sizeof(SignalFd));
+	if (sfd == NULL) {
+		return -ENOMEM;
+	}
+	sfd->mask = kmask;
+
+	int ufd = alloc_ufd();
+	if (ufd < 0) {
+		kfree(sfd);
+		return ufd;
+	}
+	int kfd = fdAlloc();
+	if (kfd < 0) {
+		free_ufd(ufd);
+		kfree(sfd);
+		return kfd;
+	}
+	fds[kfd].type = dev_signalfd;
+	fds[kfd].flags = O_RDONLY | (flags & SFD_NONBLOCK ? O_NONBLOCK : 0) |
+			 (flags & SFD_CLOEXEC ? __O_CLOEXEC : 0);
+	fds[kfd].fd_dev = &fd_dev_signalfd;
+	fds[kfd].signalfd = sfd;
+	cur_proc_fs_struct()->fdList[ufd] = kfd;
+	return ufd;
+}
+
+/**
+ * @brief 在线程的信号队列中找到最早的、未在处理中的mask中的信号，需持有td_lock
+ */
+static sigevent_t *signalfd_find(thread_t *td, sigset_t *mask) {
+	sigevent_t *se, *found = NULL;
+	// 新信号插入在队头，因此最后一个匹配项是最早的
+	TAILQ_FOREACH (se, &td->td_sigqueue, se_link) {
+		if (!(se->se_status & SE_PROCESSING) && sigset_isset(mask, se->se_signo)) {
+			found = se;
+		}
+	}
+	return found;
+}
+
+/**
+ * @brief 取出本进程的一个mask中的信号，优先取当前线程的
+ * @param remove 为假时只检查是否存在
+ * @return 信号编号，没有时返回0
+ */
+static int signalfd_dequeue(sigset_t *mask, bool remove) {
+	thread_t *cur = cpu_this()->cpu_running;
+	proc_t *p = cur->td_proc;
+	sigevent_t *se = NULL;
+	int signo = 0;
+
+	proc_lock(p);
+	mtx_lock(&cur->td_lock);
+	se = signalfd_find(cur, mask);
+	if (se != NULL) {
+		signo = se->se_signo;
+		if (remove) {
+			sigeventq_remove(cur, se);
+		}
+	}
+	mtx_unlock(&cur->td_lock);
+
+	thread_t *td;
+	TAILQ_FOREACH (td, &p->p_threads, td_plist) {
+		if (se != NULL) {
+			break;
+		}
+		if (td == cur) {
+			continue;
+		}
+		mtx_lock(&td->td_lock);
+		se = signalfd_find(td, mask);
+		if (se != NULL) {
+			signo = se->se_signo;
+			if (remove) {
+				sigeventq_remove(td, se);
+			}
+		}
+		mtx_unlock(&td->td_lock);
+	}
+	proc_unlock(p);
+
+	if (se != NULL && remove) {
+		sigevent_free(se);
+	}
+	return signo;
+}
+
+/**
+ * @brief 读出尽可能多的信号，每个信号一个signalfd_siginfo。没有信号时等待，非阻塞时返回-EAGAIN
+ * @note 传入的fd需要带锁（睡眠锁），等待期间暂时放掉
+ */
+static int fd_signalfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	if (n < sizeof(struct signalfd_siginfo)) {
+		return -EINVAL;
+	}
+	sigset_t mask = fd->signalfd->mask;
+	bool nonblock = (fd->flags & O_NONBLOCK) != 0;
+	thread_t *td = cpu_this()->cpu_running;
+
+	int signo = signalfd_dequeue(&mask, true);
+	if (signo == 0) {
+		if (nonblock) {
+			return -EAGAIN;
+		}
+
+		PollWaiter w;
+		poll_waiter_init(&w, 1);
+		poll_waiter_add_queue(&w, &signalfd_pollq);
+		mtx_unlock_sleep(&fd->lock);
+		// 先注册再检查，不会错过检查之后发送的信号
+		while ((signo = signalfd_dequeue(&mask, true)) == 0 && !td->td_killed) {
+			poll_waiter_wait(&w, 0);
+		}
+		poll_waiter_destroy(&w);
+		mtx_lock_sleep(&fd->lock);
+		if (signo == 0) {
+			return -EINTR;
+		}
+	}
+
+	struct signalfd_siginfo info;
+	u64 cnt = 0;
+	do {
+		memset(&info, 0, sizeof(info));
+		info.ssi_signo = signo;
+		copyOut(buf + cnt, &info, sizeof(info));
+		cnt += sizeof(info);
+	} while (cnt + sizeof(info) <= n && (signo = signalfd_dequeue(&mask, true)) != 0);
+	return cnt;
+}
+
+static int fd_signalfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+static int fd_signalfd_close(struct Fd *fd) {
+	kfree(fd->signalfd);
+	fd->signalfd = NULL;
+	return 0;
+}
+
+static int fd_signalfd_stat(struct Fd *fd, u64 pkStat) {
+	return 0;
+}
+
+/**
+ * @brief 本进程有关注的待处理信号时可读
+ */
+int signalfd_check_read(SignalFd *sfd) {
+	return signalfd_dequeue(&sfd->mask, false) != 0;
+}
+
+PollQueue *signalfd_poll_queue() {
+	return &signalfd_pollq;
+}
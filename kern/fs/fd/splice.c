@@ -0,0 +1,298 @@
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/pipe.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/interface.h>
+#include <sys/errno.h>
+#include <types.h>
+
+/**
+ * sendfile、splice、tee：数据在内核中从一个fd搬运到另一个fd，不经过用户态缓冲区
+ * 管道和socket是环形缓冲区，文件经过块缓存，无法直接移交页面，
+ * 因此以一个内核中转缓冲区衔接两端的dev_kread/dev_kwrite
+ */
+
+// 单次搬运的内核中转缓冲区大小
+#define SPLICE_BUF_SIZE (PAGE_SIZE * 16)
+
+/**
+ * @brief 从fd读取至多n字节到内核缓冲区kbuf
+ * @param off 非NULL时从*off处读取并推进*off，不改变fd的偏移（仅对文件有意义）
+ */
+static int splice_read(Fd *fd, void *kbuf, u64 n, off_t *off) {
+	int r;
+	if (fd->fd_dev->dev_kread == NULL) {
+		return -EINVAL;
+	}
+
+	mtx_lock_sleep(&fd->lock);
+	if (off == NULL) {
+		r = fd->fd_dev->dev_kread(fd, (u64)kbuf, n, fd->offset);
+	} else {
+		uint old_off = fd->offset;
+		r = fd->fd_dev->dev_kread(fd, (u64)kbuf, n, *off);
+		fd->offset = old_off;
+		if (r > 0) {
+			*off += r;
+		}
+	}
+	mtx_unlock_sleep(&fd->lock);
+	return r;
+}
+
+/**
+ * @brief 将内核缓冲区kbuf中的n字节写入fd
+ * @param off 非NULL时写入*off处并推进*off，不改变fd的偏移（仅对文件有意义）
+ * @param nonblock fd是管道时，管道满后是否立即返回（SPLICE_F_NONBLOCK）
+ */
+static int splice_write(Fd *fd, void *kbuf, u64 n, off_t *off, bool nonblock) {
+	int r;
+	if (fd->fd_dev->dev_kwrite == NULL) {
+		return -EINVAL;
+	}
+
+	mtx_lock_sleep(&fd->lock);
+	if (fd->type == dev_pipe) {
+		r = pipe_kwrite(fd, kbuf, n, nonblock || (fd->flags & O_NONBLOCK));
+	} else if (off == NULL) {
+		r = fd->fd_dev->dev_kwrite(fd, (u64)kbuf, n, fd->offset);
+	} else {
+		uint old_off = fd->offset;
+		r = fd->fd_dev->dev_kwrite(fd, (u64)kbuf, n, *off);
+		fd->offset = old_off;
+		if (r > 0) {
+			*off += r;
+		}
+	}
+	mtx_unlock_sleep(&fd->lock);
+	return r;
+}
+
+/**
+ * @brief 从输入端取出至多chunk字节到kbuf，保证取出的数据之后都能写到输出端
+ * 管道输入只复制不消耗，写出后再由调用者pipe_consume；
+ * 其他非文件输入（socket）读出后无法退回，因此输出是管道时按管道的空闲空间限制读取量
+ * @return 取出的字节数，0表示输入端已结束，或者错误码
+ */
+static int splice_fill(Fd *in, void *kbuf, u64 chunk, off_t *off_in, Fd *out, bool nonblock) {
+	int space;
+
+	if (in->type == dev_pipe) {
+		return pipe_peek(in->pipe, kbuf, chunk, nonblock || (in->flags & O_NONBLOCK));
+	}
+	if (in->type != dev_file && out->type == dev_pipe) {
+		space = pipe_wait_space(out->pipe, nonblock || (out->flags & O_NONBLOCK));
+		if (space < 0) {
+			return space;
+		}
+		chunk = MIN(chunk, space);
+	}
+	return splice_read(in, kbuf, chunk, off_in);
+}
+
+/**
+ * @brief 把in中至多len字节搬运到out
+ * @note 两端的fd锁不同时持有，避免两个方向相反的搬运互相死锁
+ * @note 输入是文件时循环直到搬完len字节或遇到文件尾；输入是管道或socket时只搬运一次，
+ * 有多少搬多少，以免在没有更多数据时阻塞
+ * @note 输出端写不下时，文件输入退回偏移，管道输入只消耗写出的部分，都不会丢数据
+ * @param nonblock 为真时管道两端都不阻塞（SPLICE_F_NONBLOCK）
+ * @return 搬运的字节数，或者第一次读写即失败时的错误码
+ */
+static i64 splice_transfer(Fd *in, off_t *off_in, Fd *out, off_t *off_out, size_t len,
+			   bool nonblock) {
+	i64 total = 0;
+	void *kbuf = kmalloc(SPLICE_BUF_SIZE);
+	if (kbuf == NULL) {
+		return -ENOMEM;
+	}
+
+	while (total < len) {
+		u64 chunk = MIN(len - total, SPLICE_BUF_SIZE);
+		int r = splice_fill(in, kbuf, chunk, off_in, out, nonblock);
+		if (r <= 0) {
+			if (total == 0) {
+				total = r;
+			}
+			break;
+		}
+
+		int w = splice_write(out, kbuf, r, off_out, nonblock);
+		if (in->type != dev_file && in->type != dev_pipe) {
+			// socket中读出的数据无法退回。按空闲空间读取后，只有别的写者抢先写入管道时才会写不完，
+			// 此时阻塞写完剩余部分
+			if (w == -EAGAIN) {
+				w = 0;
+			}
+			while (w >= 0 && w < r) {
+				int ww = splice_write(out, kbuf + w, r - w, off_out, false);
+				if (ww <= 0) {
+					warn("splice: output closed, drop %d bytes from fd type %d\n", r - w,
+					     in->type);
+					w = w ? w : ww;
+					break;
+				}
+				w += ww;
+			}
+		}
+		if (w < 0) {
+			if (total == 0) {
+				total = w;
+			}
+			break;
+		}
+		total += w;
+
+		if (in->type == dev_pipe) {
+			pipe_consume(in->pipe, w);
+		} else if (in->type == dev_file && w < r) {
+			// 输出端写不下更多数据，退回未写出部分的偏移
+			if (off_in != NULL) {
+				*off_in -= r - w;
+			} else {
+				mtx_lock_sleep(&in->lock);
+				in->offset -= r - w;
+				mtx_unlock_sleep(&in->lock);
+			}
+		}
+		if (w < r || in->type != dev_file || r < chunk) {
+			break;
+		}
+	}
+
+	kfree(kbuf);
+	return total;
+}
+
+static inline int fd_readable(Fd *fd) {
+	return (fd->flags & O_ACCMODE) != O_WRONLY;
+}
+
+static inline int fd_writable(Fd *fd) {
+	return (fd->flags & O_ACCMODE) != O_RDONLY;
+}
+
+/**
+ * @brief 把in_fd（必须是普通文件）中的数据发送到out_fd
+ * @param offset 用户地址。非NULL时从*offset处读取，返回时写回新的偏移，且不改变in_fd的偏移
+ */
+i64 sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+	Fd *in, *out;
+	off_t koff;
+	i64 r;
+
+	if ((in = get_kfd_by_fd(in_fd)) == NULL || (out = get_kfd_by_fd(out_fd)) == NULL) {
+		return -EBADF;
+	}
+	if (!fd_readable(in) || !fd_writable(out)) {
+		return -EBADF;
+	}
+	if (in->type != dev_file) {
+		return -EINVAL;
+	}
+
+	if (offset == NULL) {
+		return splice_transfer(in, NULL, out, NULL, count, false);
+	}
+
+	copyIn((u64)offset, &koff, sizeof(off_t));
+	if (koff < 0) {
+		return -EINVAL;
+	}
+	r = splice_transfer(in, &koff, out, NULL, count, false);
+	if (r >= 0) {
+		copyOut((u64)offset, &koff, sizeof(off_t));
+	}
+	return r;
+}
+
+/**
+ * @brief 在管道与另一个fd之间搬运数据，两端至少有一端是管道
+ * @param off_in,off_out 用户地址。管道一端必须为NULL；文件一端非NULL时的语义同sendfile的offset
+ */
+i64 splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len, unsigned int flags) {
+	Fd *in, *out;
+	off_t koff_in, koff_out;
+	i64 r;
+
+	if ((in = get_kfd_by_fd(fd_in)) == NULL || (out = get_kfd_by_fd(fd_out)) == NULL) {
+		return -EBADF;
+	}
+	if (!fd_readable(in) || !fd_writable(out)) {
+		return -EBADF;
+	}
+	if (flags & ~SPLICE_F_ALL) {
+		return -EINVAL;
+	}
+	if (in->type != dev_pipe && out->type != dev_pipe) {
+		return -EINVAL;
+	}
+	if (in->type == dev_pipe && out->type == dev_pipe && in->pipe == out->pipe) {
+		return -EINVAL;
+	}
+	if ((in->type == dev_pipe && off_in != NULL) || (out->type == dev_pipe && off_out != NULL)) {
+		return -ESPIPE;
+	}
+
+	if (off_in != NULL) {
+		copyIn((u64)off_in, &koff_in, sizeof(off_t));
+		if (koff_in < 0) {
+			return -EINVAL;
+		}
+	}
+	if (off_out != NULL) {
+		copyIn((u64)off_out, &koff_out, sizeof(off_t));
+		if (koff_out < 0) {
+			return -EINVAL;
+		}
+	}
+
+	// SPLICE_F_MOVE、SPLICE_F_MORE、SPLICE_F_GIFT只是提示，中转缓冲区的实现下没有可利用之处
+	r = splice_transfer(in, off_in ? &koff_in : NULL, out, off_out ? &koff_out : NULL, len,
+			    flags & SPLICE_F_NONBLOCK);
+
+	if (r >= 0) {
+		if (off_in != NULL) copyOut((u64)off_in, &koff_in, sizeof(off_t));
+		if (off_out != NULL) copyOut((u64)off_out, &koff_out, sizeof(off_t));
+	}
+	return r;
+}
+
+/**
+ * @brief 把管道fd_in中至多len字节复制到管道fd_out，不消耗fd_in中的数据
+ */
+i64 tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+	Fd *in, *out;
+	i64 r;
+
+	if ((in = get_kfd_by_fd(fd_in)) == NULL || (out = get_kfd_by_fd(fd_out)) == NULL) {
+		return -EBADF;
+	}
+	if (!fd_readable(in) || !fd_writable(out)) {
+		return -EBADF;
+	}
+	if (flags & ~SPLICE_F_ALL) {
+		return -EINVAL;
+	}
+	if (in->type != dev_pipe || out->type != dev_pipe || in->pipe == out->pipe) {
+		return -EINVAL;
+	}
+
+	void *kbuf = kmalloc(SPLICE_BUF_SIZE);
+	if (kbuf == NULL) {
+		return -ENOMEM;
+	}
+
+	bool nonblock = flags & SPLICE_F_NONBLOCK;
+	r = pipe_peek(in->pipe, kbuf, MIN(len, SPLICE_BUF_SIZE), nonblock || (in->flags & O_NONBLOCK));
+	if (r > 0) {
+		r = splice_write(out, kbuf, r, NULL, nonblock);
+	}
+
+	kfree(kbuf);
+	return r;
+}
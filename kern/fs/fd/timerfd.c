@@ -0,0 +1,289 @@
+#include <dev/timer.h>
+#include <fs/fd.h>
+#include <fs/fd_device.h>
+#include <fs/poll.h>
+#include <fs/thread_fs.h>
+#include <fs/timerfd.h>
+#include <lib/log.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/kmalloc.h>
+#include <proc/cpu.h>
+#include <proc/interface.h>
+#include <proc/sleep.h>
+#include <proc/thread.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+
+/**
+ * timerfd：已启动的定时器挂在全局链表上，由时钟中断检查到期，到期后累加ticks并唤醒读者
+ * 所有定时器的状态由mtx_timerfd保护（时钟中断中也会获取，因此是自旋锁）
+ */
+
+mutex_t mtx_timerfd;
+static LIST_HEAD(, TimerFd) timerfd_list;
+
+static int fd_timerfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_timerfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_timerfd_kread(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_timerfd_close(struct Fd *fd);
+static int fd_timerfd_stat(struct Fd *fd, u64 pkStat);
+
+struct FdDev fd_dev_timerfd = {
+    .dev_id = 'm',
+    .dev_name = "timerfd",
+    .dev_read = fd_timerfd_read,
+    .dev_write = fd_timerfd_write,
+    .dev_kread = fd_timerfd_kread,
+    .dev_close = fd_timerfd_close,
+    .dev_stat = fd_timerfd_stat,
+};
+
+void timerfd_init() {
+	mtx_init(&mtx_timerfd, "timerfd", false, MTX_SPIN);
+	LIST_INIT(&timerfd_list);
+}
+
+static TimerFd *get_timerfd_by_fd(int fd) {
+	Fd *kfd = get_kfd_by_fd(fd);
+	if (kfd == NULL || kfd->type != dev_timerfd) {
+		return NULL;
+	}
+	return kfd->timerfd;
+}
+
+static inline timespec_t us_to_ts(u64 us) {
+	timespec_t ts = {
+	    .tv_sec = us / USEC_PER_SEC,
+	    .tv_nsec = (us % USEC_PER_SEC) * (NSEC_PER_SEC / USEC_PER_SEC),
+	};
+	return ts;
+}
+
+static inline bool ts_valid(timespec_t *ts) {
+	return ts->tv_sec >= 0 && ts->tv_nsec >= 0 && ts->tv_nsec < NSEC_PER_SEC;
+}
+
+/**
+ * @brief 取出定时器的当前设置（剩余时间和周期），需持有mtx_timerfd
+ */
+static void timerfd_get_locked(TimerFd *tfd, struct itimerspec *its) {
+	u64 now = time_mono_us();
+	u64 left = 0;
+	if (tfd->expire != 0) {
+		// 已到期但时钟中断尚未处理时，报告最小的非零剩余时间，表示仍在运行
+		left = tfd->expire > now ? tfd->expire - now : 1;
+	}
+	its->it_value = us_to_ts(left);
+	its->it_interval = us_to_ts(tfd->interval);
+}
+
+/**
+ * @brief 停止定时器，需持有mtx_timerfd
+ */
+static void timerfd_disarm(TimerFd *tfd) {
+	if (tfd->expire != 0) {
+		LIST_REMOVE(tfd, link);
+		tfd->expire = 0;
+	}
+}
+
+/**
+ * @brief 检查所有已启动的定时器，在时钟中断中调用
+ */
+void timerfd_check() {
+	mtx_lock(&mtx_timerfd);
+	u64 now = time_mono_us();
+
+	TimerFd *tfd, *next;
+	LIST_FOREACH_PARTIAL_DEL(tfd, &timerfd_list) {
+		next = LIST_NEXT(tfd, link);
+		if (tfd->expire <= now) {
+			if (tfd->interval != 0) {
+				// 一次中断内可能错过了多个周期，一并计入
+				u64 n = (now - tfd->expire) / tfd->interval + 1;
+				tfd->ticks += n;
+				tfd->expire += n * tfd->interval;
+			} else {
+				tfd->ticks += 1;
+				timerfd_disarm(tfd);
+			}
+			wakeup(&tfd->ticks);
+			poll_wakeup(&tfd->pollq);
+		}
+		tfd = next;
+	}
+
+	mtx_unlock(&mtx_timerfd);
+}
+
+int timerfd_create(int clockid, int flags) {
+	if (clockid != CLOCK_REALTIME && clockid != CLOCK_MONOTONIC && clockid != CLOCK_BOOTTIME) {
+		return -EINVAL;
+	}
+	if (flags & ~(TFD_NONBLOCK | TFD_CLOEXEC)) {
+		return -EINVAL;
+	}
+
+	TimerFd *tfd = kmalloc(sizeof(TimerFd));
+	if (tfd == NULL) {
+		return -ENOMEM;
+	}
+	tfd->clockid = clockid;
+	tfd->expire = 0;
+	tfd->interval = 0;
+	tfd->ticks = 0;
+	poll_queue_init(&tfd->pollq);
+
+	int ufd = alloc_ufd();
+	if (ufd < 0) {
+		kfree(tfd);
+		return ufd;
+	}
+	int kfd = fdAlloc();
+	if (kfd < 0) {
+		free_ufd(ufd);
+		kfree(tfd);
+		return kfd;
+	}
+	fds[kfd].type = dev_timerfd;
+	fds[kfd].flags = O_RDONLY | (flags & TFD_NONBLOCK ? O_NONBLOCK : 0) |
+			 (flags & TFD_CLOEXEC ? __O_CLOEXEC : 0);
+	fds[kfd].fd_dev = &fd_dev_timerfd;
+	fds[kfd].timerfd = tfd;
+	cur_proc_fs_struct()->fdList[ufd] = kfd;
+	return ufd;
+}
+
+/**
+ * @param new_value 用户态的struct itimerspec，it_value为0时停止定时器
+ * @param old_value 若不为0，在此写回原来的设置
+ */
+int timerfd_settime(int fd, int flags, u64 new_value, u64 old_value) {
+	if (flags & ~(TFD_TIMER_ABSTIME | TFD_TIMER_CANCEL_ON_SET)) {
+		return -EINVAL;
+	}
+	TimerFd *tfd = get_timerfd_by_fd(fd);
+	if (tfd == NULL) {
+		return -EBADF;
+	}
+
+	struct itimerspec its, old;
+	copyIn(new_value, &its, sizeof(its));
+	if (!ts_valid(&its.it_value) || !ts_valid(&its.it_interval)) {
+		return -EINVAL;
+	}
+
+	mtx_lock(&mtx_timerfd);
+	timerfd_get_locked(tfd, &old);
+	timerfd_disarm(tfd);
+	tfd->ticks = 0;
+	tfd->interval = TS_USEC(its.it_interval);
+
+	u64 value = TS_USEC(its.it_value);
+	if (value != 0) {
+		u64 now = time_mono_us();
+		if (!(flags & TFD_TIMER_ABSTIME)) {
+			tfd->expire = now + value;
+		} else if (tfd->clockid == CLOCK_REALTIME) {
+			// 绝对的墙上时间换算为单调时钟
+			u64 offset = time_rtc_us() - now;
+			tfd->expire = value > offset ? value - offset : 1;
+		} else {
+			tfd->expire = value;
+		}
+		// expire为0表示未启动，已经过去的时间点记为1，在下一次时钟中断时到期
+		if (tfd->expire == 0) {
+			tfd->expire = 1;
+		}
+		LIST_INSERT_HEAD(&timerfd_list, tfd, link);
+	}
+	mtx_unlock(&mtx_timerfd);
+
+	if (old_value) {
+		copyOut(old_value, &old, sizeof(old));
+	}
+	return 0;
+}
+
+int timerfd_gettime(int fd, u64 curr_value) {
+	TimerFd *tfd = get_timerfd_by_fd(fd);
+	if (tfd == NULL) {
+		return -EBADF;
+	}
+
+	struct itimerspec its;
+	mtx_lock(&mtx_timerfd);
+	timerfd_get_locked(tfd, &its);
+	mtx_unlock(&mtx_timerfd);
+
+	copyOut(curr_value, &its, sizeof(its));
+	return 0;
+}
+
+/**
+ * @brief 读取上次读取后定时器到期的次数。尚未到期时等待，非阻塞时返回-EAGAIN
+ * @note 传入的fd需要带锁（睡眠锁），等待期间暂时放掉
+ */
+static int timerfd_read(struct Fd *fd, int user, u64 buf, u64 n) {
+	if (n < sizeof(u64)) {
+		return -EINVAL;
+	}
+	TimerFd *tfd = fd->timerfd;
+	thread_t *td = cpu_this()->cpu_running;
+	bool nonblock = (fd->flags & O_NONBLOCK) != 0;
+	mtx_unlock_sleep(&fd->lock);
+
+	mtx_lock(&mtx_timerfd);
+	while (tfd->ticks == 0 && !nonblock && !td->td_killed) {
+		sleep(&tfd->ticks, &mtx_timerfd, "wait for timerfd expiration");
+	}
+	u64 ticks = tfd->ticks;
+	tfd->ticks = 0;
+	mtx_unlock(&mtx_timerfd);
+	mtx_lock_sleep(&fd->lock);
+
+	if (ticks == 0) {
+		return nonblock ? -EAGAIN : -EINTR;
+	}
+	copyOutEither(user, buf, &ticks, sizeof(u64));
+	return sizeof(u64);
+}
+
+static int fd_timerfd_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return timerfd_read(fd, 1, buf, n);
+}
+
+static int fd_timerfd_kread(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return timerfd_read(fd, 0, buf, n);
+}
+
+static int fd_timerfd_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return -EINVAL;
+}
+
+static int fd_timerfd_close(struct Fd *fd) {
+	TimerFd *tfd = fd->timerfd;
+	mtx_lock(&mtx_timerfd);
+	timerfd_disarm(tfd);
+	mtx_unlock(&mtx_timerfd);
+
+	poll_queue_destroy(&tfd->pollq);
+	kfree(tfd);
+	fd->timerfd = NULL;
+	return 0;
+}
+
+static int fd_timerfd_stat(struct Fd *fd, u64 pkStat) {
+	return 0;
+}
+
+/**
+ * @brief 有未读取的到期次数时可读
+ */
+int timerfd_check_read(TimerFd *tfd) {
+	mtx_lock(&mtx_timerfd);
+	int ret = tfd->ticks > 0;
+	mtx_unlock(&mtx_timerfd);
+	return ret;
+}
@@ -6,6 +6,7 @@
 #include <lib/printf.h>
 #include <lib/string.h>
 #include <lock/mutex.h>
+#include <sys/errno.h>
 
 // 最多挂载16个文件系统
 // FS是一个只读结构，在分配并第一次初始化之后，至回收之前，都不会修改
@@ -17,17 +18,40 @@ struct mutex mtx_fs;
 
 static Buffer *getBlock(FileSystem *fs, u64 blockNum, bool is_read) {
 	assert(fs != NULL);
+	Buffer *buf;
 
 	if (fs->image == NULL) {
 		// 是挂载了根设备，直接读取块缓存层的数据即可
-		return bufRead(fs->deviceNumber, blockNum, is_read);
+		buf = bufRead(fs->deviceNumber, blockNum, is_read);
 	} else {
-		// 处理挂载了文件的情况
-		Dirent *img = fs->image;
+		// 处理挂载了文件的情况：按镜像的映射表换算为镜像所在文件系统的扇区，与之共用同一个块缓存
 		FileSystem *parentFs = fs->image->file_system;
-		int blockNo = fileBlockNo(parentFs, img->first_clus, blockNum);
-		return bufRead(parentFs->deviceNumber, blockNo, is_read);
+		i64 blockNo = loopBlockNo(fs, blockNum);
+		panic_on(blockNo < 0);
+		buf = parentFs->get(parentFs, blockNo, is_read);
 	}
+
+	// 数据区之前是保留扇区（BPB、FSInfo）和FAT表，作为元数据保留在块缓存中
+	if (blockNum < fs->superBlock.first_data_sec) {
+		bufMarkMeta(buf);
+	}
+	return buf;
+}
+
+static int prefetchBlock(FileSystem *fs, u64 blockNum) {
+	assert(fs != NULL);
+
+	if (fs->image == NULL) {
+		return bufPrefetch(fs->deviceNumber, blockNum);
+	} else if (fs->loop_map != NULL) {
+		// 没有映射表时换算需要遍历镜像的FAT链，代价与同步读取相当，不预读
+		i64 blockNo = loopBlockNo(fs, blockNum);
+		if (blockNo >= 0) {
+			FileSystem *parentFs = fs->image->file_system;
+			return parentFs->prefetch(parentFs, blockNo);
+		}
+	}
+	return -EAGAIN;
 }
 
 /**
@@ -42,6 +66,7 @@ void allocFs(struct FileSystem **pFs) {
 			memset(&fs[i], 0, sizeof(FileSystem));
 			fs[i].valid = 1;
 			fs[i].get = getBlock;
+			fs[i].prefetch = prefetchBlock;
 
 			mtx_unlock(&mtx_fs);
 			return;
@@ -60,6 +85,21 @@ void deAllocFs(struct FileSystem *fs) {
 	mtx_unlock(&mtx_fs);
 }
 
+/**
+ * @brief 同步所有已挂载的FAT文件系统的簇层元数据（FAT镜像和FSInfo），tmpfs没有FAT表，跳过
+ * @note 调用者需持有mtx_file，与卸载互斥。clusterSync会获取睡眠锁，因此不持有mtx_fs调用
+ */
+void fsSyncAll() {
+	for (int i = 0; i < MAX_FS_COUNT; i++) {
+		mtx_lock(&mtx_fs);
+		bool isFat = fs[i].valid && !IS_TMPFS(&fs[i]);
+		mtx_unlock(&mtx_fs);
+		if (isFat) {
+			clusterSync(&fs[i]);
+		}
+	}
+}
+
 FileSystem *find_fs_by(findfs_callback_t findfs, void *data) {
 	mtx_lock(&mtx_fs);
 	for (int i = 0; i < MAX_FS_COUNT; i++) {
@@ -0,0 +1,241 @@
+#include <dev/dtb.h>
+#include <fs/dirent.h>
+#include <fs/file.h>
+#include <fs/fs.h>
+#include <fs/initramfs.h>
+#include <fs/tmpfs.h>
+#include <fs/vfs.h>
+#include <lib/error.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <mm/pmm.h>
+#include <sys/errno.h>
+
+/**
+ * initramfs：启动时把一个newc格式的cpio归档解包到tmpfs中，使init脚本和测试程序不必等待块设备
+ * 归档有两个来源：编译时链接进内核的.initramfs段（优先），或QEMU -initrd 加载、由设备树给出的initrd
+ * 只支持目录和普通文件；符号链接、设备节点等其他类型的项被跳过，硬链接的每一项都作为独立的文件
+ */
+
+extern char __initramfs_start[], __initramfs_end[];
+
+#define CPIO_HEADER_SIZE 110
+#define CPIO_ALIGN(x) (((x) + 3) & ~3ul)
+
+typedef struct CpioHeader {
+	char magic[6];
+	char ino[8];
+	char mode[8];
+	char uid[8];
+	char gid[8];
+	char nlink[8];
+	char mtime[8];
+	char filesize[8];
+	char devmajor[8];
+	char devminor[8];
+	char rdevmajor[8];
+	char rdevminor[8];
+	char namesize[8];
+	char check[8];
+} CpioHeader;
+
+/**
+ * @brief 解析cpio头部中8位的十六进制字段
+ * @return 字段的值，含有非法字符时返回-1
+ */
+static i64 cpio_hex(const char *s) {
+	i64 val = 0;
+	for (int i = 0; i < 8; i++) {
+		char c = s[i];
+		if (c >= '0' && c <= '9') {
+			val = val * 16 + c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			val = val * 16 + c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			val = val * 16 + c - 'A' + 10;
+		} else {
+			return -1;
+		}
+	}
+	return val;
+}
+
+/**
+ * @brief 找到要解包的归档
+ * @param from_initrd 归档是否来自initrd（其所在的页需要在解包后释放）
+ */
+static bool initramfs_find(void **archive, u64 *size, bool *from_initrd) {
+	extern struct InitrdInfo initrdInfo;
+
+	u64 embedded = __initramfs_end - __initramfs_start;
+
+	if (embedded > 0) {
+		*archive = __initramfs_start;
+		*size = embedded;
+		*from_initrd = false;
+		return true;
+	}
+	if (initrdInfo.end > initrdInfo.start) {
+		*archive = (void *)initrdInfo.start;
+		*size = initrdInfo.end - initrdInfo.start;
+		*from_initrd = true;
+		return true;
+	}
+	return false;
+}
+
+/**
+ * @brief 归还initrd占用的页。pmmInit把它们保留到了解包之后
+ */
+static void initramfs_release_initrd() {
+	extern struct InitrdInfo initrdInfo;
+
+	for (u64 pa = PGROUNDDOWN(initrdInfo.start); pa < initrdInfo.end; pa += PAGE_SIZE) {
+		pmPageDecRef(paToPage(pa));
+	}
+	initrdInfo.start = initrdInfo.end = 0;
+}
+
+static int initramfs_unpack_file(Dirent *root, char *path, u32 mode, void *data, u32 size) {
+	Dirent *file;
+	int r;
+
+	if (S_ISDIR(mode)) {
+		// 目录可能已经由之前某个文件的路径隐式创建，或者就是根目录本身
+		if (getFile(root, path, &file) == 0) {
+			file_close(file);
+			return 0;
+		}
+		return makeDirAt(root, path, mode & 0777);
+	}
+
+	if ((r = createFile(root, path, &file)) < 0) {
+		return r;
+	}
+	if (size > 0 && (r = file_write(file, 0, (u64)data, 0, size)) != size) {
+		file_close(file);
+		return r < 0 ? r : -ENOSPC;
+	}
+	file_close(file);
+	return 0;
+}
+
+/**
+ * @brief 把newc格式的cpio归档解包到root目录下
+ * @return 解包的项数，归档格式错误时返回-EINVAL
+ */
+int initramfs_unpack(Dirent *root, void *archive, u64 size) {
+	u64 off = 0;
+	int cnt = 0;
+
+	while (off + CPIO_HEADER_SIZE <= size) {
+		CpioHeader *hdr = archive + off;
+		if (strncmp(hdr->magic, "07070", 5) != 0 || (hdr->magic[5] != '1' && hdr->magic[5] != '2')) {
+			warn("initramfs: bad cpio magic at offset %ld\n", off);
+			return -EINVAL;
+		}
+
+		i64 mode = cpio_hex(hdr->mode);
+		i64 filesize = cpio_hex(hdr->filesize);
+		i64 namesize = cpio_hex(hdr->namesize);
+		if (mode < 0 || filesize < 0 || namesize <= 0) {
+			warn("initramfs: bad cpio header at offset %ld\n", off);
+			return -EINVAL;
+		}
+
+		char *name = (char *)hdr + CPIO_HEADER_SIZE;
+		u64 data_off = CPIO_ALIGN(off + CPIO_HEADER_SIZE + namesize);
+		if (data_off + filesize > size || name[namesize - 1] != '\0') {
+			warn("initramfs: truncated cpio entry at offset %ld\n", off);
+			return -EINVAL;
+		}
+		off = CPIO_ALIGN(data_off + filesize);
+
+		if (strncmp(name, "TRAILER!!!", 11) == 0) {
+			break;
+		}
+
+		// 归档中的路径形如"./bin/sh"或"bin/sh"，统一为相对于root的路径
+		while (name[0] == '.' && name[1] == '/') {
+			name += 2;
+		}
+		while (name[0] == '/') {
+			name++;
+		}
+		if (name[0] == '\0' || (name[0] == '.' && name[1] == '\0')) {
+			continue;
+		}
+		if (!S_ISDIR(mode) && !S_ISREG(mode)) {
+			warn("initramfs: unsupported file type %o, skip %s\n", (u32)mode, name);
+			continue;
+		}
+
+		int r = initramfs_unpack_file(root, name, mode, archive + data_off, filesize);
+		if (r < 0) {
+			warn("initramfs: unpack %s failed: %d\n", name, r);
+			continue;
+		}
+		cnt++;
+	}
+
+	return cnt;
+}
+
+/**
+ * @brief INITRAMFS_MOUNT为"/"且存在归档时，以tmpfs初始化根文件系统fs并解包归档
+ * @return 是否以initramfs作为根文件系统。返回false时由调用者从块设备初始化fs
+ */
+bool initramfs_init_root(FileSystem *fs) {
+	void *archive;
+	u64 size;
+	bool from_initrd;
+
+	if (strncmp(INITRAMFS_MOUNT, "/", 2) != 0 || !initramfs_find(&archive, &size, &from_initrd)) {
+		return false;
+	}
+
+	tmpfs_init(fs);
+	int cnt = initramfs_unpack(fs->root, archive, size);
+	log(LEVEL_GLOBAL, "initramfs: %d entries unpacked to /\n", cnt);
+
+	if (from_initrd) {
+		initramfs_release_initrd();
+	}
+	return true;
+}
+
+/**
+ * @brief INITRAMFS_MOUNT不为"/"且存在归档时，在INITRAMFS_MOUNT上挂载tmpfs并解包归档
+ * @note 在根文件系统初始化之后调用
+ */
+void initramfs_init() {
+	extern FileSystem *fatFs;
+	void *archive;
+	u64 size;
+	bool from_initrd;
+	Dirent *dir;
+
+	if (strncmp(INITRAMFS_MOUNT, "/", 2) == 0 || !initramfs_find(&archive, &size, &from_initrd)) {
+		return;
+	}
+
+	if (getFile(fatFs->root, INITRAMFS_MOUNT, &dir) == 0) {
+		file_close(dir);
+	} else {
+		makeDirAt(fatFs->root, INITRAMFS_MOUNT, 0);
+	}
+
+	if (mount_fs("initramfs", fatFs->root, INITRAMFS_MOUNT, "tmpfs") < 0 ||
+	    getFile(fatFs->root, INITRAMFS_MOUNT, &dir) < 0) {
+		warn("initramfs: mount on %s failed\n", INITRAMFS_MOUNT);
+	} else {
+		// 路径解析会越过挂载点，dir是tmpfs的根目录
+		int cnt = initramfs_unpack(dir, archive, size);
+		file_close(dir);
+		log(LEVEL_GLOBAL, "initramfs: %d entries unpacked to %s\n", cnt, INITRAMFS_MOUNT);
+	}
+
+	if (from_initrd) {
+		initramfs_release_initrd();
+	}
+}
@@ -12,83 +12,173 @@
 #include <proc/sleep.h>
 #include <proc/sched.h>
 #include <lib/queue.h>
+#include <proc/thread.h>
 #include <proc/tsleep.h>
 #include <sys/errno.h>
 #include <mm/kmalloc.h>
 #include <lib/profiling.h>
 
-// 整体TODO：判别是否为非阻塞模式（fd->flags & O_NONBLOCK），
-// 如果是，直接返回错误码(-EAGAIN)，不阻塞
-// 涉及的syscall：read, write, connect, accept(已实现), recvfrom, sendto
+// 非阻塞模式（fd->flags & O_NONBLOCK，或recvfrom、sendto的MSG_DONTWAIT）下，
+// 需要等待的read、write、accept、recvfrom、sendto返回-EAGAIN，connect返回-EINPROGRESS
 
-static uint socket_bitmap[SOCKET_COUNT / 32] = {0};
-Socket sockets[SOCKET_COUNT];
+/**
+ * socket结构体按需分配，释放后放入空闲链表复用，不归还内存，因而Socket指针始终有效
+ * 绑定了地址的socket按本地端口散列，已连接的socket另按（本地端口，对端端口）散列，建立连接和查找对端无需遍历
+ * 本地通信的地址未必一致（INET与INET6、0.0.0.0与127.0.0.1），因此只用端口作为键
+ * 加锁顺序：mtx_sockhash -> socket->lock -> socket->state.state_lock
+ *
+ * 流式socket的短消息经过接收方的环形缓冲区（两次复制）。阻塞写入较长的用户数据且缓冲区为空时，
+ * 写者把数据所在的物理页借给接收方（SocketLoan），接收方直接从这些页复制到自己的缓冲区，只复制一次
+ */
+
+// 下面的读写由mtx_socketmap保护
+static LIST_HEAD(, Socket) socket_free_list;
+static int socket_cnt;	   // 已分配的socket结构体数
 struct mutex mtx_socketmap;
 
-Message messages[MESSAGE_COUNT];
-Message_list message_free_list;
-struct mutex mtx_messages;
+static LIST_HEAD(, Socket) socket_bind_hash[SOCKET_HASH_SIZE];
+static LIST_HEAD(, Socket) socket_conn_hash[SOCKET_HASH_SIZE];
+struct mutex mtx_sockhash;
 
 static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset);
 static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_socket_kread(struct Fd *fd, u64 buf, u64 n, u64 offset);
+static int fd_socket_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset);
 static int fd_socket_close(struct Fd *fd);
 static int fd_socket_stat(struct Fd *fd, u64 pkStat);
 
 static void gen_local_socket_addr();
 static Socket *remote_find_peer_socket(const Socket *local_socket);
 static Socket *find_listening_socket(const SocketAddr *addr, int type);
-static Message * message_alloc();
-static Socket * find_udp_remote_socket(SocketAddr * addr, int type, int socket_index);
-static void message_free(Message * message);
-static Socket * find_udp_connect_socket(SocketAddr * addr, int self_type, int socket_index);
+static Message *message_alloc(Socket *socket, u64 length);
+static Socket * find_udp_remote_socket(SocketAddr * addr, int type, int socket_id);
+static void message_free(Socket *socket, Message *message);
+static void message_pool_free(Socket *socket);
+static Socket * find_udp_connect_socket(SocketAddr * addr, int self_type, int socket_id);
 
 struct FdDev fd_dev_socket = {
     .dev_id = 's',
     .dev_name = "socket",
     .dev_read = fd_socket_read,
     .dev_write = fd_socket_write,
+    .dev_kread = fd_socket_kread,
+    .dev_kwrite = fd_socket_kwrite,
     .dev_close = fd_socket_close,
     .dev_stat = fd_socket_stat,
 };
 
 void socket_init() {
 	mtx_init(&mtx_socketmap, "sys_socketable", 1, MTX_SPIN);
-	mtx_init(&mtx_messages, "message_alloc", 1, MTX_SPIN);
+	mtx_init(&mtx_sockhash, "socket_hash", 1, MTX_SPIN);
 
-	for (int i = 0; i < SOCKET_COUNT; i++) {
-		// TODO: debug socket_lock重入的问题
-		mtx_init(&sockets[i].lock, "socket_lock", 1, MTX_SPIN | MTX_RECURSE);
-		mtx_init(&sockets[i].state.state_lock, "socket_state_lock", 1, MTX_SPIN | MTX_RECURSE);
-		TAILQ_INIT(&sockets[i].messages);
+	LIST_INIT(&socket_free_list);
+	for (int i = 0; i < SOCKET_HASH_SIZE; i++) {
+		LIST_INIT(&socket_bind_hash[i]);
+		LIST_INIT(&socket_conn_hash[i]);
+	}
+}
+
+/**
+ * @brief 分配一个socket结构体，优先复用空闲的，否则新分配（不超过SOCKET_MAX）
+ */
+static Socket *socketAlloc() {
+	mtx_lock(&mtx_socketmap);
+	Socket *socket = LIST_FIRST(&socket_free_list);
+	if (socket != NULL) {
+		LIST_REMOVE(socket, free_link);
+		mtx_unlock(&mtx_socketmap);
+		return socket;
+	}
+	if (socket_cnt >= SOCKET_MAX) {
+		mtx_unlock(&mtx_socketmap);
+		return NULL;
 	}
+	int id = socket_cnt++;
+	mtx_unlock(&mtx_socketmap);
 
-	// 初始化空闲message队列
-	TAILQ_INIT(&message_free_list);
-	for (int i = 0; i < MESSAGE_COUNT; i++) {
-		TAILQ_INSERT_TAIL(&message_free_list, &messages[i], message_link);
+	socket = kmalloc(sizeof(Socket));
+	if (socket == NULL) {
+		mtx_lock(&mtx_socketmap);
+		socket_cnt--;
+		mtx_unlock(&mtx_socketmap);
+		return NULL;
 	}
+	socket->id = id;
+	// TODO: debug socket_lock重入的问题
+	mtx_init(&socket->lock, "socket_lock", 1, MTX_SPIN | MTX_RECURSE);
+	mtx_init(&socket->state.state_lock, "socket_state_lock", 1, MTX_SPIN | MTX_RECURSE);
+	TAILQ_INIT(&socket->messages);
+	TAILQ_INIT(&socket->free_messages);
+	poll_queue_init(&socket->pollq);
+	socket->bufferAddr = NULL;
+	socket->loan = NULL;
+	return socket;
 }
 
+static inline int socket_bind_hash_of(u16 port) {
+	return port & (SOCKET_HASH_SIZE - 1);
+}
 
-int socketAlloc() {
-	int i;
-	mtx_lock(&mtx_socketmap);
-	for (i = 0; i < SOCKET_COUNT; i++) {
-		int index = i >> 5;
-		int inner = i & 31;
-		if ((socket_bitmap[index] & (1 << inner)) == 0) {
-			socket_bitmap[index] |= 1 << inner;
-			mtx_unlock(&mtx_socketmap);
-			return i;
+static inline int socket_conn_hash_of(u16 local_port, u16 remote_port) {
+	return (local_port * 31 + remote_port) & (SOCKET_HASH_SIZE - 1);
+}
+
+/**
+ * @brief 把socket从散列表中摘下，需持有mtx_sockhash
+ */
+static void socket_unhash(Socket *socket) {
+	if (socket->bind_hashed) {
+		LIST_REMOVE(socket, bind_link);
+		socket->bind_hashed = false;
+	}
+	if (socket->conn_hashed) {
+		LIST_REMOVE(socket, conn_link);
+		socket->conn_hashed = false;
+	}
+}
+
+/**
+ * @brief 按当前地址把socket加入散列表，需持有mtx_sockhash
+ */
+static void socket_hash(Socket *socket) {
+	if (socket->addr.port != 0) {
+		LIST_INSERT_HEAD(&socket_bind_hash[socket_bind_hash_of(socket->addr.port)], socket,
+				 bind_link);
+		socket->bind_hashed = true;
+		if (socket->target_addr.port != 0) {
+			int h = socket_conn_hash_of(socket->addr.port, socket->target_addr.port);
+			LIST_INSERT_HEAD(&socket_conn_hash[h], socket, conn_link);
+			socket->conn_hashed = true;
 		}
 	}
-	mtx_unlock(&mtx_socketmap);
-	return -1;
+}
+
+/**
+ * @brief 设置socket的本地地址和目标地址（为NULL的不修改），并更新其在散列表中的位置
+ * @note 调用者不能持有任何socket的锁
+ */
+static void socket_set_addr(Socket *socket, const SocketAddr *addr, const SocketAddr *target) {
+	mtx_lock(&mtx_sockhash);
+	mtx_lock(&socket->lock);
+	socket_unhash(socket);
+	if (addr != NULL) {
+		socket->addr = *addr;
+	}
+	if (target != NULL) {
+		socket->target_addr = *target;
+	}
+	socket_hash(socket);
+	mtx_unlock(&socket->lock);
+	mtx_unlock(&mtx_sockhash);
 }
 
 int socket(int domain, int type, int protocol) {
 	int i, usfd = -1;
 
+	if (type & ~(SOCKET_TYPE_MASK | SOCK_NONBLOCK | SOCK_CLOEXEC)) {
+		return -EINVAL;
+	}
+
 	for (i = 0; i < MAX_FD_COUNT; i++) {
 		if (cur_proc_fs_struct()->fdList[i] == -1) {
 			usfd = i;
@@ -101,26 +191,28 @@ int socket(int domain, int type, int protocol) {
 		return -1;
 	}
 
-	int socketNum = socketAlloc();
-	if (socketNum < 0) {
+	Socket *socket = socketAlloc();
+	if (socket == NULL) {
 		warn("All socket is used, please check\n");
 		return -1;
 	}
 
 	//  对socket这个结构体加锁
-	Socket *socket = &sockets[socketNum];
 	mtx_lock(&socket->lock);
 	socket->used = true;
 	socket->addr.family = domain;
 	socket->type = (type & 0xf);
 	memset(&socket->target_addr, 0, sizeof(SocketAddr));
 	socket->waiting_h = socket->waiting_t = 0;
-	socket->bufferAddr = (void *)kmalloc(SOCKET_BUFFER_SIZE);
+	// 数据报socket通过消息收发，不需要环形缓冲区
+	socket->bufferAddr = SOCK_IS_UDP(type) ? NULL : (void *)kmalloc(SOCKET_BUFFER_SIZE);
+	socket->loan = NULL;
 	socket->tid = cpu_this()->cpu_running->td_tid;
 	socket->udp_is_connect = 0;
 	socket->opposite = -1;
 	socket->self_read_close = false;
 	socket->self_write_close = false;
+	socket->connecting = false;
 
 	TAILQ_INIT(&socket->messages);
 
@@ -133,7 +225,7 @@ int socket(int domain, int type, int protocol) {
 	if (sfd < 0) {
 		warn("All fd in kernel is used, please check\n");
 		mtx_unlock(&socket->lock);
-		socketFree(socketNum);
+		socketFree(socket);
 		return -1;
 	}
 
@@ -145,8 +237,8 @@ int socket(int domain, int type, int protocol) {
 	fds[sfd].dirent = NULL;
 	fds[sfd].pipe = NULL;
 	fds[sfd].type = dev_socket;
-	u64 other_flags = type & ~0xf; // 除了类型之外的其他flags
-	fds[sfd].flags = O_RDWR | other_flags;
+	fds[sfd].flags = O_RDWR | ((type & SOCK_NONBLOCK) ? O_NONBLOCK : 0) |
+			 ((type & SOCK_CLOEXEC) ? __O_CLOEXEC : 0);
 	fds[sfd].offset = 0;
 	fds[sfd].fd_dev = &fd_dev_socket;
 	fds[sfd].socket = socket;
@@ -189,15 +281,13 @@ int bind(int sockfd, const SocketAddr *p_sockectaddr, socklen_t addrlen) {
 	// 	printf("bind type = DGRAM\n");
 	// }
 
-	mtx_lock(&socket->lock);
-
 	if (socket->addr.family == socketaddr.family) {
-		socket->addr.addr = socketaddr.addr;
-		socket->addr.port = socketaddr.port;
+		SocketAddr addr = socket->addr;
+		addr.addr = socketaddr.addr;
+		addr.port = socketaddr.port;
+		socket_set_addr(socket, &addr, NULL);
 	}
 
-	mtx_unlock(&socket->lock);
-
 	return 0;
 }
 
@@ -240,18 +330,17 @@ int connect(int sockfd, const SocketAddr *p_addr, socklen_t addrlen) {
 	warn("Thread %s: sockfd = %d  type = %d,  connect to socket: family = %d, port = %d, addr = %lx\n",
 		cpu_this()->cpu_running->td_name, sfd, local_socket->type, addr.family, addr.port, addr.addr);
 
-	mtx_lock(&local_socket->lock);
-	if (local_socket->addr.port == 0) {
-		gen_local_socket_addr(&local_socket->addr);
+	SocketAddr local_addr = local_socket->addr;
+	if (local_addr.port == 0) {
+		gen_local_socket_addr(&local_addr);
 	}
-	local_socket->target_addr = addr;
-	mtx_unlock(&local_socket->lock);
+	socket_set_addr(local_socket, &local_addr, &addr);
 
 	// 1. connected, opposite
 
 	// 如果是UDP，只设置target_addr就可以
 	if (SOCK_IS_UDP(local_socket->type)) {
-		Socket *target_socket = find_udp_connect_socket(&addr, local_socket->type & 0xf, local_socket - sockets);
+		Socket *target_socket = find_udp_connect_socket(&addr, local_socket->type & 0xf, local_socket->id);
 		if (target_socket == NULL) {
 			// asm volatile("ebreak"); //
 			warn("server socket doesn't exists or isn't listening\n");
@@ -260,7 +349,7 @@ int connect(int sockfd, const SocketAddr *p_addr, socklen_t addrlen) {
 		}
 		mtx_lock(&local_socket->lock);
 		local_socket->udp_is_connect = 1;
-		local_socket->opposite = target_socket - sockets;
+		local_socket->opposite = target_socket->id;
 		mtx_unlock(&local_socket->lock);
 		// printf("connect: type = UDP");
 		return 0;
@@ -288,6 +377,16 @@ int connect(int sockfd, const SocketAddr *p_addr, socklen_t addrlen) {
 
 	// 尝试唤醒服务端，以等待队列指针作为chan
 	wakeup(target_socket->waiting_queue);
+	poll_wakeup(&target_socket->pollq);
+
+	if (local_socket->tid != target_socket->tid && (fds[sfd].flags & O_NONBLOCK)) {
+		// 非阻塞：不等待accept，之后由poll可写或write得知连接是否建立
+		mtx_unlock(&target_socket->lock);
+		mtx_lock(&local_socket->lock);
+		local_socket->connecting = true;
+		mtx_unlock(&local_socket->lock);
+		return -EINPROGRESS;
+	}
 
 	if (local_socket->tid != target_socket->tid) {
 		//  释放服务端target_socket的锁，客户端进入睡眠，等待服务端唤醒客户端
@@ -301,8 +400,19 @@ int connect(int sockfd, const SocketAddr *p_addr, socklen_t addrlen) {
 }
 
 int accept(int sockfd, SocketAddr *p_addr, socklen_t * addrlen) {
+	return accept4(sockfd, p_addr, addrlen, 0);
+}
+
+/**
+ * @param flags SOCK_NONBLOCK、SOCK_CLOEXEC，设置在新连接的fd上
+ */
+int accept4(int sockfd, SocketAddr *p_addr, socklen_t * addrlen, int flags) {
 	SocketAddr addr;
 
+	if (flags & ~(SOCK_NONBLOCK | SOCK_CLOEXEC)) {
+		return -EINVAL;
+	}
+
 	int newUerFd;
 	int sfd = cur_proc_fs_struct()->fdList[sockfd];
 
@@ -328,81 +438,227 @@ int accept(int sockfd, SocketAddr *p_addr, socklen_t * addrlen) {
 		      "waiting for socket to enter waiting queue...\n");
 	}
 
-	// Socket *addr = socket->waiting_queue[(socket->waiting_h++) % PENDING_COUNT];
+	// 取出一个连接请求后即释放服务端socket锁，新socket的创建不阻塞其他客户端的connect
+	SocketAddr local_addr = local_socket->addr;
+	int pos = (local_socket->waiting_h++) % PENDING_COUNT;
+	addr = local_socket->waiting_queue[pos];
+	mtx_unlock(&local_socket->lock);
 
-	newUerFd = socket(local_socket->addr.family, local_socket->type, 0);
-	if (newUerFd < 0) {
-		return -1;
+	Socket *newSocket = NULL;
+	newUerFd = socket(local_addr.family, local_socket->type | flags, 0);
+	if (newUerFd >= 0) {
+		// 先加入散列表，客户端被唤醒后即可找到对端
+		newSocket = fds[cur_proc_fs_struct()->fdList[newUerFd]].socket;
+		socket_set_addr(newSocket, &local_addr, &addr);
 	}
 
-	Socket *newSocket = fds[cur_proc_fs_struct()->fdList[newUerFd]].socket;
-
-	newSocket->addr = local_socket->addr;
-	newSocket->target_addr =
-	    local_socket->waiting_queue[(local_socket->waiting_h++) % PENDING_COUNT];
-	addr = newSocket->target_addr;
-
-	//  释放服务端socket锁，唤醒newsocket对应的客户端
-	int pos = (local_socket->waiting_h - 1 + PENDING_COUNT) % PENDING_COUNT;
+	// 唤醒newsocket对应的客户端。创建失败时客户端也不再等待，之后的读写会发现没有对端
+	mtx_lock(&local_socket->lock);
 	wakeup(&local_socket->waiting_queue[pos]);
 	mtx_unlock(&local_socket->lock);
+	if (newUerFd < 0) {
+		return -1;
+	}
+
+	// 非阻塞connect的客户端不在睡眠，通过其等待队列通知连接已建立
+	Socket *client = remote_find_peer_socket(newSocket);
+	if (client != NULL) {
+		poll_wakeup(&client->pollq);
+		mtx_unlock(&client->lock);
+	}
 
-	copyOut((u64)p_addr, &addr, sizeof(SocketAddr));
+	if (p_addr) {
+		copyOut((u64)p_addr, &addr, sizeof(SocketAddr));
+	}
 	warn("Thread %s: sockfd = %d, accept socket addr = %x, port = %d\n", cpu_this()->cpu_running->td_name, sfd, addr.addr, addr.port);
 	return newUerFd;
 }
 
+/**
+ * @brief 创建一对互相连接的本地socket，不经过listen和accept
+ * @param sv 用户地址，写回两个fd
+ */
+int socketpair(int domain, int type, int protocol, int sv[2]) {
+	if (domain != AF_UNIX) {
+		return -EAFNOSUPPORT;
+	}
+	int sock_type = type & SOCKET_TYPE_MASK;
+	if (sock_type != SOCK_STREAM && sock_type != SOCK_DGRAM) {
+		return -EOPNOTSUPP;
+	}
+
+	int fd[2];
+	fd[0] = socket(domain, type, protocol);
+	if (fd[0] < 0) {
+		return fd[0];
+	}
+	fd[1] = socket(domain, type, protocol);
+	if (fd[1] < 0) {
+		closeFd(fd[0]);
+		return fd[1];
+	}
+
+	Socket *s0 = fds[cur_proc_fs_struct()->fdList[fd[0]]].socket;
+	Socket *s1 = fds[cur_proc_fs_struct()->fdList[fd[1]]].socket;
+
+	// 分配互不相同的本地地址，并把对方设为目标地址，读写时据此找到对端
+	SocketAddr addr0 = s0->addr, addr1 = s1->addr;
+	gen_local_socket_addr(&addr0);
+	gen_local_socket_addr(&addr1);
+	socket_set_addr(s0, &addr0, &addr1);
+	socket_set_addr(s1, &addr1, &addr0);
+
+	mtx_lock(&s0->lock);
+	s0->udp_is_connect = (sock_type == SOCK_DGRAM);
+	s0->opposite = s1->id;
+	mtx_unlock(&s0->lock);
+	mtx_lock(&s1->lock);
+	s1->udp_is_connect = (sock_type == SOCK_DGRAM);
+	s1->opposite = s0->id;
+	mtx_unlock(&s1->lock);
+
+	copyOut((u64)sv, fd, sizeof(fd));
+	return 0;
+}
+
 static void gen_local_socket_addr(SocketAddr * socket_addr) {
 	static u32 local_addr = (127 << 24) + 1;
 	static u32 local_port = 10000;
 	socket_addr->addr = local_addr;
-	socket_addr->port = local_port++;
+	socket_addr->port = __sync_fetch_and_add(&local_port, 1);
 }
 
 /**
  * @brief 查找指定地址和类型的监听socket
  */
 static Socket *find_listening_socket(const SocketAddr *addr, int type) {
-	for (int i = 0; i < SOCKET_COUNT; ++i) {
-		mtx_lock(&sockets[i].lock);
-		if (sockets[i].used &&
-			// sockets[i].addr.family == addr->family && // family可能未必相同，可以一个是INET一个是INET6
-		    // sockets[i].addr.addr == addr->addr &&
-			(sockets[i].type & 0xf) == type &&
-			sockets[i].addr.port == addr->port &&
-		    sockets[i].listening) {
-			// mtx_unlock(&sockets[i].lock);
-			return &sockets[i];
+	Socket *socket;
+	mtx_lock(&mtx_sockhash);
+	LIST_FOREACH (socket, &socket_bind_hash[socket_bind_hash_of(addr->port)], bind_link) {
+		// family可能未必相同，可以一个是INET一个是INET6，因此只比较端口
+		if ((socket->type & 0xf) == type && socket->addr.port == addr->port && socket->listening) {
+			mtx_lock(&socket->lock);
+			mtx_unlock(&mtx_sockhash);
+			return socket;
 		}
-		mtx_unlock(&sockets[i].lock);
 	}
+	mtx_unlock(&mtx_sockhash);
 	return NULL;
-	// TODO 加type参数即可
 }
 
 // 如果找到了对端socket，就持有锁
 static Socket *remote_find_peer_socket(const Socket *local_socket) {
-	// TODO：存在并发安全问题
-	for (int i = 0; i < SOCKET_COUNT; ++i) {
-		mtx_lock(&sockets[i].lock);
-		if ( sockets[i].used &&
-			local_socket - sockets != i && // not self
-			// sockets[i].addr.family == local_socket->target_addr.family &&
-		    sockets[i].addr.port == local_socket->target_addr.port &&
-		    // sockets[i].addr.addr == local_socket->target_addr.addr &&
-		    sockets[i].target_addr.port == local_socket->addr.port // &&
-		    // sockets[i].target_addr.addr == local_socket->addr.addr
-			) {
-			// mtx_unlock(&sockets[i].lock);
-			return &sockets[i];
+	u16 local_port = local_socket->addr.port;
+	u16 remote_port = local_socket->target_addr.port;
+	if (local_port == 0 || remote_port == 0) {
+		return NULL;
+	}
+
+	Socket *socket;
+	mtx_lock(&mtx_sockhash);
+	// 对端的（本地端口，对端端口）恰好与本socket相反
+	LIST_FOREACH (socket, &socket_conn_hash[socket_conn_hash_of(remote_port, local_port)], conn_link) {
+		if (socket != local_socket && socket->addr.port == remote_port &&
+		    socket->target_addr.port == local_port) {
+			mtx_lock(&socket->lock);
+			mtx_unlock(&mtx_sockhash);
+			return socket;
 		}
-		mtx_unlock(&sockets[i].lock);
 	}
+	mtx_unlock(&mtx_sockhash);
 	return NULL;
-	// TODO 加type参数即可
 }
 
-static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+/**
+ * @brief 固定当前进程的用户缓冲区[buf, buf + len)所在的页面，填入loan。一次至多固定SOCKET_LOAN_MAX_PAGES页
+ * @note 可能处理缺页，不能持有socket的自旋锁。使用完毕后用socket_loan_unpin释放
+ * @return 用户缓冲区无效时返回-EFAULT
+ */
+static err_t socket_loan_pin(SocketLoan *loan, u64 buf, u64 len) {
+	loan->offset = buf % PAGE_SIZE;
+	loan->len = MIN(len, SOCKET_LOAN_MAX_PAGES * PAGE_SIZE - loan->offset);
+	loan->npage = (loan->offset + loan->len + PAGE_SIZE - 1) / PAGE_SIZE;
+	loan->done = 0;
+	loan->aborted = false;
+
+	for (int i = 0; i < loan->npage; i++) {
+		err_t r = userPinPage(PGROUNDDOWN(buf) + i * PAGE_SIZE, false, &loan->pages[i]);
+		if (r < 0) {
+			while (i-- > 0) {
+				ptUnpin(loan->pages[i]);
+			}
+			return r;
+		}
+	}
+	return 0;
+}
+
+static void socket_loan_unpin(SocketLoan *loan) {
+	for (int i = 0; i < loan->npage; i++) {
+		ptUnpin(loan->pages[i]);
+	}
+}
+
+/**
+ * @brief 把已固定的页面借给target，等待target读完
+ * @note 需持有target->lock，等待期间暂时放掉
+ * @return target读走的字节数，target关闭读或自身被杀死时可能少于出借的长度
+ */
+static u64 socket_loan_wait(Socket *target, SocketLoan *loan) {
+	thread_t *td = cpu_this()->cpu_running;
+
+	target->loan = loan;
+	wakeup(&target->socketReadPos);
+	poll_wakeup(&target->pollq);
+	while (loan->done < loan->len && !loan->aborted && !td->td_killed) {
+		sleep(loan, &target->lock, "wait another socket to read loaned pages");
+	}
+	// 读完时已由读者摘下；被杀死时由自己摘下
+	if (target->loan == loan) {
+		target->loan = NULL;
+	}
+	wakeup(&target->loan);
+	return loan->done;
+}
+
+/**
+ * @brief 从对端出借的页面中读出至多n字节，全部读完后摘下出借并唤醒写者，需持有socket->lock
+ */
+static u64 socket_loan_read(Socket *socket, int user, u64 buf, u64 n) {
+	SocketLoan *loan = socket->loan;
+	u64 cnt = MIN(n, loan->len - loan->done);
+
+	for (u64 i = 0; i < cnt;) {
+		u64 pos = loan->offset + loan->done;
+		u64 len = MIN(cnt - i, PAGE_SIZE - pos % PAGE_SIZE);
+		copyOutEither(user, buf + i, (void *)(loan->pages[pos / PAGE_SIZE] + pos % PAGE_SIZE), len);
+		loan->done += len;
+		i += len;
+	}
+
+	if (loan->done == loan->len) {
+		socket->loan = NULL;
+		wakeup(loan);
+	}
+	return cnt;
+}
+
+/**
+ * @brief 本socket不再读取时，让正在出借页面的写者返回，需持有socket->lock
+ */
+static void socket_loan_abort(Socket *socket) {
+	if (socket->loan != NULL) {
+		socket->loan->aborted = true;
+		wakeup(socket->loan);
+		socket->loan = NULL;
+	}
+}
+
+/**
+ * @param user 为真时buf为用户地址，否则为内核地址（仅支持流式socket）
+ * @param nonblock 为真时没有数据可读则返回-EAGAIN
+ */
+static int socket_read(struct Fd *fd, int user, u64 buf, u64 n, bool nonblock) {
 	warn("Thread %s: socket read, fd = %d, n = %d\n", cpu_this()->cpu_running->td_name, fd - fds, n);
 	// int i;
 	// char ch;
@@ -411,7 +667,10 @@ static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	// UDP：直接从对端地址读取
 	if (SOCK_IS_UDP(localSocket->type)) {
-		return recvfrom(fd - fds, (void *)buf, n, 0, &localSocket->target_addr, NULL, 0);
+		if (!user) {
+			return -EINVAL;
+		}
+		return recvfrom(fd - fds, (void *)buf, n, nonblock ? MSG_DONTWAIT : 0, &localSocket->target_addr, NULL, 0);
 	}
 
 	// TCP
@@ -422,12 +681,18 @@ static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 		mtx_unlock(&localSocket->lock);
 		return -EPIPE;
 	}
-	while (localSocket->socketReadPos == localSocket->socketWritePos) {
+	while (localSocket->socketReadPos == localSocket->socketWritePos && localSocket->loan == NULL) {
 		mtx_lock(&localSocket->state.state_lock);
 		if (!localSocket->state.is_close && !localSocket->state.opposite_write_close) {
 			mtx_unlock(&localSocket->state.state_lock);
 
+			if (nonblock) {
+				mtx_unlock(&localSocket->lock);
+				return -EAGAIN;
+			}
+
 			wakeup(&localSocket->socketWritePos);
+			poll_wakeup(&localSocket->pollq);
 
 			PROFILING_START
 			// log(999, "[%ld] %s read sleep, wait socket to write\n", time_rtc_us(), cpu_this()->cpu_running->td_name);
@@ -443,6 +708,15 @@ static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 		}
 	}
 
+	// 出借的数据排在缓冲区中的数据之后，且出借期间其他写者不写入缓冲区，因此缓冲区读空后再读出借的页面
+	if (localSocket->socketReadPos == localSocket->socketWritePos && localSocket->loan != NULL) {
+		u64 cnt = socket_loan_read(localSocket, user, buf, n);
+		fd->offset += cnt;
+		poll_wakeup(&localSocket->pollq);
+		mtx_unlock(&localSocket->lock);
+		return cnt;
+	}
+
 	PROFILING_START
 
 	u64 socket_volumn = localSocket->socketWritePos - localSocket->socketReadPos; // 实际容量
@@ -455,10 +729,10 @@ static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	if (read_volumn != 0) {
 		if (read_begin < read_end) {
-			copyOut(buf, localSocket->bufferAddr + read_begin, read_volumn);
+			copyOutEither(user, buf, localSocket->bufferAddr + read_begin, read_volumn);
 		} else {
-			copyOut(buf, localSocket->bufferAddr + read_begin, SOCKET_BUFFER_SIZE - read_begin);
-			copyOut(buf + SOCKET_BUFFER_SIZE - read_begin, localSocket->bufferAddr, read_end);
+			copyOutEither(user, buf, localSocket->bufferAddr + read_begin, SOCKET_BUFFER_SIZE - read_begin);
+			copyOutEither(user, buf + SOCKET_BUFFER_SIZE - read_begin, localSocket->bufferAddr, read_end);
 		}
 	}
 
@@ -467,13 +741,18 @@ static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 	fd->offset += read_volumn;
 
 	wakeup(&localSocket->socketWritePos);
+	poll_wakeup(&localSocket->pollq);
 	mtx_unlock(&localSocket->lock);
 	PROFILING_END_WITH_NAME("socket read actual data")
 
 	return read_volumn;
 }
 
-static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+/**
+ * @param user 为真时buf为用户地址，否则为内核地址（仅支持流式socket）
+ * @param nonblock 为真时缓冲区满则返回已写入的字节数，一个字节也没写入时返回-EAGAIN
+ */
+static int socket_write(struct Fd *fd, int user, u64 buf, u64 n, bool nonblock) {
 	u64 begin_time = time_rtc_us();
 
 	warn("thread %s: socket write, fd = %d, n = %d\n", cpu_this()->cpu_running->td_name, fd - fds, n);
@@ -483,7 +762,10 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	// UDP
 	if (SOCK_IS_UDP(localSocket->type)) {
-		return sendto(fd - fds, (void *)buf, n, 0, &localSocket->target_addr, NULL, 0);
+		if (!user) {
+			return -EINVAL;
+		}
+		return sendto(fd - fds, (void *)buf, n, nonblock ? MSG_DONTWAIT : 0, &localSocket->target_addr, NULL, 0);
 	}
 
 	// TCP
@@ -495,6 +777,11 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 	mtx_unlock(&localSocket->lock);
 
 	Socket *targetSocket = remote_find_peer_socket(localSocket);
+	if (targetSocket == NULL && localSocket->connecting) {
+		// 非阻塞connect尚未被accept
+		return nonblock ? -EAGAIN : -ENOTCONN;
+	}
+	localSocket->connecting = false;
 	if (targetSocket == NULL || targetSocket->self_read_close) {
 		warn("socket write error: can\'t find target socket.\n");
 		// 原因可能是远端已关闭,或者远端关闭读
@@ -503,6 +790,7 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	mtx_lock(&localSocket->state.state_lock); // 获得自身socket的状态锁，从而来获得targetSocket是否关闭的状态
 
+	// 循环中break时仍持有状态锁，在循环后统一放掉
 	while (i < n) {
 		// mtx_lock(
 		//     &localSocket->state.state_lock); // 获得自身socket的状态锁，从而来获得targetSocket是否关闭的状态
@@ -514,21 +802,79 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 				return -EPIPE;
 			} else {
 				warn("socket writer can\'t write more.\n");
-				mtx_unlock(&localSocket->state.state_lock);
 				break;
 			}
 		}
 		// 对端肯定没有关闭,   但不一定没有关闭读， 此时对面有可能已经关闭了读
 		if (targetSocket->self_read_close) {
 			warn("socket writer can\'t write more because target is close reader\n");
-			mtx_unlock(&localSocket->state.state_lock);
 			break;
 			// TODO 可以改成写入非0 break 没有写入 return -EPIPE
+		} else if (targetSocket->loan != NULL) {
+			// 另一个写者正在出借页面，等它被读完再写入，避免数据交错
+			if (nonblock) {
+				if (i == 0) {
+					mtx_unlock(&localSocket->state.state_lock);
+					mtx_unlock(&targetSocket->lock);
+					return -EAGAIN;
+				}
+				break;
+			}
+			mtx_unlock(&localSocket->state.state_lock);
+			sleep(&targetSocket->loan, &targetSocket->lock, "wait another socket to read loaned pages");
+			mtx_lock(&localSocket->state.state_lock);
+		} else if (user && !nonblock && n - i >= SOCKET_LOAN_MIN &&
+			   targetSocket->socketWritePos - targetSocket->socketReadPos == SOCKET_BUFFER_SIZE) {
+			// 缓冲区已满，放不下的长数据出借页面给对端，而不是等待缓冲区腾出空间后再复制
+			// 能放进缓冲区的数据总是先写入缓冲区，写者不会因为本可以缓冲的数据而等待读者
+			// 固定页面时可能处理缺页，先放掉对端的锁
+			SocketLoan loan;
+			mtx_unlock(&localSocket->state.state_lock);
+			mtx_unlock(&targetSocket->lock);
+			err_t r = socket_loan_pin(&loan, buf + i, n - i);
+			mtx_lock(&targetSocket->lock);
+			mtx_lock(&localSocket->state.state_lock);
+			if (r < 0) {
+				if (i == 0) {
+					mtx_unlock(&localSocket->state.state_lock);
+					mtx_unlock(&targetSocket->lock);
+					return r;
+				}
+				break;
+			}
+
+			// 放锁期间对端可能已关闭或读走了数据，此时放弃出借，回到循环开头重新判断
+			if (!localSocket->state.is_close && !targetSocket->self_read_close &&
+			    targetSocket->loan == NULL &&
+			    targetSocket->socketWritePos - targetSocket->socketReadPos == SOCKET_BUFFER_SIZE) {
+				mtx_unlock(&localSocket->state.state_lock);
+				i += socket_loan_wait(targetSocket, &loan);
+				mtx_lock(&localSocket->state.state_lock);
+			}
+			socket_loan_unpin(&loan);
+
+			if (cpu_this()->cpu_running->td_killed) {
+				if (i == 0) {
+					mtx_unlock(&localSocket->state.state_lock);
+					mtx_unlock(&targetSocket->lock);
+					return -EINTR;
+				}
+				break;
+			}
 		} else {
 			if (targetSocket->socketWritePos - targetSocket->socketReadPos == SOCKET_BUFFER_SIZE) {
+				if (nonblock) {
+					if (i == 0) {
+						mtx_unlock(&localSocket->state.state_lock);
+						mtx_unlock(&targetSocket->lock);
+						return -EAGAIN;
+					}
+					break;
+				}
 				mtx_unlock(&localSocket->state.state_lock);
 
 				wakeup(&targetSocket->socketReadPos);
+				poll_wakeup(&targetSocket->pollq);
 				PROFILING_START
 				// log(999, "[%ld] %s write sleep, wait socket to read\n", time_rtc_us(), cpu_this()->cpu_running->td_name);
 				u64 _start = time_rtc_us();
@@ -541,7 +887,7 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 				mtx_lock(&localSocket->state.state_lock);
 			} else {
 				u64 left_size = SOCKET_BUFFER_SIZE - (targetSocket->socketWritePos - targetSocket->socketReadPos);
-				u64 write_length = MIN(left_size, n);
+				u64 write_length = MIN(left_size, n - i);
 				u64 write_dst = targetSocket->socketWritePos + write_length;
 
 				// 当write_begin < write_end, 写[write_begin, write_end)
@@ -550,10 +896,10 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 				u64 write_end = write_dst % SOCKET_BUFFER_SIZE;
 
 				if (write_begin < write_end) {
-					copyIn(buf + i, targetSocket->bufferAddr + write_begin, write_length);
+					copyInEither(user, buf + i, targetSocket->bufferAddr + write_begin, write_length);
 				} else {
-					copyIn(buf + i, targetSocket->bufferAddr + write_begin,  SOCKET_BUFFER_SIZE - write_begin);
-					copyIn(buf + i + SOCKET_BUFFER_SIZE - write_begin, targetSocket->bufferAddr,  write_end);
+					copyInEither(user, buf + i, targetSocket->bufferAddr + write_begin,  SOCKET_BUFFER_SIZE - write_begin);
+					copyInEither(user, buf + i + SOCKET_BUFFER_SIZE - write_begin, targetSocket->bufferAddr,  write_end);
 				}
 				i += write_length;
 				targetSocket->socketWritePos += write_length;
@@ -566,19 +912,39 @@ static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
 
 	fd->offset += i;
 	wakeup(&targetSocket->socketReadPos);
+	poll_wakeup(&targetSocket->pollq);
 	mtx_unlock(&targetSocket->lock);
 	return i;
 }
 
-void socketFree(int socketNum) {
+static int fd_socket_read(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return socket_read(fd, 1, buf, n, fd->flags & O_NONBLOCK);
+}
 
-	Socket *socket = &sockets[socketNum];
+static int fd_socket_write(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return socket_write(fd, 1, buf, n, fd->flags & O_NONBLOCK);
+}
 
+static int fd_socket_kread(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return socket_read(fd, 0, buf, n, fd->flags & O_NONBLOCK);
+}
+
+static int fd_socket_kwrite(struct Fd *fd, u64 buf, u64 n, u64 offset) {
+	return socket_write(fd, 0, buf, n, fd->flags & O_NONBLOCK);
+}
+
+void socketFree(Socket *socket) {
+	// 先从散列表中摘下，之后的查找不会再找到本socket
+	mtx_lock(&mtx_sockhash);
 	mtx_lock(&socket->lock);
+	socket_unhash(socket);
+	mtx_unlock(&mtx_sockhash);
+
 	if (socket->listening != 0) {
-		warn("closing listening socket %d\n", socketNum);
+		warn("closing listening socket %d\n", socket->id);
 	}
 	socket->used = false;
+	socket_loan_abort(socket);
 	socket->socketReadPos = 0;
 	socket->socketWritePos = 0;
 	socket->listening = 0;
@@ -596,26 +962,19 @@ void socketFree(int socketNum) {
 	memset(&socket->target_addr, 0, sizeof(SocketAddr));
 	memset(socket->waiting_queue, 0, (sizeof(SocketAddr) * PENDING_COUNT));
 
-	Message * message;
-	while (!TAILQ_EMPTY(&socket->messages)) {
-		message = TAILQ_FIRST(&socket->messages);
-		TAILQ_REMOVE(&socket->messages, message, message_link);
-		message_free(message);
-	}
+	message_pool_free(socket);
 
 	mtx_lock(&socket->state.state_lock);
 	socket->state.is_close = false;
 	mtx_unlock(&socket->state.state_lock);
 
+	// 唤醒仍在poll本socket的等待者，并摘下它们挂在队列上的项
+	poll_queue_destroy(&socket->pollq);
+
 	mtx_unlock(&socket->lock);
 
 	mtx_lock(&mtx_socketmap);
-	//  对socketBitMap加锁，使得只有一个进程能够进入Alloc函数
-
-	assert(socketNum >= 0 && socketNum < SOCKET_COUNT);
-	int index = socketNum >> 5;
-	int inner = socketNum & 31;
-	socket_bitmap[index] &= ~(1 << inner);
+	LIST_INSERT_HEAD(&socket_free_list, socket, free_link);
 	mtx_unlock(&mtx_socketmap);
 }
 
@@ -629,12 +988,13 @@ static int fd_socket_close(struct Fd *fd) {
 		targetSocket->state.is_close = true;
 		mtx_unlock(&targetSocket->state.state_lock);
 		wakeup(&targetSocket->socketReadPos);
+		poll_wakeup(&targetSocket->pollq);
 		mtx_unlock(&targetSocket->lock);
 	}
 
 	wakeup(&localSocket->socketWritePos); // TODO 检查此处wake的正确性
-	int socketNum = localSocket - sockets;
-	socketFree(socketNum);
+	poll_wakeup(&localSocket->pollq);
+	socketFree(localSocket);
 
 	return 0;
 }
@@ -643,81 +1003,106 @@ static int fd_socket_stat(struct Fd *fd, u64 pkStat) {
 	return 0;
 }
 
-// udpdata struct
-static Message * message_alloc() {
-	Message * message;
-	mtx_lock(&mtx_messages);
-	if (TAILQ_EMPTY(&message_free_list)) {
-		warn("no free message struct\n");
-		mtx_unlock(&mtx_messages);
+/**
+ * @brief 在接收方socket的消息池中分配一个能容纳length字节的消息，需持有socket->lock
+ * @return 消息池已满或内存不足时返回NULL
+ */
+static Message *message_alloc(Socket *socket, u64 length) {
+	Message *message = TAILQ_FIRST(&socket->free_messages);
+	if (message != NULL) {
+		TAILQ_REMOVE(&socket->free_messages, message, message_link);
+	} else if (socket->message_cnt < SOCKET_MESSAGE_MAX) {
+		message = kmalloc(sizeof(Message));
+		if (message == NULL) {
+			return NULL;
+		}
+		socket->message_cnt++;
+	} else {
+		warn("socket %d: message pool is full\n", socket->id);
 		return NULL;
 	}
-	message = TAILQ_FIRST(&message_free_list);
-	TAILQ_REMOVE(&message_free_list, message, message_link);
-	mtx_unlock(&mtx_messages);
 
-	message->message_link.tqe_next= NULL;
-	message->message_link.tqe_prev = NULL;
-	message->bufferAddr = (void *)kvmAlloc();
+	// 复用的缓冲区不够大时重新分配
+	if (message->capacity < length) {
+		if (message->bufferAddr != NULL) {
+			kfree(message->bufferAddr);
+		}
+		message->capacity = MAX(length, 1);
+		message->bufferAddr = kmalloc(message->capacity);
+	}
 	message->length = 0;
-
 	return message;
 }
 
-// designed only by UDP
-static Socket * find_udp_connect_socket(SocketAddr * addr, int self_type, int socket_index) {
-	for (int i = 0; i < SOCKET_COUNT; ++i) {
-		mtx_lock(&sockets[i].lock);
-		if ( sockets[i].used &&
-			i != socket_index && // 不能找到自己
-			sockets[i].type == self_type &&
-			// sockets[i].addr.family == addr->family &&
-		    (sockets[i].addr.port == addr->port)// &&
-		    // sockets[i].addr.addr == addr->addr
-			&& (!sockets[i].udp_is_connect || (sockets[i].udp_is_connect && sockets[i].opposite == socket_index))
-		) {
-			mtx_unlock(&sockets[i].lock);
-			return &sockets[i];
+/**
+ * @brief 把消息放回socket的消息池，需持有socket->lock
+ */
+static void message_free(Socket *socket, Message *message) {
+	message->family = 0;
+	message->port = 0;
+	message->addr = 0;
+	message->length = 0;
+	// 大的缓冲区不留在池中，避免长期占用内存
+	if (message->capacity > MESSAGE_KEEP_SIZE) {
+		kfree(message->bufferAddr);
+		message->bufferAddr = NULL;
+		message->capacity = 0;
+	}
+	TAILQ_INSERT_HEAD(&socket->free_messages, message, message_link);
+}
+
+/**
+ * @brief 释放socket的所有消息（包括未读的），需持有socket->lock
+ */
+static void message_pool_free(Socket *socket) {
+	Message *message;
+	while ((message = TAILQ_FIRST(&socket->messages)) != NULL) {
+		TAILQ_REMOVE(&socket->messages, message, message_link);
+		TAILQ_INSERT_HEAD(&socket->free_messages, message, message_link);
+	}
+	while ((message = TAILQ_FIRST(&socket->free_messages)) != NULL) {
+		TAILQ_REMOVE(&socket->free_messages, message, message_link);
+		if (message->bufferAddr != NULL) {
+			kfree(message->bufferAddr);
 		}
-		mtx_unlock(&sockets[i].lock);
+		kfree(message);
 	}
-	return NULL;
-} // TODO type判断还有些问题
+	socket->message_cnt = 0;
+}
 
-// designed only by UDP
-static Socket * find_udp_remote_socket(SocketAddr * addr, int self_type, int socket_index) {
-	for (int i = 0; i < SOCKET_COUNT; ++i) {
-		mtx_lock(&sockets[i].lock);
-		if ( sockets[i].used &&
-			i != socket_index && // 不能找到自己
-			sockets[i].type == self_type &&
-			// sockets[i].addr.family == addr->family &&
-		    (sockets[i].addr.port == addr->port &&(!sockets[i].udp_is_connect || (sockets[i].udp_is_connect && sockets[i].opposite == socket_index)))
-		    // sockets[i].addr.addr == addr->addr
-			&& (!sockets[i].udp_is_connect || (sockets[i].udp_is_connect && sockets[i].opposite == socket_index))
-		) {
-			mtx_unlock(&sockets[i].lock);
-			return &sockets[i];
+/**
+ * @brief 查找端口为addr->port、可以与socket_id通信的UDP socket，需持有mtx_sockhash
+ */
+static Socket *find_udp_socket_locked(SocketAddr *addr, int self_type, int socket_id) {
+	Socket *socket;
+	LIST_FOREACH (socket, &socket_bind_hash[socket_bind_hash_of(addr->port)], bind_link) {
+		if (socket->id != socket_id && // 不能找到自己
+		    socket->type == self_type && socket->addr.port == addr->port &&
+		    (!socket->udp_is_connect || socket->opposite == socket_id)) {
+			return socket;
 		}
-		mtx_unlock(&sockets[i].lock);
 	}
 	return NULL;
-} // TODO type判断还有些问题
-
+}
 
-static void message_free(Message * message) {
-	message->message_link.tqe_next = NULL;
-	message->message_link.tqe_prev = NULL;
-	message->family = 0;
-	message->port = 0;
-	message->addr = 0;
-	message->length = 0;
-	kvmFree((u64)message->bufferAddr);
+// designed only by UDP
+static Socket * find_udp_connect_socket(SocketAddr * addr, int self_type, int socket_id) {
+	mtx_lock(&mtx_sockhash);
+	Socket *socket = find_udp_socket_locked(addr, self_type, socket_id);
+	mtx_unlock(&mtx_sockhash);
+	return socket;
+} // TODO type判断还有些问题
 
-	mtx_lock(&mtx_messages);
-	TAILQ_INSERT_TAIL(&message_free_list, message, message_link);
-	mtx_unlock(&mtx_messages);
-}
+// designed only by UDP，如果找到了就持有其锁
+static Socket * find_udp_remote_socket(SocketAddr * addr, int self_type, int socket_id) {
+	mtx_lock(&mtx_sockhash);
+	Socket *socket = find_udp_socket_locked(addr, self_type, socket_id);
+	if (socket != NULL) {
+		mtx_lock(&socket->lock);
+	}
+	mtx_unlock(&mtx_sockhash);
+	return socket;
+} // TODO type判断还有些问题
 
 /**
  * @brief 接收用户数据报，将对方地址存入src_addr
@@ -740,13 +1125,15 @@ int recvfrom(int sockfd, void *buffer, size_t len, int flags, SocketAddr *src_ad
 
 		local_socket = fds[sfd].socket;
 		if (local_socket->type == 1) {
-			return fd_socket_read(&fds[sfd], (u64)buffer,  (u64)len, 0);
+			bool nonblock = (fds[sfd].flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
+			return socket_read(&fds[sfd], 1, (u64)buffer, (u64)len, nonblock);
 		}
 		ws = sfd;
 	} else {
 		local_socket = fds[sockfd].socket;
 		ws = sockfd;
 	}
+	bool nonblock = (fds[ws].flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
 
 	SocketAddr socketaddr;
 	if (!user) socketaddr = *src_addr;
@@ -770,7 +1157,10 @@ int recvfrom(int sockfd, void *buffer, size_t len, int flags, SocketAddr *src_ad
 		}
 
 		if (message == NULL) {
-			// TODO：wakeup
+			if (nonblock) {
+				mtx_unlock(&local_socket->lock);
+				return -EAGAIN;
+			}
 			sleep(&local_socket->messages, &local_socket->lock,
 			      "wait another UDP socket to write");
 			// tsleep(&local_socket->messages, &local_socket->lock, "wait another UDP socket to write", 10000);
@@ -788,11 +1178,10 @@ int recvfrom(int sockfd, void *buffer, size_t len, int flags, SocketAddr *src_ad
 	}
 
 	TAILQ_REMOVE(&local_socket->messages, message, message_link);
+	message_free(local_socket, message);
 
 	mtx_unlock(&local_socket->lock);
 
-	message_free(message);
-
 	warn("thread %s: socket fd = %d recvfrom addr: %x, port %d\n", cpu_this()->cpu_running->td_name, ws, socketaddr.addr, socketaddr.port);
 	return min_size;
 
@@ -819,13 +1208,15 @@ int sendto(int sockfd, const void * buffer, size_t len, int flags, const SocketA
 		}
 		assert(local_socket != NULL);
 		if (local_socket->type == 1) {
-			return fd_socket_write(&fds[sfd], (u64)buffer,  (u64)len, 0);
+			bool nonblock = (fds[sfd].flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
+			return socket_write(&fds[sfd], 1, (u64)buffer, (u64)len, nonblock);
 		}
 		ws = sfd;
 	} else {
 		local_socket = fds[sockfd].socket;
 		ws = sockfd;
 	}
+	bool nonblock = (fds[ws].flags & O_NONBLOCK) || (flags & MSG_DONTWAIT);
 
 	SocketAddr socketaddr;
 	if (user) {
@@ -835,29 +1226,31 @@ int sendto(int sockfd, const void * buffer, size_t len, int flags, const SocketA
 	}
 
 
-	Socket * target_socket = find_udp_remote_socket(&socketaddr, local_socket->type, local_socket - sockets);
+	int min_len = MIN(len, MESSAGE_MAX_SIZE);
+	Socket * target_socket = find_udp_remote_socket(&socketaddr, local_socket->type, local_socket->id);
 
 	if (target_socket == NULL) {
 		warn("target addr socket doesn't exists\n");
-		return MIN(len, 65535); // 发送不了也不报错，因为UDP不校验发送的正确性
+		return min_len; // 发送不了也不报错，因为UDP不校验发送的正确性
 	}
 
-	Message * message = message_alloc();
+	// 消息从接收方的消息池中分配，不同的收发对之间不争用锁
+	Message * message = message_alloc(target_socket, min_len);
 	if (message == NULL) {
-		return -1;
+		mtx_unlock(&target_socket->lock);
+		// 接收方积压的数据报过多，非阻塞时让调用者稍后重试
+		return nonblock ? -EAGAIN : -ENOBUFS;
 	}
 
 	message->family = local_socket->addr.family;
 	message->addr = local_socket->addr.addr;
 	message->port = local_socket->addr.port;
 
-	int min_len = MIN(len, 65535);
 	copyIn((u64)buffer, message->bufferAddr, min_len);
 	message->length = min_len;
-
-	mtx_lock(&target_socket->lock);
 	TAILQ_INSERT_TAIL(&target_socket->messages, message, message_link);
 	wakeup(&target_socket->messages); // 唤醒对端的recvfrom
+	poll_wakeup(&target_socket->pollq);
 	mtx_unlock(&target_socket->lock);
 
 	warn("thread %s: socket fd = %d sendto addr: %x, port %d\n", cpu_this()->cpu_running->td_name, ws, socketaddr.addr, socketaddr.port);
@@ -905,6 +1298,10 @@ int getsockopt(int sockfd, int lever, int optname, void * optval, socklen_t * op
 		} else if (optname == SO_SNDBUF) {
 			val = 16384;
 			copyOut((u64)optval, &val, sizeof(socklen_t));
+		} else if (optname == SO_ERROR) {
+			// 非阻塞connect完成后由此查询结果，本地连接不会异步失败
+			val = 0;
+			copyOut((u64)optval, &val, sizeof(socklen_t));
 		}
 		copyOut((u64)optlen, &size, sizeof(socklen_t));
 	}
@@ -935,7 +1332,8 @@ int socket_read_check(struct Fd *fd) {
 			ret = 1;
 		} else {
 			mtx_lock(&socket->state.state_lock);
-			ret = ((socket->socketReadPos != socket->socketWritePos) || (socket->state.is_close) || (socket->state.opposite_write_close));
+			ret = ((socket->socketReadPos != socket->socketWritePos) || (socket->loan != NULL) ||
+			       (socket->state.is_close) || (socket->state.opposite_write_close));
 			mtx_unlock(&socket->state.state_lock);
 		}
 	} else {
@@ -987,17 +1385,20 @@ int socket_write_check(struct Fd* fd) {
 		}
 		mtx_unlock(&socket->state.state_lock);
 
-		// 对方已关闭
+		// 非阻塞connect尚未被accept时不可写；否则对方已关闭
 		if (targetSocket == NULL) {
-			ret = 1;
+			ret = socket->connecting ? 0 : 1;
 			goto out;
-		}else if (targetSocket->self_read_close) {
+		}
+		socket->connecting = false;
+		if (targetSocket->self_read_close) {
 			ret = 1;
 			mtx_unlock(&targetSocket->lock);
 			goto out;
 		}
 
-		ret = (targetSocket->socketWritePos - targetSocket->socketReadPos != SOCKET_BUFFER_SIZE);
+		ret = (targetSocket->socketWritePos - targetSocket->socketReadPos != SOCKET_BUFFER_SIZE) &&
+		      (targetSocket->loan == NULL);
 		mtx_unlock(&targetSocket->lock);
 	} else {
 		mtx_unlock(&socket->lock);
@@ -1009,6 +1410,25 @@ out:
 	return ret;
 }
 
+/**
+ * @brief 获取socket的状态变化会唤醒的等待队列
+ * 可读状态只取决于自身；流式socket的可写状态取决于对端的缓冲区，对端读走数据时唤醒的是对端的队列
+ */
+int socket_poll_queues(struct Fd *fd, PollQueue *qs[POLL_MAX_QUEUE]) {
+	Socket *socket = fd->socket;
+	int n = 0;
+
+	qs[n++] = &socket->pollq;
+	if ((socket->type & 0xf) == SOCK_STREAM && !socket->listening) {
+		Socket *targetSocket = remote_find_peer_socket(socket);
+		if (targetSocket != NULL) {
+			qs[n++] = &targetSocket->pollq;
+			mtx_unlock(&targetSocket->lock);
+		}
+	}
+	return n;
+}
+
 int shutdown(int sockfd, int how) {
 
 	int sfd = cur_proc_fs_struct()->fdList[sockfd];
@@ -1029,7 +1449,9 @@ int shutdown(int sockfd, int how) {
 	if (how == SHUT_RD) {
 		mtx_lock(&local_socket->lock);
 		local_socket->self_read_close = true;
+		socket_loan_abort(local_socket);
 		wakeup(&local_socket->socketWritePos);
+		poll_wakeup(&local_socket->pollq);
 		mtx_unlock(&local_socket->lock);
 	} else if (how == SHUT_WR) {
 		Socket *target_socket = remote_find_peer_socket(local_socket);
@@ -1038,10 +1460,12 @@ int shutdown(int sockfd, int how) {
 			target_socket->state.opposite_write_close = true;
 			mtx_unlock(&target_socket->state.state_lock);
 			wakeup(&target_socket->socketReadPos);
+			poll_wakeup(&target_socket->pollq);
 			mtx_unlock(&target_socket->lock);
 		}
 		mtx_lock(&local_socket->lock);
 		local_socket->self_write_close= true;
+		poll_wakeup(&local_socket->pollq);
 		mtx_unlock(&local_socket->lock);
 
 	} else if (how == SHUT_RDWR) {
@@ -1052,13 +1476,16 @@ int shutdown(int sockfd, int how) {
 			target_socket->state.opposite_write_close = true;
 			mtx_unlock(&target_socket->state.state_lock);
 			wakeup(&target_socket->socketReadPos);
+			poll_wakeup(&target_socket->pollq);
 			mtx_unlock(&target_socket->lock);
 		}
 
 		mtx_lock(&local_socket->lock);
 		local_socket->self_write_close= true;
 		local_socket->self_read_close = true;
+		socket_loan_abort(local_socket);
 		wakeup(&local_socket->socketWritePos);
+		poll_wakeup(&local_socket->pollq);
 		mtx_unlock(&local_socket->lock);
 	} else {
 		return -EINVAL;
@@ -0,0 +1,379 @@
+#include <fs/dirent.h>
+#include <fs/fat32.h>
+#include <fs/file_device.h>
+#include <fs/fs.h>
+#include <fs/tmpfs.h>
+#include <fs/vfs.h>
+#include <lib/error.h>
+#include <lib/log.h>
+#include <lib/string.h>
+#include <lib/transfer.h>
+#include <lock/mutex.h>
+#include <mm/vmm.h>
+#include <sys/errno.h>
+#include <sys/syscall_fs.h>
+
+/**
+ * tmpfs：数据只保存在内存中的文件系统，用于/tmp等临时文件
+ * 目录树就是Dirent树，没有磁盘上的目录项；文件数据按页保存在Dirent的两级页表tmp_pages中，
+ * 读写只在这些页与调用者的缓冲区之间复制，不经过FAT、块缓存和设备
+ * 超级块中只使用bytes_per_clus（页大小）、data_clus_cnt（页配额）、free_cnt（剩余配额）和
+ * fat_lock（保护配额的自旋锁）
+ */
+
+extern mutex_t mtx_file;
+
+// 一页能容纳的页地址个数
+#define TMPFS_PTRS_PER_PAGE (PAGE_SIZE / sizeof(u64))
+// 两级页表所能容纳的最大文件大小
+#define TMPFS_FILE_MAX_SIZE ((u64)TMPFS_PTRS_PER_PAGE * TMPFS_PTRS_PER_PAGE * PAGE_SIZE)
+
+struct FileDev file_dev_tmpfs = {
+    .dev_id = 't',
+    .dev_name = "tmpfs",
+    .dev_read = tmpfs_read,
+    .dev_write = tmpfs_write,
+};
+
+// 读取空洞时使用的全0页
+static u8 zero_page[PAGE_SIZE];
+
+/**
+ * @brief 初始化一个tmpfs，页配额为当前空闲物理页数的一半
+ */
+void tmpfs_init(FileSystem *fs) {
+	extern u64 pageleft;
+	SuperBlock *sb = &fs->superBlock;
+
+	strncpy(fs->name, "tmpfs", 8);
+	fs->type = FS_TMPFS;
+	sb->bytes_per_clus = PAGE_SIZE;
+	sb->data_clus_cnt = pageleft / 2;
+	sb->free_cnt = sb->data_clus_cnt;
+	mtx_init(&sb->fat_lock, "tmpfs", false, MTX_SPIN);
+
+	Dirent *root = dirent_alloc();
+	strncpy(root->name, "/", 2);
+	root->file_system = fs;
+	root->raw_dirent.DIR_Attr = ATTR_DIRECTORY;
+	root->type = DIRENT_DIR;
+	root->dev = &file_dev_tmpfs;
+	root->parent_dirent = NULL;
+	LIST_INIT(&root->child_list);
+	root->linkcnt = 1;
+	fs->root = root;
+
+	log(LEVEL_GLOBAL, "tmpfs init finished, %d pages available\n", sb->free_cnt);
+}
+
+/**
+ * @brief 从配额中扣除一页，配额用尽时返回false
+ */
+static bool tmpfs_charge(FileSystem *fs) {
+	SuperBlock *sb = &fs->superBlock;
+	bool ok;
+
+	mtx_lock(&sb->fat_lock);
+	ok = sb->free_cnt > 0;
+	if (ok) {
+		sb->free_cnt -= 1;
+	}
+	mtx_unlock(&sb->fat_lock);
+	return ok;
+}
+
+static void tmpfs_uncharge(FileSystem *fs, u32 cnt) {
+	SuperBlock *sb = &fs->superBlock;
+
+	mtx_lock(&sb->fat_lock);
+	sb->free_cnt += cnt;
+	mtx_unlock(&sb->fat_lock);
+}
+
+/**
+ * @brief 获取文件第pgno页的地址，调用者需持有file->lock
+ * @param alloc 为真时分配不存在的页（新页已清零），配额用尽时返回0；为假时不存在的页返回0
+ */
+static u64 tmpfs_page(Dirent *file, u32 pgno, bool alloc) {
+	u32 i = pgno / TMPFS_PTRS_PER_PAGE, j = pgno % TMPFS_PTRS_PER_PAGE;
+
+	if (file->tmp_pages == NULL) {
+		if (!alloc) {
+			return 0;
+		}
+		file->tmp_pages = (u64 **)kvmAlloc();
+	}
+
+	u64 *leaf = file->tmp_pages[i];
+	if (leaf == NULL) {
+		if (!alloc) {
+			return 0;
+		}
+		leaf = file->tmp_pages[i] = (u64 *)kvmAlloc();
+	}
+
+	if (leaf[j] == 0 && alloc) {
+		if (!tmpfs_charge(file->file_system)) {
+			return 0;
+		}
+		leaf[j] = kvmAlloc();
+	}
+	return leaf[j];
+}
+
+/**
+ * @brief 释放文件第from页及之后的所有页，from为0时同时释放页表本身
+ */
+static void tmpfs_free_pages(Dirent *file, u32 from) {
+	u64 **dir = file->tmp_pages;
+	u32 freed = 0;
+
+	if (dir == NULL) {
+		return;
+	}
+
+	for (u32 i = from / TMPFS_PTRS_PER_PAGE; i < TMPFS_PTRS_PER_PAGE; i++) {
+		u64 *leaf = dir[i];
+		if (leaf == NULL) {
+			continue;
+		}
+
+		u32 j0 = i == from / TMPFS_PTRS_PER_PAGE ? from % TMPFS_PTRS_PER_PAGE : 0;
+		for (u32 j = j0; j < TMPFS_PTRS_PER_PAGE; j++) {
+			if (leaf[j] != 0) {
+				kvmFree(leaf[j]);
+				leaf[j] = 0;
+				freed++;
+			}
+		}
+		if (j0 == 0) {
+			kvmFree((u64)leaf);
+			dir[i] = NULL;
+		}
+	}
+
+	if (from == 0) {
+		kvmFree((u64)dir);
+		file->tmp_pages = NULL;
+	}
+	tmpfs_uncharge(file->file_system, freed);
+}
+
+/**
+ * @brief 读取文件off处的n字节到dst。user为真时dst是用户地址，否则为内核地址
+ * @note 未写入过的页（空洞）读出为0
+ * @return 读取的字节数，遇到文件尾时返回0
+ */
+int tmpfs_read(Dirent *file, int user, u64 dst, uint off, uint n) {
+	mtx_lock_sleep(&file->lock);
+
+	if (off >= file->file_size) {
+		mtx_unlock_sleep(&file->lock);
+		return 0;
+	}
+	n = MIN(n, file->file_size - off);
+
+	for (u32 done = 0; done < n;) {
+		u32 pos = off + done;
+		u32 len = MIN(PAGE_SIZE - pos % PAGE_SIZE, n - done);
+		u64 page = tmpfs_page(file, pos / PAGE_SIZE, false);
+		void *src = page ? (void *)(page + pos % PAGE_SIZE) : (void *)zero_page;
+
+		copyOutEither(user, dst + done, src, len);
+		done += len;
+	}
+
+	mtx_unlock_sleep(&file->lock);
+	return n;
+}
+
+/**
+ * @brief 将src的n字节写入文件off处，按需分配页。user为真时src是用户地址，否则为内核地址
+ * @note 允许off超出文件尾，中间的部分成为空洞
+ * @return 写入的字节数。配额用尽时只写入已分配到页的部分，一个字节也没写入时返回-ENOSPC
+ */
+int tmpfs_write(Dirent *file, int user, u64 src, uint off, uint n) {
+	if ((u64)off + n > TMPFS_FILE_MAX_SIZE) {
+		return -EFBIG;
+	}
+
+	mtx_lock_sleep(&file->lock);
+
+	u32 done = 0;
+	while (done < n) {
+		u32 pos = off + done;
+		u32 len = MIN(PAGE_SIZE - pos % PAGE_SIZE, n - done);
+		u64 page = tmpfs_page(file, pos / PAGE_SIZE, true);
+		if (page == 0) {
+			warn("tmpfs: no space left when writing %s\n", file->name);
+			break;
+		}
+
+		copyInEither(user, src + done, (void *)(page + pos % PAGE_SIZE), len);
+		done += len;
+	}
+
+	if (off + done > file->file_size) {
+		file->file_size = off + done;
+	}
+
+	mtx_unlock_sleep(&file->lock);
+	return (done == 0 && n != 0) ? -ENOSPC : done;
+}
+
+/**
+ * @brief file_copy_range中至少一端是tmpfs文件的情形：逐页在tmpfs的页与另一端之间直接读写，不经过中转缓冲区
+ * @note 加锁顺序与file_copy_range相同
+ */
+int tmpfs_copy_range(Dirent *src, uint soff, Dirent *dst, uint doff, uint n) {
+	Dirent *first = src < dst ? src : dst;
+	Dirent *second = src < dst ? dst : src;
+	int r = 0;
+
+	mtx_lock_sleep(&first->lock);
+	if (second != first) {
+		mtx_lock_sleep(&second->lock);
+	}
+
+	n = soff >= src->file_size ? 0 : MIN(n, src->file_size - soff);
+	u32 done = 0;
+	while (done < n) {
+		u32 s = soff + done, d = doff + done;
+
+		if (IS_TMPFS(src->file_system)) {
+			u32 len = MIN(PAGE_SIZE - s % PAGE_SIZE, n - done);
+			u64 page = tmpfs_page(src, s / PAGE_SIZE, false);
+			void *buf = page ? (void *)(page + s % PAGE_SIZE) : (void *)zero_page;
+			r = dst->dev->dev_write(dst, 0, (u64)buf, d, len);
+		} else {
+			u32 len = MIN(PAGE_SIZE - d % PAGE_SIZE, n - done);
+			u64 page = tmpfs_page(dst, d / PAGE_SIZE, true);
+			if (page == 0) {
+				r = -ENOSPC;
+				break;
+			}
+			r = file_read(src, 0, page + d % PAGE_SIZE, s, len);
+			if (r > 0 && d + r > dst->file_size) {
+				dst->file_size = d + r;
+			}
+		}
+
+		if (r <= 0) {
+			break;
+		}
+		done += r;
+	}
+
+	if (second != first) {
+		mtx_unlock_sleep(&second->lock);
+	}
+	mtx_unlock_sleep(&first->lock);
+	return (done == 0 && r < 0) ? r : done;
+}
+
+/**
+ * @brief 将文件大小改为newsize。缩小时释放文件尾之后的所有页，扩大时新增的部分是空洞
+ */
+void tmpfs_truncate(Dirent *file, u64 newsize) {
+	mtx_lock_sleep(&file->lock);
+
+	if (newsize < file->file_size) {
+		// 新文件尾所在页的剩余部分清零，以后再扩大文件时应读出0
+		if (newsize % PAGE_SIZE != 0) {
+			u64 page = tmpfs_page(file, newsize / PAGE_SIZE, false);
+			if (page != 0) {
+				memset((void *)(page + newsize % PAGE_SIZE), 0,
+				       PAGE_SIZE - newsize % PAGE_SIZE);
+			}
+		}
+		tmpfs_free_pages(file, PGROUNDUP(newsize) / PAGE_SIZE);
+	}
+	file->file_size = newsize;
+
+	mtx_unlock_sleep(&file->lock);
+}
+
+/**
+ * @brief 为文件的[offset, offset + len)预先分配页，参数已由file_fallocate检查
+ * @note 不带FALLOC_FL_KEEP_SIZE时同时扩大文件；带FALLOC_FL_KEEP_SIZE时文件尾之后的页在截断时被释放
+ */
+int tmpfs_fallocate(Dirent *file, int mode, u64 offset, u64 len) {
+	if (offset + len > TMPFS_FILE_MAX_SIZE) {
+		return -EFBIG;
+	}
+
+	mtx_lock_sleep(&file->lock);
+	for (u64 pgno = offset / PAGE_SIZE; pgno < PGROUNDUP(offset + len) / PAGE_SIZE; pgno++) {
+		if (tmpfs_page(file, pgno, true) == 0) {
+			mtx_unlock_sleep(&file->lock);
+			return -ENOSPC;
+		}
+	}
+	if (!(mode & FALLOC_FL_KEEP_SIZE) && offset + len > file->file_size) {
+		file->file_size = offset + len;
+	}
+	mtx_unlock_sleep(&file->lock);
+	return 0;
+}
+
+/**
+ * @brief 在tmpfs目录中分配一个名为name的Dirent，并获取其引用。tmpfs没有磁盘上的目录项，无需写入dir
+ */
+int tmpfs_alloc_file(Dirent *dir, Dirent **file, char *name) {
+	Dirent *dirent = dirent_alloc();
+
+	strncpy(dirent->name, name, MAX_NAME_LEN);
+	dget(dirent);
+
+	*file = dirent;
+	return 0;
+}
+
+/**
+ * @brief 读取tmpfs目录中的第offset个子项的文件名
+ * @return 1表示读到一项，0表示已到目录尾
+ */
+int tmpfs_getdent(Dirent *dir, u32 offset, char *name, int len, int *next_offset) {
+	Dirent *child;
+	u32 i = 0;
+
+	mtx_lock_sleep(&mtx_file);
+	LIST_FOREACH (child, &dir->child_list, dirent_link) {
+		if (i++ == offset) {
+			strncpy(name, child->name, len);
+			*next_offset = offset + 1;
+			mtx_unlock_sleep(&mtx_file);
+			return 1;
+		}
+	}
+	*next_offset = offset;
+	mtx_unlock_sleep(&mtx_file);
+	return 0;
+}
+
+/**
+ * @brief 判断tmpfs中是否还有被引用的文件。调用者持有根目录的一个引用
+ * @note 打开文件或以其为工作目录时，会获取其路径上包括根目录在内所有目录的引用
+ */
+bool tmpfs_busy(FileSystem *fs) {
+	return fs->root->refcnt > 1;
+}
+
+static void tmpfs_free_tree(Dirent *dir) {
+	Dirent *child;
+
+	while ((child = LIST_FIRST(&dir->child_list)) != NULL) {
+		dirent_remove_child(child);
+		tmpfs_free_tree(child);
+	}
+	tmpfs_free_pages(dir, 0);
+	dirent_dealloc(dir);
+}
+
+/**
+ * @brief 卸载时释放tmpfs的整个目录树和全部数据页，调用者需持有mtx_file
+ */
+void tmpfs_destroy(FileSystem *fs) {
+	tmpfs_free_tree(fs->root);
+	fs->root = NULL;
+}
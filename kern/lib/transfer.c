@@ -6,12 +6,15 @@
 #include <proc/interface.h>
 #include <proc/proc.h>
 #include <proc/thread.h>
+#include <sys/errno.h>
 #include <trap/trap.h>
 
 typedef err_t (*user_kernel_callback_t)(void *uptr, void *kptr, size_t len, void *arg);
 
 
 extern err_t page_fault_handler(pte_t *pd, u64 violate, u64 badva);
+
+#define USER_PIN_RETRY 4
 static void test_page_fault(Pte *upd, u64 va, Pte pte, u64 permneed) {
 	// 无效，传入权限一定违反
 	if (!(pte & PTE_V)) {
@@ -108,6 +111,50 @@ void copyIn(u64 uPtr, void *kPtr, int len) {
 	userToKernel(cur_proc_pt(), uPtr, kPtr, len, copyInCallback, PTE_R, NULL);
 }
 
+/**
+ * @brief 固定当前进程用户地址uPtr所在的页面，页面不在或权限不足时先处理缺页（含写时复制）
+ * @note 使用完毕后用ptUnpin释放
+ * @param write 为真时要求该页可写
+ * @param pa 返回uPtr对应的物理地址
+ * @return 地址无效时返回-EFAULT
+ */
+err_t userPinPage(u64 uPtr, bool write, u64 *pa) {
+	Pte *pgDir = cur_proc_pt();
+	u64 perm = PTE_U | (write ? PTE_W : PTE_R);
+	// 处理缺页后、固定前页面可能被其他线程解除映射，此时重新处理缺页
+	for (int i = 0; i < USER_PIN_RETRY; i++) {
+		if (ptPin(pgDir, uPtr, perm, pa) == 0) {
+			return 0;
+		}
+		if (page_fault_handler(pgDir, perm & ~PTE_U, uPtr) != 0) {
+			return -EFAULT;
+		}
+	}
+	return -EFAULT;
+}
+
+/**
+ * @brief 将内核数据拷贝到dst。user为真时dst为用户地址，否则为内核地址
+ */
+void copyOutEither(int user, u64 dst, void *kPtr, int len) {
+	if (user) {
+		copyOut(dst, kPtr, len);
+	} else {
+		memmove((void *)dst, kPtr, len);
+	}
+}
+
+/**
+ * @brief 将src处的数据拷贝入内核。user为真时src为用户地址，否则为内核地址
+ */
+void copyInEither(int user, u64 src, void *kPtr, int len) {
+	if (user) {
+		copyIn(src, kPtr, len);
+	} else {
+		memmove(kPtr, (void *)src, len);
+	}
+}
+
 /**
  * @brief 将用户态的字符串拷贝进内核
  * @param n 表示传输的最大字符数
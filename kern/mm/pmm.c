@@ -4,6 +4,7 @@
  */
 
 #include <dev/dtb.h>
+#include <dev/ramdisk.h>
 #include <fs/buf.h>
 #include <lib/error.h>
 #include <lib/log.h>
@@ -26,6 +27,7 @@ Page *pages = NULL;
 PageList pageFreeList;
 
 extern struct MemInfo memInfo;
+extern struct InitrdInfo initrdInfo;
 extern char end[];
 
 // 模块初始化函数
@@ -43,6 +45,18 @@ void pmmInit() {
 	u64 freemem = PGROUNDUP((u64)end); // 空闲内存页的起始地址
 	npage = memInfo.size / PAGE_SIZE;  // 内存页数
 
+	// initrd可能落在下面为内核数据结构预留的区域中，先把它搬到内存顶端，这些页保留到解包之后再释放
+	u64 initrdPage = 0;
+	if (initrdInfo.end > initrdInfo.start) {
+		u64 size = initrdInfo.end - initrdInfo.start;
+		initrdPage = PGROUNDUP(size) >> PAGE_SHIFT;
+		u64 dst = MEMBASE + ((npage - initrdPage) << PAGE_SHIFT);
+		memmove((void *)dst, (void *)initrdInfo.start, size);
+		initrdInfo.start = dst;
+		initrdInfo.end = dst + size;
+		log(MM_GLOBAL, "\tInitrd moved to 0x%08lx~0x%08lx\n", initrdInfo.start, initrdInfo.end);
+	}
+
 	// 内存管理模块的数组
 	pages = pmInitPush(freemem, npage * sizeof(Page), &freemem); // 初始化内存页数组
 
@@ -58,13 +72,18 @@ void pmmInit() {
 
 	// 为 VirtIO 驱动分配连续的两页
 	extern void *virtioDriverBuffer;
-	virtioDriverBuffer = pmInitPush(freemem, 2 * PAGE_SIZE, &freemem);
+	virtioDriverBuffer = pmInitPush(freemem, 3 * PAGE_SIZE, &freemem);
 
 	// 为磁盘缓存分配内存
 	extern void *bufferData;
-	bufferData = pmInitPush(freemem, BGROUP_NUM * sizeof(BufferDataGroup), &freemem);
-	extern void *bufferGroups;
-	bufferGroups = pmInitPush(freemem, BGROUP_NUM * sizeof(BufferGroup), &freemem);
+	bufferData = pmInitPush(freemem, BUF_NUM * sizeof(BufferData), &freemem);
+	extern void *bufferShards;
+	bufferShards = pmInitPush(freemem, BSHARD_NUM * sizeof(BufferShard), &freemem);
+#if RAMDISK_SIZE > 0
+	// 为内存块设备分配内存
+	ramdiskData = pmInitPush(freemem, RAMDISK_SIZE, &freemem);
+	ramdiskSize = RAMDISK_SIZE;
+#endif
 	extern thread_t *threads;
 	threads = pmInitPush(freemem, NTHREAD * sizeof(thread_t), &freemem);
 	extern proc_t *procs;
@@ -88,11 +107,15 @@ void pmmInit() {
 		pages[i].ref = 1;
 	}
 	log(MM_GLOBAL, "\tTo pages[0:%d) used\n", pageused);
-	for (u64 i = pageused; i < npage; i++) {
+	panic_on(pageused + initrdPage > npage);
+	for (u64 i = pageused; i < npage - initrdPage; i++) {
 		LIST_INSERT_HEAD(&pageFreeList, &pages[i], link);
 	}
-	pageleft = npage - pageused;
-	log(MM_GLOBAL, "\tFrom pages[%d:%d) free\n", pageused, npage);
+	for (u64 i = npage - initrdPage; i < npage; i++) {
+		pages[i].ref = 1;
+	}
+	pageleft = npage - pageused - initrdPage;
+	log(MM_GLOBAL, "\tFrom pages[%d:%d) free\n", pageused, npage - initrdPage);
 
 	log(MM_GLOBAL, "Physical Memory Init Finished, `pm` Functions Available!\n");
 }
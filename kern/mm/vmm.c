@@ -191,6 +191,34 @@ Pte ptLookup(Pte *pgdir, u64 va) {
 	return pte == NULL ? 0 : *pte;
 }
 
+/**
+ * @brief 查找va映射的物理页，权限满足perm时增加其引用计数（固定页面），与查找在同一临界区内完成
+ * @note 固定后页面即使被解除映射也不会被回收，使用完毕后用ptUnpin释放
+ * @param pa 返回va对应的物理地址（含页内偏移）
+ * @return 页面未映射或权限不足时返回-E_NO_MAP
+ */
+err_t ptPin(Pte *pgdir, u64 va, u64 perm, u64 *pa) {
+	mtx_lock(&kvmlock);
+	Pte *pte = ptWalk(pgdir, va, false);
+	if (pte == NULL || !(*pte & PTE_V) || (*pte & perm) != perm || pteToPa(*pte) < MEMBASE) {
+		mtx_unlock(&kvmlock);
+		return -E_NO_MAP;
+	}
+	pmPageIncRef(pteToPage(*pte));
+	*pa = pteToPa(*pte) + va % PAGE_SIZE;
+	mtx_unlock(&kvmlock);
+	return 0;
+}
+
+/**
+ * @brief 释放ptPin固定的页面，pa可以是页内的任意地址
+ */
+void ptUnpin(u64 pa) {
+	mtx_lock(&kvmlock);
+	pmPageDecRef(paToPage(PGROUNDDOWN(pa)));
+	mtx_unlock(&kvmlock);
+}
+
 /**
  * @brief 修改已有映射、或添加映射
  */
@@ -1,3 +1,4 @@
+#include <fs/signalfd.h>
 #include <lib/log.h>
 #include <lib/transfer.h>
 #include <proc/cpu.h>
@@ -15,7 +16,10 @@ bool sig_td_canhandle(thread_t *td, int signo) {
 	return canhandle;
 }
 
-void sig_send_td(thread_t *td, int signo) {
+/**
+ * @brief 把信号加入线程的信号队列，调用者可能持有线程的锁
+ */
+static void sig_post_td(thread_t *td, int signo) {
 	// warn("%lx send signal %d to thread %lx\n", cpu_this()->cpu_running->td_tid, signo,
 	//      td->td_tid);
 
@@ -34,6 +38,11 @@ void sig_send_td(thread_t *td, int signo) {
 	}
 }
 
+void sig_send_td(thread_t *td, int signo) {
+	sig_post_td(td, signo);
+	signalfd_notify();
+}
+
 void sig_send_proc(proc_t *p, int signo) {
 	assert(p != NULL);
 	proc_lock(p);
@@ -49,9 +58,10 @@ void sig_send_proc(proc_t *p, int signo) {
 		mtx_lock(&td->td_lock);
 		// 从头部开始找到第一个可以处理该信号的线程
 		if (sig_td_canhandle(td, signo)) {
-			sig_send_td(td, signo);
+			sig_post_td(td, signo);
 			mtx_unlock(&td->td_lock);
 			proc_unlock(p);
+			signalfd_notify();
 			return;
 		}
 		mtx_unlock(&td->td_lock);
@@ -63,7 +73,9 @@ void sig_send_proc(proc_t *p, int signo) {
 	}
 	td = TAILQ_FIRST(&p->p_threads);
 	mtx_lock(&td->td_lock);
-	sig_send_td(td, signo);
+	sig_post_td(td, signo);
 	mtx_unlock(&td->td_lock);
 	proc_unlock(p);
+	// 通知signalfd的读者时不能持有线程的锁
+	signalfd_notify();
 }
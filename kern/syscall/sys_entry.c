@@ -38,6 +38,7 @@ static syscall_function_t sys_table[] = {
     [SYS_fstatat] = {sys_fstatat, "fstatat"},
     [SYS_faccessat] = {sys_faccessat, "faccessat"},
 	[SYS_ftruncate] = {sys_ftruncate, "ftruncate"},
+	[SYS_fallocate] = {sys_fallocate, "fallocate"},
     [SYS_close] = {sys_close, "close"},
     [SYS_dup] = {sys_dup, "dup"},
     [SYS_dup3] = {sys_dup3, "dup3"},
@@ -76,6 +77,7 @@ static syscall_function_t sys_table[] = {
     [SYS_listen] = {sys_listen, "listen"},
     [SYS_connect] = {sys_connect, "connect"},
     [SYS_accept] = {sys_accept, "accept"},
+    [SYS_accept4] = {sys_accept4, "accept4"},
     [SYS_recvfrom] = {sys_recvfrom, "recvfrom"},
     [SYS_sendto] = {sys_sendto, "sendto"},
     [SYS_getsockname] = {sys_getsocketname, "getsockname"},
@@ -121,9 +123,24 @@ static syscall_function_t sys_table[] = {
     [SYS_shutdown] = {sys_shutdown, "shutdown"},
 	[SYS_readlinkat] = {sys_readlinkat, "readlinkat"},
 	[SYS_copy_file_range] = {sys_copy_file_range, "copy_file_range"},
+	[SYS_sendfile] = {sys_sendfile, "sendfile"},
+	[SYS_splice] = {sys_splice, "splice"},
+	[SYS_tee] = {sys_tee, "tee"},
+	[SYS_io_uring_setup] = {sys_io_uring_setup, "io_uring_setup"},
+	[SYS_io_uring_enter] = {sys_io_uring_enter, "io_uring_enter"},
+	[SYS_epoll_create1] = {sys_epoll_create1, "epoll_create1"},
+	[SYS_epoll_ctl] = {sys_epoll_ctl, "epoll_ctl"},
+	[SYS_epoll_pwait] = {sys_epoll_pwait, "epoll_pwait"},
+	[SYS_eventfd2] = {sys_eventfd2, "eventfd2"},
+	[SYS_timerfd_create] = {sys_timerfd_create, "timerfd_create"},
+	[SYS_timerfd_settime] = {sys_timerfd_settime, "timerfd_settime"},
+	[SYS_timerfd_gettime] = {sys_timerfd_gettime, "timerfd_gettime"},
+	[SYS_signalfd4] = {sys_signalfd4, "signalfd4"},
 	[SYS_getrandom] = {sys_getrandom, "getrandom"},
 	[SYS_setgroups] = {sys_setgroups, "setgroups"},
 	[SYS_fchmod] = {sys_fchmod, "fchmod"},
+	[SYS_fadvise64] = {sys_fadvise64, "fadvise64"},
+	[SYS_readahead] = {sys_readahead, "readahead"},
 };
 
 /**
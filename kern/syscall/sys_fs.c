@@ -1,15 +1,23 @@
+#include <fs/epoll.h>
+#include <fs/eventfd.h>
 #include <fs/fd.h>
+#include <fs/io_uring.h>
 #include <fs/file.h>
 #include <fs/file_time.h>
 #include <fs/kload.h>
 #include <fs/pipe.h>
+#include <fs/poll.h>
+#include <fs/signalfd.h>
 #include <fs/thread_fs.h>
+#include <fs/timerfd.h>
 #include <fs/vfs.h>
 #include <fs/buf.h>
+#include <fs/dirent.h>
 #include <lib/error.h>
 #include <lib/log.h>
 #include <lib/string.h>
 #include <lib/transfer.h>
+#include <mm/kmalloc.h>
 #include <mm/memlayout.h>
 #include <mm/vmm.h>
 #include <proc/cpu.h>
@@ -25,8 +33,6 @@
 #include <fs/socket.h>
 #include <fs/console.h>
 
-static inline int check_pselect_r(int fd);
-static inline int check_pselect_w(int fd);
 
 int sys_write(int fd, u64 buf, size_t count) {
 	return write(fd, buf, count);
@@ -73,9 +79,9 @@ u64 sys_getcwd(u64 buf, int size) {
 	return buf;
 }
 
-int sys_pipe2(u64 pfd) {
+int sys_pipe2(u64 pfd, int flags) {
 	int fd[2];
-	int ret = pipe(fd);
+	int ret = pipe(fd, flags);
 	if (ret < 0) {
 		return ret;
 	} else {
@@ -128,16 +134,20 @@ int sys_mkdirat(int dirFd, u64 path, int mode) {
 int sys_mount(u64 special, u64 dir, u64 fstype, u64 flags, u64 data) {
 	char specialStr[MAX_NAME_LEN];
 	char dirPath[MAX_NAME_LEN];
+	char fstypeStr[MAX_NAME_LEN];
 
-	// 1. 将special和dir加载到字符串数组中
+	// 1. 将special、dir和fstype加载到字符串数组中
 	copyInStr(special, specialStr, MAX_NAME_LEN);
 	copyInStr(dir, dirPath, MAX_NAME_LEN);
+	if (fstype != 0) {
+		copyInStr(fstype, fstypeStr, MAX_NAME_LEN);
+	}
 
 	// 2. 计算cwd，如果dir不是绝对路径，则是相对于cwd
 	Dirent *cwd = get_cwd_dirent(cur_proc_fs_struct());
 
 	// 3. 挂载
-	return mount_fs(specialStr, cwd, dirPath);
+	return mount_fs(specialStr, cwd, dirPath, fstype != 0 ? fstypeStr : NULL);
 }
 
 int sys_umount(u64 special, u64 flags) {
@@ -170,6 +180,7 @@ int sys_fstat(int fd, u64 pkstat) {
 }
 
 #define TIOCGWINSZ 0x5413
+#define FIONBIO 0x5421
 struct WinSize {
 	unsigned short ws_row;
 	unsigned short ws_col;
@@ -181,6 +192,21 @@ struct WinSize {
 int sys_ioctl(int fd, u64 request, u64 data) {
 	if (request == TIOCGWINSZ) {
 		copyOut(data, &winSize, sizeof(winSize));
+	} else if (request == FIONBIO) {
+		// 等同于用F_SETFL设置或清除O_NONBLOCK
+		Fd *kfd = get_kfd_by_fd(fd);
+		if (kfd == NULL) {
+			return -EBADF;
+		}
+		int on;
+		copyIn(data, &on, sizeof(on));
+		mtx_lock_sleep(&kfd->lock);
+		if (on) {
+			kfd->flags |= O_NONBLOCK;
+		} else {
+			kfd->flags &= ~O_NONBLOCK;
+		}
+		mtx_unlock_sleep(&kfd->lock);
 	}
 	// 否则不做任何操作
 	return 0;
@@ -200,6 +226,27 @@ size_t sys_copy_file_range(int fd_in, off_t *off_in,
 	return copy_file_range(fd_in, off_in, fd_out, off_out, len, flags);
 }
 
+i64 sys_sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+	return sendfile(out_fd, in_fd, offset, count);
+}
+
+i64 sys_splice(int fd_in, off_t *off_in, int fd_out, off_t *off_out, size_t len,
+	       unsigned int flags) {
+	return splice(fd_in, off_in, fd_out, off_out, len, flags);
+}
+
+i64 sys_tee(int fd_in, int fd_out, size_t len, unsigned int flags) {
+	return tee(fd_in, fd_out, len, flags);
+}
+
+int sys_io_uring_setup(u32 entries, u64 params) {
+	return io_uring_setup(entries, (struct io_uring_params *)params);
+}
+
+int sys_io_uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags, u64 sig, size_t sigsz) {
+	return io_uring_enter(fd, to_submit, min_complete, flags, sig, sigsz);
+}
+
 size_t sys_getrandom(u64 buf, size_t buflen, unsigned int flags) {
 	u8 prime = 251;
 	u64 now = time_rtc_clock();
@@ -214,8 +261,56 @@ int sys_fstatat(int dirFd, u64 pPath, u64 pkstat, int flags) {
 	return fileStatAtFd(dirFd, pPath, pkstat, flags);
 }
 
-// 因为所有write默认都会写回磁盘，所以此处可以什么也不做
+/**
+ * @brief 提示内核文件的访问模式，用于调整预读策略
+ */
+int sys_fadvise64(int fd, off_t offset, off_t len, int advice) {
+	Fd *kfd;
+	if ((kfd = get_kfd_by_fd(fd)) == NULL) {
+		return -EBADF;
+	}
+	if (kfd->type != dev_file) {
+		return -ESPIPE;
+	}
+	if (offset < 0 || len < 0) {
+		return -EINVAL;
+	}
+
+	mtx_lock_sleep(&kfd->lock);
+	int ret = fd_file_advise(kfd, offset, len, advice);
+	mtx_unlock_sleep(&kfd->lock);
+	return ret;
+}
+
+/**
+ * @brief 将文件[offset, offset+count)的内容预读入缓存，不等待读取完成
+ */
+int sys_readahead(int fd, off_t offset, size_t count) {
+	Fd *kfd;
+	if ((kfd = get_kfd_by_fd(fd)) == NULL) {
+		return -EBADF;
+	}
+	if (kfd->type != dev_file || offset < 0) {
+		return -EINVAL;
+	}
+	// 与fadvise不同，count为0表示不预读，而不是直到文件末尾
+	if (count == 0) {
+		return 0;
+	}
+
+	mtx_lock_sleep(&kfd->lock);
+	int ret = fd_file_advise(kfd, offset, count, POSIX_FADV_WILLNEED);
+	mtx_unlock_sleep(&kfd->lock);
+	return ret;
+}
+
+// 数据由缓冲区层统一写回，此处只需写回延迟更新的目录项
 int sys_fsync(int fd) {
+	Dirent *file;
+	unwrap(getDirentByFd(fd, &file, NULL));
+	if (file != NULL) {
+		dirent_flush(file);
+	}
 	return 0;
 }
 
@@ -230,107 +325,67 @@ int sys_faccessat(int dirFd, u64 pPath, int mode, int flags) {
 /**
  * @brief 原型：int ppoll(struct pollfd *fds, nfds_t nfds,
 	       const struct timespec *tmo_p, const sigset_t *sigmask);
- * 等待其中一个文件描述符就绪
- * 目前的处理策略：标记所有有效fd为就绪，无视timeout和sigmask，立即返回(TODO)
+ * 等待其中一个文件描述符就绪。先在所有fd的等待队列上注册，再检查就绪，未就绪时睡眠到被唤醒或超时
+ * 目前只处理POLLIN和POLLOUT，无视sigmask
  * @return fds数组中revents非0的个数。其中fds数组中，
  * revents返回events标定事件的子集或者三种特殊值：POLLERR, POLLHUP, POLLNVAL
  */
 int sys_ppoll(u64 p_fds, int nfds, u64 tmo_p, u64 sigmask) {
-	struct pollfd poll_fd;
+	thread_t *td = cpu_this()->cpu_running;
 	struct timespec tmo;
+	u64 deadline = 0;
+	bool timeout = false;
 	int ret = 0;
+
+	if (nfds < 0 || nfds > MAX_FD_COUNT) {
+		return -EINVAL;
+	}
 	if (tmo_p) {
 		copyIn(tmo_p, &tmo, sizeof(tmo));
-		if (TS_USEC(tmo) != 0) tsleep(&tmo, NULL, "ppoll", time_mono_us() + TS_USEC(tmo));
+		deadline = time_mono_us() + TS_USEC(tmo);
+		timeout = TS_USEC(tmo) == 0;
+	}
+
+	struct pollfd *pfds = kmalloc(MAX(nfds, 1) * sizeof(struct pollfd));
+	copyIn(p_fds, pfds, nfds * sizeof(struct pollfd));
+
+	PollWaiter w;
+	poll_waiter_init(&w, nfds);
+	for (int i = 0; i < nfds; i++) {
+		Fd *kfd = pfds[i].fd < 0 ? NULL : get_kfd_by_fd(pfds[i].fd);
+		if (kfd != NULL) {
+			poll_waiter_add(&w, kfd);
+		}
 	}
 
 	while (1) {
 		ret = 0;
 		for (int i = 0; i < nfds; i++) {
-			u64 cur_fds = p_fds + i * sizeof(poll_fd);
-			copyIn(cur_fds, &poll_fd, sizeof(poll_fd));
-			poll_fd.revents = 0;
-
-			if (poll_fd.fd < 0) {
-				poll_fd.revents = 0;
+			pfds[i].revents = 0;
+			if (pfds[i].fd < 0) {
+				continue;
+			}
+			Fd *kfd = get_kfd_by_fd(pfds[i].fd);
+			if (kfd == NULL) {
+				pfds[i].revents = POLLNVAL;
 			} else {
-				// 目前只处理POLLIN和POLLOUT两种等待事件
-				if (poll_fd.events & POLLIN) {
-					int r = check_pselect_r(poll_fd.fd);
-					if (r < 0) return r;
-					if (r) poll_fd.revents |= POLLIN;
-				}
-				if (poll_fd.events & POLLOUT) {
-					int r = check_pselect_w(poll_fd.fd);
-					if (r < 0) return r;
-					if (r) poll_fd.revents |= POLLOUT;
-				}
+				pfds[i].revents = fd_poll(kfd, pfds[i].events & (POLLIN | POLLOUT));
 			}
-			copyOut(cur_fds, &poll_fd, sizeof(poll_fd));
-
-			if (poll_fd.revents != 0)
+			if (pfds[i].revents != 0) {
 				ret += 1;
+			}
 		}
 
-		if (ret || tmo_p) {
+		if (ret || timeout || td->td_killed) {
 			break;
 		}
-
-		// if (!tmo_p) {
-		// 	tsleep(&tmo, NULL, "ppoll", 100);
-		// }
-	}
-	return ret;
-}
-
-/**
- * @brief 检查fd是否可以读取。可以返回1，不可以返回0，失败返回负数
- */
-static inline int check_pselect_r(int fd) {
-	Fd *kfd = get_kfd_by_fd(fd);
-	int ret;
-	if (kfd == NULL) {
-		return -EBADF;
-	}
-	mtx_lock_sleep(&kfd->lock);
-
-	// 目前只处理socket和其他
-	if (kfd->type == dev_socket) {
-		ret = socket_read_check(kfd);
-	} else if (kfd->type == dev_pipe) {
-		ret = pipe_check_read(kfd->pipe);
-	} else if (kfd->type == dev_console) {
-		ret = console_check_read();
-	} else {
-		ret = 1;
-	}
-	mtx_unlock_sleep(&kfd->lock);
-	return ret;
-}
-
-/**
- * @brief 检查fd是否可以写入。可以返回1，不可以返回0，失败返回负数
- */
-static inline int check_pselect_w(int fd) {
-	Fd *kfd = get_kfd_by_fd(fd);
-	int ret;
-	if (kfd == NULL) {
-		warn("pselect6: fd %d not found\n", fd);
-		return -EBADF;
+		// 超时后再检查一次
+		timeout = poll_waiter_wait(&w, deadline) == -ETIMEDOUT;
 	}
-	mtx_lock_sleep(&kfd->lock);
 
-	// 目前只处理socket,pipe,其他
-	if (kfd->type == dev_socket) {
-		ret = socket_write_check(kfd);
-	} else if (kfd->type == dev_pipe) {
-		ret = pipe_check_write(kfd->pipe);
-	} else if (kfd->type == dev_console) {
-		ret = console_check_write();
-	} else {
-		ret = 1;
-	}
-	mtx_unlock_sleep(&kfd->lock);
+	poll_waiter_destroy(&w);
+	copyOut(p_fds, pfds, nfds * sizeof(struct pollfd));
+	kfree(pfds);
 	return ret;
 }
 
@@ -338,12 +393,15 @@ static inline int check_pselect_w(int fd) {
  * 原型：int pselect6(int nfds, fd_set *readfds, fd_set *writefds,
                    fd_set *exceptfds, const struct timespec *timeout,
                    const sigset_t *sigmask) {
+ * 与ppoll相同，基于等待队列睡眠。不报告任何异常情况
  */
 int sys_pselect6(int nfds, u64 p_readfds, u64 p_writefds, u64 p_exceptfds, u64 p_timeout,
 				u64 sigmask) {
+	thread_t *td = cpu_this()->cpu_running;
 	int fd, r;
 	int func_ret = 0;
-	u64 timeout_us;
+	u64 deadline = 0;
+	bool timeout_end = false;
 
 	fd_set readfds, writefds, exceptfds;
 	fd_set readfds_cur, writefds_cur, exceptfds_cur;
@@ -357,38 +415,32 @@ int sys_pselect6(int nfds, u64 p_readfds, u64 p_writefds, u64 p_exceptfds, u64 p
 	if (p_writefds) copyIn(p_writefds, &writefds, sizeof(writefds));
 	if (p_exceptfds) copyIn(p_exceptfds, &exceptfds, sizeof(exceptfds));
 	if (p_timeout) {
+		// timeout为NULL表示永久等待，等于0表示不等待
 		copyIn(p_timeout, &timeout, sizeof(timeout));
-		timeout_us = TS_USEC(timeout); // 等于0表示不等待
-	} else {
-		// 如果timeout为NULL，表示永久等待
-		timeout_us = 1000000ul * 9999999ul;
-	}
-
-	u64 start = time_rtc_us();
-	if (timeout_us != 0) {
-		warn("pselect6: timeout_us = %d\n", timeout_us);
-	}
-
-	// debug
-	log(LEVEL_GLOBAL, "pselect6: timeout_us = %d\n", timeout_us);
-	log(LEVEL_GLOBAL, "readfds: \n");
-	FD_SET_FOREACH(fd, &readfds) {
-		log(LEVEL_GLOBAL, "%d\n", fd);
+		deadline = time_mono_us() + TS_USEC(timeout);
+		timeout_end = TS_USEC(timeout) == 0;
 	}
-	log(LEVEL_GLOBAL, "\n");
+	log(LEVEL_GLOBAL, "pselect6: nfds = %d, timeout_us = %ld\n", nfds, TS_USEC(timeout));
 
-	log(LEVEL_GLOBAL, "writefds: \n");
-	FD_SET_FOREACH(fd, &writefds) {
-		log(LEVEL_GLOBAL, "%d\n", fd);
+	// 在读写集合中所有fd的等待队列上注册
+	int nwait = 0;
+	for (fd = 0; fd < nfds && fd < FD_SETSIZE; fd++) {
+		if (FD_ISSET(fd, &readfds) || FD_ISSET(fd, &writefds)) {
+			nwait++;
+		}
 	}
-	log(LEVEL_GLOBAL, "\n");
-
-	log(LEVEL_GLOBAL, "exceptfds: \n");
-	FD_SET_FOREACH(fd, &exceptfds) {
-		log(LEVEL_GLOBAL, "%d\n", fd);
+	PollWaiter w;
+	poll_waiter_init(&w, nwait);
+	for (fd = 0; fd < nfds && fd < FD_SETSIZE; fd++) {
+		if (FD_ISSET(fd, &readfds) || FD_ISSET(fd, &writefds)) {
+			Fd *kfd = get_kfd_by_fd(fd);
+			if (kfd == NULL) {
+				poll_waiter_destroy(&w);
+				return -EBADF;
+			}
+			poll_waiter_add(&w, kfd);
+		}
 	}
-	log(LEVEL_GLOBAL, "\n");
-	// debug end
 
 	while (1) {
 		// 创建一套临时的fds数组，用于记录轮询情况
@@ -397,63 +449,40 @@ int sys_pselect6(int nfds, u64 p_readfds, u64 p_writefds, u64 p_exceptfds, u64 p
 		exceptfds_cur = exceptfds;
 
 		int tot = 0; // 就绪的fd数目
-		log(FS_GLOBAL, "readfds: \n");
 		FD_SET_FOREACH(fd, &readfds_cur) {
-			log(FS_GLOBAL, "%d\n", fd);
-			r = check_pselect_r(fd);
+			r = fd_poll_check(fd, POLLIN);
 			if (r < 0) {
+				poll_waiter_destroy(&w);
 				return r;
 			} else if (r == 0) {
 				FD_CLR(fd, &readfds_cur);
 			} else {
-				FD_SET(fd, &readfds_cur);
-				log(FS_GLOBAL, "Thread %s: read FD_SET %d\n", cpu_this()->cpu_running->td_name, fd);
+				tot++;
+				log(FS_GLOBAL, "Thread %s: read FD_SET %d\n", td->td_name, fd);
 			}
-			tot += r;
 		}
-		log(FS_GLOBAL, "\n");
 
-		log(FS_GLOBAL, "writefds: \n");
 		FD_SET_FOREACH(fd, &writefds_cur) {
-			log(FS_GLOBAL, "%d\n", fd);
-			r = check_pselect_w(fd);
+			r = fd_poll_check(fd, POLLOUT);
 			if (r < 0) {
+				poll_waiter_destroy(&w);
 				return r;
 			} else if (r == 0) {
 				FD_CLR(fd, &writefds_cur);
 			} else {
-				FD_SET(fd, &writefds_cur);
-				log(FS_GLOBAL, "Thread %s: write FD_SET %d\n", cpu_this()->cpu_running->td_name, fd);
+				tot++;
+				log(FS_GLOBAL, "Thread %s: write FD_SET %d\n", td->td_name, fd);
 			}
-			tot += r;
 		}
-		log(FS_GLOBAL, "\n");
-
-		// 暂时省略
-		// log(FS_GLOBAL, "exceptfds: \n");
-		// FD_SET_FOREACH(fd, &exceptfds_cur) {
-		// 	log(FS_GLOBAL, "%d\n", fd);
-		// }
-		// log(FS_GLOBAL, "\n");
 
-		if (tot > 0) {
+		if (tot > 0 || timeout_end || td->td_killed) {
 			func_ret = tot;
 			break;
-		} else {
-			if (timeout_us >= 10000) {
-				// 小睡10ms
-				tsleep(&timeout, NULL, "pselect", time_mono_us() + 10000);
-			}
-			// 否则，循环消耗时间即可
-		}
-
-		// 超时退出
-		u64 now = time_rtc_us();
-		if (timeout_us == 0 || now - start >= timeout_us) {
-			func_ret = 0;
-			break;
 		}
+		// 超时后再检查一次
+		timeout_end = poll_waiter_wait(&w, deadline) == -ETIMEDOUT;
 	}
+	poll_waiter_destroy(&w);
 
 	// 不要返回任何异常情况
 	memset(&exceptfds_cur, 0, sizeof(exceptfds_cur));
@@ -465,6 +494,37 @@ int sys_pselect6(int nfds, u64 p_readfds, u64 p_writefds, u64 p_exceptfds, u64 p
 	return func_ret;
 }
 
+int sys_epoll_create1(int flags) {
+	return epoll_create1(flags);
+}
+
+int sys_epoll_ctl(int epfd, int op, int fd, u64 event) {
+	return epoll_ctl(epfd, op, fd, event);
+}
+
+int sys_epoll_pwait(int epfd, u64 events, int maxevents, int timeout, u64 sigmask) {
+	return epoll_pwait(epfd, events, maxevents, timeout, sigmask);
+}
+
+int sys_eventfd2(unsigned int initval, int flags) {
+	return eventfd2(initval, flags);
+}
+
+int sys_timerfd_create(int clockid, int flags) {
+	return timerfd_create(clockid, flags);
+}
+
+int sys_timerfd_settime(int fd, int flags, u64 new_value, u64 old_value) {
+	return timerfd_settime(fd, flags, new_value, old_value);
+}
+
+int sys_timerfd_gettime(int fd, u64 curr_value) {
+	return timerfd_gettime(fd, curr_value);
+}
+
+int sys_signalfd4(int fd, u64 mask, u64 sizemask, int flags) {
+	return signalfd4(fd, mask, sizemask, flags);
+}
 
 /**
  * @brief 控制文件描述符的属性
@@ -494,16 +554,16 @@ int sys_fcntl(int fd, int cmd, int arg) {
 			kfd->flags &= ~__O_CLOEXEC;
 		break;
 	case FCNTL_GET_FILE_STATUS: // 等同于F_GETFL
-		ret = kfd->flags;
+		// close-on-exec是fd的标志，不属于文件状态
+		ret = kfd->flags & ~__O_CLOEXEC;
 		break;
 	case FCNTL_DUPFD_CLOEXEC:
 		// TODO: 实现CLOEXEC标志位
 		ret = dup(fd);
 		break;
 	case FCNTL_SETFL:
-		// TODO: 未实现
-		kfd->flags = arg; // 主要是O_NONBLOCK
-		warn("fcntl: FCNTL_SETFL not implemented\n");
+		// 与Linux一致，只能修改这些状态标志，访问模式和创建标志被忽略
+		kfd->flags = (kfd->flags & ~FCNTL_SETFL_MASK) | (arg & FCNTL_SETFL_MASK);
 		break;
 	default:
 		warn("fcntl: unknown cmd %d\n", cmd);
@@ -572,6 +632,7 @@ size_t sys_pwrite64(int fd, u64 buf, size_t count, off_t offset) {
 }
 
 #define MSDOS_SUPER_MAGIC 0x4d44 /* MD */
+#define TMPFS_MAGIC 0x01021994
 
 int sys_statfs(u64 ppath, struct statfs *buf) {
 	Dirent *file;
@@ -592,6 +653,20 @@ int sys_statfs(u64 ppath, struct statfs *buf) {
 		extern u64 used_dirents;
 
 		assert(fs != NULL);
+		if (IS_TMPFS(fs)) {
+			statfs.f_type = TMPFS_MAGIC;
+			statfs.f_bsize = PAGE_SIZE;
+			statfs.f_blocks = fs->superBlock.data_clus_cnt;
+			statfs.f_bfree = fs->superBlock.free_cnt;
+			statfs.f_bavail = statfs.f_bfree;
+			statfs.f_files = MAX_DIRENT;
+			statfs.f_ffree = MAX(MAX_DIRENT - used_dirents, 0);
+			statfs.f_namelen = MAX_NAME_LEN;
+
+			copyOut((u64)buf, &statfs, sizeof(statfs));
+			file_close(file);
+			return 0;
+		}
 		statfs.f_type = MSDOS_SUPER_MAGIC;
 		statfs.f_bsize = fs->superBlock.bytes_per_clus;
 		statfs.f_blocks = fs->superBlock.bpb.tot_sec / fs->superBlock.bpb.sec_per_clus;
@@ -615,17 +690,37 @@ int sys_ftruncate(int fd, off_t length) {
 	Dirent *file;
 	unwrap(getDirentByFd(fd, &file, NULL));
 
-	extern mutex_t mtx_file;
-	mtx_lock_sleep(&mtx_file);
+	int r = 0;
+	mtx_lock_sleep(&file->lock);
 
 	if (length <= file->file_size) {
-		file_shrink(file, length);
+		r = file_shrink(file, length);
 	} else {
-		file_extend(file, length);
+		r = file_extend(file, length);
 	}
 
-	mtx_unlock_sleep(&mtx_file);
-	return 0;
+	mtx_unlock_sleep(&file->lock);
+	return r;
+}
+
+/**
+ * @brief 为文件预分配空间
+ */
+int sys_fallocate(int fd, int mode, off_t offset, off_t len) {
+	Dirent *file;
+	int kernFd;
+	if (offset < 0 || len <= 0) {
+		return -EINVAL;
+	}
+	unwrap(getDirentByFd(fd, &file, &kernFd));
+	if (file == NULL) {
+		// 管道、套接字等
+		return -ESPIPE;
+	}
+	if ((fds[kernFd].flags & O_ACCMODE) == O_RDONLY) {
+		return -EBADF;
+	}
+	return file_fallocate(file, mode, offset, len);
 }
 
 int sys_readlinkat(int dirfd, u64 pathname, u64 buf, size_t bufsiz) {
@@ -654,7 +749,7 @@ int sys_readlinkat(int dirfd, u64 pathname, u64 buf, size_t bufsiz) {
 }
 
 int sys_sync() {
-	bufSync();
+	fs_sync();
 	return 0;
 }
 
@@ -664,6 +759,5 @@ int sys_syncfs(int fd) {
 
 
 int sys_socketpair(int domain, int type, int protocol, int *fds) {
-	warn("socketpair not implemented\n");
-	return sys_pipe2((u64)fds);
+	return socketpair(domain, type, protocol, fds);
 }
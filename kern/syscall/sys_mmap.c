@@ -1,4 +1,5 @@
 #include <fs/fd.h>
+#include <fs/io_uring.h>
 #include <fs/kload.h>
 #include <fs/vfs.h>
 #include <lib/log.h>
@@ -130,6 +131,12 @@ void *sys_mmap(u64 start, size_t len, int prot, int flags, int fd, off_t off) {
 		mtx_unlock(&cur_proc()->p_lock);
 
 		// B. 文件映射
+		// io_uring的共享区域不对应文件，直接映射其内核页
+		Fd *kfd = get_kfd_by_fd(fd);
+		if (kfd != NULL && kfd->type == dev_uring) {
+			return io_uring_mmap(kfd, start, len, perm, off);
+		}
+
 		// 3. 通过fd获取文件
 		r = getDirentByFd(fd, &file, NULL);
 		if (r < 0) {
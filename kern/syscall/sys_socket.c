@@ -20,6 +20,10 @@ int sys_accept(int sockfd, SocketAddr *addr, socklen_t * addrlen) {
 	return accept(sockfd, addr, addrlen);
 }
 
+int sys_accept4(int sockfd, SocketAddr *addr, socklen_t * addrlen, int flags) {
+	return accept4(sockfd, addr, addrlen, flags);
+}
+
 int sys_recvfrom(int sockfd, void *buffer, size_t len, int flgas, SocketAddr * src_addr, socklen_t *addrlen) {
 	return recvfrom(sockfd, buffer, len, flgas, src_addr, addrlen, 1);
 }
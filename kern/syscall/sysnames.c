@@ -281,6 +281,8 @@ char *sys_names[] = {
     [SYS_io_pgetevents] = "io_pgetevents",
     [SYS_rseq] = "rseq",
     [SYS_kexec_file_load] = "kexec_file_load",
+    [SYS_io_uring_setup] = "io_uring_setup",
+    [SYS_io_uring_enter] = "io_uring_enter",
     [SYS_riscv_flush_icache] = "riscv_flush_icache",
     [SYS_spawn] = "spawn",
     [SYS_mailread] = "mailread",
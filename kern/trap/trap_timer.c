@@ -1,4 +1,5 @@
 #include <dev/timer.h>
+#include <fs/timerfd.h>
 #include <lib/log.h>
 #include <proc/cpu.h>
 #include <proc/sched.h>
@@ -12,6 +13,7 @@ void ktrap_timer() {
 	handler_timer_int();
 	tsleep_check();
 	itimer_check();
+	timerfd_check();
 }
 
 void utrap_timer() {